@@ -18,6 +18,7 @@
 #include <esp_log.h>
 
 #include "iic.h"
+#include "iic_regmap_chips.h"
 #include "bp1658cj.h"
 
 static const char *TAG = "driver_bp1658cj";
@@ -73,23 +74,30 @@ typedef struct {
     bp1658cj_cw_current_t cw_current;
     uint8_t mapping_addr[BP1658CJ_MAX_PIN];
     bool init_done;
+    iic_device_t *iic;
+    iic_shadow_t grayscale;
 } bp1658cj_handle_t;
 
 static bp1658cj_handle_t *s_bp1658cj = NULL;
 
-static uint8_t get_mapping_addr(bp1658cj_channel_t channel)
+static const iic_regmap_t *const s_regmap = &iic_regmap_bp1658cj;
+
+static void set_grayscale(uint8_t *value, bp1658cj_channel_t channel, uint16_t data)
 {
-    uint8_t addr[] = { BIT_R_OUT1, BIT_G_OUT2, BIT_B_OUT3, BIT_C_OUT4, BIT_W_OUT5 };
-    uint8_t result = addr[s_bp1658cj->mapping_addr[channel]];
+    iic_regmap_set_grayscale(s_regmap, value, s_bp1658cj->mapping_addr[channel], data);
+}
 
-    return result;
+static esp_err_t write_grayscale(uint8_t *value)
+{
+    return iic_driver_write_grayscale(s_bp1658cj->iic, &s_bp1658cj->grayscale, s_regmap, value, NULL);
 }
 
 static esp_err_t set_mode_and_current(bool enable_sleep_mode, bp1658cj_rgb_current_t rgb, bp1658cj_cw_current_t wy)
 {
     uint8_t value[1] = { 0 };
     uint8_t addr = BASE_ADDR | BIT_MAX_CURRENT | BIT_SLEEP_MODE_ENABLE;
-    value[0] = (rgb << 4) | (wy);
+    value[0] = iic_regmap_pack_current(s_regmap, rgb, wy);
+    iic_driver_shadow_invalidate(&s_bp1658cj->grayscale);
     if (enable_sleep_mode) {
         addr |= BIT_SLEEP_MODE_ENABLE;
         s_bp1658cj->init_done = false;
@@ -98,7 +106,7 @@ static esp_err_t set_mode_and_current(bool enable_sleep_mode, bp1658cj_rgb_curre
         s_bp1658cj->init_done = true;
     }
 
-    return iic_driver_write(addr, value, sizeof(value));
+    return iic_driver_write(s_bp1658cj->iic, addr, value, sizeof(value));
 }
 
 esp_err_t bp1658cj_set_max_current(bp1658cj_rgb_current_t rgb, bp1658cj_cw_current_t wy)
@@ -107,9 +115,9 @@ esp_err_t bp1658cj_set_max_current(bp1658cj_rgb_current_t rgb, bp1658cj_cw_curre
 
     uint8_t value = 0;
     uint8_t addr = BASE_ADDR | BIT_MAX_CURRENT | BIT_ALL_OUT_ENABLE;
-    value = (rgb << 4) | (wy);
+    value = iic_regmap_pack_current(s_regmap, rgb, wy);
 
-    return iic_driver_write(addr, &value, 1);
+    return iic_driver_write(s_bp1658cj->iic, addr, &value, 1);
 }
 
 esp_err_t bp1658cj_set_sleep_mode(bool enable_sleep)
@@ -117,6 +125,7 @@ esp_err_t bp1658cj_set_sleep_mode(bool enable_sleep)
     BP1658CJ_CHECK(s_bp1658cj, "not init", return ESP_ERR_INVALID_STATE);
 
     uint8_t addr = BASE_ADDR | BIT_SLEEP_MODE_ENABLE;
+    iic_driver_shadow_invalidate(&s_bp1658cj->grayscale);
     if (enable_sleep) {
         addr |= BIT_SLEEP_MODE_ENABLE;
         s_bp1658cj->init_done = false;
@@ -125,7 +134,7 @@ esp_err_t bp1658cj_set_sleep_mode(bool enable_sleep)
         s_bp1658cj->init_done = true;
     }
 
-    return iic_driver_write(addr, NULL, 0);
+    return iic_driver_write(s_bp1658cj->iic, addr, NULL, 0);
 }
 
 esp_err_t bp1658cj_set_shutdown(void)
@@ -133,10 +142,9 @@ esp_err_t bp1658cj_set_shutdown(void)
     BP1658CJ_CHECK(s_bp1658cj, "not init", return ESP_ERR_INVALID_STATE);
 
     uint8_t _value[10] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_R_OUT1 | BIT_ALL_OUT_ENABLE;
-    
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    iic_driver_shadow_invalidate(&s_bp1658cj->grayscale);
+    return write_grayscale(_value);
 }
 
 esp_err_t bp1658cj_regist_channel(bp1658cj_channel_t channel, bp1658cj_out_pin_t pin)
@@ -159,13 +167,11 @@ esp_err_t bp1658cj_set_channel(bp1658cj_channel_t channel, uint16_t value)
         set_mode_and_current(false, s_bp1658cj->rgb_current, s_bp1658cj->cw_current);
     }
 
-    uint8_t _value[2] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_ALL_OUT_ENABLE | get_mapping_addr(channel);
-
-    _value[0] = (value & 0x1F);
-    _value[1] = (value >> 5);
+    uint8_t _value[10] = { 0 };
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    memcpy(_value, s_bp1658cj->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, channel, value);
+    return write_grayscale(_value);
 }
 
 esp_err_t bp1658cj_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
@@ -177,19 +183,14 @@ esp_err_t bp1658cj_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t
         set_mode_and_current(false, s_bp1658cj->rgb_current, s_bp1658cj->cw_current);
     }
 
-    uint8_t _value[6] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_R_OUT1 | BIT_ALL_OUT_ENABLE;
-
-    _value[s_bp1658cj->mapping_addr[0] * 2 + 0] = (value_r & 0x1F);
-    _value[s_bp1658cj->mapping_addr[0] * 2 + 1] = (value_r >> 5);
-
-    _value[s_bp1658cj->mapping_addr[1] * 2 + 0] = (value_g & 0x1F);
-    _value[s_bp1658cj->mapping_addr[1] * 2 + 1] = (value_g >> 5);
+    uint8_t _value[10] = { 0 };
 
-    _value[s_bp1658cj->mapping_addr[2] * 2 + 0] = (value_b & 0x1F);
-    _value[s_bp1658cj->mapping_addr[2] * 2 + 1] = (value_b >> 5);
+    memcpy(_value, s_bp1658cj->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, BP1658CJ_CHANNEL_R, value_r);
+    set_grayscale(_value, BP1658CJ_CHANNEL_G, value_g);
+    set_grayscale(_value, BP1658CJ_CHANNEL_B, value_b);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t bp1658cj_set_cw_channel(uint16_t value_c, uint16_t value_w)
@@ -200,16 +201,13 @@ esp_err_t bp1658cj_set_cw_channel(uint16_t value_c, uint16_t value_w)
     if (!s_bp1658cj->init_done) {
         set_mode_and_current(false, s_bp1658cj->rgb_current, s_bp1658cj->cw_current);
     }
-    uint8_t _value[4] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_C_OUT4 | BIT_ALL_OUT_ENABLE;
-
-    _value[(s_bp1658cj->mapping_addr[3] - 3) * 2 + 0] = (value_c & 0x1F);
-    _value[(s_bp1658cj->mapping_addr[3] - 3) * 2 + 1] = (value_c >> 5);
+    uint8_t _value[10] = { 0 };
 
-    _value[(s_bp1658cj->mapping_addr[4] - 3) * 2 + 0] = (value_w & 0x1F);
-    _value[(s_bp1658cj->mapping_addr[4] - 3) * 2 + 1] = (value_w >> 5);
+    memcpy(_value, s_bp1658cj->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, BP1658CJ_CHANNEL_C, value_c);
+    set_grayscale(_value, BP1658CJ_CHANNEL_W, value_w);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t bp1658cj_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b, uint16_t value_c, uint16_t value_w)
@@ -222,25 +220,14 @@ esp_err_t bp1658cj_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_
         set_mode_and_current(false, s_bp1658cj->rgb_current, s_bp1658cj->cw_current);
     }
     uint8_t _value[10] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_R_OUT1 | BIT_ALL_OUT_ENABLE;
-
-    _value[s_bp1658cj->mapping_addr[0] * 2 + 0] = (value_r & 0x1F);
-    _value[s_bp1658cj->mapping_addr[0] * 2 + 1] = (value_r >> 5);
-
-    _value[s_bp1658cj->mapping_addr[1] * 2 + 0] = (value_g & 0x1F);
-    _value[s_bp1658cj->mapping_addr[1] * 2 + 1] = (value_g >> 5);
-
-    _value[s_bp1658cj->mapping_addr[2] * 2 + 0] = (value_b & 0x1F);
-    _value[s_bp1658cj->mapping_addr[2] * 2 + 1] = (value_b >> 5);
-
-    _value[s_bp1658cj->mapping_addr[3] * 2 + 0] = (value_c & 0x1F);
-    _value[s_bp1658cj->mapping_addr[3] * 2 + 1] = (value_c >> 5);
-
-    _value[s_bp1658cj->mapping_addr[4] * 2 + 0] = (value_w & 0x1F);
-    _value[s_bp1658cj->mapping_addr[4] * 2 + 1] = (value_w >> 5);
 
+    set_grayscale(_value, BP1658CJ_CHANNEL_R, value_r);
+    set_grayscale(_value, BP1658CJ_CHANNEL_G, value_g);
+    set_grayscale(_value, BP1658CJ_CHANNEL_B, value_b);
+    set_grayscale(_value, BP1658CJ_CHANNEL_C, value_c);
+    set_grayscale(_value, BP1658CJ_CHANNEL_W, value_w);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t bp1658cj_init(driver_bp1658cj_t *config)
@@ -253,6 +240,7 @@ esp_err_t bp1658cj_init(driver_bp1658cj_t *config)
     s_bp1658cj = calloc(1, sizeof(bp1658cj_handle_t));
     BP1658CJ_CHECK(s_bp1658cj, "alloc fail", return ESP_ERR_NO_MEM);
     memset(s_bp1658cj->mapping_addr, INVALID_ADDR, BP1658CJ_MAX_PIN);
+    iic_driver_shadow_init(&s_bp1658cj->grayscale, iic_regmap_image_size(s_regmap), s_regmap->channel_bytes);
 
     s_bp1658cj->rgb_current = config->rgb_current;
     s_bp1658cj->cw_current = config->cw_current;
@@ -262,11 +250,11 @@ esp_err_t bp1658cj_init(driver_bp1658cj_t *config)
         ESP_LOGW(TAG, "The frequency is too high, adjust it to 400khz");
     }
 
-    err |= iic_driver_init(I2C_NUM_0, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ);
+    err |= iic_driver_init(config->iic_port, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ, &s_bp1658cj->iic);
     BP1658CJ_CHECK(err == ESP_OK, "i2c master init fail", goto EXIT);
 
     if (config->enable_iic_queue) {
-        err |= iic_driver_send_task_create();
+        err |= iic_driver_send_task_create(s_bp1658cj->iic);
         BP1658CJ_CHECK(err == ESP_OK, "task create fail", goto EXIT);
     }
 
@@ -274,6 +262,9 @@ esp_err_t bp1658cj_init(driver_bp1658cj_t *config)
 EXIT:
 
     if (s_bp1658cj) {
+        if (s_bp1658cj->iic) {
+            iic_driver_deinit(s_bp1658cj->iic);
+        }
         free(s_bp1658cj);
         s_bp1658cj = NULL;
     }
@@ -285,8 +276,7 @@ esp_err_t bp1658cj_deinit(void)
     BP1658CJ_CHECK(s_bp1658cj, "not init", return ESP_ERR_INVALID_STATE);
 
     bp1658cj_set_shutdown();
-    iic_driver_deinit();
-    iic_driver_task_destroy();
+    iic_driver_deinit(s_bp1658cj->iic);
     free(s_bp1658cj);
     s_bp1658cj = NULL;
     return ESP_OK;
@@ -18,6 +18,7 @@
 #include <esp_log.h>
 
 #include "iic.h"
+#include "iic_regmap_chips.h"
 #include "bp5758d.h"
 
 static const char *TAG = "bp5758d";
@@ -89,16 +90,22 @@ typedef struct {
     uint8_t current[BP5758D_MAX_PIN];
     uint8_t mapping_addr[BP5758D_MAX_PIN];
     bool init_done;
+    iic_device_t *iic;
+    iic_shadow_t grayscale;
 } bp5758d_handle_t;
 
 static bp5758d_handle_t *s_bp5758d = NULL;
 
-static uint8_t get_mapping_addr(bp5758d_channel_t channel)
+static const iic_regmap_t *const s_regmap = &iic_regmap_bp5758d;
+
+static void set_grayscale(uint8_t *value, bp5758d_channel_t channel, uint16_t data)
 {
-    uint8_t addr[] = { BIT_OUT1_GRAYSCALE, BIT_OUT2_GRAYSCALE, BIT_OUT3_GRAYSCALE, BIT_OUT4_GRAYSCALE, BIT_OUT5_GRAYSCALE };
-    uint8_t result = addr[s_bp5758d->mapping_addr[channel]];
+    iic_regmap_set_grayscale(s_regmap, value, s_bp5758d->mapping_addr[channel], data);
+}
 
-    return result;
+static esp_err_t write_grayscale(uint8_t *value)
+{
+    return iic_driver_write_grayscale(s_bp5758d->iic, &s_bp5758d->grayscale, s_regmap, value, NULL);
 }
 
 static esp_err_t set_sleep_mode_and_current(bool enable_sleep, uint8_t *current)
@@ -106,6 +113,9 @@ static esp_err_t set_sleep_mode_and_current(bool enable_sleep, uint8_t *current)
     uint8_t addr = BASE_ADDR | BIT_OUT_SELECT;
     uint8_t value[6] = { 0 };
 
+    // The grayscale registers are written again in full after the chip sleeps or wakes up
+    iic_driver_shadow_invalidate(&s_bp5758d->grayscale);
+
     if (enable_sleep) {
         addr |= BIT_ENABLE_SLEEP_MODE;
         value[0] = BIT_ALL_OUT_DISABLE;
@@ -118,7 +128,7 @@ static esp_err_t set_sleep_mode_and_current(bool enable_sleep, uint8_t *current)
         s_bp5758d->init_done = true;
     }
 
-    return iic_driver_write(addr, value, sizeof(value));
+    return iic_driver_write(s_bp5758d->iic, addr, value, sizeof(value));
 }
 
 static void convert_current_value(uint8_t *output, uint8_t *input)
@@ -146,9 +156,10 @@ esp_err_t bp5758d_set_shutdown(void)
 {
     BP5758D_CHECK(s_bp5758d, "not init", return ESP_ERR_INVALID_STATE);
     uint8_t _value[10] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_DISABLE_SLEEP_MODE | BIT_OUT1_GRAYSCALE;
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    // Always sent, whatever the shadow holds
+    iic_driver_shadow_invalidate(&s_bp5758d->grayscale);
+    return write_grayscale(_value);
 }
 
 esp_err_t bp5758d_regist_channel(bp5758d_channel_t channel, bp5758d_out_pin_t pin)
@@ -172,15 +183,12 @@ esp_err_t bp5758d_set_channel(bp5758d_channel_t channel, uint16_t value)
         set_sleep_mode_and_current(false, s_bp5758d->current);
     }
 
-    uint8_t _value[2] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_DISABLE_SLEEP_MODE;
+    uint8_t _value[10] = { 0 };
     ESP_LOGD(TAG, "src: %d", value);
 
-    _value[0] = (value & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[1] = (value >> 5) | BIT_GRAYSCALE_DATA_HEAD;
-    addr |= (get_mapping_addr(channel));
-    ESP_LOGD(TAG, "transfer: 0x%x 0x%x", _value[0], _value[1]);
-    return iic_driver_write(addr, _value, sizeof(_value));
+    memcpy(_value, s_bp5758d->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, channel, value);
+    return write_grayscale(_value);
 }
 
 esp_err_t bp5758d_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
@@ -192,19 +200,14 @@ esp_err_t bp5758d_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t v
         set_sleep_mode_and_current(false, s_bp5758d->current);
     }
 
-    uint8_t _value[6] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_OUT1_GRAYSCALE | BIT_DISABLE_SLEEP_MODE;
-
-    _value[s_bp5758d->mapping_addr[0] * 2 + 0] = (value_r & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[0] * 2 + 1] = (value_r >> 5) | BIT_GRAYSCALE_DATA_HEAD;
-
-    _value[s_bp5758d->mapping_addr[1] * 2 + 0] = (value_g & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[1] * 2 + 1] = (value_g >> 5) | BIT_GRAYSCALE_DATA_HEAD;
+    uint8_t _value[10] = { 0 };
 
-    _value[s_bp5758d->mapping_addr[2] * 2 + 0] = (value_b & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[2] * 2 + 1] = (value_b >> 5) | BIT_GRAYSCALE_DATA_HEAD;
+    memcpy(_value, s_bp5758d->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, BP5758D_CHANNEL_R, value_r);
+    set_grayscale(_value, BP5758D_CHANNEL_G, value_g);
+    set_grayscale(_value, BP5758D_CHANNEL_B, value_b);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t bp5758d_set_cw_channel(uint16_t value_c, uint16_t value_w)
@@ -216,16 +219,13 @@ esp_err_t bp5758d_set_cw_channel(uint16_t value_c, uint16_t value_w)
         set_sleep_mode_and_current(false, s_bp5758d->current);
     }
 
-    uint8_t _value[4] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_OUT4_GRAYSCALE | BIT_DISABLE_SLEEP_MODE;
-
-    _value[(s_bp5758d->mapping_addr[3] - 3) * 2 + 0] = (value_c & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[(s_bp5758d->mapping_addr[3] - 3) * 2 + 1] = (value_c >> 5) | BIT_GRAYSCALE_DATA_HEAD;
+    uint8_t _value[10] = { 0 };
 
-    _value[(s_bp5758d->mapping_addr[4] - 3) * 2 + 0] = (value_w & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[(s_bp5758d->mapping_addr[4] - 3) * 2 + 1] = (value_w >> 5) | BIT_GRAYSCALE_DATA_HEAD;
+    memcpy(_value, s_bp5758d->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, BP5758D_CHANNEL_C, value_c);
+    set_grayscale(_value, BP5758D_CHANNEL_W, value_w);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t bp5758d_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b, uint16_t value_c, uint16_t value_w)
@@ -239,24 +239,14 @@ esp_err_t bp5758d_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_t
     }
 
     uint8_t _value[10] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_OUT1_GRAYSCALE | BIT_DISABLE_SLEEP_MODE;
-
-    _value[s_bp5758d->mapping_addr[0] * 2 + 0] = (value_r & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[0] * 2 + 1] = (value_r >> 5) | BIT_GRAYSCALE_DATA_HEAD;
-
-    _value[s_bp5758d->mapping_addr[1] * 2 + 0] = (value_g & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[1] * 2 + 1] = (value_g >> 5) | BIT_GRAYSCALE_DATA_HEAD;
 
-    _value[s_bp5758d->mapping_addr[2] * 2 + 0] = (value_b & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[2] * 2 + 1] = (value_b >> 5) | BIT_GRAYSCALE_DATA_HEAD;
+    set_grayscale(_value, BP5758D_CHANNEL_R, value_r);
+    set_grayscale(_value, BP5758D_CHANNEL_G, value_g);
+    set_grayscale(_value, BP5758D_CHANNEL_B, value_b);
+    set_grayscale(_value, BP5758D_CHANNEL_C, value_c);
+    set_grayscale(_value, BP5758D_CHANNEL_W, value_w);
 
-    _value[s_bp5758d->mapping_addr[3] * 2 + 0] = (value_c & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[3] * 2 + 1] = (value_c >> 5) | BIT_GRAYSCALE_DATA_HEAD;
-
-    _value[s_bp5758d->mapping_addr[4] * 2 + 0] = (value_w & 0x1F) | BIT_GRAYSCALE_DATA_HEAD;
-    _value[s_bp5758d->mapping_addr[4] * 2 + 1] = (value_w >> 5) | BIT_GRAYSCALE_DATA_HEAD;
-
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t bp5758d_init(driver_bp5758d_t *config)
@@ -269,6 +259,7 @@ esp_err_t bp5758d_init(driver_bp5758d_t *config)
     s_bp5758d = calloc(1, sizeof(bp5758d_handle_t));
     BP5758D_CHECK(s_bp5758d, "alloc fail", return ESP_ERR_NO_MEM);
     memset(s_bp5758d->mapping_addr, INVALID_ADDR, BP5758D_MAX_PIN);
+    iic_driver_shadow_init(&s_bp5758d->grayscale, iic_regmap_image_size(s_regmap), s_regmap->channel_bytes);
     convert_current_value(s_bp5758d->current, config->current);
 
     if (config->freq_khz > 300) {
@@ -276,11 +267,11 @@ esp_err_t bp5758d_init(driver_bp5758d_t *config)
         ESP_LOGW(TAG, "The frequency is too high, adjust it to 300khz");
     }
 
-    err |= iic_driver_init(I2C_NUM_0, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ);
+    err |= iic_driver_init(config->iic_port, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ, &s_bp5758d->iic);
     BP5758D_CHECK(err == ESP_OK, "i2c master init fail", goto EXIT);
 
     if (config->enable_iic_queue) {
-        err |= iic_driver_send_task_create();
+        err |= iic_driver_send_task_create(s_bp5758d->iic);
         BP5758D_CHECK(err == ESP_OK, "task create fail", goto EXIT);
     }
 
@@ -288,6 +279,9 @@ esp_err_t bp5758d_init(driver_bp5758d_t *config)
 EXIT:
 
     if (s_bp5758d) {
+        if (s_bp5758d->iic) {
+            iic_driver_deinit(s_bp5758d->iic);
+        }
         free(s_bp5758d);
         s_bp5758d = NULL;
     }
@@ -299,8 +293,7 @@ esp_err_t bp5758d_deinit(void)
     BP5758D_CHECK(s_bp5758d, "not init", return ESP_ERR_INVALID_STATE);
 
     bp5758d_set_shutdown();
-    iic_driver_deinit();
-    iic_driver_task_destroy();
+    iic_driver_deinit(s_bp5758d->iic);
     free(s_bp5758d);
     s_bp5758d = NULL;
     return ESP_OK;
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "driver/gpio.h"
+#include "driver/i2c.h"
 #pragma once
 
 /**
@@ -25,6 +26,7 @@ typedef struct {
     gpio_num_t iic_sda;
     bool enable_iic_queue;
     uint16_t freq_khz;
+    i2c_port_t iic_port;            // One chip of each type, chips on the same port must use the same pins and frequency
 } driver_bp5758d_t;
 
 /**
@@ -13,8 +13,10 @@
 // limitations under the License.
 
 #include <string.h>
+#include <inttypes.h>
 
 #include <esp_log.h>
+#include <esp_timer.h>
 
 #include "iic.h"
 
@@ -26,6 +28,12 @@
 #define NACK_VAL                    (0x1)
 #define MAX_CMD_DATA_LEN            (15)
 
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0))
+/* One frame is start + address + data + stop, the command link is built in a static buffer */
+#define IIC_USE_STATIC_CMD_LINK     1
+#define IIC_CMD_LINK_SIZE           I2C_LINK_RECOMMENDED_SIZE(2)
+#endif
+
 #ifdef CONFIG_LB_IIC_TASK_STACK
 #define IIC_TASK_STACK              CONFIG_LB_IIC_TASK_STACK
 #else
@@ -38,6 +46,9 @@
 #define IIC_QUEUE_SIZE              20
 #endif
 
+/* Frames written back to back in one pass of the send task, at most one per chip */
+#define IIC_BATCH_MAX_FRAMES        (8)
+
 #ifdef CONFIG_LB_IIC_TASK_PRIORITY
 #define IIC_TASK_PRIORITY           CONFIG_LB_IIC_TASK_PRIORITY
 #else
@@ -52,63 +63,246 @@ static const char *TAG = "iic";
         action;                                                             \
     }
 
-typedef struct {
-    QueueHandle_t cmd_queue_handle;
-    TaskHandle_t send_task_handle;
-    i2c_port_t i2c_master_num;
-} iic_config_t;
-
 typedef struct {
     uint8_t addr;
     uint8_t data[MAX_CMD_DATA_LEN];
     size_t real_data_size;
+    int64_t queued_us;
 } i2c_send_data_t;
 
-static iic_config_t *s_obj = NULL;
+/**
+ * @brief Outcome of one frame on the bus, accounted in the stats once the queue mutex is taken
+ *
+ */
+typedef struct {
+    esp_err_t err;
+    size_t size;
+    int64_t queued_us;
+    int64_t start_us;
+    int64_t end_us;
+} iic_transfer_t;
+
+typedef struct iic_bus_s iic_bus_t;
+
+/**
+ * @brief A chip on a bus, its pending frames are kept in a ring buffer instead of a FreeRTOS queue
+ *
+ * @note A new frame with the same address byte and length as the newest pending frame replaces it in place,
+ * so a burst of updates to the same registers only occupies one slot. Only the newest frame is compared,
+ * replacing an older one would reorder it with the frames queued after it.
+ *
+ */
+struct iic_device_s {
+    iic_bus_t *bus;
+    bool use_queue;
+    i2c_send_data_t frames[IIC_QUEUE_SIZE];
+    uint16_t head;
+    uint16_t count;
+    struct iic_device_s *next;
+};
+
+/**
+ * @brief An i2c port shared by all the chips wired to it
+ *
+ * @note The send task takes the oldest pending frame of every chip in one pass and writes them back to back,
+ * so a chip with a long backlog does not delay the others by more than one frame each.
+ *
+ */
+struct iic_bus_s {
+    i2c_port_t i2c_master_num;
+    gpio_num_t sda_io_num;
+    gpio_num_t scl_io_num;
+    uint32_t clk_freq_hz;
+    iic_device_t *devices;
+    uint8_t queue_users;                /* devices that send through the task */
+    SemaphoreHandle_t queue_mutex;      /* protects the rings of all devices, the send task handle and the stats */
+    SemaphoreHandle_t bus_mutex;        /* held for a whole batch, direct writes wait for it */
+    SemaphoreHandle_t task_exit;        /* given by the send task when it has stopped */
+    TaskHandle_t send_task_handle;      /* NULL once the task is asked to stop */
+    iic_driver_stats_t stats;
+    int64_t stats_start_us;
+    uint32_t lost_frames;               /* dropped and failed frames since the bus was created, not cleared with the stats */
+#if IIC_USE_STATIC_CMD_LINK
+    uint8_t cmd_link_buffer[IIC_CMD_LINK_SIZE];
+#endif
+};
+
+static iic_bus_t *s_bus[I2C_NUM_MAX] = { NULL };
+static portMUX_TYPE s_bus_list_lock = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t s_bus_list_mutex_buffer;
+static SemaphoreHandle_t s_bus_list_mutex = NULL;
+
+/**
+ * @brief Take the mutex of the bus list, created by the first caller and never deleted
+ *
+ */
+static void bus_list_lock(void)
+{
+    portENTER_CRITICAL(&s_bus_list_lock);
+    if (!s_bus_list_mutex) {
+        s_bus_list_mutex = xSemaphoreCreateMutexStatic(&s_bus_list_mutex_buffer);
+    }
+    portEXIT_CRITICAL(&s_bus_list_lock);
+
+    xSemaphoreTake(s_bus_list_mutex, portMAX_DELAY);
+}
 
-static esp_err_t _write(uint8_t addr, uint8_t *data_wr, size_t size)
+/**
+ * @brief Write one frame, the bus mutex must be held
+ *
+ */
+static esp_err_t _write(iic_bus_t *bus, uint8_t addr, uint8_t *data_wr, size_t size, iic_transfer_t *transfer)
 {
 #if 0
     ESP_LOG_BUFFER_HEX_LEVEL(" _write addr:", &addr, 1, ESP_LOG_INFO);
     ESP_LOG_BUFFER_HEX_LEVEL(" _write data:", data_wr, size, ESP_LOG_INFO);
     printf("--------------------\r\n");
 #endif
+    transfer->start_us = esp_timer_get_time();
+#if IIC_USE_STATIC_CMD_LINK
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(bus->cmd_link_buffer, sizeof(bus->cmd_link_buffer));
+#else
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+#endif
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, addr, ACK_CHECK_DIS);
-    i2c_master_write(cmd, data_wr, size, ACK_CHECK_DIS);
+    if (size > 0) {
+        i2c_master_write(cmd, data_wr, size, ACK_CHECK_DIS);
+    }
     i2c_master_stop(cmd);
-    esp_err_t err = i2c_master_cmd_begin(s_obj->i2c_master_num, cmd, pdMS_TO_TICKS(10));
+    esp_err_t err = i2c_master_cmd_begin(bus->i2c_master_num, cmd, pdMS_TO_TICKS(10));
+#if IIC_USE_STATIC_CMD_LINK
+    i2c_cmd_link_delete_static(cmd);
+#else
     i2c_cmd_link_delete(cmd);
+#endif
+
+    transfer->end_us = esp_timer_get_time();
+    transfer->size = size;
+    transfer->err = err;
 
     return err;
 }
 
+/**
+ * @brief Account the time, outcome and latency of a transfer, the queue mutex must be held
+ *
+ */
+static void stats_record(iic_bus_t *bus, const iic_transfer_t *transfer)
+{
+    uint32_t transfer_us = transfer->end_us - transfer->start_us;
+    uint32_t latency_us = transfer->end_us - transfer->queued_us;
+    int bucket = 0;
+
+    bus->stats.busy_us += transfer_us;
+    if (transfer_us > bus->stats.max_transfer_us) {
+        bus->stats.max_transfer_us = transfer_us;
+    }
+    if (transfer->err == ESP_OK) {
+        bus->stats.sent_frames++;
+        bus->stats.sent_bytes += transfer->size + 1;
+    } else {
+        bus->stats.failed_frames++;
+        bus->lost_frames++;
+    }
+
+    while (bucket < IIC_LATENCY_BUCKET_NUM - 1 && latency_us >= (IIC_LATENCY_BUCKET_BASE_US << bucket)) {
+        bucket++;
+    }
+    bus->stats.latency_histogram[bucket]++;
+    bus->stats.total_latency_us += latency_us;
+    if (latency_us > bus->stats.max_latency_us) {
+        bus->stats.max_latency_us = latency_us;
+    }
+}
+
+/**
+ * @brief Take the oldest pending frame of every device of the bus
+ *
+ * @return Number of frames taken
+ */
+static int batch_pop(iic_bus_t *bus, i2c_send_data_t *batch, int batch_size)
+{
+    int count = 0;
+
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    for (iic_device_t *device = bus->devices; device && count < batch_size; device = device->next) {
+        if (device->count > 0) {
+            batch[count++] = device->frames[device->head];
+            device->head = (device->head + 1) % IIC_QUEUE_SIZE;
+            device->count--;
+        }
+    }
+    xSemaphoreGive(bus->queue_mutex);
+
+    return count;
+}
+
+static bool send_task_running(iic_bus_t *bus)
+{
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    bool running = bus->send_task_handle != NULL;
+    xSemaphoreGive(bus->queue_mutex);
+
+    return running;
+}
+
 static void send_task(void *arg)
 {
-    i2c_send_data_t data;
+    iic_bus_t *bus = (iic_bus_t *)arg;
+    i2c_send_data_t batch[IIC_BATCH_MAX_FRAMES];
+    iic_transfer_t transfer[IIC_BATCH_MAX_FRAMES];
+
     while (true) {
-        if (xQueueReceive(s_obj->cmd_queue_handle, &data, portMAX_DELAY) == pdPASS) {
-            _write(data.addr, data.data, data.real_data_size);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!send_task_running(bus)) {
+            break;
+        }
+
+        int count = 0;
+        while ((count = batch_pop(bus, batch, IIC_BATCH_MAX_FRAMES)) > 0) {
+            xSemaphoreTake(bus->bus_mutex, portMAX_DELAY);
+            for (int i = 0; i < count; i++) {
+                transfer[i].queued_us = batch[i].queued_us;
+                _write(bus, batch[i].addr, batch[i].data, batch[i].real_data_size, &transfer[i]);
+            }
+            xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+            for (int i = 0; i < count; i++) {
+                stats_record(bus, &transfer[i]);
+            }
+            bus->stats.batches++;
+            xSemaphoreGive(bus->queue_mutex);
+            xSemaphoreGive(bus->bus_mutex);
         }
     }
+
+    // Nothing of the bus is used after this, the deleting task may free it right away
+    xSemaphoreGive(bus->task_exit);
     vTaskDelete(NULL);
 }
 
-static void clean_up(void)
+static void bus_delete(iic_bus_t *bus)
 {
-    if (s_obj->cmd_queue_handle) {
-        vQueueDelete(s_obj->cmd_queue_handle);
-        s_obj->cmd_queue_handle = NULL;
+    if (bus->send_task_handle) {
+        vTaskDelete(bus->send_task_handle);
+        bus->send_task_handle = NULL;
     }
-
-    if (s_obj->send_task_handle) {
-        vTaskDelete(s_obj->send_task_handle);
-        s_obj->send_task_handle = NULL;
+    if (bus->queue_mutex) {
+        vSemaphoreDelete(bus->queue_mutex);
+        bus->queue_mutex = NULL;
+    }
+    if (bus->bus_mutex) {
+        vSemaphoreDelete(bus->bus_mutex);
+        bus->bus_mutex = NULL;
     }
+    if (bus->task_exit) {
+        vSemaphoreDelete(bus->task_exit);
+        bus->task_exit = NULL;
+    }
+    free(bus);
 }
 
-esp_err_t iic_driver_init(i2c_port_t i2c_master_num, gpio_num_t sda_io_num, gpio_num_t scl_io_num, uint32_t clk_freq_hz)
+static esp_err_t bus_create(i2c_port_t i2c_master_num, gpio_num_t sda_io_num, gpio_num_t scl_io_num, uint32_t clk_freq_hz, iic_bus_t **out_bus)
 {
     esp_err_t err = ESP_FAIL;
     i2c_config_t conf = { 0 };
@@ -124,68 +318,343 @@ esp_err_t iic_driver_init(i2c_port_t i2c_master_num, gpio_num_t sda_io_num, gpio
     err = i2c_param_config(i2c_master_num, &conf);
     IIC_CHECK(err == ESP_OK, "i2c param config fail", return err);
 
+    iic_bus_t *bus = calloc(1, sizeof(iic_bus_t));
+    IIC_CHECK(bus, "alloc fail", return ESP_ERR_NO_MEM);
+    bus->i2c_master_num = i2c_master_num;
+    bus->sda_io_num = sda_io_num;
+    bus->scl_io_num = scl_io_num;
+    bus->clk_freq_hz = clk_freq_hz;
+    bus->stats_start_us = esp_timer_get_time();
+
+    bus->queue_mutex = xSemaphoreCreateMutex();
+    IIC_CHECK(bus->queue_mutex, "queue mutex create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+    bus->bus_mutex = xSemaphoreCreateMutex();
+    IIC_CHECK(bus->bus_mutex, "bus mutex create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+    bus->task_exit = xSemaphoreCreateBinary();
+    IIC_CHECK(bus->task_exit, "task exit semaphore create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+
     err = i2c_driver_install(i2c_master_num, conf.mode, I2C_MASTER_RX_BUF_DISABLE, I2C_MASTER_TX_BUF_DISABLE, 0);
-    IIC_CHECK(err == ESP_OK, "i2c driver install fail", return err);
+    IIC_CHECK(err == ESP_OK, "i2c driver install fail", goto EXIT);
 
-    s_obj = calloc(1, sizeof(iic_config_t));
-    IIC_CHECK(s_obj, "alloc fail", return ESP_ERR_NO_MEM);
-    s_obj->i2c_master_num = i2c_master_num;
+    *out_bus = bus;
 
+    return ESP_OK;
+
+EXIT:
+    bus_delete(bus);
+    return err;
+}
+
+esp_err_t iic_driver_init(i2c_port_t i2c_master_num, gpio_num_t sda_io_num, gpio_num_t scl_io_num, uint32_t clk_freq_hz, iic_device_t **out_device)
+{
+    esp_err_t err = ESP_OK;
+    IIC_CHECK(i2c_master_num < I2C_NUM_MAX, "invalid i2c port", return ESP_ERR_INVALID_ARG);
+    IIC_CHECK(out_device, "device is null", return ESP_ERR_INVALID_ARG);
+
+    iic_device_t *device = calloc(1, sizeof(iic_device_t));
+    IIC_CHECK(device, "alloc fail", return ESP_ERR_NO_MEM);
+
+    bus_list_lock();
+
+    // 1. The first chip of a port installs the i2c driver, the next ones must use the same wiring
+    iic_bus_t *bus = s_bus[i2c_master_num];
+    if (!bus) {
+        err = bus_create(i2c_master_num, sda_io_num, scl_io_num, clk_freq_hz, &bus);
+        IIC_CHECK(err == ESP_OK, "bus create fail", goto EXIT);
+        s_bus[i2c_master_num] = bus;
+    } else {
+        IIC_CHECK(bus->sda_io_num == sda_io_num && bus->scl_io_num == scl_io_num && bus->clk_freq_hz == clk_freq_hz, "i2c port %d is used with other pins or frequency", err = ESP_ERR_INVALID_STATE; goto EXIT, i2c_master_num);
+    }
+
+    // 2. Add the chip to the bus
+    device->bus = bus;
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    device->next = bus->devices;
+    bus->devices = device;
+    xSemaphoreGive(bus->queue_mutex);
+
+    xSemaphoreGive(s_bus_list_mutex);
+    *out_device = device;
+
+    return ESP_OK;
+
+EXIT:
+    xSemaphoreGive(s_bus_list_mutex);
+    free(device);
     return err;
 }
 
-esp_err_t iic_driver_write(uint8_t addr, uint8_t *data_wr, size_t size)
+esp_err_t iic_driver_write(iic_device_t *device, uint8_t addr, uint8_t *data_wr, size_t size)
 {
     esp_err_t err = ESP_OK;
-    if (s_obj->cmd_queue_handle && s_obj->send_task_handle) {
-        if (uxQueueSpacesAvailable(s_obj->cmd_queue_handle) == 0) {
-            // ESP_LOGE(TAG, "queue full, reset");
-            ESP_LOG_BUFFER_HEX_LEVEL(TAG, data_wr, size, ESP_LOG_DEBUG);
-            xQueueReset(s_obj->cmd_queue_handle);
-            err = ESP_FAIL;
+    IIC_CHECK(device, "device is null", return ESP_ERR_INVALID_ARG);
+    IIC_CHECK(size <= MAX_CMD_DATA_LEN, "data too long", return ESP_ERR_INVALID_SIZE);
+    iic_bus_t *bus = device->bus;
+    int64_t queued_us = esp_timer_get_time();
+
+    if (device->use_queue) {
+        xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+
+        // 1. The newest pending frame writes the same registers, the latest value wins
+        i2c_send_data_t *data = NULL;
+        if (device->count > 0) {
+            data = &device->frames[(device->head + device->count - 1) % IIC_QUEUE_SIZE];
+            if (data->addr == addr && data->real_data_size == size) {
+                bus->stats.coalesced_frames++;
+            } else {
+                data = NULL;
+            }
         }
-        i2c_send_data_t data = { 0 };
-        data.addr = addr;
-        data.real_data_size = size;
-        memcpy(data.data, data_wr, size);
-        if (xQueueSend(s_obj->cmd_queue_handle, &data, 0) != pdTRUE) {
-            ESP_LOGE(TAG, "queue send data fail");
-            ESP_LOG_BUFFER_HEX_LEVEL(TAG, data_wr, size, ESP_LOG_DEBUG);
-            return ESP_FAIL;
+
+        // 2. Append a new frame, the oldest one is discarded if there is no space left
+        if (!data) {
+            if (device->count >= IIC_QUEUE_SIZE) {
+                ESP_LOG_BUFFER_HEX_LEVEL(TAG, device->frames[device->head].data, device->frames[device->head].real_data_size, ESP_LOG_DEBUG);
+                device->head = (device->head + 1) % IIC_QUEUE_SIZE;
+                device->count--;
+                bus->stats.dropped_frames++;
+                bus->lost_frames++;
+            }
+            data = &device->frames[(device->head + device->count) % IIC_QUEUE_SIZE];
+            data->queued_us = queued_us;
+            device->count++;
         }
+        data->addr = addr;
+        data->real_data_size = size;
+        memcpy(data->data, data_wr, size);
+        if (device->count > bus->stats.max_pending_frames) {
+            bus->stats.max_pending_frames = device->count;
+        }
+
+        // The handle is cleared under this mutex before the task is stopped, so a set handle is always a running task
+        if (bus->send_task_handle) {
+            xTaskNotifyGive(bus->send_task_handle);
+        }
+        xSemaphoreGive(bus->queue_mutex);
         return err;
     }
 
-    return _write(addr, data_wr, size);
+    iic_transfer_t transfer = {
+        .queued_us = queued_us,
+    };
+    xSemaphoreTake(bus->bus_mutex, portMAX_DELAY);
+    err = _write(bus, addr, data_wr, size, &transfer);
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    stats_record(bus, &transfer);
+    xSemaphoreGive(bus->queue_mutex);
+    xSemaphoreGive(bus->bus_mutex);
+
+    return err;
+}
+
+esp_err_t iic_driver_send_task_create(iic_device_t *device)
+{
+    IIC_CHECK(device, "device is null", return ESP_ERR_INVALID_ARG);
+    IIC_CHECK(!device->use_queue, "already initialized", return ESP_ERR_INVALID_STATE);
+    iic_bus_t *bus = device->bus;
+
+    // One send task per bus serves all the chips wired to it
+    xSemaphoreTake(s_bus_list_mutex, portMAX_DELAY);
+    if (!bus->send_task_handle) {
+        xTaskCreate(send_task, "send_task", IIC_TASK_STACK, bus, IIC_TASK_PRIORITY, &bus->send_task_handle);
+    }
+    if (bus->send_task_handle) {
+        bus->queue_users++;
+        device->use_queue = true;
+    }
+    xSemaphoreGive(s_bus_list_mutex);
+    IIC_CHECK(device->use_queue, "task create fail", return ESP_ERR_NO_MEM);
+
+    return ESP_OK;
+}
+
+esp_err_t iic_driver_task_destroy(iic_device_t *device)
+{
+    IIC_CHECK(device, "device is null", return ESP_ERR_INVALID_ARG);
+    IIC_CHECK(device->use_queue, "handle is null", return ESP_ERR_INVALID_STATE);
+    iic_bus_t *bus = device->bus;
+
+    // 1. The pending frames of this chip are dropped, the last chip that uses the queue asks the task to stop
+    xSemaphoreTake(s_bus_list_mutex, portMAX_DELAY);
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    device->use_queue = false;
+    device->head = 0;
+    device->count = 0;
+    TaskHandle_t task = NULL;
+    if (--bus->queue_users == 0) {
+        task = bus->send_task_handle;
+        bus->send_task_handle = NULL;
+    }
+    xSemaphoreGive(bus->queue_mutex);
+
+    // 2. The task ends its current batch and exits by itself, so it never dies holding a mutex
+    if (task) {
+        xTaskNotifyGive(task);
+        xSemaphoreTake(bus->task_exit, portMAX_DELAY);
+    }
+    xSemaphoreGive(s_bus_list_mutex);
+
+    return ESP_OK;
 }
 
-esp_err_t iic_driver_send_task_create(void)
+esp_err_t iic_driver_deinit(iic_device_t *device)
 {
-    IIC_CHECK(!s_obj->cmd_queue_handle || !s_obj->send_task_handle, "already initialized", return ESP_ERR_INVALID_STATE);
+    IIC_CHECK(device, "device is null", return ESP_ERR_INVALID_ARG);
+    iic_bus_t *bus = device->bus;
+
+    if (device->use_queue) {
+        iic_driver_task_destroy(device);
+    }
 
-    s_obj->cmd_queue_handle = xQueueCreate(IIC_QUEUE_SIZE, sizeof(i2c_send_data_t));
-    IIC_CHECK(s_obj->cmd_queue_handle, "queue create fail", goto EXIT);
+    xSemaphoreTake(s_bus_list_mutex, portMAX_DELAY);
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    for (iic_device_t **it = &bus->devices; *it; it = &(*it)->next) {
+        if (*it == device) {
+            *it = device->next;
+            break;
+        }
+    }
+    xSemaphoreGive(bus->queue_mutex);
+    free(device);
 
-    xTaskCreate(send_task, "send_task", IIC_TASK_STACK, NULL, IIC_TASK_PRIORITY, &s_obj->send_task_handle);
-    IIC_CHECK(s_obj->send_task_handle, "task create fail", goto EXIT);
+    // The last chip of a port releases the i2c driver
+    if (!bus->devices) {
+        s_bus[bus->i2c_master_num] = NULL;
+        i2c_driver_delete(bus->i2c_master_num);
+        bus_delete(bus);
+    }
+    xSemaphoreGive(s_bus_list_mutex);
 
     return ESP_OK;
+}
+
+esp_err_t iic_driver_get_stats(i2c_port_t i2c_master_num, iic_driver_stats_t *stats)
+{
+    esp_err_t err = ESP_OK;
+    IIC_CHECK(i2c_master_num < I2C_NUM_MAX, "invalid i2c port", return ESP_ERR_INVALID_ARG);
+    IIC_CHECK(stats, "stats is null", return ESP_ERR_INVALID_ARG);
+
+    // 1. The bus list mutex keeps the bus from being deleted while it is read
+    bus_list_lock();
+    iic_bus_t *bus = s_bus[i2c_master_num];
+    IIC_CHECK(bus, "init() must be called first", err = ESP_ERR_INVALID_STATE; goto EXIT);
+
+    // 2. The send task and the writers update the stats under the queue mutex, copy them in one piece
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    *stats = bus->stats;
+    int64_t elapsed_us = esp_timer_get_time() - bus->stats_start_us;
+    xSemaphoreGive(bus->queue_mutex);
+
+    // 3. The utilization comes from the copy, so it matches the other fields
+    stats->utilization = (elapsed_us > 0 && stats->busy_us < elapsed_us) ? stats->busy_us * 100 / elapsed_us : 100;
 
 EXIT:
-    clean_up();
-    return ESP_ERR_NO_MEM;
+    xSemaphoreGive(s_bus_list_mutex);
+    return err;
 }
 
-esp_err_t iic_driver_task_destroy(void)
+esp_err_t iic_driver_reset_stats(i2c_port_t i2c_master_num)
 {
-    IIC_CHECK(s_obj->cmd_queue_handle || s_obj->send_task_handle, "handle is null", return ESP_ERR_INVALID_STATE);
-    clean_up();
-    return ESP_OK;
+    esp_err_t err = ESP_OK;
+    IIC_CHECK(i2c_master_num < I2C_NUM_MAX, "invalid i2c port", return ESP_ERR_INVALID_ARG);
+
+    bus_list_lock();
+    iic_bus_t *bus = s_bus[i2c_master_num];
+    IIC_CHECK(bus, "init() must be called first", err = ESP_ERR_INVALID_STATE; goto EXIT);
+
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    memset(&bus->stats, 0, sizeof(iic_driver_stats_t));
+    bus->stats_start_us = esp_timer_get_time();
+    xSemaphoreGive(bus->queue_mutex);
+
+EXIT:
+    xSemaphoreGive(s_bus_list_mutex);
+    return err;
 }
 
-esp_err_t iic_driver_deinit(void)
+void iic_driver_shadow_init(iic_shadow_t *shadow, uint8_t size, uint8_t channel_size)
 {
-    i2c_driver_delete(s_obj->i2c_master_num);
-    clean_up();
+    memset(shadow, 0, sizeof(iic_shadow_t));
+    shadow->size = (size < IIC_SHADOW_MAX_SIZE) ? size : IIC_SHADOW_MAX_SIZE;
+    shadow->channel_size = channel_size ? channel_size : 1;
+}
+
+void iic_driver_shadow_invalidate(iic_shadow_t *shadow)
+{
+    shadow->valid = false;
+}
+
+bool iic_driver_shadow_update(iic_device_t *device, iic_shadow_t *shadow, const uint8_t *regs, uint8_t *offset, uint8_t *size)
+{
+    iic_bus_t *bus = device->bus;
+    int first = 0;
+    int last = shadow->size - 1;
+
+    // 1. A lost frame may have held registers that are not written again, a backlog may soon drop one
+    xSemaphoreTake(bus->queue_mutex, portMAX_DELAY);
+    uint32_t lost_frames = bus->lost_frames;
+    bool backlog = device->use_queue && device->count >= IIC_QUEUE_SIZE / 2;
+    xSemaphoreGive(bus->queue_mutex);
+
+    // 2. Otherwise only the range between the first and the last changed byte is written
+    if (shadow->valid && !backlog && lost_frames == shadow->lost_frames) {
+        while (first < shadow->size && regs[first] == shadow->regs[first]) {
+            first++;
+        }
+        if (first == shadow->size) {
+            return false;
+        }
+        while (regs[last] == shadow->regs[last]) {
+            last--;
+        }
+        first -= first % shadow->channel_size;
+        last += shadow->channel_size - 1 - last % shadow->channel_size;
+    }
+
+    memcpy(shadow->regs, regs, shadow->size);
+    shadow->valid = true;
+    shadow->lost_frames = lost_frames;
+    *offset = first;
+    *size = last - first + 1;
+
+    return true;
+}
+
+esp_err_t iic_driver_write_grayscale(iic_device_t *device, iic_shadow_t *shadow, const iic_regmap_t *map, const uint8_t *image, const uint8_t *prefix)
+{
+    uint8_t offset = 0;
+    uint8_t size = 0;
+    uint8_t addr = 0;
+    uint8_t data[IIC_REGMAP_MAX_DATA_SIZE] = { 0 };
+    IIC_CHECK(device && map->prefix_size + iic_regmap_image_size(map) <= MAX_CMD_DATA_LEN, "invalid register map", return ESP_ERR_INVALID_ARG);
+
+    if (!iic_driver_shadow_update(device, shadow, image, &offset, &size)) {
+        return ESP_OK;
+    }
+    uint8_t len = iic_regmap_encode(map, image, offset, size, prefix, &addr, data);
+    ESP_LOGD(TAG, "grayscale addr:%x size:%d", addr, len);
+
+    return iic_driver_write(device, addr, data, len);
+}
+
+esp_err_t iic_driver_print_stats(i2c_port_t i2c_master_num)
+{
+    iic_driver_stats_t stats = { 0 };
+    esp_err_t err = iic_driver_get_stats(i2c_master_num, &stats);
+    IIC_CHECK(err == ESP_OK, "get stats fail", return err);
+
+    uint32_t transfers = stats.sent_frames + stats.failed_frames;
+    ESP_LOGI(TAG, "i2c port %d: sent:%"PRIu32" (%"PRIu32" bytes) failed:%"PRIu32" coalesced:%"PRIu32" dropped:%"PRIu32" max pending:%"PRIu32" batches:%"PRIu32,
+             i2c_master_num, stats.sent_frames, stats.sent_bytes, stats.failed_frames, stats.coalesced_frames, stats.dropped_frames, stats.max_pending_frames, stats.batches);
+    ESP_LOGI(TAG, "transfer avg:%"PRIu32"us max:%"PRIu32"us, latency avg:%"PRIu32"us max:%"PRIu32"us, utilization:%d%%",
+             transfers ? (uint32_t)(stats.busy_us / transfers) : 0, stats.max_transfer_us,
+             transfers ? (uint32_t)(stats.total_latency_us / transfers) : 0, stats.max_latency_us, stats.utilization);
+    for (int i = 0; i < IIC_LATENCY_BUCKET_NUM; i++) {
+        if (i < IIC_LATENCY_BUCKET_NUM - 1) {
+            ESP_LOGI(TAG, "  < %6dus: %"PRIu32, IIC_LATENCY_BUCKET_BASE_US << i, stats.latency_histogram[i]);
+        } else {
+            ESP_LOGI(TAG, "  >=%6dus: %"PRIu32, IIC_LATENCY_BUCKET_BASE_US << (i - 1), stats.latency_histogram[i]);
+        }
+    }
     return ESP_OK;
 }
@@ -13,10 +13,95 @@
 // limitations under the License.
 
 #include "driver/i2c.h"
+#include "iic_regmap.h"
 #pragma once
 
-esp_err_t iic_driver_init(i2c_port_t i2c_master_num, gpio_num_t sda_io_num, gpio_num_t scl_io_num, uint32_t clk_freq_hz);
-esp_err_t iic_driver_write(uint8_t addr, uint8_t *data_wr, size_t size);
-esp_err_t iic_driver_send_task_create(void);
-esp_err_t iic_driver_task_destroy(void);
-esp_err_t iic_driver_deinit(void);
+/* Bucket i of the latency histogram counts the frames that took less than (IIC_LATENCY_BUCKET_BASE_US << i), the last one counts the rest */
+#define IIC_LATENCY_BUCKET_NUM      (8)
+#define IIC_LATENCY_BUCKET_BASE_US  (256)
+
+/**
+ * @brief Statistics of one i2c port, shared by all the chips wired to it
+ *
+ * @note The latency of a frame runs from iic_driver_write() until its transfer ends, so it includes the time spent in the queue
+ * and waiting for the bus. A coalesced frame keeps the time of the frame it replaced.
+ *
+ */
+typedef struct {
+    uint32_t sent_frames;           /* Frames written to the bus successfully */
+    uint32_t sent_bytes;            /* Address and data bytes of the frames written successfully */
+    uint32_t failed_frames;         /* Frames rejected by the i2c driver */
+    uint32_t coalesced_frames;      /* Frames that replaced a pending frame for the same registers */
+    uint32_t dropped_frames;        /* Pending frames discarded because the queue of their chip was full */
+    uint32_t max_pending_frames;    /* High-water mark of the queue of any chip */
+    uint32_t batches;               /* Passes of the send task, each one writes the oldest frame of every chip back to back */
+    uint64_t busy_us;               /* Time spent in transfers */
+    uint8_t utilization;            /* busy_us over the time since the bus was created or the stats were reset, in percent */
+    uint32_t max_transfer_us;       /* Longest single transfer, busy_us / (sent_frames + failed_frames) is the average */
+    uint32_t max_latency_us;        /* Longest latency of a frame */
+    uint64_t total_latency_us;      /* Sum of the latencies of the written frames */
+    uint32_t latency_histogram[IIC_LATENCY_BUCKET_NUM];
+} iic_driver_stats_t;
+
+/**
+ * @brief A chip on an i2c port, chips of different types may share one port
+ *
+ */
+typedef struct iic_device_s iic_device_t;
+
+#define IIC_SHADOW_MAX_SIZE         (16)
+
+/**
+ * @brief Copy of the registers last written to a chip, so that only the changed ones are written again
+ *
+ * @note The chips auto-increment the register address, so the changed registers go out as one frame holding
+ * the smallest run of whole channels that covers them. A full image is written after any frame of the port is lost,
+ * and while the send queue of the chip is half full, so that dropping the oldest frame never leaves a register stale.
+ *
+ */
+typedef struct {
+    uint8_t regs[IIC_SHADOW_MAX_SIZE];
+    uint8_t size;                   /* Register bytes of the image */
+    uint8_t channel_size;           /* Register bytes of one channel, a written range never splits a channel */
+    bool valid;                     /* The chip holds regs, otherwise the next update writes the full image */
+    uint32_t lost_frames;           /* Lost frames of the port when regs were last written, a count iic_driver_reset_stats() does not clear */
+} iic_shadow_t;
+
+/**
+ * @brief Add a chip to an i2c port
+ *
+ * @note The first chip of a port installs the i2c driver, the next ones must use the same pins and frequency.
+ * The chips of a port see each other's frames, they can only share it if their address bytes do not overlap.
+ * Chip driver instances are not supported yet: each chip driver keeps one global context, so the whole system
+ * drives at most one chip of each type, whatever the port. hal_output_init() rejects a second instance of a driver type.
+ */
+esp_err_t iic_driver_init(i2c_port_t i2c_master_num, gpio_num_t sda_io_num, gpio_num_t scl_io_num, uint32_t clk_freq_hz, iic_device_t **out_device);
+esp_err_t iic_driver_write(iic_device_t *device, uint8_t addr, uint8_t *data_wr, size_t size);
+esp_err_t iic_driver_send_task_create(iic_device_t *device);
+esp_err_t iic_driver_task_destroy(iic_device_t *device);
+esp_err_t iic_driver_deinit(iic_device_t *device);
+esp_err_t iic_driver_get_stats(i2c_port_t i2c_master_num, iic_driver_stats_t *stats);
+esp_err_t iic_driver_reset_stats(i2c_port_t i2c_master_num);
+
+/**
+ * @brief Register shadow of a chip
+ *
+ * @note iic_driver_shadow_update() stores the new image and returns true if a frame is needed, offset and size
+ * give the range of the image to write. The image starts as zeros and is written in full the first time.
+ */
+void iic_driver_shadow_init(iic_shadow_t *shadow, uint8_t size, uint8_t channel_size);
+void iic_driver_shadow_invalidate(iic_shadow_t *shadow);
+bool iic_driver_shadow_update(iic_device_t *device, iic_shadow_t *shadow, const uint8_t *regs, uint8_t *offset, uint8_t *size);
+
+/**
+ * @brief Write the grayscale registers of the image that differ from the shadow, encoded with the register map of the chip
+ *
+ * @param prefix map->prefix_size bytes sent before the grayscale, may be NULL if the map has none
+ */
+esp_err_t iic_driver_write_grayscale(iic_device_t *device, iic_shadow_t *shadow, const iic_regmap_t *map, const uint8_t *image, const uint8_t *prefix);
+
+/**
+ * @brief Log the statistics of a port, including the latency histogram
+ *
+ */
+esp_err_t iic_driver_print_stats(i2c_port_t i2c_master_num);
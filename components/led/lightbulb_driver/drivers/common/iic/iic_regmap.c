@@ -0,0 +1,82 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "iic_regmap.h"
+
+uint8_t iic_regmap_image_size(const iic_regmap_t *map)
+{
+    return map->pin_num * map->channel_bytes;
+}
+
+void iic_regmap_set_grayscale(const iic_regmap_t *map, uint8_t *image, uint8_t pin, uint16_t value)
+{
+    if (pin >= map->pin_num) {
+        return;
+    }
+
+    uint8_t mask = (1 << map->data_bits) - 1;
+    uint8_t *out = &image[pin * map->channel_bytes];
+    if (map->channel_bytes == 1) {
+        out[0] = value & mask;
+    } else if (map->high_byte_first) {
+        out[0] = (value >> map->data_bits) & mask;
+        out[1] = value & mask;
+    } else {
+        out[0] = value & mask;
+        out[1] = (value >> map->data_bits) & mask;
+    }
+}
+
+uint8_t iic_regmap_pack_current(const iic_regmap_t *map, uint8_t rgb, uint8_t cw)
+{
+    return (rgb << map->current_rgb_shift) | (cw << map->current_cw_shift);
+}
+
+uint8_t iic_regmap_parity(const iic_regmap_t *map, uint8_t byte)
+{
+    if (map->parity == IIC_REGMAP_PARITY_EVEN_BIT0) {
+        uint8_t ones = byte & 0xFE;
+        ones ^= ones >> 4;
+        ones ^= ones >> 2;
+        ones ^= ones >> 1;
+        byte = (byte & 0xFE) | (ones & 0x01);
+    }
+
+    return byte;
+}
+
+uint8_t iic_regmap_encode(const iic_regmap_t *map, const uint8_t *image, uint8_t offset, uint8_t size, const uint8_t *prefix, uint8_t *addr, uint8_t *data)
+{
+    uint8_t len = 0;
+
+    *addr = iic_regmap_parity(map, map->addr_base | ((map->addr_out1 + offset / map->addr_unit) << map->addr_shift));
+
+    // 1. Bytes the chip expects before the grayscale
+    for (int i = 0; i < map->prefix_size; i++) {
+        data[len++] = iic_regmap_parity(map, prefix[i]);
+    }
+
+    // 2. Grayscale, the common case without shift and parity is a plain copy
+    if (map->data_shift == 0 && map->parity == IIC_REGMAP_PARITY_NONE) {
+        memcpy(&data[len], &image[offset], size);
+        return len + size;
+    }
+    for (int i = 0; i < size; i++) {
+        data[len++] = iic_regmap_parity(map, image[offset + i] << map->data_shift);
+    }
+
+    return len;
+}
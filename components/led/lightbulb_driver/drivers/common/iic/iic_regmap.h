@@ -0,0 +1,63 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Longest frame after the address byte that an encoded register map may need */
+#define IIC_REGMAP_MAX_DATA_SIZE    (15)
+
+typedef enum {
+    IIC_REGMAP_PARITY_NONE = 0,
+    IIC_REGMAP_PARITY_EVEN_BIT0,    /* B[0] of every byte, address included, makes its number of ones even */
+} iic_regmap_parity_t;
+
+/**
+ * @brief Register map of an IIC dimming chip, interpreted by one encoder instead of hand-coded frames in every driver
+ *
+ * @note The grayscale image holds the grayscale register bytes of OUT1 to OUTn in register order, before data_shift and parity.
+ * A frame for the image bytes [offset, offset + size) is sent with the address byte
+ * addr_base | ((addr_out1 + offset / addr_unit) << addr_shift), followed by prefix_size bytes given by the driver and the image bytes.
+ *
+ */
+typedef struct {
+    uint8_t addr_base;              /* Bits of the address byte shared by every grayscale frame */
+    uint8_t addr_out1;              /* Address field of the OUT1 grayscale */
+    uint8_t addr_unit;              /* Image bytes per address step, 1 for byte addresses, channel_bytes for channel addresses */
+    uint8_t addr_shift;             /* Position of the address field in the address byte */
+    uint8_t pin_num;                /* Number of outputs */
+    uint8_t channel_bytes;          /* Grayscale bytes of one output, 1 or 2 */
+    uint8_t data_bits;              /* Bits of the value held by one grayscale byte, the first byte holds the low bits with 2 bytes */
+    uint8_t data_shift;             /* Position of the value bits in a grayscale byte */
+    bool high_byte_first;           /* The high bits of the value are sent first */
+    uint8_t prefix_size;            /* Bytes sent between the address byte and the grayscale, such as the current byte */
+    iic_regmap_parity_t parity;
+    uint8_t current_rgb_shift;      /* Current byte shared by all outputs: (rgb << current_rgb_shift) | (cw << current_cw_shift) */
+    uint8_t current_cw_shift;
+} iic_regmap_t;
+
+/**
+ * @brief Encode the registers of a chip described by an iic_regmap_t
+ *
+ * @note These functions only use the map and the buffers, they can run on the host.
+ * iic_regmap_set_grayscale() ignores a pin the map does not have, such as an unregistered channel.
+ * iic_regmap_encode() returns the number of data bytes written after the address byte.
+ */
+uint8_t iic_regmap_image_size(const iic_regmap_t *map);
+void iic_regmap_set_grayscale(const iic_regmap_t *map, uint8_t *image, uint8_t pin, uint16_t value);
+uint8_t iic_regmap_pack_current(const iic_regmap_t *map, uint8_t rgb, uint8_t cw);
+uint8_t iic_regmap_parity(const iic_regmap_t *map, uint8_t byte);
+uint8_t iic_regmap_encode(const iic_regmap_t *map, const uint8_t *image, uint8_t offset, uint8_t size, const uint8_t *prefix, uint8_t *addr, uint8_t *data);
@@ -0,0 +1,83 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "iic_regmap_chips.h"
+
+/* The RGB and WY outputs are not driven together, so the grayscale is not shadowed */
+const iic_regmap_t iic_regmap_sm2135e = {
+    .addr_base = 0xC0,                  /* BASE_ADDR */
+    .addr_out1 = 0x02,                  /* BIT_R_OUT1 */
+    .addr_unit = 1,
+    .pin_num = 5,
+    .channel_bytes = 1,
+    .data_bits = 8,
+    .current_rgb_shift = 4,
+};
+
+const iic_regmap_t iic_regmap_sm2135eh = {
+    .addr_base = 0xC0,                  /* BASE_ADDR */
+    .addr_out1 = 0x02,                  /* BIT_R_OUT1 */
+    .addr_unit = 1,
+    .pin_num = 5,
+    .channel_bytes = 1,
+    .data_bits = 8,
+    .current_rgb_shift = 4,
+};
+
+/* The address selects a channel, every grayscale frame starts with the current byte */
+const iic_regmap_t iic_regmap_sm2x35egh = {
+    .addr_base = 0xC0 | 0x18,           /* BASE_ADDR | BIT_ALL_CHANNEL */
+    .addr_out1 = 0x00,                  /* BIT_R_OUT1 */
+    .addr_unit = 2,
+    .pin_num = 5,
+    .channel_bytes = 2,
+    .data_bits = 8,
+    .high_byte_first = true,
+    .prefix_size = 1,
+    .current_rgb_shift = 4,
+};
+
+/* The 10-bit grayscale of OUT1-OUT5 is split in 5-bit bytes, low bits first */
+const iic_regmap_t iic_regmap_bp5758d = {
+    .addr_base = 0x80 | 0x20,           /* BASE_ADDR | BIT_DISABLE_SLEEP_MODE */
+    .addr_out1 = 0x06,                  /* BIT_OUT1_GRAYSCALE */
+    .addr_unit = 1,
+    .pin_num = 5,
+    .channel_bytes = 2,
+    .data_bits = 5,
+};
+
+const iic_regmap_t iic_regmap_bp1658cj = {
+    .addr_base = 0x80 | 0x30,           /* BASE_ADDR | BIT_ALL_OUT_ENABLE */
+    .addr_out1 = 0x01,                  /* BIT_R_OUT1 */
+    .addr_unit = 1,
+    .pin_num = 5,
+    .channel_bytes = 2,
+    .data_bits = 5,
+    .current_rgb_shift = 4,
+};
+
+/* Byte4 - Byte13, the grayscale bits are B[5:1] and B[0] is the parity of every byte */
+const iic_regmap_t iic_regmap_kp18058 = {
+    .addr_base = 0x80 | 0x60,           /* BASE_ADDR | BIT_ALL_CHANNEL */
+    .addr_out1 = 0x06 >> 1,             /* BIT_NEXT_BYTE4 >> 1 */
+    .addr_unit = 1,
+    .addr_shift = 1,
+    .pin_num = 5,
+    .channel_bytes = 2,
+    .data_bits = 5,
+    .data_shift = 1,
+    .high_byte_first = true,
+    .parity = IIC_REGMAP_PARITY_EVEN_BIT0,
+};
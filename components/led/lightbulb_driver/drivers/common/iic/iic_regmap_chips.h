@@ -0,0 +1,30 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "iic_regmap.h"
+
+/**
+ * @brief Register maps of the supported IIC dimming chips
+ *
+ * @note The maps hold the register values of the data sheets as literals so that they can be checked on the host,
+ * the comments name the register bits of each driver.
+ */
+extern const iic_regmap_t iic_regmap_sm2135e;
+extern const iic_regmap_t iic_regmap_sm2135eh;
+extern const iic_regmap_t iic_regmap_sm2x35egh;
+extern const iic_regmap_t iic_regmap_bp5758d;
+extern const iic_regmap_t iic_regmap_bp1658cj;
+extern const iic_regmap_t iic_regmap_kp18058;
@@ -18,6 +18,7 @@
 #include <esp_log.h>
 
 #include "iic.h"
+#include "iic_regmap_chips.h"
 #include "kp18058.h"
 
 static const char *TAG = "kp18058";
@@ -107,59 +108,33 @@ typedef struct {
     uint8_t mapping_addr[KP18058_MAX_PIN];
     /* Mark Byte1 Byte2 Byte3, these parameters will not change after initialization. */
     uint8_t fixed_bit[3];
+    iic_device_t *iic;
+    /* Byte4 - Byte13 before the shift and the parity bit */
+    iic_shadow_t grayscale;
 } kp18058_handle_t;
 
 static kp18058_handle_t *s_kp18058 = NULL;
 
-static IRAM_ATTR uint8_t parity_check(uint8_t input)
-{
-#if 0
-    uint8_t result = input;
-    result ^= result >> 8;
-    result ^= result >> 4;
-    result ^= result >> 2;
-    result ^= result >> 1;
-
-    return (result % 2 == 0) ? input : (input |= 0x01);
-#else
-    static uint8_t table[256] = {
-        0,   0,   3,   3,   5,   5,   6,   6,   9,   9,   10,  10,  12,  12,  15,  15,
-        17,  17,  18,  18,  20,  20,  23,  23,  24,  24,  27,  27,  29,  29,  30,  30,
-        33,  33,  34,  34,  36,  36,  39,  39,  40,  40,  43,  43,  45,  45,  46,  46,
-        48,  48,  51,  51,  53,  53,  54,  54,  57,  57,  58,  58,  60,  60,  63,  63,
-        65,  65,  66,  66,  68,  68,  71,  71,  72,  72,  75,  75,  77,  77,  78,  78,
-        80,  80,  83,  83,  85,  85,  86,  86,  89,  89,  90,  90,  92,  92,  95,  95,
-        96,  96,  99,  99,  101, 101, 102, 102, 105, 105, 106, 106, 108, 108, 111, 111,
-        113, 113, 114, 114, 116, 116, 119, 119, 120, 120, 123, 123, 125, 125, 126, 126,
-        129, 129, 130, 130, 132, 132, 135, 135, 136, 136, 139, 139, 141, 141, 142, 142,
-        144, 144, 147, 147, 149, 149, 150, 150, 153, 153, 154, 154, 156, 156, 159, 159,
-        160, 160, 163, 163, 165, 165, 166, 166, 169, 169, 170, 170, 172, 172, 175, 175,
-        177, 177, 178, 178, 180, 180, 183, 183, 184, 184, 187, 187, 189, 189, 190, 190,
-        192, 192, 195, 195, 197, 197, 198, 198, 201, 201, 202, 202, 204, 204, 207, 207,
-        209, 209, 210, 210, 212, 212, 215, 215, 216, 216, 219, 219, 221, 221, 222, 222,
-        225, 225, 226, 226, 228, 228, 231, 231, 232, 232, 235, 235, 237, 237, 238, 238,
-        240, 240, 243, 243, 245, 245, 246, 246, 249, 249, 250, 250, 252, 252, 255, 255,
-    };
-    return (table[input]);
-#endif
-}
+static const iic_regmap_t *const s_regmap = &iic_regmap_kp18058;
 
-static uint8_t get_mapping_addr(kp18058_channel_t channel)
+static esp_err_t _write(uint8_t addr, uint8_t *data_wr, size_t size)
 {
-    uint8_t addr[] = { BIT_NEXT_BYTE4, BIT_NEXT_BYTE6, BIT_NEXT_BYTE8, BIT_NEXT_BYTE10, BIT_NEXT_BYTE12 };
-    uint8_t result = addr[s_kp18058->mapping_addr[channel]];
+    addr = iic_regmap_parity(s_regmap, addr);
+    for (int i = 0; i < size; i++) {
+        data_wr[i] = iic_regmap_parity(s_regmap, data_wr[i]);
+    }
 
-    return result;
+    return iic_driver_write(s_kp18058->iic, addr, data_wr, size);
 }
 
-static esp_err_t _write(uint8_t addr, uint8_t *data_wr, size_t size)
+static void set_grayscale(uint8_t *value, kp18058_channel_t channel, uint16_t data)
 {
-    addr = parity_check(addr);
-    for (int i = 0; i < size; i++) {
-        data_wr[i] = parity_check(data_wr[i]);
-    }
+    iic_regmap_set_grayscale(s_regmap, value, s_kp18058->mapping_addr[channel], data);
+}
 
-    return iic_driver_write(addr, data_wr, size);
+static esp_err_t write_grayscale(uint8_t *value)
+{
+    return iic_driver_write_grayscale(s_kp18058->iic, &s_kp18058->grayscale, s_regmap, value, NULL);
 }
 
 static esp_err_t set_init_data(void)
@@ -183,6 +158,7 @@ esp_err_t kp18058_set_standby_mode(bool enable_standby)
         addr |= BIT_ALL_CHANNEL;
     }
     memcpy(&value[0], s_kp18058->fixed_bit, 3);
+    iic_driver_shadow_invalidate(&s_kp18058->grayscale);
 
     return _write(addr, value, sizeof(value));
 }
@@ -208,18 +184,17 @@ esp_err_t kp18058_set_channel(kp18058_channel_t channel, uint16_t value)
     KP18058_CHECK(s_kp18058->mapping_addr[channel] != INVALID_ADDR, "channel:%d not regist", return ESP_ERR_INVALID_STATE, channel);
     KP18058_CHECK(value <= 1023, "value out of range", return ESP_ERR_INVALID_ARG);
 
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | get_mapping_addr(channel);
-    uint8_t _value[2] = { 0 };
+    uint8_t _value[10] = { 0 };
 
     if (!s_kp18058->init_done) {
         set_init_data();
         s_kp18058->init_done = true;
     }
 
-    _value[0] = (value >> 5) << 1;
-    _value[1] = (value & 0x1F) << 1;
+    memcpy(_value, s_kp18058->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, channel, value);
 
-    return _write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t kp18058_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
@@ -227,24 +202,19 @@ esp_err_t kp18058_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t v
     KP18058_CHECK(s_kp18058, "not init", return ESP_ERR_INVALID_STATE);
     KP18058_CHECK(s_kp18058->mapping_addr[0] != INVALID_ADDR || s_kp18058->mapping_addr[1] != INVALID_ADDR || s_kp18058->mapping_addr[2] != INVALID_ADDR, "color channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_NEXT_BYTE4;
-    uint8_t _value[6] = { 0 };
+    uint8_t _value[10] = { 0 };
 
     if (!s_kp18058->init_done) {
         set_init_data();
         s_kp18058->init_done = true;
     }
 
-    _value[s_kp18058->mapping_addr[0] * 2 + 0] = (value_r >> 5) << 1;
-    _value[s_kp18058->mapping_addr[0] * 2 + 1] = (value_r & 0x1F) << 1;
-
-    _value[s_kp18058->mapping_addr[1] * 2 + 0] = (value_g >> 5) << 1;
-    _value[s_kp18058->mapping_addr[1] * 2 + 1] = (value_g & 0x1F) << 1;
+    memcpy(_value, s_kp18058->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, KP18058_CHANNEL_R, value_r);
+    set_grayscale(_value, KP18058_CHANNEL_G, value_g);
+    set_grayscale(_value, KP18058_CHANNEL_B, value_b);
 
-    _value[s_kp18058->mapping_addr[2] * 2 + 0] = (value_b >> 5) << 1;
-    _value[s_kp18058->mapping_addr[2] * 2 + 1] = (value_b & 0x1F) << 1;
-
-    return _write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t kp18058_set_cw_channel(uint16_t value_c, uint16_t value_w)
@@ -252,21 +222,18 @@ esp_err_t kp18058_set_cw_channel(uint16_t value_c, uint16_t value_w)
     KP18058_CHECK(s_kp18058, "not init", return ESP_ERR_INVALID_STATE);
     KP18058_CHECK(s_kp18058->mapping_addr[3] != INVALID_ADDR || s_kp18058->mapping_addr[4] != INVALID_ADDR, "white channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_NEXT_BYTE10;
-    uint8_t _value[4] = { 0 };
+    uint8_t _value[10] = { 0 };
 
     if (!s_kp18058->init_done) {
         set_init_data();
         s_kp18058->init_done = true;
     }
 
-    _value[(s_kp18058->mapping_addr[3] - 3) * 2 + 0] = (value_c >> 5) << 1;
-    _value[(s_kp18058->mapping_addr[3] - 3) * 2 + 1] = (value_c & 0x1F) << 1;
+    memcpy(_value, s_kp18058->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, KP18058_CHANNEL_C, value_c);
+    set_grayscale(_value, KP18058_CHANNEL_W, value_w);
 
-    _value[(s_kp18058->mapping_addr[4] - 3) * 2 + 0] = (value_w >> 5) << 1;
-    _value[(s_kp18058->mapping_addr[4] - 3) * 2 + 1] = (value_w & 0x1F) << 1;
-
-    return _write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t kp18058_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b, uint16_t value_c, uint16_t value_w)
@@ -274,7 +241,6 @@ esp_err_t kp18058_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_t
     KP18058_CHECK(s_kp18058, "not init", return ESP_ERR_INVALID_STATE);
     KP18058_CHECK(s_kp18058->mapping_addr[3] != INVALID_ADDR || s_kp18058->mapping_addr[4] != INVALID_ADDR, "white channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_NEXT_BYTE4;
     uint8_t _value[10] = { 0 };
 
     if (!s_kp18058->init_done) {
@@ -282,22 +248,13 @@ esp_err_t kp18058_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_t
         s_kp18058->init_done = true;
     }
 
-    _value[s_kp18058->mapping_addr[0] * 2 + 0] = (value_r >> 5) << 1;
-    _value[s_kp18058->mapping_addr[0] * 2 + 1] = (value_r & 0x1F) << 1;
-
-    _value[s_kp18058->mapping_addr[1] * 2 + 0] = (value_g >> 5) << 1;
-    _value[s_kp18058->mapping_addr[1] * 2 + 1] = (value_g & 0x1F) << 1;
-
-    _value[s_kp18058->mapping_addr[2] * 2 + 0] = (value_b >> 5) << 1;
-    _value[s_kp18058->mapping_addr[2] * 2 + 1] = (value_b & 0x1F) << 1;
-
-    _value[s_kp18058->mapping_addr[3] * 2 + 0] = (value_c >> 5) << 1;
-    _value[s_kp18058->mapping_addr[3] * 2 + 1] = (value_c & 0x1F) << 1;
-
-    _value[s_kp18058->mapping_addr[4] * 2 + 0] = (value_w >> 5) << 1;
-    _value[s_kp18058->mapping_addr[4] * 2 + 1] = (value_w & 0x1F) << 1;
+    set_grayscale(_value, KP18058_CHANNEL_R, value_r);
+    set_grayscale(_value, KP18058_CHANNEL_G, value_g);
+    set_grayscale(_value, KP18058_CHANNEL_B, value_b);
+    set_grayscale(_value, KP18058_CHANNEL_C, value_c);
+    set_grayscale(_value, KP18058_CHANNEL_W, value_w);
 
-    return _write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t kp18058_init(driver_kp18058_t *config)
@@ -312,6 +269,7 @@ esp_err_t kp18058_init(driver_kp18058_t *config)
     s_kp18058 = calloc(1, sizeof(kp18058_handle_t));
     KP18058_CHECK(s_kp18058, "alloc fail", return ESP_ERR_NO_MEM);
     memset(s_kp18058->mapping_addr, INVALID_ADDR, KP18058_MAX_PIN);
+    iic_driver_shadow_init(&s_kp18058->grayscale, iic_regmap_image_size(s_regmap), s_regmap->channel_bytes);
 
     // The following configuration defaults value are from the KP18058 data sheet
     // Byte 1
@@ -349,11 +307,11 @@ esp_err_t kp18058_init(driver_kp18058_t *config)
         ESP_LOGW(TAG, "The frequency is too high, adjust it to 300khz");
     }
 
-    err |= iic_driver_init(I2C_NUM_0, config->iic_sda, config->iic_clk, config->iic_freq_khz * IIC_BASE_UNIT_HZ);
+    err |= iic_driver_init(config->iic_port, config->iic_sda, config->iic_clk, config->iic_freq_khz * IIC_BASE_UNIT_HZ, &s_kp18058->iic);
     KP18058_CHECK(err == ESP_OK, "i2c master init fail", goto EXIT);
 
     if (config->enable_iic_queue) {
-        err |= iic_driver_send_task_create();
+        err |= iic_driver_send_task_create(s_kp18058->iic);
         KP18058_CHECK(err == ESP_OK, "task create fail", goto EXIT);
     }
 
@@ -361,6 +319,9 @@ esp_err_t kp18058_init(driver_kp18058_t *config)
 EXIT:
 
     if (s_kp18058) {
+        if (s_kp18058->iic) {
+            iic_driver_deinit(s_kp18058->iic);
+        }
         free(s_kp18058);
         s_kp18058 = NULL;
     }
@@ -372,8 +333,7 @@ esp_err_t kp18058_deinit(void)
     KP18058_CHECK(s_kp18058, "not init", return ESP_ERR_INVALID_STATE);
 
     kp18058_set_shutdown();
-    iic_driver_deinit();
-    iic_driver_task_destroy();
+    iic_driver_deinit(s_kp18058->iic);
     free(s_kp18058);
     s_kp18058 = NULL;
     return ESP_OK;
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "driver/gpio.h"
+#include "driver/i2c.h"
 #pragma once
 
 /**
@@ -69,6 +70,7 @@ typedef struct {
     gpio_num_t iic_clk;
     gpio_num_t iic_sda;
     uint16_t iic_freq_khz;
+    i2c_port_t iic_port;            // One chip of each type, chips on the same port must use the same pins and frequency
     bool enable_iic_queue : 1;
     bool enable_custom_param : 1;   // If enabled will customize byte1-3, Otherwise use default parameters.
     struct {
@@ -17,6 +17,7 @@
 
 #include <esp_log.h>
 #include <esp_compiler.h>
+#include <esp_timer.h>
 #include <driver/ledc.h>
 
 #include "pwm.h"
@@ -39,37 +40,145 @@ typedef struct {
 #if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0))
     bool invert_level;
 #endif
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+    pwm_fade_end_cb_t fade_end_cb;
+    void *fade_end_priv;
+#endif
 } pwm_handle_t;
 
 static pwm_handle_t *s_pwm = NULL;
 
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+static IRAM_ATTR bool pwm_fade_end_isr(const ledc_cb_param_t *param, void *user_arg)
+{
+    pwm_handle_t *pwm = (pwm_handle_t *)user_arg;
+
+    if (param->event == LEDC_FADE_END_EVT && pwm->fade_end_cb) {
+        return pwm->fade_end_cb((pwm_channel_t)param->channel, pwm->fade_end_priv);
+    }
+
+    return false;
+}
+#endif
+
 #if CONFIG_PM_ENABLE
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "esp_pm.h"
 
+#define PWM_LOCK_SLEEP                          BIT(0)
+#define PWM_LOCK_APB                            BIT(1)
+#define PWM_LOCK_CPU                            BIT(2)
+#define PWM_LOCK_ALL                            (PWM_LOCK_SLEEP | PWM_LOCK_APB | PWM_LOCK_CPU)
+
+typedef enum {
+    PWM_POWER_SLEEP = 0,
+    PWM_POWER_STEADY,
+    PWM_POWER_ACTIVE,
+} pwm_power_state_t;
+
 static esp_pm_lock_handle_t s_sleep_lock = NULL;
 static esp_pm_lock_handle_t s_freq_lock = NULL;
 static esp_pm_lock_handle_t s_cpu_lock = NULL;
-static bool s_lock_is_take = false;
 static bool s_create_done = false;
-static void power_control_enable_sleep(void)
+static portMUX_TYPE s_power_lock = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t s_power_mutex_buffer;
+static SemaphoreHandle_t s_power_mutex = NULL;
+static uint8_t s_lock_mask = 0;
+static uint8_t s_steady_lock_mask = 0;
+static bool s_fade_active = false;
+static bool s_sleep_requested = false;
+static pwm_power_state_t s_power_state = PWM_POWER_SLEEP;
+static int64_t s_power_state_time = 0;
+static pwm_power_stats_t s_power_stats = { 0 };
+
+static void power_control_lock_update(uint8_t old_mask, uint8_t lock_mask)
 {
-    if (s_lock_is_take && s_create_done) {
-        ESP_LOGW(TAG, "release power lock, wifi enable sleep");
-        esp_pm_lock_release(s_freq_lock);
+    // The new locks are taken before the old ones are released, so the chip never sleeps in between
+    uint8_t acquire_mask = lock_mask & ~old_mask;
+    uint8_t release_mask = old_mask & ~lock_mask;
+
+    if (acquire_mask & PWM_LOCK_SLEEP) {
+        esp_pm_lock_acquire(s_sleep_lock);
+    }
+    if (acquire_mask & PWM_LOCK_APB) {
+        esp_pm_lock_acquire(s_freq_lock);
+    }
+    if (acquire_mask & PWM_LOCK_CPU) {
+        esp_pm_lock_acquire(s_cpu_lock);
+    }
+    if (release_mask & PWM_LOCK_CPU) {
         esp_pm_lock_release(s_cpu_lock);
+    }
+    if (release_mask & PWM_LOCK_APB) {
+        esp_pm_lock_release(s_freq_lock);
+    }
+    if (release_mask & PWM_LOCK_SLEEP) {
         esp_pm_lock_release(s_sleep_lock);
-        s_lock_is_take = false;
     }
 }
 
-static void power_control_disable_sleep(void)
+static void power_control_time_update(int64_t now)
 {
-    if (!s_lock_is_take && s_create_done) {
-        ESP_LOGW(TAG, "acquire power lock, disable sleep");
-        esp_pm_lock_acquire(s_freq_lock);
-        esp_pm_lock_acquire(s_cpu_lock);
-        esp_pm_lock_acquire(s_sleep_lock);
-        s_lock_is_take = true;
+    int64_t elapsed = now - s_power_state_time;
+
+    if (s_power_state == PWM_POWER_ACTIVE) {
+        s_power_stats.active_us += elapsed;
+    } else if (s_power_state == PWM_POWER_STEADY) {
+        s_power_stats.steady_us += elapsed;
+    } else {
+        s_power_stats.sleep_us += elapsed;
+    }
+    s_power_state_time = now;
+}
+
+/**
+ * @brief Hold the power locks needed by the current output
+ *
+ * @note A running fade holds all locks. A steady output only holds the locks its LEDC clock needs,
+ * and an output switched off by pwm_set_sleep() holds none. A sleep request made during a fade is applied when the fade ends.
+ * The esp_pm calls may block, they are made after the spinlock is released and s_power_mutex keeps them in the order of the masks.
+ */
+static void power_control_update(void)
+{
+    if (!s_create_done) {
+        return;
+    }
+
+    xSemaphoreTake(s_power_mutex, portMAX_DELAY);
+    portENTER_CRITICAL(&s_power_lock);
+    uint8_t old_mask = s_lock_mask;
+    pwm_power_state_t state = s_fade_active ? PWM_POWER_ACTIVE : (s_sleep_requested ? PWM_POWER_SLEEP : PWM_POWER_STEADY);
+    if (state != s_power_state) {
+        power_control_time_update(esp_timer_get_time());
+        if (state == PWM_POWER_ACTIVE) {
+            s_power_stats.active_count++;
+        }
+        s_power_state = state;
+        s_lock_mask = (state == PWM_POWER_ACTIVE) ? PWM_LOCK_ALL : (state == PWM_POWER_STEADY) ? s_steady_lock_mask : 0;
+    }
+    uint8_t lock_mask = s_lock_mask;
+    portEXIT_CRITICAL(&s_power_lock);
+
+    power_control_lock_update(old_mask, lock_mask);
+    xSemaphoreGive(s_power_mutex);
+}
+
+/**
+ * @brief Every write wakes an output that was put to sleep, unless it is the last step of a fade
+ *
+ */
+static void power_control_wake(void)
+{
+    portENTER_CRITICAL(&s_power_lock);
+    bool wake = !s_fade_active && s_sleep_requested;
+    if (wake) {
+        s_sleep_requested = false;
+    }
+    portEXIT_CRITICAL(&s_power_lock);
+
+    if (wake) {
+        power_control_update();
     }
 }
 
@@ -85,9 +194,46 @@ static esp_err_t power_control_lock_create(void)
     err = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "freq_lock", &s_freq_lock);
     PWM_CHECK(err == ESP_OK, "create freq lock fail", return err);
 
+    // A static output only needs its LEDC clock: APB on ESP32, XTAL on other targets, and RC_FAST also runs in light sleep
+#if CONFIG_PWM_STEADY_LIGHT_SLEEP
+    s_steady_lock_mask = 0;
+#elif CONFIG_IDF_TARGET_ESP32
+    s_steady_lock_mask = PWM_LOCK_SLEEP | PWM_LOCK_APB;
+#else
+    s_steady_lock_mask = PWM_LOCK_SLEEP;
+#endif
+    s_power_mutex = xSemaphoreCreateMutexStatic(&s_power_mutex_buffer);
+    s_lock_mask = 0;
+    s_fade_active = false;
+    s_sleep_requested = false;
+    s_power_state = PWM_POWER_SLEEP;
+    s_power_state_time = esp_timer_get_time();
+    memset(&s_power_stats, 0, sizeof(s_power_stats));
     s_create_done = true;
     return err;
 }
+
+static void power_control_lock_delete(void)
+{
+    if (!s_create_done) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_power_lock);
+    s_fade_active = false;
+    s_sleep_requested = true;
+    portEXIT_CRITICAL(&s_power_lock);
+    power_control_update();
+    s_create_done = false;
+    vSemaphoreDelete(s_power_mutex);
+    s_power_mutex = NULL;
+    esp_pm_lock_delete(s_sleep_lock);
+    esp_pm_lock_delete(s_cpu_lock);
+    esp_pm_lock_delete(s_freq_lock);
+    s_sleep_lock = NULL;
+    s_cpu_lock = NULL;
+    s_freq_lock = NULL;
+}
 #endif
 
 esp_err_t pwm_init(driver_pwm_t *config)
@@ -112,7 +258,14 @@ esp_err_t pwm_init(driver_pwm_t *config)
 #else
     s_pwm->ledc_config.speed_mode = LEDC_LOW_SPEED_MODE;
     s_pwm->ledc_config.duty_resolution = LEDC_TIMER_12_BIT;
+#if CONFIG_PWM_STEADY_LIGHT_SLEEP && (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0))
+    // RC_FAST keeps running in light sleep, the LEDC driver keeps it powered up when it is selected
+    s_pwm->ledc_config.clk_cfg = LEDC_USE_RC_FAST_CLK;
+#elif CONFIG_PWM_STEADY_LIGHT_SLEEP
+    s_pwm->ledc_config.clk_cfg = LEDC_USE_RTC8M_CLK;
+#else
     s_pwm->ledc_config.clk_cfg = LEDC_USE_XTAL_CLK;
+#endif
 #endif
 
     err = ledc_timer_config(&s_pwm->ledc_config);
@@ -123,7 +276,7 @@ esp_err_t pwm_init(driver_pwm_t *config)
 #if CONFIG_PM_ENABLE
     err = power_control_lock_create();
     PWM_CHECK(err == ESP_OK, "power_control_lock_create fail", goto EXIT);
-    power_control_disable_sleep();
+    power_control_update();
 #endif
 
     return ESP_OK;
@@ -140,6 +293,9 @@ EXIT:
 esp_err_t pwm_deinit()
 {
     ledc_fade_func_uninstall();
+#if CONFIG_PM_ENABLE
+    power_control_lock_delete();
+#endif
 
     if (s_pwm) {
         free(s_pwm);
@@ -169,6 +325,13 @@ esp_err_t pwm_regist_channel(pwm_channel_t channel, gpio_num_t gpio_num)
     };
     err = ledc_channel_config(&ledc_ch_config);
     PWM_CHECK(err == ESP_OK, "channel config fail", return ESP_ERR_INVALID_STATE);
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+    ledc_cbs_t cbs = {
+        .fade_cb = pwm_fade_end_isr,
+    };
+    err = ledc_cb_register(s_pwm->ledc_config.speed_mode, channel, &cbs, s_pwm);
+    PWM_CHECK(err == ESP_OK, "fade callback register fail", return ESP_ERR_INVALID_STATE);
+#endif
     ESP_LOGI(TAG, "channel:%d -> gpio_num:%d", channel, gpio_num);
     s_pwm->registered_channel_mask |= (1 << channel);
 
@@ -183,7 +346,7 @@ esp_err_t pwm_set_channel(pwm_channel_t channel, uint16_t value)
     PWM_CHECK((value <= (1 << s_pwm->ledc_config.duty_resolution)), "value out of range", return ESP_ERR_INVALID_ARG);
 
 #if CONFIG_PM_ENABLE
-    power_control_disable_sleep();
+    power_control_wake();
 #endif
 
     err |= ledc_set_duty(s_pwm->ledc_config.speed_mode, channel, value);
@@ -204,7 +367,7 @@ esp_err_t pwm_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value
               (value_b <= (1 << s_pwm->ledc_config.duty_resolution)), "value out of range", return ESP_ERR_INVALID_ARG);
 
 #if CONFIG_PM_ENABLE
-    power_control_disable_sleep();
+    power_control_wake();
 #endif
 
     //Must be set first
@@ -230,7 +393,7 @@ esp_err_t pwm_set_cctb_or_cw_channel(uint16_t value_cct_c, uint16_t value_b_w)
               (value_b_w <= (1 << s_pwm->ledc_config.duty_resolution)), "value out of range", return ESP_ERR_INVALID_ARG);
 
 #if CONFIG_PM_ENABLE
-    power_control_disable_sleep();
+    power_control_wake();
 #endif
 
     //Must be set first
@@ -260,7 +423,7 @@ esp_err_t pwm_set_rgbcctb_or_rgbcw_channel(uint16_t value_r, uint16_t value_g, u
               (value_b_w <= (1 << s_pwm->ledc_config.duty_resolution)), "value out of range", return ESP_ERR_INVALID_ARG);
 
 #if CONFIG_PM_ENABLE
-    power_control_disable_sleep();
+    power_control_wake();
 #endif
 
     //Must be set first
@@ -286,7 +449,7 @@ esp_err_t pwm_set_shutdown(void)
     PWM_CHECK(s_pwm, "pwm_init() must be called first", return ESP_ERR_INVALID_STATE);
 
 #if CONFIG_PM_ENABLE
-    power_control_disable_sleep();
+    power_control_wake();
 #endif
 
     for (int i = 0; i < PWM_CHANNEL_MAX; i++) {
@@ -305,23 +468,101 @@ esp_err_t pwm_set_hw_fade(pwm_channel_t channel, uint16_t value, int fade_ms)
     PWM_CHECK(value <= ((1 << s_pwm->ledc_config.duty_resolution)), "value out of range", return ESP_ERR_INVALID_ARG);
 
 #if CONFIG_PM_ENABLE
-    power_control_disable_sleep();
+    power_control_wake();
 #endif
 
     return ledc_set_fade_time_and_start(s_pwm->ledc_config.speed_mode, channel, value, fade_ms, LEDC_FADE_NO_WAIT);
 }
 
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+esp_err_t pwm_stop_hw_fade(pwm_channel_t channel, uint16_t *value)
+{
+    esp_err_t err = ESP_OK;
+    PWM_CHECK(s_pwm, "pwm_init() must be called first", return ESP_ERR_INVALID_STATE);
+    PWM_CHECK(s_pwm->registered_channel_mask & BIT(channel), "Channel not registered", return ESP_ERR_INVALID_STATE);
+    PWM_CHECK(value, "value is null", return ESP_ERR_INVALID_ARG);
+
+    // Stopping a channel that is not fading only reads its duty back
+    err = ledc_fade_stop(s_pwm->ledc_config.speed_mode, channel);
+    PWM_CHECK(err == ESP_OK, "fade stop fail", return err);
+    *value = ledc_get_duty(s_pwm->ledc_config.speed_mode, channel);
+
+    return ESP_OK;
+}
+
+esp_err_t pwm_set_fade_end_cb(pwm_fade_end_cb_t cb, void *priv)
+{
+    PWM_CHECK(s_pwm, "pwm_init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    // The interrupt may be running on the other core, the callback is cleared before its argument
+    s_pwm->fade_end_cb = NULL;
+    s_pwm->fade_end_priv = priv;
+    s_pwm->fade_end_cb = cb;
+
+    return ESP_OK;
+}
+#endif
+
 esp_err_t pwm_set_sleep(bool is_enable)
 {
 #if CONFIG_PM_ENABLE
-    if (is_enable) {
-        power_control_enable_sleep();
-    } else {
-        power_control_disable_sleep();
-    }
+    PWM_CHECK(s_pwm, "pwm_init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    portENTER_CRITICAL(&s_power_lock);
+    s_sleep_requested = is_enable;
+    portEXIT_CRITICAL(&s_power_lock);
+    power_control_update();
     return ESP_OK;
 #else
     ESP_LOGE(TAG, "You need to enable power management via menuconfig");
     return ESP_FAIL;
 #endif
 }
+
+esp_err_t pwm_set_fade_active(bool is_active)
+{
+#if CONFIG_PM_ENABLE
+    PWM_CHECK(s_pwm, "pwm_init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    portENTER_CRITICAL(&s_power_lock);
+    s_fade_active = is_active;
+    portEXIT_CRITICAL(&s_power_lock);
+    power_control_update();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t pwm_get_power_stats(pwm_power_stats_t *stats)
+{
+#if CONFIG_PM_ENABLE
+    PWM_CHECK(s_pwm, "pwm_init() must be called first", return ESP_ERR_INVALID_STATE);
+    PWM_CHECK(stats, "stats is null", return ESP_ERR_INVALID_ARG);
+
+    // The time of the current state is counted up to now
+    portENTER_CRITICAL(&s_power_lock);
+    power_control_time_update(esp_timer_get_time());
+    *stats = s_power_stats;
+    stats->steady_light_sleep = !(s_steady_lock_mask & PWM_LOCK_SLEEP);
+    portEXIT_CRITICAL(&s_power_lock);
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "You need to enable power management via menuconfig");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t pwm_reset_power_stats(void)
+{
+#if CONFIG_PM_ENABLE
+    PWM_CHECK(s_pwm, "pwm_init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    portENTER_CRITICAL(&s_power_lock);
+    memset(&s_power_stats, 0, sizeof(s_power_stats));
+    s_power_state_time = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_power_lock);
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "You need to enable power management via menuconfig");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
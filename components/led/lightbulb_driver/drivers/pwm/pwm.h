@@ -118,6 +118,35 @@ esp_err_t pwm_set_shutdown(void);
  */
 esp_err_t pwm_set_hw_fade(pwm_channel_t channel, uint16_t value, int fade_ms);
 
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+/**
+ * @brief Fade end callback, called from the LEDC interrupt
+ *
+ * @return Whether a higher priority task was woken up
+ */
+typedef bool (*pwm_fade_end_cb_t)(pwm_channel_t channel, void *priv);
+
+/**
+ * @brief Stop the hardware fade of a channel
+ * @note The duty is kept where the fade was stopped, the fade end callback is not called.
+ *
+ * @param channel Abstract channel
+ * @param value Output value at which the channel stopped
+ * @return esp_err_t
+ */
+esp_err_t pwm_stop_hw_fade(pwm_channel_t channel, uint16_t *value);
+
+/**
+ * @brief Set the callback called when a hardware fade ends
+ * @note The callback runs in the LEDC interrupt, it must be placed in IRAM.
+ *
+ * @param cb Callback, NULL to remove it
+ * @param priv Argument passed to the callback
+ * @return esp_err_t
+ */
+esp_err_t pwm_set_fade_end_cb(pwm_fade_end_cb_t cb, void *priv);
+#endif
+
 /**
  * @brief Deinitialize pwm and release resources
  *
@@ -132,3 +161,40 @@ esp_err_t pwm_deinit(void);
  * @return esp_err_t
  */
 esp_err_t pwm_set_sleep(bool is_enable);
+
+/**
+ * @brief Power lock statistics
+ * @note Multiplied by the current the board draws in each state, the times give an estimate of the average current.
+ *
+ */
+typedef struct {
+    uint64_t active_us;             /* Time with a fade running, all power locks held */
+    uint64_t steady_us;             /* Time with a static output, only the locks needed by the LEDC clock held */
+    uint64_t sleep_us;              /* Time with the output put to sleep by pwm_set_sleep(), no power lock held */
+    uint32_t active_count;          /* Fades that took the power locks, each one keeps the chip awake until it ends */
+    bool steady_light_sleep;        /* A static output allows light sleep, see CONFIG_PWM_STEADY_LIGHT_SLEEP */
+} pwm_power_stats_t;
+
+/**
+ * @brief Tell the driver whether a fade is running
+ * @note With power management enabled, the CPU and APB frequency locks are only held while a fade runs.
+ *
+ * @param is_active
+ * @return esp_err_t
+ */
+esp_err_t pwm_set_fade_active(bool is_active);
+
+/**
+ * @brief Get the power lock statistics, counted since pwm_init() or the last reset
+ *
+ * @param stats Output statistics
+ * @return esp_err_t ESP_ERR_NOT_SUPPORTED if power management is disabled
+ */
+esp_err_t pwm_get_power_stats(pwm_power_stats_t *stats);
+
+/**
+ * @brief Reset the power lock statistics
+ *
+ * @return esp_err_t
+ */
+esp_err_t pwm_reset_power_stats(void);
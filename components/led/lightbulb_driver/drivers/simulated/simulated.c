@@ -0,0 +1,175 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "simulated.h"
+
+static const char *TAG = "driver_simulated";
+
+#define SIMULATED_CHECK(a, str, action, ...)                                \
+    if (unlikely(!(a))) {                                                   \
+        ESP_LOGE(TAG, str, ##__VA_ARGS__);                                  \
+        action;                                                             \
+    }
+
+#if CONFIG_ENABLE_DRIVER_DEBUG_LOG_OUTPUT
+#define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
+#endif
+
+#define SIMULATED_DEFAULT_RECORD_NUM    (1024)
+
+typedef struct {
+    simulated_record_t *records;
+    uint32_t max_record_num;
+    uint32_t record_num;
+    uint32_t total_num;
+    uint8_t registered_mask;
+    uint16_t value[SIMULATED_CHANNEL_MAX];
+} simulated_handle_t;
+
+static simulated_handle_t *s_simulated = NULL;
+
+static esp_err_t record_write(uint8_t channel_mask)
+{
+    SIMULATED_CHECK((channel_mask & s_simulated->registered_mask) == channel_mask, "channel not regist, mask:%x", return ESP_ERR_INVALID_STATE, channel_mask);
+
+    if (s_simulated->record_num < s_simulated->max_record_num) {
+        simulated_record_t *record = &s_simulated->records[s_simulated->record_num++];
+        record->time_us = esp_timer_get_time();
+        record->channel_mask = channel_mask;
+        memcpy(record->value, s_simulated->value, sizeof(record->value));
+    }
+    s_simulated->total_num++;
+
+    ESP_LOGD(TAG, "mask:%x [%d %d %d %d %d]", channel_mask, s_simulated->value[0], s_simulated->value[1], s_simulated->value[2], s_simulated->value[3], s_simulated->value[4]);
+    return ESP_OK;
+}
+
+esp_err_t simulated_regist_channel(simulated_channel_t channel, int pin)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+    SIMULATED_CHECK(channel < SIMULATED_CHANNEL_MAX, "check channel fail", return ESP_ERR_INVALID_ARG);
+
+    s_simulated->registered_mask |= BIT(channel);
+    return ESP_OK;
+}
+
+esp_err_t simulated_set_channel(simulated_channel_t channel, uint16_t value)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+    SIMULATED_CHECK(channel < SIMULATED_CHANNEL_MAX, "check channel fail", return ESP_ERR_INVALID_ARG);
+
+    s_simulated->value[channel] = value;
+    return record_write(BIT(channel));
+}
+
+esp_err_t simulated_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+
+    s_simulated->value[SIMULATED_CHANNEL_R] = value_r;
+    s_simulated->value[SIMULATED_CHANNEL_G] = value_g;
+    s_simulated->value[SIMULATED_CHANNEL_B] = value_b;
+    return record_write(BIT(SIMULATED_CHANNEL_R) | BIT(SIMULATED_CHANNEL_G) | BIT(SIMULATED_CHANNEL_B));
+}
+
+esp_err_t simulated_set_wy_channel(uint16_t value_w, uint16_t value_y)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+
+    s_simulated->value[SIMULATED_CHANNEL_W] = value_w;
+    s_simulated->value[SIMULATED_CHANNEL_Y] = value_y;
+    return record_write(BIT(SIMULATED_CHANNEL_W) | BIT(SIMULATED_CHANNEL_Y));
+}
+
+esp_err_t simulated_set_rgbwy_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b, uint16_t value_w, uint16_t value_y)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+
+    s_simulated->value[SIMULATED_CHANNEL_R] = value_r;
+    s_simulated->value[SIMULATED_CHANNEL_G] = value_g;
+    s_simulated->value[SIMULATED_CHANNEL_B] = value_b;
+    s_simulated->value[SIMULATED_CHANNEL_W] = value_w;
+    s_simulated->value[SIMULATED_CHANNEL_Y] = value_y;
+    return record_write(BIT(SIMULATED_CHANNEL_MAX) - 1);
+}
+
+esp_err_t simulated_set_shutdown(void)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+
+    memset(s_simulated->value, 0, sizeof(s_simulated->value));
+    return record_write(s_simulated->registered_mask);
+}
+
+esp_err_t simulated_get_records(const simulated_record_t **records, uint32_t *record_num, uint32_t *total_num)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+    SIMULATED_CHECK(records && record_num, "records is null", return ESP_ERR_INVALID_ARG);
+
+    *records = s_simulated->records;
+    *record_num = s_simulated->record_num;
+    if (total_num) {
+        *total_num = s_simulated->total_num;
+    }
+    return ESP_OK;
+}
+
+esp_err_t simulated_clear_records(void)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+
+    s_simulated->record_num = 0;
+    s_simulated->total_num = 0;
+    return ESP_OK;
+}
+
+esp_err_t simulated_init(driver_simulated_t *config)
+{
+    esp_err_t err = ESP_OK;
+
+    SIMULATED_CHECK(config, "config is null", return ESP_ERR_INVALID_ARG);
+    SIMULATED_CHECK(!s_simulated, "already init done", return ESP_ERR_INVALID_ARG);
+
+    s_simulated = calloc(1, sizeof(simulated_handle_t));
+    SIMULATED_CHECK(s_simulated, "alloc fail", return ESP_ERR_NO_MEM);
+
+    s_simulated->max_record_num = config->max_record_num ? config->max_record_num : SIMULATED_DEFAULT_RECORD_NUM;
+    s_simulated->records = calloc(s_simulated->max_record_num, sizeof(simulated_record_t));
+    SIMULATED_CHECK(s_simulated->records, "record buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+
+    return err;
+EXIT:
+
+    if (s_simulated) {
+        free(s_simulated);
+        s_simulated = NULL;
+    }
+    return err;
+}
+
+esp_err_t simulated_deinit(void)
+{
+    SIMULATED_CHECK(s_simulated, "not init", return ESP_ERR_INVALID_STATE);
+
+    free(s_simulated->records);
+    free(s_simulated);
+    s_simulated = NULL;
+    return ESP_OK;
+}
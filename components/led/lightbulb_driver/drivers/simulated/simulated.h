@@ -0,0 +1,149 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Output configuration
+ *
+ */
+typedef struct {
+    uint32_t max_record_num; // Writes kept in memory, later writes are only counted
+} driver_simulated_t;
+
+/**
+ * @brief Simulated channel abstract definition
+ *
+ */
+typedef enum {
+    SIMULATED_CHANNEL_R = 0,
+    SIMULATED_CHANNEL_G,
+    SIMULATED_CHANNEL_B,
+    SIMULATED_CHANNEL_W,
+    SIMULATED_CHANNEL_Y,
+    SIMULATED_CHANNEL_MAX,
+} simulated_channel_t;
+
+/**
+ * @brief One write received by the simulated driver
+ *
+ */
+typedef struct {
+    int64_t time_us; // esp_timer time of the write
+    uint8_t channel_mask; // Channels written, BIT(simulated_channel_t)
+    uint16_t value[SIMULATED_CHANNEL_MAX]; // Output of all channels after the write
+} simulated_record_t;
+
+/**
+ * @brief Initialize the simulated output
+ *
+ * @note Nothing is driven, every write is timestamped and kept in memory so that the fade engine can be measured without hardware.
+ *
+ * @param config Driver configuration
+ * @return esp_err_t
+ */
+esp_err_t simulated_init(driver_simulated_t *config);
+
+/**
+ * @brief Deinitialize the simulated output and release the records
+ *
+ * @return esp_err_t
+ */
+esp_err_t simulated_deinit(void);
+
+/**
+ * @brief Register a channel, the output pin is ignored
+ *
+ * @param channel Channel to be registered
+ * @param pin Output pin, unused
+ * @return esp_err_t
+ */
+esp_err_t simulated_regist_channel(simulated_channel_t channel, int pin);
+
+/**
+ * @brief Set the output of one channel
+ *
+ * @param channel Channel to be set
+ * @param value Output value
+ * @return esp_err_t
+ */
+esp_err_t simulated_set_channel(simulated_channel_t channel, uint16_t value);
+
+/**
+ * @brief Set the output of the color channels in one write
+ *
+ * @param value_r Output red value
+ * @param value_g Output green value
+ * @param value_b Output blue value
+ * @return esp_err_t
+ */
+esp_err_t simulated_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b);
+
+/**
+ * @brief Set the output of the white channels in one write
+ *
+ * @param value_w Output cold white value
+ * @param value_y Output warm yellow value
+ * @return esp_err_t
+ */
+esp_err_t simulated_set_wy_channel(uint16_t value_w, uint16_t value_y);
+
+/**
+ * @brief Set the output of all channels in one write
+ *
+ * @param value_r Output red value
+ * @param value_g Output green value
+ * @param value_b Output blue value
+ * @param value_w Output cold white value
+ * @param value_y Output warm yellow value
+ * @return esp_err_t
+ */
+esp_err_t simulated_set_rgbwy_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b, uint16_t value_w, uint16_t value_y);
+
+/**
+ * @brief Set all channels to 0
+ *
+ * @return esp_err_t
+ */
+esp_err_t simulated_set_shutdown(void);
+
+/**
+ * @brief Get the writes recorded since init or the last simulated_clear_records()
+ *
+ * @note The records are appended by the fade tick task, read them only once the fade is finished.
+ *
+ * @param records Output pointer to the first record
+ * @param record_num Output number of records kept in memory
+ * @param total_num Output number of writes, including the ones that did not fit in memory, can be NULL
+ * @return esp_err_t
+ */
+esp_err_t simulated_get_records(const simulated_record_t **records, uint32_t *record_num, uint32_t *total_num);
+
+/**
+ * @brief Drop all records, the output values are kept
+ *
+ * @return esp_err_t
+ */
+esp_err_t simulated_clear_records(void);
+
+#ifdef __cplusplus
+}
+#endif
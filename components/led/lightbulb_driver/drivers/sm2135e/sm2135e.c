@@ -18,6 +18,7 @@
 #include <esp_log.h>
 
 #include "iic.h"
+#include "iic_regmap_chips.h"
 #include "sm2135e.h"
 
 static const char *TAG = "driver_sm2135e";
@@ -75,19 +76,30 @@ typedef struct {
     sm2135e_wy_current_t wy_current;
     uint8_t mapping_addr[SM2135E_MAX_PIN];
     bool running_wy_mode;
+    iic_device_t *iic;
 } sm2135e_handle_t;
 
 static sm2135e_handle_t *s_sm2135e = NULL;
 
-static uint8_t get_mapping_addr(sm2135e_channel_t channel)
+static const iic_regmap_t *const s_regmap = &iic_regmap_sm2135e;
+
+static uint8_t get_max_current(void)
 {
-    return s_sm2135e->mapping_addr[channel];
+    return iic_regmap_pack_current(s_regmap, s_sm2135e->rgb_current, s_sm2135e->wy_current);
 }
 
-static uint8_t get_max_current(void)
+/**
+ * @brief Write the grayscale of the outputs [first, first + num) from a full image
+ *
+ */
+static esp_err_t write_grayscale(const uint8_t *image, uint8_t first, uint8_t num)
 {
-    uint8_t value = (s_sm2135e->rgb_current << 4) | (s_sm2135e->wy_current);
-    return value;
+    uint8_t addr = 0;
+    uint8_t data[SM2135E_MAX_PIN] = { 0 };
+    uint8_t len = iic_regmap_encode(s_regmap, image, first, num, NULL, &addr, data);
+
+    ESP_LOGD(TAG, "addr:%x size:%d", addr, len);
+    return iic_driver_write(s_sm2135e->iic, addr, data, len);
 }
 
 static esp_err_t set_mode_and_current(bool set_wy_mode, sm2135e_rgb_current_t rgb, sm2135e_wy_current_t wy)
@@ -104,10 +116,10 @@ static esp_err_t set_mode_and_current(bool set_wy_mode, sm2135e_rgb_current_t rg
         s_sm2135e->running_wy_mode = false;
     }
 
-    _value[0] = (rgb << 4) | (wy);
+    _value[0] = iic_regmap_pack_current(s_regmap, rgb, wy);
     _value[1] = mode;
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return iic_driver_write(s_sm2135e->iic, addr, _value, sizeof(_value));
 }
 
 esp_err_t sm2135e_set_max_current(sm2135e_rgb_current_t rgb, sm2135e_wy_current_t wy)
@@ -116,8 +128,8 @@ esp_err_t sm2135e_set_max_current(sm2135e_rgb_current_t rgb, sm2135e_wy_current_
 
     uint8_t value = 0;
     uint8_t addr = BASE_ADDR | BIT_MAX_CURRENT;
-    value = (rgb << 4) | (wy);
-    return iic_driver_write(addr, &value, 1);
+    value = iic_regmap_pack_current(s_regmap, rgb, wy);
+    return iic_driver_write(s_sm2135e->iic, addr, &value, 1);
 }
 
 esp_err_t sm2135e_set_output_mode(bool set_wy_mode)
@@ -135,15 +147,15 @@ esp_err_t sm2135e_set_output_mode(bool set_wy_mode)
     ESP_LOGD(TAG, "sm2135e_set_output_mode:%d", set_wy_mode);
     _value[0] = mode;
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return iic_driver_write(s_sm2135e->iic, addr, _value, sizeof(_value));
 }
 
 esp_err_t sm2135e_set_shutdown(void)
 {
     SM2135E_CHECK(s_sm2135e, "not init", return ESP_ERR_INVALID_STATE);
-    uint8_t _value[5] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_R_OUT1;
-    return iic_driver_write(addr, _value, sizeof(_value));
+    uint8_t _value[SM2135E_MAX_PIN] = { 0 };
+
+    return write_grayscale(_value, 0, SM2135E_MAX_PIN);
 }
 
 esp_err_t sm2135e_regist_channel(sm2135e_channel_t channel, sm2135e_out_pin_t pin)
@@ -161,17 +173,18 @@ esp_err_t sm2135e_set_channel(sm2135e_channel_t channel, uint8_t value)
     SM2135E_CHECK(s_sm2135e, "not init", return ESP_ERR_INVALID_STATE);
     SM2135E_CHECK(s_sm2135e->mapping_addr[channel] != INVALID_ADDR, "channel:%d not regist", return ESP_ERR_INVALID_STATE, channel);
 
-    uint8_t _value = value;
-    uint8_t addr = BASE_ADDR;
+    uint8_t _value[SM2135E_MAX_PIN] = { 0 };
+    uint8_t pin = s_sm2135e->mapping_addr[channel];
     esp_err_t err = ESP_OK;
 
+    iic_regmap_set_grayscale(s_regmap, _value, pin, value);
+
     if (channel >= SM2135E_CHANNEL_W) {
         if (!s_sm2135e->running_wy_mode) {
             ESP_LOGD(TAG, "switch channel");
             err |= set_mode_and_current(true, s_sm2135e->rgb_current, s_sm2135e->wy_current);
         }
-        addr |= (BIT_R_OUT1 + get_mapping_addr(channel));
-        err |= iic_driver_write(addr, &_value, 1);
+        err |= write_grayscale(_value, pin, 1);
         return err;
     }
 
@@ -179,10 +192,9 @@ esp_err_t sm2135e_set_channel(sm2135e_channel_t channel, uint8_t value)
         ESP_LOGD(TAG, "switch channel");
         err |= set_mode_and_current(false, s_sm2135e->rgb_current, s_sm2135e->wy_current);
     }
-    addr |= (BIT_R_OUT1 + get_mapping_addr(channel));
-    ESP_LOGD(TAG, "addr:%x value:%x", addr, _value);
+    ESP_LOGD(TAG, "pin:%d value:%x", pin, value);
 
-    return iic_driver_write(addr, &_value, 1);
+    return err | write_grayscale(_value, pin, 1);
 }
 
 esp_err_t sm2135e_set_rgb_channel(uint8_t value_r, uint8_t value_g, uint8_t value_b)
@@ -190,19 +202,20 @@ esp_err_t sm2135e_set_rgb_channel(uint8_t value_r, uint8_t value_g, uint8_t valu
     SM2135E_CHECK(s_sm2135e, "not init", return ESP_ERR_INVALID_STATE);
     SM2135E_CHECK(s_sm2135e->mapping_addr[0] != INVALID_ADDR || s_sm2135e->mapping_addr[1] != INVALID_ADDR || s_sm2135e->mapping_addr[2] != INVALID_ADDR, "color channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t _value[5] = { 0 };
+    uint8_t _value[2 + SM2135E_MAX_PIN] = { 0 };
     uint8_t addr = BASE_ADDR | BIT_MAX_CURRENT;
     uint8_t mode = BIT_RGB_MODE;
     s_sm2135e->running_wy_mode = false;
 
     _value[0] = get_max_current();
     _value[1] = mode;
-    _value[s_sm2135e->mapping_addr[SM2135E_CHANNEL_R] + 2] = value_r;
-    _value[s_sm2135e->mapping_addr[SM2135E_CHANNEL_G] + 2] = value_g;
-    _value[s_sm2135e->mapping_addr[SM2135E_CHANNEL_B] + 2] = value_b;
+    // OUT1-OUT3 follow the current and mode bytes
+    iic_regmap_set_grayscale(s_regmap, &_value[2], s_sm2135e->mapping_addr[SM2135E_CHANNEL_R], value_r);
+    iic_regmap_set_grayscale(s_regmap, &_value[2], s_sm2135e->mapping_addr[SM2135E_CHANNEL_G], value_g);
+    iic_regmap_set_grayscale(s_regmap, &_value[2], s_sm2135e->mapping_addr[SM2135E_CHANNEL_B], value_b);
 
     ESP_LOGD(TAG, "addr:%x current:%x mode:%x [out1:[%x] out2:[%x] out3:[%x]]", addr, _value[0], _value[1], _value[2], _value[3], _value[4]);
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return iic_driver_write(s_sm2135e->iic, addr, _value, 5);
 }
 
 esp_err_t sm2135e_set_wy_channel(uint8_t value_w, uint8_t value_y)
@@ -210,19 +223,18 @@ esp_err_t sm2135e_set_wy_channel(uint8_t value_w, uint8_t value_y)
     SM2135E_CHECK(s_sm2135e, "not init", return ESP_ERR_INVALID_STATE);
     SM2135E_CHECK(s_sm2135e->mapping_addr[3] != INVALID_ADDR || s_sm2135e->mapping_addr[4] != INVALID_ADDR, "white channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t _value[2] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_W_OUT4;
+    uint8_t _value[SM2135E_MAX_PIN] = { 0 };
 
-    _value[s_sm2135e->mapping_addr[SM2135E_CHANNEL_W] - 3] = value_w;
-    _value[s_sm2135e->mapping_addr[SM2135E_CHANNEL_Y] - 3] = value_y;
+    iic_regmap_set_grayscale(s_regmap, _value, s_sm2135e->mapping_addr[SM2135E_CHANNEL_W], value_w);
+    iic_regmap_set_grayscale(s_regmap, _value, s_sm2135e->mapping_addr[SM2135E_CHANNEL_Y], value_y);
 
     if (!s_sm2135e->running_wy_mode) {
         ESP_LOGD(TAG, "switch channel");
         set_mode_and_current(true, s_sm2135e->rgb_current, s_sm2135e->wy_current);
     }
 
-    ESP_LOGD(TAG, "addr:%x out1:[%x] out2:[%x]", addr, _value[0], _value[1]);
-    return iic_driver_write(addr, _value, sizeof(_value));
+    ESP_LOGD(TAG, "out4:[%x] out5:[%x]", _value[3], _value[4]);
+    return write_grayscale(_value, 3, 2);
 }
 
 esp_err_t sm2135e_init(driver_sm2135e_t *config)
@@ -244,17 +256,20 @@ esp_err_t sm2135e_init(driver_sm2135e_t *config)
         ESP_LOGW(TAG, "The frequency is too high, adjust it to 400khz");
     }
 
-    err |= iic_driver_init(I2C_NUM_0, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ);
+    err |= iic_driver_init(config->iic_port, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ, &s_sm2135e->iic);
     SM2135E_CHECK(err == ESP_OK, "i2c master init fail", goto EXIT);
 
     if (config->enable_iic_queue) {
-        err |= iic_driver_send_task_create();
+        err |= iic_driver_send_task_create(s_sm2135e->iic);
         SM2135E_CHECK(err == ESP_OK, "task create fail", goto EXIT);
     }
 
     return err;
 EXIT:
     if (s_sm2135e) {
+        if (s_sm2135e->iic) {
+            iic_driver_deinit(s_sm2135e->iic);
+        }
         free(s_sm2135e);
         s_sm2135e = NULL;
     }
@@ -266,8 +281,7 @@ esp_err_t sm2135e_deinit(void)
     SM2135E_CHECK(s_sm2135e, "not init", return ESP_ERR_INVALID_STATE);
 
     sm2135e_set_shutdown();
-    iic_driver_deinit();
-    iic_driver_task_destroy();
+    iic_driver_deinit(s_sm2135e->iic);
     free(s_sm2135e);
     s_sm2135e = NULL;
     return ESP_OK;
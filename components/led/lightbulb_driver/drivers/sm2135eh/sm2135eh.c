@@ -19,6 +19,7 @@
 
 #include "sm2135eh.h"
 #include "iic.h"
+#include "iic_regmap_chips.h"
 
 static const char *TAG = "driver_sm2135eh";
 
@@ -75,24 +76,31 @@ typedef struct {
     sm2135eh_wy_current_t wy_current;
     uint8_t mapping_addr[SM2135EH_MAX_PIN];
     bool init_done;
+    iic_device_t *iic;
+    iic_shadow_t grayscale;
 } sm2135eh_handle_t;
 
 static sm2135eh_handle_t *s_sm2135eh = NULL;
 
-static uint8_t get_mapping_addr(sm2135eh_channel_t channel)
+static const iic_regmap_t *const s_regmap = &iic_regmap_sm2135eh;
+
+static void set_grayscale(uint8_t *value, sm2135eh_channel_t channel, uint8_t data)
 {
-    uint8_t addr[] = { BIT_R_OUT1, BIT_G_OUT2, BIT_B_OUT3, BIT_W_OUT4, BIT_Y_OUT5 };
-    uint8_t result = addr[s_sm2135eh->mapping_addr[channel]];
+    iic_regmap_set_grayscale(s_regmap, value, s_sm2135eh->mapping_addr[channel], data);
+}
 
-    return result;
+static esp_err_t write_grayscale(uint8_t *value)
+{
+    return iic_driver_write_grayscale(s_sm2135eh->iic, &s_sm2135eh->grayscale, s_regmap, value, NULL);
 }
 
 static esp_err_t set_mode_and_current(bool enable_standby_mode, sm2135eh_rgb_current_t rgb, sm2135eh_wy_current_t wy)
 {
     uint8_t value[2] = { 0 };
     uint8_t addr = BASE_ADDR | BIT_MAX_CURRENT;
-    value[0] = (rgb << 4) | (wy);
+    value[0] = iic_regmap_pack_current(s_regmap, rgb, wy);
     value[1] = BIT_DISABLE_STANDBY;
+    iic_driver_shadow_invalidate(&s_sm2135eh->grayscale);
     if (enable_standby_mode) {
         value[1] |= BIT_ENABLE_STANDBY;
         s_sm2135eh->init_done = false;
@@ -100,7 +108,7 @@ static esp_err_t set_mode_and_current(bool enable_standby_mode, sm2135eh_rgb_cur
         s_sm2135eh->init_done = true;
     }
 
-    return iic_driver_write(addr, value, sizeof(value));
+    return iic_driver_write(s_sm2135eh->iic, addr, value, sizeof(value));
 }
 
 esp_err_t sm2135eh_set_max_current(sm2135eh_rgb_current_t rgb, sm2135eh_wy_current_t wy)
@@ -109,9 +117,9 @@ esp_err_t sm2135eh_set_max_current(sm2135eh_rgb_current_t rgb, sm2135eh_wy_curre
 
     uint8_t value = 0;
     uint8_t addr = BASE_ADDR | BIT_MAX_CURRENT;
-    value = (rgb << 4) | (wy);
+    value = iic_regmap_pack_current(s_regmap, rgb, wy);
 
-    return iic_driver_write(addr, &value, 1);
+    return iic_driver_write(s_sm2135eh->iic, addr, &value, 1);
 }
 
 esp_err_t sm2135eh_set_standby_mode(bool enable_standby)
@@ -120,6 +128,7 @@ esp_err_t sm2135eh_set_standby_mode(bool enable_standby)
 
     uint8_t addr = BASE_ADDR | BIT_STANDBY_MODE_SELECT;
     uint8_t value = BIT_DISABLE_STANDBY;
+    iic_driver_shadow_invalidate(&s_sm2135eh->grayscale);
     if (enable_standby) {
         value |= BIT_ENABLE_STANDBY;
         s_sm2135eh->init_done = false;
@@ -128,7 +137,7 @@ esp_err_t sm2135eh_set_standby_mode(bool enable_standby)
     }
     ESP_LOGD(TAG, "sm2135eh_set_standby_mode:%d", enable_standby);
 
-    return iic_driver_write(addr, &value, 1);
+    return iic_driver_write(s_sm2135eh->iic, addr, &value, 1);
 }
 
 esp_err_t sm2135eh_set_shutdown(void)
@@ -136,8 +145,9 @@ esp_err_t sm2135eh_set_shutdown(void)
     SM2135EH_CHECK(s_sm2135eh, "not init", return ESP_ERR_INVALID_STATE);
 
     uint8_t _value[5] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_R_OUT1;
-    iic_driver_write(addr, _value, sizeof(_value));
+
+    iic_driver_shadow_invalidate(&s_sm2135eh->grayscale);
+    write_grayscale(_value);
 
     return sm2135eh_set_standby_mode(true);
 }
@@ -160,10 +170,12 @@ esp_err_t sm2135eh_set_channel(sm2135eh_channel_t channel, uint8_t value)
     if (!s_sm2135eh->init_done) {
         set_mode_and_current(false, s_sm2135eh->rgb_current, s_sm2135eh->wy_current);
     }
-    uint8_t _value = value;
-    uint8_t addr = BASE_ADDR | get_mapping_addr(channel);
+    uint8_t _value[5] = { 0 };
+
+    memcpy(_value, s_sm2135eh->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, channel, value);
 
-    return iic_driver_write(addr, &_value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2135eh_set_rgb_channel(uint8_t value_r, uint8_t value_g, uint8_t value_b)
@@ -174,15 +186,15 @@ esp_err_t sm2135eh_set_rgb_channel(uint8_t value_r, uint8_t value_g, uint8_t val
     if (!s_sm2135eh->init_done) {
         set_mode_and_current(false, s_sm2135eh->rgb_current, s_sm2135eh->wy_current);
     }
-    uint8_t _value[3] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_R_OUT1;
+    uint8_t _value[5] = { 0 };
 
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_R]] = value_r;
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_G]] = value_g;
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_B]] = value_b;
+    memcpy(_value, s_sm2135eh->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, SM2135EH_CHANNEL_R, value_r);
+    set_grayscale(_value, SM2135EH_CHANNEL_G, value_g);
+    set_grayscale(_value, SM2135EH_CHANNEL_B, value_b);
 
-    ESP_LOGD(TAG, "addr:%x [out1:[%x] out2:[%x] out3:[%x]]", addr, _value[0], _value[1], _value[2]);
-    return iic_driver_write(addr, _value, sizeof(_value));
+    ESP_LOGD(TAG, "[out1:[%x] out2:[%x] out3:[%x]]", _value[0], _value[1], _value[2]);
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2135eh_set_wy_channel(uint8_t value_w, uint8_t value_y)
@@ -193,14 +205,14 @@ esp_err_t sm2135eh_set_wy_channel(uint8_t value_w, uint8_t value_y)
     if (!s_sm2135eh->init_done) {
         set_mode_and_current(false, s_sm2135eh->rgb_current, s_sm2135eh->wy_current);
     }
-    uint8_t _value[2] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_W_OUT4;
+    uint8_t _value[5] = { 0 };
 
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_W] - 3] = value_w;
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_Y] - 3] = value_y;
+    memcpy(_value, s_sm2135eh->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, SM2135EH_CHANNEL_W, value_w);
+    set_grayscale(_value, SM2135EH_CHANNEL_Y, value_y);
 
-    ESP_LOGD(TAG, "addr:%x [out1:[%x] out2:[%x]]", addr, _value[0], _value[1]);
-    return iic_driver_write(addr, _value, sizeof(_value));
+    ESP_LOGD(TAG, "[out4:[%x] out5:[%x]]", _value[3], _value[4]);
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2135eh_set_rgbwy_channel(uint8_t value_r, uint8_t value_g, uint8_t value_b, uint8_t value_w, uint8_t value_y)
@@ -215,16 +227,15 @@ esp_err_t sm2135eh_set_rgbwy_channel(uint8_t value_r, uint8_t value_g, uint8_t v
         s_sm2135eh->init_done = true;
     }
     uint8_t _value[5] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_R_OUT1;
 
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_R]] = value_r;
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_G]] = value_g;
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_B]] = value_b;
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_W]] = value_w;
-    _value[s_sm2135eh->mapping_addr[SM2135EH_CHANNEL_Y]] = value_y;
+    set_grayscale(_value, SM2135EH_CHANNEL_R, value_r);
+    set_grayscale(_value, SM2135EH_CHANNEL_G, value_g);
+    set_grayscale(_value, SM2135EH_CHANNEL_B, value_b);
+    set_grayscale(_value, SM2135EH_CHANNEL_W, value_w);
+    set_grayscale(_value, SM2135EH_CHANNEL_Y, value_y);
 
-    ESP_LOGD(TAG, "addr:%x [out1:[%x] out2:[%x] out3:[%x] out4:[%x] out5:[%x]]", addr, _value[0], _value[1], _value[2], _value[3], _value[4]);
-    return iic_driver_write(addr, _value, sizeof(_value));
+    ESP_LOGD(TAG, "[out1:[%x] out2:[%x] out3:[%x] out4:[%x] out5:[%x]]", _value[0], _value[1], _value[2], _value[3], _value[4]);
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2135eh_init(driver_sm2135eh_t *config)
@@ -237,6 +248,7 @@ esp_err_t sm2135eh_init(driver_sm2135eh_t *config)
     s_sm2135eh = calloc(1, sizeof(sm2135eh_handle_t));
     SM2135EH_CHECK(s_sm2135eh, "alloc fail", return ESP_ERR_NO_MEM);
     memset(s_sm2135eh->mapping_addr, INVALID_ADDR, SM2135EH_MAX_PIN);
+    iic_driver_shadow_init(&s_sm2135eh->grayscale, iic_regmap_image_size(s_regmap), s_regmap->channel_bytes);
 
     s_sm2135eh->rgb_current = config->rgb_current;
     s_sm2135eh->wy_current = config->wy_current;
@@ -246,11 +258,11 @@ esp_err_t sm2135eh_init(driver_sm2135eh_t *config)
         ESP_LOGW(TAG, "The frequency is too high, adjust it to 400khz");
     }
 
-    err |= iic_driver_init(I2C_NUM_0, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ);
+    err |= iic_driver_init(config->iic_port, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ, &s_sm2135eh->iic);
     SM2135EH_CHECK(err == ESP_OK, "i2c master init fail", goto EXIT);
 
     if (config->enable_iic_queue) {
-        err |= iic_driver_send_task_create();
+        err |= iic_driver_send_task_create(s_sm2135eh->iic);
         SM2135EH_CHECK(err == ESP_OK, "task create fail", goto EXIT);
     }
 
@@ -258,6 +270,9 @@ esp_err_t sm2135eh_init(driver_sm2135eh_t *config)
 EXIT:
 
     if (s_sm2135eh) {
+        if (s_sm2135eh->iic) {
+            iic_driver_deinit(s_sm2135eh->iic);
+        }
         free(s_sm2135eh);
         s_sm2135eh = NULL;
     }
@@ -269,8 +284,7 @@ esp_err_t sm2135eh_deinit(void)
     SM2135EH_CHECK(s_sm2135eh, "not init", return ESP_ERR_INVALID_STATE);
 
     sm2135eh_set_shutdown();
-    iic_driver_deinit();
-    iic_driver_task_destroy();
+    iic_driver_deinit(s_sm2135eh->iic);
     free(s_sm2135eh);
     s_sm2135eh = NULL;
     return ESP_OK;
@@ -18,6 +18,7 @@
 #include <esp_log.h>
 
 #include "iic.h"
+#include "iic_regmap_chips.h"
 #include "sm2x35egh.h"
 
 /* Driver available for sm2235egh sm2335egh */
@@ -76,17 +77,13 @@ typedef struct {
     sm2x35egh_cw_current_t cw_current;
     uint8_t mapping_addr[SM2x35EGH_MAX_PIN];
     bool init_done;
+    iic_device_t *iic;
+    iic_shadow_t grayscale;
 } sm2x35eh_handle_t;
 
 static sm2x35eh_handle_t *s_sm2x35egh = NULL;
 
-static uint8_t get_mapping_addr(sm2x35egh_channel_t channel)
-{
-    uint8_t addr[] = { BIT_R_OUT1, BIT_G_OUT2, BIT_B_OUT3, BIT_C_OUT4, BIT_W_OUT5 };
-    uint8_t result = addr[s_sm2x35egh->mapping_addr[channel]];
-
-    return result;
-}
+static const iic_regmap_t *const s_regmap = &iic_regmap_sm2x35egh;
 
 static uint8_t get_max_current(void)
 {
@@ -94,6 +91,18 @@ static uint8_t get_max_current(void)
     return value;
 }
 
+static void set_grayscale(uint8_t *value, sm2x35egh_channel_t channel, uint16_t data)
+{
+    iic_regmap_set_grayscale(s_regmap, value, s_sm2x35egh->mapping_addr[channel], data);
+}
+
+static esp_err_t write_grayscale(uint8_t *value)
+{
+    uint8_t current = get_max_current();
+
+    return iic_driver_write_grayscale(s_sm2x35egh->iic, &s_sm2x35egh->grayscale, s_regmap, value, &current);
+}
+
 esp_err_t sm2x35egh_set_standby_mode(bool enable_standby)
 {
     SM2x35EGH_CHECK(s_sm2x35egh, "not init", return ESP_ERR_INVALID_STATE);
@@ -101,22 +110,22 @@ esp_err_t sm2x35egh_set_standby_mode(bool enable_standby)
     uint8_t addr = BASE_ADDR | BIT_STANDBY | BIT_R_OUT1;
     uint8_t value[11] = { 0 };
     value[0] = get_max_current();
+    iic_driver_shadow_invalidate(&s_sm2x35egh->grayscale);
     if (!enable_standby) {
         addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_R_OUT1;
     }
 
-    return iic_driver_write(addr, value, sizeof(value));
+    return iic_driver_write(s_sm2x35egh->iic, addr, value, sizeof(value));
 }
 
 esp_err_t sm2x35egh_set_shutdown(void)
 {
     SM2x35EGH_CHECK(s_sm2x35egh, "not init", return ESP_ERR_INVALID_STATE);
 
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_R_OUT1;
-    uint8_t value[11] = { 0 };
-    value[0] = get_max_current();
+    uint8_t value[10] = { 0 };
 
-    return iic_driver_write(addr, value, sizeof(value));
+    iic_driver_shadow_invalidate(&s_sm2x35egh->grayscale);
+    return write_grayscale(value);
 }
 
 esp_err_t sm2x35egh_regist_channel(sm2x35egh_channel_t channel, sm2x35egh_out_pin_t pin)
@@ -135,14 +144,12 @@ esp_err_t sm2x35egh_set_channel(sm2x35egh_channel_t channel, uint16_t value)
     SM2x35EGH_CHECK(s_sm2x35egh->mapping_addr[channel] != INVALID_ADDR, "channel:%d not regist", return ESP_ERR_INVALID_STATE, channel);
     SM2x35EGH_CHECK(value <= 1023, "value out of range", return ESP_ERR_INVALID_ARG);
 
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | get_mapping_addr(channel);
-    uint8_t _value[3] = { 0 };
+    uint8_t _value[10] = { 0 };
 
-    _value[0] = get_max_current();
-    _value[2] = value & 0xFF;
-    _value[1] = value >> 8;
+    memcpy(_value, s_sm2x35egh->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, channel, value);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2x35egh_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
@@ -150,21 +157,14 @@ esp_err_t sm2x35egh_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t
     SM2x35EGH_CHECK(s_sm2x35egh, "not init", return ESP_ERR_INVALID_STATE);
     SM2x35EGH_CHECK(s_sm2x35egh->mapping_addr[0] != INVALID_ADDR || s_sm2x35egh->mapping_addr[1] != INVALID_ADDR || s_sm2x35egh->mapping_addr[2] != INVALID_ADDR, "color channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_R_OUT1;
-    uint8_t _value[7] = { 0 };
-
-    _value[0] = get_max_current();
-
-    _value[s_sm2x35egh->mapping_addr[0] * 2 + 2] = value_r & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[0] * 2 + 1] = value_r >> 8;
-
-    _value[s_sm2x35egh->mapping_addr[1] * 2 + 2] = value_g & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[1] * 2 + 1] = value_g >> 8;
+    uint8_t _value[10] = { 0 };
 
-    _value[s_sm2x35egh->mapping_addr[2] * 2 + 2] = value_b & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[2] * 2 + 1] = value_b >> 8;
+    memcpy(_value, s_sm2x35egh->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, SM2x35EGH_CHANNEL_R, value_r);
+    set_grayscale(_value, SM2x35EGH_CHANNEL_G, value_g);
+    set_grayscale(_value, SM2x35EGH_CHANNEL_B, value_b);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2x35egh_set_cw_channel(uint16_t value_c, uint16_t value_w)
@@ -172,17 +172,13 @@ esp_err_t sm2x35egh_set_cw_channel(uint16_t value_c, uint16_t value_w)
     SM2x35EGH_CHECK(s_sm2x35egh, "not init", return ESP_ERR_INVALID_STATE);
     SM2x35EGH_CHECK(s_sm2x35egh->mapping_addr[3] != INVALID_ADDR || s_sm2x35egh->mapping_addr[4] != INVALID_ADDR, "white channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t _value[5] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_C_OUT4;
-    _value[0] = get_max_current();
+    uint8_t _value[10] = { 0 };
 
-    _value[(s_sm2x35egh->mapping_addr[3] - 3) * 2 + 2] = value_c & 0xFF;
-    _value[(s_sm2x35egh->mapping_addr[3] - 3) * 2 + 1] = value_c >> 8;
+    memcpy(_value, s_sm2x35egh->grayscale.regs, sizeof(_value));
+    set_grayscale(_value, SM2x35EGH_CHANNEL_C, value_c);
+    set_grayscale(_value, SM2x35EGH_CHANNEL_W, value_w);
 
-    _value[(s_sm2x35egh->mapping_addr[4] - 3) * 2 + 2] = value_w & 0xFF;
-    _value[(s_sm2x35egh->mapping_addr[4] - 3) * 2 + 1] = value_w >> 8;
-
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2x35egh_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b, uint16_t value_c, uint16_t value_w)
@@ -190,26 +186,15 @@ esp_err_t sm2x35egh_set_rgbcw_channel(uint16_t value_r, uint16_t value_g, uint16
     SM2x35EGH_CHECK(s_sm2x35egh, "not init", return ESP_ERR_INVALID_STATE);
     SM2x35EGH_CHECK(s_sm2x35egh->mapping_addr[3] != INVALID_ADDR || s_sm2x35egh->mapping_addr[4] != INVALID_ADDR, "white channel not regist", return ESP_ERR_INVALID_STATE);
 
-    uint8_t _value[11] = { 0 };
-    uint8_t addr = BASE_ADDR | BIT_ALL_CHANNEL | BIT_R_OUT1;
-    _value[0] = get_max_current();
-
-    _value[s_sm2x35egh->mapping_addr[0] * 2 + 2] = value_r & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[0] * 2 + 1] = value_r >> 8;
-
-    _value[s_sm2x35egh->mapping_addr[1] * 2 + 2] = value_g & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[1] * 2 + 1] = value_g >> 8;
-
-    _value[s_sm2x35egh->mapping_addr[2] * 2 + 2] = value_b & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[2] * 2 + 1] = value_b >> 8;
-
-    _value[s_sm2x35egh->mapping_addr[3] * 2 + 2] = value_c & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[3] * 2 + 1] = value_c >> 8;
+    uint8_t _value[10] = { 0 };
 
-    _value[s_sm2x35egh->mapping_addr[4] * 2 + 2] = value_w & 0xFF;
-    _value[s_sm2x35egh->mapping_addr[4] * 2 + 1] = value_w >> 8;
+    set_grayscale(_value, SM2x35EGH_CHANNEL_R, value_r);
+    set_grayscale(_value, SM2x35EGH_CHANNEL_G, value_g);
+    set_grayscale(_value, SM2x35EGH_CHANNEL_B, value_b);
+    set_grayscale(_value, SM2x35EGH_CHANNEL_C, value_c);
+    set_grayscale(_value, SM2x35EGH_CHANNEL_W, value_w);
 
-    return iic_driver_write(addr, _value, sizeof(_value));
+    return write_grayscale(_value);
 }
 
 esp_err_t sm2x35egh_init(driver_sm2x35egh_t *config)
@@ -222,6 +207,7 @@ esp_err_t sm2x35egh_init(driver_sm2x35egh_t *config)
     s_sm2x35egh = calloc(1, sizeof(sm2x35eh_handle_t));
     SM2x35EGH_CHECK(s_sm2x35egh, "alloc fail", return ESP_ERR_NO_MEM);
     memset(s_sm2x35egh->mapping_addr, INVALID_ADDR, SM2x35EGH_MAX_PIN);
+    iic_driver_shadow_init(&s_sm2x35egh->grayscale, iic_regmap_image_size(s_regmap), s_regmap->channel_bytes);
 
     s_sm2x35egh->rgb_current = config->rgb_current;
     s_sm2x35egh->cw_current = config->cw_current;
@@ -231,11 +217,11 @@ esp_err_t sm2x35egh_init(driver_sm2x35egh_t *config)
         ESP_LOGW(TAG, "The frequency is too high, adjust it to 400khz");
     }
 
-    err |= iic_driver_init(I2C_NUM_0, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ);
+    err |= iic_driver_init(config->iic_port, config->iic_sda, config->iic_clk, config->freq_khz * IIC_BASE_UNIT_HZ, &s_sm2x35egh->iic);
     SM2x35EGH_CHECK(err == ESP_OK, "i2c master init fail", goto EXIT);
 
     if (config->enable_iic_queue) {
-        err |= iic_driver_send_task_create();
+        err |= iic_driver_send_task_create(s_sm2x35egh->iic);
         SM2x35EGH_CHECK(err == ESP_OK, "task create fail", goto EXIT);
     }
 
@@ -243,7 +229,11 @@ esp_err_t sm2x35egh_init(driver_sm2x35egh_t *config)
 EXIT:
 
     if (s_sm2x35egh) {
+        if (s_sm2x35egh->iic) {
+            iic_driver_deinit(s_sm2x35egh->iic);
+        }
         free(s_sm2x35egh);
+        s_sm2x35egh = NULL;
     }
     return err;
 }
@@ -253,8 +243,7 @@ esp_err_t sm2x35egh_deinit(void)
     SM2x35EGH_CHECK(s_sm2x35egh, "not init", return ESP_ERR_INVALID_STATE);
 
     sm2x35egh_set_shutdown();
-    iic_driver_deinit();
-    iic_driver_task_destroy();
+    iic_driver_deinit(s_sm2x35egh->iic);
     free(s_sm2x35egh);
     s_sm2x35egh = NULL;
     return ESP_OK;
@@ -13,23 +13,33 @@
 // limitations under the License.
 
 #include <string.h>
+#include <sys/param.h>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <esp_log.h>
 #include <driver/spi_master.h>
 #include <hal/spi_hal.h>
 
 #include "ws2812.h"
+#include "ws2812_encode.h"
 
 static const char *TAG = "ws2812";
 
 #define WS2812_SPI_SPEED_HZ     (2400 * 1000)
-#define WS2812_LED_BUF          (9)
 #define WS2812_LED_BUF_BIT      (WS2812_LED_BUF * 8)
 
 typedef struct {
+    SemaphoreHandle_t mutex;        /* the fade tick and the per-pixel callers share the framebuffers and the SPI device */
     spi_device_handle_t spi_handle;
+    spi_transaction_t trans;
+    bool trans_pending;
     uint16_t led_num;
-    uint8_t *buf;
+    uint8_t *pixels;
+    uint8_t *buf[2];
+    uint8_t back;
+    uint16_t dirty_start[2];
+    uint16_t dirty_end[2];
     uint32_t buf_size;
 } ws2812_handle_t;
 
@@ -45,73 +55,125 @@ static ws2812_handle_t *s_ws2812 = NULL;
 #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
 #endif
 
-static esp_err_t _write(uint8_t *buf, size_t size)
+static esp_err_t wait_trans_done(void)
 {
-    spi_transaction_t t = { 0 };
+    spi_transaction_t *ret_trans = NULL;
 
-    t.length = size;
-    t.tx_buffer = buf;
-    t.rx_buffer = NULL;
+    if (!s_ws2812->trans_pending) {
+        return ESP_OK;
+    }
+    s_ws2812->trans_pending = false;
 
-    return spi_device_transmit(s_ws2812->spi_handle, &t);;
+    return spi_device_get_trans_result(s_ws2812->spi_handle, &ret_trans, portMAX_DELAY);
 }
 
-static void set_data_bit(uint8_t data, uint8_t *buf)
+/**
+ * @brief Queue the back buffer for transmission and swap buffers
+ *
+ * @note The call only waits for the previous frame, so the caller can encode the next frame
+ * into the other buffer while this one is still being sent by DMA.
+ *
+ */
+static esp_err_t _write(size_t size)
 {
-    *(buf + 2) |= data & BIT(0) ? BIT(2) | BIT(1) : BIT(2);
-    *(buf + 2) |= data & BIT(1) ? BIT(5) | BIT(4) : BIT(5);
-    *(buf + 2) |= data & BIT(2) ? BIT(7) : 0x00;
-    *(buf + 1) |= data & BIT(2) ? BIT(0) : BIT(0);
-    *(buf + 1) |= data & BIT(3) ? BIT(3) | BIT(2) : BIT(3);
-    *(buf + 1) |= data & BIT(4) ? BIT(6) | BIT(5) : BIT(6);
-    *(buf + 0) |= data & BIT(5) ? BIT(1) | BIT(0) : BIT(1);
-    *(buf + 0) |= data & BIT(6) ? BIT(4) | BIT(3) : BIT(4);
-    *(buf + 0) |= data & BIT(7) ? BIT(7) | BIT(6) : BIT(7);
+    esp_err_t err = wait_trans_done();
+    WS2812_CHECK(err == ESP_OK, "wait trans fail", return err);
+
+    memset(&s_ws2812->trans, 0, sizeof(spi_transaction_t));
+    s_ws2812->trans.length = size * 8;
+    s_ws2812->trans.tx_buffer = s_ws2812->buf[s_ws2812->back];
+    s_ws2812->trans.rx_buffer = NULL;
+
+    err = spi_device_queue_trans(s_ws2812->spi_handle, &s_ws2812->trans, portMAX_DELAY);
+    WS2812_CHECK(err == ESP_OK, "queue trans fail", return err);
+
+    s_ws2812->trans_pending = true;
+    s_ws2812->back ^= 1;
+
+    return ESP_OK;
 }
 
-static void generate_data(uint32_t index, uint8_t red, uint8_t green, uint8_t blue, uint8_t *out_buf)
+/**
+ * @brief Extend the dirty range of both buffers to cover [start, end)
+ *
+ * @note Each buffer keeps its own range because it was last encoded one frame before the other.
+ * A single range per buffer is kept, so two far apart pixels re-encode everything between them.
+ *
+ */
+static void mark_dirty(uint16_t start, uint16_t end)
 {
-    memset(out_buf + (index) * WS2812_LED_BUF, 0, WS2812_LED_BUF);
-    set_data_bit(green, out_buf + (index) * WS2812_LED_BUF);
-    set_data_bit(red, out_buf + (index) * WS2812_LED_BUF + 3);
-    set_data_bit(blue, out_buf + (index) * WS2812_LED_BUF + 6);
+    for (int i = 0; i < 2; i++) {
+        if (s_ws2812->dirty_start[i] >= s_ws2812->dirty_end[i]) {
+            s_ws2812->dirty_start[i] = start;
+            s_ws2812->dirty_end[i] = end;
+        } else {
+            s_ws2812->dirty_start[i] = MIN(s_ws2812->dirty_start[i], start);
+            s_ws2812->dirty_end[i] = MAX(s_ws2812->dirty_end[i], end);
+        }
+    }
 }
 
 static void cleanup(void)
 {
+    if (!s_ws2812) {
+        return;
+    }
+
     if (s_ws2812->spi_handle) {
+        wait_trans_done();
         spi_bus_remove_device(s_ws2812->spi_handle);
         spi_bus_free(SPI2_HOST);
         s_ws2812->spi_handle = NULL;
     }
 
-    if (s_ws2812->buf) {
-        free(s_ws2812->buf);
-        s_ws2812->buf = NULL;
+    for (int i = 0; i < 2; i++) {
+        if (s_ws2812->buf[i]) {
+            free(s_ws2812->buf[i]);
+            s_ws2812->buf[i] = NULL;
+        }
     }
 
-    if (s_ws2812) {
-        free(s_ws2812);
-        s_ws2812 = NULL;
+    if (s_ws2812->pixels) {
+        free(s_ws2812->pixels);
+        s_ws2812->pixels = NULL;
     }
+
+    if (s_ws2812->mutex) {
+        vSemaphoreDelete(s_ws2812->mutex);
+        s_ws2812->mutex = NULL;
+    }
+
+    free(s_ws2812);
+    s_ws2812 = NULL;
 }
 
 esp_err_t ws2812_init(driver_ws2812_t *config)
 {
     esp_err_t err = ESP_OK;
     WS2812_CHECK(config, "config is null", return ESP_ERR_INVALID_ARG);
+    WS2812_CHECK(config->led_num > 0, "led_num is 0", return ESP_ERR_INVALID_ARG);
     WS2812_CHECK(!s_ws2812, "already init done", return ESP_ERR_INVALID_ARG);
 
     s_ws2812 = calloc(1, sizeof(ws2812_handle_t));
-    WS2812_CHECK(err == ESP_OK, "alloc fail", return ESP_ERR_NO_MEM);
+    WS2812_CHECK(s_ws2812, "alloc fail", return ESP_ERR_NO_MEM);
     s_ws2812->led_num = config->led_num;
     s_ws2812->buf_size = s_ws2812->led_num * WS2812_LED_BUF;
-
-    s_ws2812->buf = heap_caps_malloc(s_ws2812->buf_size, MALLOC_CAP_DMA);
-    memset(s_ws2812->buf, 0, s_ws2812->buf_size);
+    s_ws2812->mutex = xSemaphoreCreateMutex();
+    WS2812_CHECK(s_ws2812->mutex, "mutex create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+
+    // 1. Pixel framebuffer, 3 bytes per LED in R, G, B order
+    s_ws2812->pixels = calloc(s_ws2812->led_num, 3);
+    WS2812_CHECK(s_ws2812->pixels, "pixels alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+
+    // 2. Two encoded frames, one is sent by DMA while the other is being encoded
+    for (int i = 0; i < 2; i++) {
+        s_ws2812->buf[i] = heap_caps_malloc(s_ws2812->buf_size, MALLOC_CAP_DMA);
+        WS2812_CHECK(s_ws2812->buf[i], "dma buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+        ws2812_encode_fill(s_ws2812->buf[i], s_ws2812->led_num, 0, 0, 0);
+    }
 
     err = gpio_set_drive_capability(config->ctrl_io, GPIO_DRIVE_CAP_3);
-    WS2812_CHECK(err == ESP_OK, "set drive capability fail", return err);
+    WS2812_CHECK(err == ESP_OK, "set drive capability fail", goto EXIT);
 
     spi_bus_config_t buscfg = {
         .mosi_io_num = config->ctrl_io,
@@ -139,7 +201,7 @@ esp_err_t ws2812_init(driver_ws2812_t *config)
     int dma_chan = SPI2_HOST;
     err = spi_bus_initialize(SPI2_HOST, &buscfg, dma_chan);
 #endif
-    WS2812_CHECK(err == ESP_OK, "spi_bus_initialize error", return err);
+    WS2812_CHECK(err == ESP_OK, "spi_bus_initialize error", goto EXIT);
 
 #if !CONFIG_IDF_TARGET_ESP32
     spi_dev_t *hw = spi_periph_signal[SPI2_HOST].hw;
@@ -148,8 +210,8 @@ esp_err_t ws2812_init(driver_ws2812_t *config)
     err = spi_bus_add_device(SPI2_HOST, &devcfg, &s_ws2812->spi_handle);
     WS2812_CHECK(err == ESP_OK, "spi_bus_add_device error", goto EXIT);
 
-    err = _write(s_ws2812->buf, s_ws2812->buf_size);
-    WS2812_CHECK(err == ESP_OK, "set init data fail", return err);
+    err = _write(s_ws2812->buf_size);
+    WS2812_CHECK(err == ESP_OK, "set init data fail", goto EXIT);
 
     return ESP_OK;
 
@@ -171,9 +233,61 @@ esp_err_t ws2812_set_rgb_channel(uint8_t value_r, uint8_t value_g, uint8_t value
 {
     WS2812_CHECK(s_ws2812, "ws2812b_init() must be called first", return ESP_ERR_INVALID_STATE);
 
-    for (int i = 0; i < s_ws2812->led_num; i++ ) {
-        generate_data(i, value_r, value_g, value_b, s_ws2812->buf);
+    xSemaphoreTake(s_ws2812->mutex, portMAX_DELAY);
+    for (uint32_t i = 0; i < s_ws2812->led_num; i++) {
+        s_ws2812->pixels[i * 3 + 0] = value_r;
+        s_ws2812->pixels[i * 3 + 1] = value_g;
+        s_ws2812->pixels[i * 3 + 2] = value_b;
+    }
+    ws2812_encode_fill(s_ws2812->buf[s_ws2812->back], s_ws2812->led_num, value_r, value_g, value_b);
+
+    // The back buffer is fully encoded now, only the other one is stale
+    mark_dirty(0, s_ws2812->led_num);
+    s_ws2812->dirty_start[s_ws2812->back] = 0;
+    s_ws2812->dirty_end[s_ws2812->back] = 0;
+
+    esp_err_t err = _write(s_ws2812->buf_size);
+    xSemaphoreGive(s_ws2812->mutex);
+
+    return err;
+}
+
+esp_err_t ws2812_set_pixel(uint16_t index, uint8_t value_r, uint8_t value_g, uint8_t value_b)
+{
+    WS2812_CHECK(s_ws2812, "ws2812b_init() must be called first", return ESP_ERR_INVALID_STATE);
+    WS2812_CHECK(index < s_ws2812->led_num, "index:%d out of range", return ESP_ERR_INVALID_ARG, index);
+
+    xSemaphoreTake(s_ws2812->mutex, portMAX_DELAY);
+    uint8_t *pixel = s_ws2812->pixels + index * 3;
+    if (pixel[0] != value_r || pixel[1] != value_g || pixel[2] != value_b) {
+        pixel[0] = value_r;
+        pixel[1] = value_g;
+        pixel[2] = value_b;
+        mark_dirty(index, index + 1);
+    }
+    xSemaphoreGive(s_ws2812->mutex);
+
+    return ESP_OK;
+}
+
+esp_err_t ws2812_commit(void)
+{
+    WS2812_CHECK(s_ws2812, "ws2812b_init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    xSemaphoreTake(s_ws2812->mutex, portMAX_DELAY);
+    uint8_t back = s_ws2812->back;
+    uint8_t *out_buf = s_ws2812->buf[back];
+    uint8_t *pixel = s_ws2812->pixels + s_ws2812->dirty_start[back] * 3;
+
+    // Only the pixels changed since this buffer was last sent are encoded again
+    for (uint32_t i = s_ws2812->dirty_start[back]; i < s_ws2812->dirty_end[back]; i++, pixel += 3) {
+        ws2812_encode_led(out_buf + i * WS2812_LED_BUF, pixel[0], pixel[1], pixel[2]);
     }
+    s_ws2812->dirty_start[back] = 0;
+    s_ws2812->dirty_end[back] = 0;
 
-    return _write(s_ws2812->buf, s_ws2812->led_num * WS2812_LED_BUF_BIT);
+    esp_err_t err = _write(s_ws2812->buf_size);
+    xSemaphoreGive(s_ws2812->mutex);
+
+    return err;
 }
@@ -24,7 +24,7 @@ extern "C" {
  *
  */
 typedef struct {
-    uint8_t led_num;
+    uint16_t led_num;
     gpio_num_t ctrl_io;
 } driver_ws2812_t;
 
@@ -53,6 +53,30 @@ esp_err_t ws2812_deinit(void);
  */
 esp_err_t ws2812_set_rgb_channel(uint8_t value_r, uint8_t value_g, uint8_t value_b);
 
+/**
+ * @brief Set the color of one LED in the framebuffer
+ *
+ * @note Nothing is sent until ws2812_commit() is called. The calls are serialized with the writes of the fade tick,
+ * but a running fade still overwrites the whole strip on its next tick.
+ *
+ * @param index LED index, starting from 0
+ * @param value_r Output red value
+ * @param value_g Output green value
+ * @param value_b Output blue value
+ * @return esp_err_t
+ */
+esp_err_t ws2812_set_pixel(uint16_t index, uint8_t value_r, uint8_t value_g, uint8_t value_b);
+
+/**
+ * @brief Encode the framebuffer and send it to the strip
+ *
+ * @note The frame is queued to DMA and the function returns without waiting for it to be sent.
+ * It only blocks if the previous frame is still being sent.
+ *
+ * @return esp_err_t
+ */
+esp_err_t ws2812_commit(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,30 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+/* SPI bytes of one LED, 24 data bits of 3 SPI bits each */
+#define WS2812_LED_BUF              (9)
+
+/**
+ * @brief Encode LEDs into the SPI frame, G, R, B order on the wire
+ *
+ * @note These functions only use the buffers, they can run on the host.
+ * ws2812_encode_fill() sets every LED to the same color with 32-bit stores of a pre-encoded 4-LED block
+ * (4 LEDs take exactly 9 words), out_buf must be word aligned.
+ */
+void ws2812_encode_led(uint8_t *led_buf, uint8_t red, uint8_t green, uint8_t blue);
+void ws2812_encode_fill(uint8_t *out_buf, uint32_t led_num, uint8_t red, uint8_t green, uint8_t blue);
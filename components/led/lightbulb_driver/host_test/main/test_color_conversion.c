@@ -0,0 +1,300 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <unity.h>
+
+#include "lightbulb.h"
+
+#ifndef MAX
+#define MAX(a, b)                                   (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef MIN
+#define MIN(a, b)                                   (((a) < (b)) ? (a) : (b))
+#endif
+
+/* Chromaticity step of the xyY grid, every Q8 point of the triangle */
+#define CONVERSION_XY_STEP                          (1.0f / 256)
+
+/* Largest differences from the float baseline over the whole grid, the integer code reaches them at the rounding edges */
+#define RGB2HSV_MAX_HUE_ERROR                       (1)
+#define RGB2HSV_MAX_SV_ERROR                        (1)
+#define XYY2RGB_MAX_ERROR                           (1)
+#define RGB2XYY_MAX_XY_ERROR                        (0.0015f)
+#define RGB2XYY_MAX_LUMINANCE_ERROR                 (0.0008f)
+
+/**
+ * @brief Float color conversions of the earlier lightbulb.c, the reference for the integer ones
+ *
+ * @note The bodies are kept verbatim, only the argument checks are left out since every input below is in range.
+ */
+static esp_err_t baseline_xyy2rgb(float x, float y, float Y, uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    float _x = x;
+    float _y = y;
+    float _z = 1.0f - _x - _y;
+    float _X, _Y, _Z;
+    float _r, _g, _b;
+
+    // Calculate XYZ values
+    _Y = Y / 100.0;
+    _X = (_Y / _y) * _x;
+    _Z = (_Y / _y) * _z;
+
+    // X, Y and Z input refer to a D65/2° standard illuminant.
+    // sR, sG and sB (standard RGB) output range = 0 ÷ 255
+    // convert XYZ to RGB - CIE XYZ to sRGB
+    _r = (_X * 3.2410f) - (_Y * 1.5374f) - (_Z * 0.4986f);
+    _g = -(_X * 0.9692f) + (_Y * 1.8760f) + (_Z * 0.0416f);
+    _b = (_X * 0.0556f) - (_Y * 0.2040f) + (_Z * 1.0570f);
+
+    // apply gamma 2.2 correction
+    _r = (_r <= 0.00304f ? 12.92f * _r : (1.055f) * pow(_r, (1.0f / 2.4f)) - 0.055f);
+    _g = (_g <= 0.00304f ? 12.92f * _g : (1.055f) * pow(_g, (1.0f / 2.4f)) - 0.055f);
+    _b = (_b <= 0.00304f ? 12.92f * _b : (1.055f) * pow(_b, (1.0f / 2.4f)) - 0.055f);
+
+    // Round off
+    _r = MIN(1.0, _r);
+    _r = MAX(0, _r);
+
+    _g = MIN(1.0, _g);
+    _g = MAX(0, _g);
+
+    _b = MIN(1.0, _b);
+    _b = MAX(0, _b);
+
+    *red = (uint8_t)(_r * 255 + 0.5);
+    *green = (uint8_t)(_g * 255 + 0.5);
+    *blue = (uint8_t)(_b * 255 + 0.5);
+
+    return ESP_OK;
+}
+
+static esp_err_t baseline_rgb2xyy(uint8_t red, uint8_t green, uint8_t blue, float *x, float *y, float *Y)
+{
+    float _red = red / 255.0;
+    float _green = green / 255.0;
+    float _blue = blue / 255.0;
+
+    if (_red > 0.04045) {
+        _red = pow(( _red + 0.055 ) / 1.055, 2.4);
+    } else {
+        _red = _red / 12.92;
+    }
+
+    if ( _green > 0.04045 ) {
+        _green = pow(( _green + 0.055 ) / 1.055, 2.4);
+    } else {
+        _green = _green / 12.92;
+    }
+
+    if ( _blue > 0.04045 ) {
+        _blue = pow(( _blue + 0.055 ) / 1.055, 2.4);
+    } else {
+        _blue = _blue / 12.92;
+    }
+
+    _red = _red * 100;
+    _green = _green * 100;
+    _blue = _blue * 100;
+
+    float _X = _red * 0.4124 + _green * 0.3576 + _blue * 0.1805;
+    float _Y = _red * 0.2126 + _green * 0.7152 + _blue * 0.0722;
+    float _Z = _red * 0.0193 + _green * 0.1192 + _blue * 0.9505;
+
+    *Y = _Y;
+    *x = _X / ( _X + _Y + _Z );
+    *y = _Y / ( _X + _Y + _Z );
+
+    return ESP_OK;
+}
+
+static esp_err_t baseline_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    hue = hue % 360;
+    uint16_t hi = (hue / 60) % 6;
+    uint16_t F = 100 * hue / 60 - 100 * hi;
+    uint16_t P = value * (100 - saturation) / 100;
+    uint16_t Q = value * (10000 - F * saturation) / 10000;
+    uint16_t T = value * (10000 - saturation * (100 - F)) / 10000;
+
+    switch (hi) {
+    case 0:
+        *red = value;
+        *green = T;
+        *blue = P;
+        break;
+
+    case 1:
+        *red = Q;
+        *green = value;
+        *blue = P;
+        break;
+
+    case 2:
+        *red = P;
+        *green = value;
+        *blue = T;
+        break;
+
+    case 3:
+        *red = P;
+        *green = Q;
+        *blue = value;
+        break;
+
+    case 4:
+        *red = T;
+        *green = P;
+        *blue = value;
+        break;
+
+    case 5:
+        *red = value;
+        *green = P;
+        *blue = Q;
+        break;
+
+    default:
+        return ESP_FAIL;
+    }
+
+    *red = *red * 255 / 100;
+    *green = *green * 255 / 100;
+    *blue = *blue * 255 / 100;
+
+    return ESP_OK;
+}
+
+static esp_err_t baseline_rgb2hsv(uint16_t red, uint16_t green, uint16_t blue, uint16_t *hue, uint8_t *saturation, uint8_t *value)
+{
+    float _hue, _saturation, _value;
+    float m_max = MAX(red, MAX(green, blue));
+    float m_min = MIN(red, MIN(green, blue));
+    float m_delta = m_max - m_min;
+
+    _value = m_max / 255.0;
+
+    if (m_delta == 0) {
+        _hue = 0;
+        _saturation = 0;
+    } else {
+        _saturation = m_delta / m_max;
+
+        if (red == m_max) {
+            _hue = (green - blue) / m_delta;
+        } else if (green == m_max) {
+            _hue = 2 + (blue - red) / m_delta;
+        } else {
+            _hue = 4 + (red - green) / m_delta;
+        }
+
+        _hue = _hue * 60;
+
+        if (_hue < 0) {
+            _hue = _hue + 360;
+        }
+    }
+
+    *hue = (int)(_hue + 0.5);
+    *saturation = (int)(_saturation * 100 + 0.5);
+    *value = (int)(_value * 100 + 0.5);
+
+    return ESP_OK;
+}
+
+void test_hsv2rgb_exhaustive(void)
+{
+    // Every input, the integer code must give the bytes of the baseline
+    for (uint16_t hue = 0; hue <= 360; hue++) {
+        for (uint8_t saturation = 0; saturation <= 100; saturation++) {
+            for (uint8_t value = 0; value <= 100; value++) {
+                uint8_t rgb[3], ref[3];
+                TEST_ASSERT_EQUAL(ESP_OK, lightbulb_hsv2rgb(hue, saturation, value, &rgb[0], &rgb[1], &rgb[2]));
+                TEST_ASSERT_EQUAL(ESP_OK, baseline_hsv2rgb(hue, saturation, value, &ref[0], &ref[1], &ref[2]));
+                TEST_ASSERT_EQUAL_UINT8_ARRAY(ref, rgb, 3);
+            }
+        }
+    }
+}
+
+void test_rgb2hsv_exhaustive(void)
+{
+    int max_hue_error = 0, max_sv_error = 0;
+
+    // Every input, hue compared on the circle
+    for (int red = 0; red <= 255; red++) {
+        for (int green = 0; green <= 255; green++) {
+            for (int blue = 0; blue <= 255; blue++) {
+                uint16_t hue, ref_hue;
+                uint8_t saturation, value, ref_saturation, ref_value;
+                TEST_ASSERT_EQUAL(ESP_OK, lightbulb_rgb2hsv(red, green, blue, &hue, &saturation, &value));
+                TEST_ASSERT_EQUAL(ESP_OK, baseline_rgb2hsv(red, green, blue, &ref_hue, &ref_saturation, &ref_value));
+                int hue_error = abs(hue - ref_hue);
+                max_hue_error = MAX(max_hue_error, MIN(hue_error, 360 - hue_error));
+                max_sv_error = MAX(max_sv_error, MAX(abs(saturation - ref_saturation), abs(value - ref_value)));
+            }
+        }
+    }
+    printf("rgb2hsv max error: hue %d saturation/value %d\n", max_hue_error, max_sv_error);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(RGB2HSV_MAX_HUE_ERROR, max_hue_error);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(RGB2HSV_MAX_SV_ERROR, max_sv_error);
+}
+
+void test_xyy2rgb_exhaustive(void)
+{
+    int max_error = 0;
+
+    // Every Q8 point of the chromaticity triangle x + y <= 1 without y = 0, every integer luminance
+    for (int i = 0; i <= 256; i++) {
+        for (int j = 1; i + j <= 256; j++) {
+            float x = i * CONVERSION_XY_STEP;
+            float y = j * CONVERSION_XY_STEP;
+            for (int Y = 0; Y <= 100; Y++) {
+                uint8_t rgb[3], ref[3];
+                TEST_ASSERT_EQUAL(ESP_OK, lightbulb_xyy2rgb(x, y, Y, &rgb[0], &rgb[1], &rgb[2]));
+                TEST_ASSERT_EQUAL(ESP_OK, baseline_xyy2rgb(x, y, Y, &ref[0], &ref[1], &ref[2]));
+                for (int c = 0; c < 3; c++) {
+                    max_error = MAX(max_error, abs(rgb[c] - ref[c]));
+                }
+            }
+        }
+    }
+    printf("xyy2rgb max error: %d\n", max_error);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(XYY2RGB_MAX_ERROR, max_error);
+}
+
+void test_rgb2xyy_exhaustive(void)
+{
+    float max_xy_error = 0, max_luminance_error = 0;
+
+    // Every input, black has no chromaticity and is skipped
+    for (int red = 0; red <= 255; red++) {
+        for (int green = 0; green <= 255; green++) {
+            for (int blue = (red || green) ? 0 : 1; blue <= 255; blue++) {
+                float x, y, Y, ref_x, ref_y, ref_Y;
+                TEST_ASSERT_EQUAL(ESP_OK, lightbulb_rgb2xyy(red, green, blue, &x, &y, &Y));
+                TEST_ASSERT_EQUAL(ESP_OK, baseline_rgb2xyy(red, green, blue, &ref_x, &ref_y, &ref_Y));
+                max_xy_error = MAX(max_xy_error, MAX(fabsf(x - ref_x), fabsf(y - ref_y)));
+                max_luminance_error = MAX(max_luminance_error, fabsf(Y - ref_Y));
+            }
+        }
+    }
+    printf("rgb2xyy max error: xy %f Y %f\n", max_xy_error, max_luminance_error);
+    TEST_ASSERT_TRUE(max_xy_error <= RGB2XYY_MAX_XY_ERROR);
+    TEST_ASSERT_TRUE(max_luminance_error <= RGB2XYY_MAX_LUMINANCE_ERROR);
+}
@@ -0,0 +1,187 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <unity.h>
+
+#include "iic_regmap.h"
+#include "iic_regmap_chips.h"
+
+/* Image bytes of the largest map, 5 outputs of 2 bytes fit with room to spare */
+#define TEST_IMAGE_SIZE             (16)
+
+/**
+ * @brief Bit by bit reference of one encoded grayscale byte, checks iic_regmap_encode() without sharing its code
+ *
+ */
+static uint8_t regmap_reference_byte(const iic_regmap_t *map, uint16_t value, int byte)
+{
+    uint8_t result = 0;
+    bool high = (map->channel_bytes == 2) && (byte == (map->high_byte_first ? 0 : 1));
+
+    for (int bit = 0; bit < map->data_bits; bit++) {
+        int src = high ? bit + map->data_bits : bit;
+        if (value & (1 << src)) {
+            result |= 1 << (bit + map->data_shift);
+        }
+    }
+    if (map->parity == IIC_REGMAP_PARITY_EVEN_BIT0) {
+        int ones = 0;
+        for (int bit = 1; bit < 8; bit++) {
+            ones += (result >> bit) & 0x01;
+        }
+        result = (result & 0xFE) | (ones & 0x01);
+    }
+    return result;
+}
+
+void test_iic_regmap_encoder(void)
+{
+    const int round_count = 2000;
+    uint8_t image[TEST_IMAGE_SIZE] = { 0 };
+    uint8_t data[IIC_REGMAP_MAX_DATA_SIZE] = { 0 };
+    uint16_t value[5] = { 0 };
+
+    // 1. Random maps in the range of the supported chips, every frame is compared with the reference
+    for (int round = 0; round < round_count; round++) {
+        iic_regmap_t map = {
+            .addr_base = 0x80,
+            .addr_out1 = rand() % 4,
+            .pin_num = 5,
+            .channel_bytes = 1 + rand() % 2,
+            .addr_shift = rand() % 2,
+            .high_byte_first = rand() % 2,
+            .prefix_size = rand() % 2,
+            .parity = rand() % 2 ? IIC_REGMAP_PARITY_EVEN_BIT0 : IIC_REGMAP_PARITY_NONE,
+        };
+        map.data_bits = (map.channel_bytes == 2) ? 5 : 7;
+        map.data_shift = rand() % (8 - map.data_bits + 1);
+        map.addr_unit = rand() % 2 ? 1 : map.channel_bytes;
+
+        uint8_t prefix = rand() & 0xFF;
+        uint16_t max = (1 << (map.data_bits * map.channel_bytes)) - 1;
+        for (int pin = 0; pin < map.pin_num; pin++) {
+            value[pin] = rand() % (max + 1);
+            iic_regmap_set_grayscale(&map, image, pin, value[pin]);
+        }
+        uint8_t first = (rand() % map.pin_num) * map.channel_bytes;
+        uint8_t size = iic_regmap_image_size(&map) - first;
+        size -= (rand() % (size / map.channel_bytes)) * map.channel_bytes;
+
+        uint8_t addr = 0;
+        uint8_t len = iic_regmap_encode(&map, image, first, size, &prefix, &addr, data);
+
+        TEST_ASSERT_EQUAL_UINT8(map.prefix_size + size, len);
+        TEST_ASSERT_EQUAL_HEX8(iic_regmap_parity(&map, map.addr_base | ((map.addr_out1 + first / map.addr_unit) << map.addr_shift)), addr);
+        if (map.prefix_size) {
+            TEST_ASSERT_EQUAL_HEX8(iic_regmap_parity(&map, prefix), data[0]);
+        }
+        for (int i = 0; i < size; i++) {
+            int byte = first + i;
+            TEST_ASSERT_EQUAL_HEX8(regmap_reference_byte(&map, value[byte / map.channel_bytes], byte % map.channel_bytes), data[map.prefix_size + i]);
+        }
+    }
+
+    // 2. A pin the map does not have leaves the image untouched
+    iic_regmap_t map = { .pin_num = 5, .channel_bytes = 2, .data_bits = 5, .addr_unit = 1 };
+    memset(image, 0, sizeof(image));
+    iic_regmap_set_grayscale(&map, image, 0xFF, 1023);
+    for (int i = 0; i < TEST_IMAGE_SIZE; i++) {
+        TEST_ASSERT_EQUAL_UINT8(0, image[i]);
+    }
+}
+
+/* Grayscale of OUT1-OUT5 used by the fixed frames */
+static const uint16_t s_chip_value_10bit[5] = { 0x3A5, 0x05A, 0x3FF, 0x000, 0x1C3 };
+static const uint8_t s_chip_value_8bit[5] = { 0xA5, 0x5A, 0xFF, 0x00, 0x3C };
+
+typedef struct {
+    const char *name;
+    const iic_regmap_t *map;
+    bool value_8bit;
+    uint8_t first_pin;
+    uint8_t pin_count;
+    uint8_t addr;
+    uint8_t len;
+    uint8_t data[IIC_REGMAP_MAX_DATA_SIZE];
+} regmap_chip_frame_t;
+
+/**
+ * @brief Frames of the hand-coded encoders the register maps replaced, with mapping_addr[channel] = channel
+ *
+ * @note The SM2x35EGH frames start with the current byte of rgb 3 and cw 5.
+ * The SM2135E RGB frame starts at the current register and is not described by the map.
+ */
+static const regmap_chip_frame_t s_chip_frame[] = {
+    { "sm2135e wy",      &iic_regmap_sm2135e,   true,  3, 2, 0xC5, 2,  { 0x00, 0x3C } },
+    { "sm2135e out2",    &iic_regmap_sm2135e,   true,  1, 1, 0xC3, 1,  { 0x5A } },
+    { "sm2135e out5",    &iic_regmap_sm2135e,   true,  4, 1, 0xC6, 1,  { 0x3C } },
+    { "sm2135eh rgbwy",  &iic_regmap_sm2135eh,  true,  0, 5, 0xC2, 5,  { 0xA5, 0x5A, 0xFF, 0x00, 0x3C } },
+    { "sm2135eh rgb",    &iic_regmap_sm2135eh,  true,  0, 3, 0xC2, 3,  { 0xA5, 0x5A, 0xFF } },
+    { "sm2135eh wy",     &iic_regmap_sm2135eh,  true,  3, 2, 0xC5, 2,  { 0x00, 0x3C } },
+    { "sm2135eh out2",   &iic_regmap_sm2135eh,  true,  1, 1, 0xC3, 1,  { 0x5A } },
+    { "sm2135eh out5",   &iic_regmap_sm2135eh,  true,  4, 1, 0xC6, 1,  { 0x3C } },
+    { "sm2x35egh rgbcw", &iic_regmap_sm2x35egh, false, 0, 5, 0xD8, 11, { 0x35, 0x03, 0xA5, 0x00, 0x5A, 0x03, 0xFF, 0x00, 0x00, 0x01, 0xC3 } },
+    { "sm2x35egh rgb",   &iic_regmap_sm2x35egh, false, 0, 3, 0xD8, 7,  { 0x35, 0x03, 0xA5, 0x00, 0x5A, 0x03, 0xFF } },
+    { "sm2x35egh cw",    &iic_regmap_sm2x35egh, false, 3, 2, 0xDB, 5,  { 0x35, 0x00, 0x00, 0x01, 0xC3 } },
+    { "sm2x35egh out2",  &iic_regmap_sm2x35egh, false, 1, 1, 0xD9, 3,  { 0x35, 0x00, 0x5A } },
+    { "sm2x35egh out5",  &iic_regmap_sm2x35egh, false, 4, 1, 0xDC, 3,  { 0x35, 0x01, 0xC3 } },
+    { "bp5758d rgbcw",   &iic_regmap_bp5758d,   false, 0, 5, 0xA6, 10, { 0x05, 0x1D, 0x1A, 0x02, 0x1F, 0x1F, 0x00, 0x00, 0x03, 0x0E } },
+    { "bp5758d rgb",     &iic_regmap_bp5758d,   false, 0, 3, 0xA6, 6,  { 0x05, 0x1D, 0x1A, 0x02, 0x1F, 0x1F } },
+    { "bp5758d cw",      &iic_regmap_bp5758d,   false, 3, 2, 0xAC, 4,  { 0x00, 0x00, 0x03, 0x0E } },
+    { "bp5758d out2",    &iic_regmap_bp5758d,   false, 1, 1, 0xA8, 2,  { 0x1A, 0x02 } },
+    { "bp5758d out5",    &iic_regmap_bp5758d,   false, 4, 1, 0xAE, 2,  { 0x03, 0x0E } },
+    { "bp1658cj rgbcw",  &iic_regmap_bp1658cj,  false, 0, 5, 0xB1, 10, { 0x05, 0x1D, 0x1A, 0x02, 0x1F, 0x1F, 0x00, 0x00, 0x03, 0x0E } },
+    { "bp1658cj rgb",    &iic_regmap_bp1658cj,  false, 0, 3, 0xB1, 6,  { 0x05, 0x1D, 0x1A, 0x02, 0x1F, 0x1F } },
+    { "bp1658cj cw",     &iic_regmap_bp1658cj,  false, 3, 2, 0xB7, 4,  { 0x00, 0x00, 0x03, 0x0E } },
+    { "bp1658cj out2",   &iic_regmap_bp1658cj,  false, 1, 1, 0xB3, 2,  { 0x1A, 0x02 } },
+    { "bp1658cj out5",   &iic_regmap_bp1658cj,  false, 4, 1, 0xB9, 2,  { 0x03, 0x0E } },
+    { "kp18058 rgbcw",   &iic_regmap_kp18058,   false, 0, 5, 0xE7, 10, { 0x3A, 0x0A, 0x05, 0x35, 0x3F, 0x3F, 0x00, 0x00, 0x1D, 0x06 } },
+    { "kp18058 rgb",     &iic_regmap_kp18058,   false, 0, 3, 0xE7, 6,  { 0x3A, 0x0A, 0x05, 0x35, 0x3F, 0x3F } },
+    { "kp18058 cw",      &iic_regmap_kp18058,   false, 3, 2, 0xF3, 4,  { 0x00, 0x00, 0x1D, 0x06 } },
+    { "kp18058 out2",    &iic_regmap_kp18058,   false, 1, 1, 0xEB, 2,  { 0x05, 0x35 } },
+    { "kp18058 out5",    &iic_regmap_kp18058,   false, 4, 1, 0xF6, 2,  { 0x1D, 0x06 } },
+};
+
+void test_iic_regmap_chips(void)
+{
+    uint8_t image[TEST_IMAGE_SIZE] = { 0 };
+    uint8_t data[IIC_REGMAP_MAX_DATA_SIZE] = { 0 };
+
+    // 1. The current byte of the SM2x35EGH prefix
+    uint8_t current = iic_regmap_pack_current(&iic_regmap_sm2x35egh, 3, 5);
+    TEST_ASSERT_EQUAL_HEX8(0x35, current);
+
+    // 2. Every frame of the real maps matches the bytes of the hand-coded encoders
+    for (size_t i = 0; i < sizeof(s_chip_frame) / sizeof(s_chip_frame[0]); i++) {
+        const regmap_chip_frame_t *frame = &s_chip_frame[i];
+        const iic_regmap_t *map = frame->map;
+
+        memset(image, 0, sizeof(image));
+        for (int pin = 0; pin < map->pin_num; pin++) {
+            iic_regmap_set_grayscale(map, image, pin, frame->value_8bit ? s_chip_value_8bit[pin] : s_chip_value_10bit[pin]);
+        }
+
+        uint8_t addr = 0;
+        memset(data, 0, sizeof(data));
+        uint8_t len = iic_regmap_encode(map, image, frame->first_pin * map->channel_bytes, frame->pin_count * map->channel_bytes, &current, &addr, data);
+
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(frame->len, len, frame->name);
+        TEST_ASSERT_EQUAL_HEX8_MESSAGE(frame->addr, addr, frame->name);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY_MESSAGE(frame->data, data, frame->len, frame->name);
+    }
+}
@@ -0,0 +1,40 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+
+#include <unity.h>
+
+void test_iic_regmap_encoder(void);
+void test_iic_regmap_chips(void);
+void test_ws2812_encoder(void);
+void test_simulated_fade(void);
+void test_hsv2rgb_exhaustive(void);
+void test_rgb2hsv_exhaustive(void);
+void test_xyy2rgb_exhaustive(void);
+void test_rgb2xyy_exhaustive(void);
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_iic_regmap_encoder);
+    RUN_TEST(test_iic_regmap_chips);
+    RUN_TEST(test_ws2812_encoder);
+    RUN_TEST(test_simulated_fade);
+    RUN_TEST(test_hsv2rgb_exhaustive);
+    RUN_TEST(test_rgb2hsv_exhaustive);
+    RUN_TEST(test_xyy2rgb_exhaustive);
+    RUN_TEST(test_rgb2xyy_exhaustive);
+    exit(UNITY_END());
+}
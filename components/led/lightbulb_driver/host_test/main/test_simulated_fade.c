@@ -0,0 +1,97 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <unity.h>
+
+#include "lightbulb.h"
+#include "simulated.h"
+
+#define TEST_FADE_MS                (800)
+#define TEST_RECORD_NUM             (512)
+
+/**
+ * @brief Output of all channels after the last recorded write
+ *
+ */
+static void simulated_final_value(uint16_t value[SIMULATED_CHANNEL_MAX], uint32_t *total_num)
+{
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+
+    TEST_ASSERT_EQUAL(ESP_OK, simulated_get_records(&records, &record_num, total_num));
+    TEST_ASSERT_TRUE(record_num > 0);
+    memcpy(value, records[record_num - 1].value, sizeof(uint16_t) * SIMULATED_CHANNEL_MAX);
+}
+
+void test_simulated_fade(void)
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = TEST_RECORD_NUM,
+        .capability.enable_fades = true,
+        .capability.fades_ms = TEST_FADE_MS,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 0,
+        .init_status.value = 50,
+    };
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+    uint32_t total_num = 0;
+    uint16_t reference[SIMULATED_CHANNEL_MAX] = { 0 };
+    uint16_t value[SIMULATED_CHANNEL_MAX] = { 0 };
+    lightbulb_fade_stats_t stats = { 0 };
+
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(TEST_FADE_MS + 200));
+
+    // 1. The value written without fade is the one the fade has to end on
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_set_fades_function(false));
+    TEST_ASSERT_EQUAL(ESP_OK, simulated_clear_records());
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_set_hsv(240, 80, 60));
+    vTaskDelay(pdMS_TO_TICKS(50));
+    simulated_final_value(reference, NULL);
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_set_hsv(0, 0, 50));
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    // 2. The same change with fade, run by the fade tick on the host
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_set_fades_function(true));
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_set_fade_time(TEST_FADE_MS));
+    TEST_ASSERT_EQUAL(ESP_OK, simulated_clear_records());
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_set_hsv(240, 80, 60));
+    vTaskDelay(pdMS_TO_TICKS(TEST_FADE_MS + 300));
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_get_fade_stats(&stats));
+    simulated_final_value(value, &total_num);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(reference, value, SIMULATED_CHANNEL_MAX);
+    TEST_ASSERT_EQUAL_UINT32(stats.writes, total_num);
+
+    // 3. The fade is made of several steps spread over the fade time, in time order
+    TEST_ASSERT_EQUAL(ESP_OK, simulated_get_records(&records, &record_num, NULL));
+    TEST_ASSERT_TRUE(record_num > 2);
+    for (uint32_t i = 1; i < record_num; i++) {
+        TEST_ASSERT_TRUE(records[i].time_us >= records[i - 1].time_us);
+    }
+    int64_t duration_ms = (records[record_num - 1].time_us - records[0].time_us) / 1000;
+    TEST_ASSERT_TRUE(duration_ms >= TEST_FADE_MS / 2);
+    TEST_ASSERT_TRUE(duration_ms <= TEST_FADE_MS + 100);
+
+    TEST_ASSERT_EQUAL(ESP_OK, lightbulb_deinit());
+}
@@ -0,0 +1,94 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <unity.h>
+
+#include "ws2812_encode.h"
+
+#ifndef BIT
+#define BIT(nr)                     (1UL << (nr))
+#endif
+
+/* 300 LEDs like the encoding benchmark, plus 3 so the frame ends with a partial 4-LED block */
+#define TEST_LED_NUM                (303)
+
+/**
+ * @brief Bit by bit encoder of the driver before the lookup table, kept verbatim as the reference
+ *
+ */
+static void set_data_bit(uint8_t data, uint8_t *buf)
+{
+    *(buf + 2) |= data & BIT(0) ? BIT(2) | BIT(1) : BIT(2);
+    *(buf + 2) |= data & BIT(1) ? BIT(5) | BIT(4) : BIT(5);
+    *(buf + 2) |= data & BIT(2) ? BIT(7) : 0x00;
+    *(buf + 1) |= data & BIT(2) ? BIT(0) : BIT(0);
+    *(buf + 1) |= data & BIT(3) ? BIT(3) | BIT(2) : BIT(3);
+    *(buf + 1) |= data & BIT(4) ? BIT(6) | BIT(5) : BIT(6);
+    *(buf + 0) |= data & BIT(5) ? BIT(1) | BIT(0) : BIT(1);
+    *(buf + 0) |= data & BIT(6) ? BIT(4) | BIT(3) : BIT(4);
+    *(buf + 0) |= data & BIT(7) ? BIT(7) | BIT(6) : BIT(7);
+}
+
+static void generate_data(uint32_t index, uint8_t red, uint8_t green, uint8_t blue, uint8_t *out_buf)
+{
+    memset(out_buf + (index) * WS2812_LED_BUF, 0, WS2812_LED_BUF);
+    set_data_bit(green, out_buf + (index) * WS2812_LED_BUF);
+    set_data_bit(red, out_buf + (index) * WS2812_LED_BUF + 3);
+    set_data_bit(blue, out_buf + (index) * WS2812_LED_BUF + 6);
+}
+
+void test_ws2812_encoder(void)
+{
+    /* Word aligned, ws2812_encode_fill() writes 32-bit words like into the DMA buffer */
+    static uint32_t frame[(TEST_LED_NUM * WS2812_LED_BUF + 3) / 4];
+    static uint32_t ref_frame[(TEST_LED_NUM * WS2812_LED_BUF + 3) / 4];
+    uint8_t led[WS2812_LED_BUF], ref[WS2812_LED_BUF];
+
+    // 1. Every byte in every color slot, the lookup table against the bit by bit encoder
+    for (int value = 0; value < 256; value++) {
+        ws2812_encode_led(led, value, 0, 0);
+        generate_data(0, value, 0, 0, ref);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(ref, led, WS2812_LED_BUF);
+        ws2812_encode_led(led, 0, value, 0);
+        generate_data(0, 0, value, 0, ref);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(ref, led, WS2812_LED_BUF);
+        ws2812_encode_led(led, 0, 0, value);
+        generate_data(0, 0, 0, value, ref);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(ref, led, WS2812_LED_BUF);
+    }
+
+    // 2. Whole frames of one color, every LED count up to TEST_LED_NUM covers each partial block
+    for (uint32_t led_num = 1; led_num <= TEST_LED_NUM; led_num++) {
+        uint8_t red = rand(), green = rand(), blue = rand();
+        memset(frame, 0xA5, sizeof(frame));
+        memset(ref_frame, 0xA5, sizeof(ref_frame));
+        ws2812_encode_fill((uint8_t *)frame, led_num, red, green, blue);
+        for (uint32_t i = 0; i < led_num; i++) {
+            generate_data(i, red, green, blue, (uint8_t *)ref_frame);
+        }
+        // The bytes after the last LED must be left untouched
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(ref_frame, frame, sizeof(frame));
+    }
+
+    // 3. A frame of different pixels, as ws2812_commit() encodes it
+    for (uint32_t i = 0; i < TEST_LED_NUM; i++) {
+        uint8_t red = rand(), green = rand(), blue = rand();
+        ws2812_encode_led((uint8_t *)frame + i * WS2812_LED_BUF, red, green, blue);
+        generate_data(i, red, green, blue, (uint8_t *)ref_frame);
+    }
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(ref_frame, frame, TEST_LED_NUM * WS2812_LED_BUF);
+}
@@ -19,7 +19,12 @@
 #include <freertos/semphr.h>
 #include "freertos/timers.h"
 
+#if CONFIG_IDF_TARGET_LINUX
+/* The linux target has no GPIO, pins are only carried through the configuration */
+typedef int gpio_num_t;
+#else
 #include <hal/gpio_hal.h>
+#endif
 #include <esp_log.h>
 
 #ifdef CONFIG_ENABLE_PWM_DRIVER
@@ -54,6 +59,10 @@
 #include "kp18058.h"
 #endif
 
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+#include "simulated.h"
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -79,6 +88,9 @@ typedef enum {
     /* Single Bus */
     DRIVER_WS2812,
 
+    /* Host, records the writes in memory */
+    DRIVER_SIMULATED,
+
     DRIVER_SELECT_MAX,
 } lightbulb_driver_t;
 
@@ -123,7 +135,7 @@ typedef enum {
  * @brief Balance coefficient
  * @note This coefficient will be applied to the last processed data.
  *       Usually used for trimming current or for color calibration.
- *       Set the range is 0.5-1.0, if not set the default is 1.0.
+ *       Set the range is 0.5-1.0, if not set the default is 1.0, a coefficient out of range is rejected.
  *
  */
 typedef struct {
@@ -196,6 +208,39 @@ typedef struct {
     uint8_t brightness;         // range: 0-100
 } lightbulb_status_t;
 
+/**
+ * @brief Status journal statistics, see CONFIG_LB_STATUS_USE_JOURNAL
+ *
+ */
+typedef struct {
+    uint32_t records;           // Records appended, a status equal to the stored one is not written
+    uint32_t bytes;             // Bytes written, sector headers included
+    uint32_t erases;            // Flash sectors erased
+    uint32_t last_write_us;     // Duration of the last append, sector erase included
+    uint32_t max_write_us;      // Longest append since the journal was opened
+} lightbulb_status_journal_stats_t;
+
+/**
+ * @brief Where lightbulb_status_fast_restore() found the status
+ *
+ */
+typedef enum {
+    STATUS_SOURCE_NONE = 0,     // Nothing stored, the application default is used
+    STATUS_SOURCE_RTC_MEM,      // Status kept in RTC memory across a soft reset
+    STATUS_SOURCE_JOURNAL,      // Status journal partition, see CONFIG_LB_STATUS_USE_JOURNAL
+} lightbulb_status_source_t;
+
+/**
+ * @brief Boot-to-light latency, all times are counted from the chip boot
+ *
+ */
+typedef struct {
+    lightbulb_status_source_t source;   // Where the status was restored from
+    uint32_t restore_start_us;          // lightbulb_status_fast_restore() was called
+    uint32_t restore_us;                // Time spent reading the status
+    uint32_t light_on_us;               // The first lightbulb_init() wrote the status to the driver, 0 if the bulb stays off
+} lightbulb_boot_stats_t;
+
 /**
  * @brief Output limit or gain without changing color
  *
@@ -230,6 +275,27 @@ typedef struct {
     uint16_t max; // Maximum color temperature value, default is 7000 k
 } lightbulb_cct_kelvin_range_t;
 
+/**
+ * @brief Shape of a fade from the current output to the target
+ *
+ */
+typedef enum {
+    FADE_CURVE_LINEAR = 0,      // Same output step on every tick
+    FADE_CURVE_CIE_LSTAR,       // Same step of perceived lightness (CIE L*) on every tick, avoids front-loading the change
+    FADE_CURVE_EASE_IN_OUT,     // Starts and ends slowly
+    FADE_CURVE_CUSTOM,          // Curve set by lightbulb_set_custom_fade_curve(), linear if none is set
+    FADE_CURVE_MAX,
+} lightbulb_fade_curve_t;
+
+/**
+ * @brief Custom fade curve
+ * @note Sampled a few times when a fade is armed, never on the fade tick.
+ *
+ * @param progress Elapsed part of the fade, range: 0-1.0
+ * @return Part of the change applied at this point, 0 at the start and 1.0 at the end
+ */
+typedef float (*lightbulb_fade_curve_cb_t)(float progress);
+
 /**
  * @brief Function pointers to store lightbulb status
  *
@@ -253,6 +319,7 @@ typedef struct {
     lightbulb_status_storage_cb_t storage_cb; // This callback function will be called when the lightbulb status starts to be stored.
     hardware_monitor_user_cb_t monitor_cb;    // This callback function will be called when there is a problem with the underlying hardware,
                                               // and if it returns true then subsequent communication will be aborted.
+    lightbulb_fade_curve_t fade_curve;        // Fade curve of the set APIs that do not take one, default is linear.
     bool enable_fades : 1;                    // Color switching uses fade effects instead of direct rapid changes.
     bool enable_lowpower : 1;                 // Low-power regulation with lights off.
     bool enable_status_storage : 1;           // Store lightbulb state to nvs.
@@ -306,6 +373,9 @@ typedef struct {
 #endif
 #ifdef CONFIG_ENABLE_WS2812_DRIVER
         driver_ws2812_t ws2812;
+#endif
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+        driver_simulated_t simulated;
 #endif
     } driver_conf;
 
@@ -346,7 +416,7 @@ typedef struct {
     uint16_t cct;
     uint8_t min_brightness;
     uint8_t max_brightness;
-    uint16_t effect_cycle_ms;
+    uint16_t effect_cycle_ms;       // range: greater than 24
 
     /*
      * If total_ms > 0 will enable auto-stop timer.
@@ -362,6 +432,58 @@ typedef struct {
     bool interrupt_forbidden;
 } lightbulb_effect_config_t;
 
+/**
+ * @brief One step of a timeline effect
+ *
+ */
+typedef struct {
+    lightbulb_works_mode_t mode;    // WORK_COLOR uses hue, saturation and value, WORK_WHITE uses cct and brightness
+    uint16_t hue;                   // range: 0-360
+    uint8_t saturation;             // range: 0-100
+    uint8_t value;                  // range: 0-100
+    uint16_t cct;                   // range: 0-100 or kelvin
+    uint8_t brightness;             // range: 0-100
+    uint16_t fade_ms;               // Fade from the previous keyframe, 0 jumps to this one
+    lightbulb_fade_curve_t curve;   // Curve of the fade
+    uint16_t hold_ms;               // Time the keyframe is kept after the fade
+    uint8_t loop_count;             // After the hold, go back to keyframe loop_to this many more times, 0 for no loop
+    uint8_t loop_to;                // Index of the keyframe to go back to, not after this one
+} lightbulb_keyframe_t;
+
+/**
+ * @brief Timeline effect configuration options
+ *
+ */
+typedef struct {
+    const lightbulb_keyframe_t *keyframes;
+    uint8_t keyframe_num;           // range: 1-LIGHTBULB_TIMELINE_MAX_KEYFRAMES
+    uint8_t repeat;                 // Plays of the whole timeline, 0 loops forever. A looped part must take 12ms at least
+    int total_ms;                   // Same as lightbulb_effect_config_t
+    void(*user_cb)(void);           // Called when the timeline ends or total_ms elapses
+    bool interrupt_forbidden;       // Same as lightbulb_effect_config_t
+} lightbulb_timeline_config_t;
+
+#define LIGHTBULB_TIMELINE_MAX_KEYFRAMES            (32)
+
+/**
+ * @brief Fade statistics, counted from the last new target
+ * @note The fade tick only wakes up when an output value changes, so slow fades need far fewer ticks than their duration suggests.
+ *
+ */
+typedef struct {
+    uint32_t ticks; // Wake-ups of the fade tick
+    uint32_t writes; // Writes issued to the driver, a write covering several channels in one frame counts once
+    uint32_t busy_us; // Time spent in the fade tick, including the driver writes
+    uint32_t hw_fades; // Channel fades handed whole to the hardware, see CONFIG_PWM_HW_FADE_OFFLOAD
+    uint32_t hw_fade_us; // Time those fades ran in the hardware with no fade tick, added when they end or are interrupted
+} lightbulb_fade_stats_t;
+
+/**
+ * @brief Handle of a lightbulb instance created by lightbulb_create()
+ *
+ */
+typedef struct lightbulb_obj_s *lightbulb_handle_t;
+
 /**
  * @brief Initialize the lightbulb
  *
@@ -377,6 +499,28 @@ esp_err_t lightbulb_init(lightbulb_config_t *config);
  */
 esp_err_t lightbulb_deinit(void);
 
+/**
+ * @brief Create another lightbulb instance, such as a PWM zone next to an IIC zone
+ *
+ * @note All instances share one fade tick task and timer. Each driver can only be used by one instance,
+ * and only one instance can use an IIC dimming chip. The status storage and the fast restore belong to the
+ * instance of lightbulb_init(), other instances only call the `storage_cb` of their capability.
+ *
+ * @param config Configuration parameters
+ * @param handle Output, the handle of the new instance
+ * @return esp_err_t
+ *      - ESP_ERR_INVALID_STATE The driver is used by another instance
+ */
+esp_err_t lightbulb_create(lightbulb_config_t *config, lightbulb_handle_t *handle);
+
+/**
+ * @brief Delete an instance created by lightbulb_create()
+ *
+ * @param handle Instance handle
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_delete(lightbulb_handle_t handle);
+
 /**
  * @brief Set lightbulb fade time
  *
@@ -385,6 +529,24 @@ esp_err_t lightbulb_deinit(void);
  */
 esp_err_t lightbulb_set_fade_time(uint32_t fades_ms);
 
+/**
+ * @brief Update the white balance coefficients used for color output
+ *
+ * @note The RGB output tables are rebuilt, the new coefficients take effect from the next color change.
+ *
+ * @param balance Balance coefficients, range: 0.5-1.0
+ * @return esp_err_t ESP_ERR_INVALID_ARG if a coefficient is out of range
+ */
+esp_err_t lightbulb_set_balance_coefficient(lightbulb_custom_balance_coefficient_t *balance);
+
+/**
+ * @brief Get the number of fade ticks and driver writes used since the last new target
+ *
+ * @param stats Output statistics
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_get_fade_stats(lightbulb_fade_stats_t *stats);
+
 /**
  * @brief Enable/Disable the lightbulb fade function
  *
@@ -450,9 +612,10 @@ esp_err_t lightbulb_rgb2hsv(uint16_t red, uint16_t green, uint16_t blue, uint16_
  * @brief Convert xyY model to RGB model
  * @note Refer: https://www.easyrgb.com/en/convert.php#inputFORM
  *              https://www.easyrgb.com/en/math.php
+ *       Computed in fixed point, the gamma curve is a lookup table
  * 
  * @param x range: 0-1.0
- * @param y range: 0-1.0
+ * @param y range: (0-1.0]
  * @param Y range: 0-100.0
  * @param red range: 0-255
  * @param green range: 0-255
@@ -463,6 +626,7 @@ esp_err_t lightbulb_xyy2rgb(float x, float y, float Y, uint8_t *red, uint8_t *gr
 
 /**
  * @brief Convert RGB model to xyY model
+ * @note Black has no chromaticity, x and y are reported as 0
  * 
  * @param red range: 0-255
  * @param green range: 0-255
@@ -538,7 +702,7 @@ esp_err_t lightbulb_set_brightness(uint8_t brightness);
  *            The grayscale will be recalculated in lightbulb, so we cannot directly operate the underlying driver through the xyY interface.
  * 
  * @param x range: 0-1.0
- * @param y range: 0-1.0
+ * @param y range: greater than 0, up to 1.0
  * @param Y range: 0-100.0
  * @return esp_err_t 
  */
@@ -563,6 +727,57 @@ esp_err_t lightbulb_set_hsv(uint16_t hue, uint8_t saturation, uint8_t value);
  */
 esp_err_t lightbulb_set_cctb(uint16_t cct, uint8_t brightness);
 
+/**
+ * @brief Set hsv with the given fade curve
+ *
+ * @param hue range: 0-360
+ * @param saturation range: 0-100
+ * @param value range: 0-100
+ * @param curve Fade curve of this change
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_set_hsv_with_curve(uint16_t hue, uint8_t saturation, uint8_t value, lightbulb_fade_curve_t curve);
+
+/**
+ * @brief Set cct and brightness with the given fade curve
+ * @note Supports use percentage or Kelvin
+ * @param cct range: 0-100 or 2200-7000k
+ * @param brightness range: 0-100
+ * @param curve Fade curve of this change
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_set_cctb_with_curve(uint16_t cct, uint8_t brightness, lightbulb_fade_curve_t curve);
+
+/**
+ * @brief Set the curve used by FADE_CURVE_CUSTOM
+ *
+ * @param curve Custom curve, NULL makes FADE_CURVE_CUSTOM linear
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_set_custom_fade_curve(lightbulb_fade_curve_cb_t curve);
+
+/**
+ * @brief Start deferring the color and white changes
+ *
+ * @note Until the matching lightbulb_commit(), lightbulb_set_hsv(), lightbulb_set_cctb(), lightbulb_set_switch() and the
+ * single attribute setters only check and save the new status, the output is left untouched.
+ * Calls can be nested, the output is updated by the outermost lightbulb_commit().
+ *
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_begin(void);
+
+/**
+ * @brief Write the changes saved since lightbulb_begin()
+ *
+ * @note All deferred changes are merged into one conversion and one fade, the fade curve of the last change is used.
+ *       The final on/off state decides whether the saved color or white is written or the output is turned off,
+ *       a light that was already off when the transaction began is left untouched.
+ *
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_commit(void);
+
 /**
  * @brief Set on/off
  *
@@ -638,6 +853,7 @@ esp_err_t lightbulb_get_all_detail(lightbulb_status_t *status);
 
 /**
  * @brief Get lightbulb status from nvs
+ * @note With CONFIG_LB_STATUS_USE_JOURNAL, the status is read from the journal partition, nvs is only read if the journal is empty.
  *
  * @param value Stored state
  * @return esp_err_t
@@ -646,6 +862,7 @@ esp_err_t lightbulb_status_get_from_nvs(lightbulb_status_t *value);
 
 /**
  * @brief Store lightbulb state to nvs.
+ * @note With CONFIG_LB_STATUS_USE_JOURNAL, only the changed fields are appended to the journal partition.
  *
  * @param value Current running state
  * @return esp_err_t
@@ -659,6 +876,34 @@ esp_err_t lightbulb_status_set_to_nvs(const lightbulb_status_t *value);
  */
 esp_err_t lightbulb_status_erase_nvs_storage(void);
 
+/**
+ * @brief Get the status journal statistics
+ *
+ * @param stats Output statistics since the journal was opened
+ * @return esp_err_t ESP_ERR_NOT_SUPPORTED if the journal is disabled, ESP_ERR_NOT_FOUND if there is no journal partition
+ */
+esp_err_t lightbulb_get_status_journal_stats(lightbulb_status_journal_stats_t *stats);
+
+/**
+ * @brief Read the last status without nvs, so the bulb can be lit before nvs_flash_init() and Wi-Fi
+ *
+ * @note The status kept in RTC memory is used after a soft reset, it is updated on every change and so is newer than the stored one.
+ *       Otherwise the status journal partition is read. Call it first in app_main() and pass the result to lightbulb_init() as init_status.
+ *       ESP_ERR_NOT_FOUND means nothing was found this way, lightbulb_status_get_from_nvs() can still be used after nvs_flash_init().
+ *
+ * @param value Restored status, not changed if nothing is found
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_status_fast_restore(lightbulb_status_t *value);
+
+/**
+ * @brief Get the boot-to-light latency of this boot
+ *
+ * @param stats Output statistics
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_get_boot_stats(lightbulb_boot_stats_t *stats);
+
 /**
  * @brief Start some blinking/breathing effects
  *
@@ -667,6 +912,18 @@ esp_err_t lightbulb_status_erase_nvs_storage(void);
  */
 esp_err_t lightbulb_basic_effect_start(lightbulb_effect_config_t *config);
 
+/**
+ * @brief Start a timeline effect, a sequence of keyframes with their own fades and holds
+ *
+ * @note The keyframes are converted to output values once and stored as compact bytecode, which the fade tick evaluates.
+ *       No timer is used besides the fade tick, which only wakes up when an output changes or a step ends.
+ *       lightbulb_basic_effect_stop() and lightbulb_basic_effect_stop_and_restore() also stop a timeline effect.
+ *
+ * @param config Timeline configuration
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_timeline_effect_start(const lightbulb_timeline_config_t *config);
+
 /**
  * @brief Stop the effect in progress and keep the current lighting output
  *
@@ -681,6 +938,341 @@ esp_err_t lightbulb_basic_effect_stop(void);
  */
 esp_err_t lightbulb_basic_effect_stop_and_restore(void);
 
+/**
+ * @brief Set xyY
+ * @note The xyY model cannot fully correspond to the HSV model, see lightbulb_set_xyy().
+ *
+ * @param handle Instance handle
+ * @param x range: 0-1.0
+ * @param y range: greater than 0, up to 1.0
+ * @param Y range: 0-100.0
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_xyy(lightbulb_handle_t handle, float x, float y, float Y);
+
+/**
+ * @brief Convert CCT kelvin to percentage
+ *
+ * @param handle Instance handle
+ * @param kelvin default range: 2200k - 7000k
+ * @param percentage range: 0 - 100
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_kelvin2percentage(lightbulb_handle_t handle, uint16_t kelvin, uint8_t *percentage);
+
+/**
+ * @brief Convert percentage to kelvin
+ *
+ * @param handle Instance handle
+ * @param percentage range: 0 - 100
+ * @param kelvin default range: 2200k - 7000k
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_percentage2kelvin(lightbulb_handle_t handle, uint8_t percentage, uint16_t *kelvin);
+
+/**
+ * @brief Set hue
+ *
+ * @param handle Instance handle
+ * @param hue range: 0-360
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_hue(lightbulb_handle_t handle, uint16_t hue);
+
+/**
+ * @brief Set saturation
+ *
+ * @param handle Instance handle
+ * @param saturation range: 0-100
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_saturation(lightbulb_handle_t handle, uint8_t saturation);
+
+/**
+ * @brief Set value
+ *
+ * @param handle Instance handle
+ * @param value range: 0-100
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_value(lightbulb_handle_t handle, uint8_t value);
+
+/**
+ * @brief Set color temperature (CCT)
+ * @note Supports use percentage or Kelvin values
+ *
+ * @param handle Instance handle
+ * @param cct range: 0-100 or 2200-7000
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_cct(lightbulb_handle_t handle, uint16_t cct);
+
+/**
+ * @brief Set brightness
+ *
+ * @param handle Instance handle
+ * @param brightness
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_brightness(lightbulb_handle_t handle, uint8_t brightness);
+
+/**
+ * @brief Set hsv
+ *
+ * @param handle Instance handle
+ * @param hue range: 0-360
+ * @param saturation range: 0-100
+ * @param value range: 0-100
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_hsv(lightbulb_handle_t handle, uint16_t hue, uint8_t saturation, uint8_t value);
+
+/**
+ * @brief Set hsv with the given fade curve
+ *
+ * @param handle Instance handle
+ * @param hue range: 0-360
+ * @param saturation range: 0-100
+ * @param value range: 0-100
+ * @param curve Fade curve of this change
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_hsv_with_curve(lightbulb_handle_t handle, uint16_t hue, uint8_t saturation, uint8_t value, lightbulb_fade_curve_t curve);
+
+/**
+ * @brief Set cct and brightness
+ * @note Supports use percentage or Kelvin
+ *
+ * @param handle Instance handle
+ * @param cct range: 0-100 or 2200-7000k
+ * @param brightness range: 0-100
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_cctb(lightbulb_handle_t handle, uint16_t cct, uint8_t brightness);
+
+/**
+ * @brief Set cct and brightness with the given fade curve
+ * @note Supports use percentage or Kelvin
+ *
+ * @param handle Instance handle
+ * @param cct range: 0-100 or 2200-7000k
+ * @param brightness range: 0-100
+ * @param curve Fade curve of this change
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_cctb_with_curve(lightbulb_handle_t handle, uint16_t cct, uint8_t brightness, lightbulb_fade_curve_t curve);
+
+/**
+ * @brief Start deferring the color and white changes
+ * @note Until the matching lightbulb_handle_commit(), the setters of this instance only check and save the new status,
+ *       see lightbulb_begin().
+ *
+ * @param handle Instance handle
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_begin(lightbulb_handle_t handle);
+
+/**
+ * @brief Write the changes saved since lightbulb_handle_begin()
+ * @note All deferred changes of this instance are merged into one fade, see lightbulb_commit().
+ *
+ * @param handle Instance handle
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_commit(lightbulb_handle_t handle);
+
+/**
+ * @brief Set on/off
+ *
+ * @param handle Instance handle
+ * @param status on/off status
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_switch(lightbulb_handle_t handle, bool status);
+
+/**
+ * @brief Get hue
+ *
+ * @param handle Instance handle
+ * @return int16_t
+ */
+int16_t lightbulb_handle_get_hue(lightbulb_handle_t handle);
+
+/**
+ * @brief Get saturation
+ *
+ * @param handle Instance handle
+ * @return int8_t
+ */
+int8_t lightbulb_handle_get_saturation(lightbulb_handle_t handle);
+
+/**
+ * @brief Get value
+ *
+ * @param handle Instance handle
+ * @return int8_t
+ */
+int8_t lightbulb_handle_get_value(lightbulb_handle_t handle);
+
+/**
+ * @brief Get CCT percentage
+ *
+ * @param handle Instance handle
+ * @return int8_t
+ */
+int8_t lightbulb_handle_get_cct_percentage(lightbulb_handle_t handle);
+
+/**
+ * @brief Get CCT kelvin
+ *
+ * @param handle Instance handle
+ * @return int16_t
+ */
+int16_t lightbulb_handle_get_cct_kelvin(lightbulb_handle_t handle);
+
+/**
+ * @brief Get brightness
+ *
+ * @param handle Instance handle
+ * @return int8_t
+ */
+int8_t lightbulb_handle_get_brightness(lightbulb_handle_t handle);
+
+/**
+ * @brief Get all status
+ *
+ * @param handle Instance handle
+ * @param status
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_get_all_detail(lightbulb_handle_t handle, lightbulb_status_t *status);
+
+/**
+ * @brief Get on/off status
+ *
+ * @param handle Instance handle
+ * @return true on
+ * @return false off
+ */
+bool lightbulb_handle_get_switch(lightbulb_handle_t handle);
+
+/**
+ * @brief Enable/Disable the lightbulb fade function
+ *
+ * @param handle Instance handle
+ * @param is_enable Enable/Disable
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_fades_function(lightbulb_handle_t handle, bool is_enable);
+
+/**
+ * @brief Enable/Disable the lightbulb storage function
+ *
+ * @param handle Instance handle
+ * @param is_enable Enable/Disable
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_storage_function(lightbulb_handle_t handle, bool is_enable);
+
+/**
+ * @brief Set lightbulb fade time
+ *
+ * @param handle Instance handle
+ * @param fades_ms range: 100ms - 3000ms
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_fade_time(lightbulb_handle_t handle, uint32_t fades_ms);
+
+/**
+ * @brief Update the white balance coefficients used for color output
+ * @note The RGB output tables of this instance are rebuilt, the new coefficients take effect from its next color change.
+ *
+ * @param handle Instance handle
+ * @param balance Balance coefficients, range: 0.5-1.0
+ * @return esp_err_t ESP_ERR_INVALID_ARG if a coefficient is out of range
+ */
+esp_err_t lightbulb_handle_set_balance_coefficient(lightbulb_handle_t handle, lightbulb_custom_balance_coefficient_t *balance);
+
+/**
+ * @brief Set the curve used by FADE_CURVE_CUSTOM
+ *
+ * @param handle Instance handle
+ * @param curve Custom curve, NULL makes FADE_CURVE_CUSTOM linear
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_set_custom_fade_curve(lightbulb_handle_t handle, lightbulb_fade_curve_cb_t curve);
+
+/**
+ * @brief Get the number of fade ticks and driver writes used since the last new target
+ *
+ * @param handle Instance handle
+ * @param stats Output statistics
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_get_fade_stats(lightbulb_handle_t handle, lightbulb_fade_stats_t *stats);
+
+/**
+ * @brief Get lightbulb fade function enabled status
+ *
+ * @param handle Instance handle
+ * @return true Enabled
+ * @return false Disabled
+ */
+bool lightbulb_handle_get_fades_function_status(lightbulb_handle_t handle);
+
+/**
+ * @brief Get work mode
+ *
+ * @param handle Instance handle
+ * @return lightbulb_works_mode_t
+ */
+lightbulb_works_mode_t lightbulb_handle_get_mode(lightbulb_handle_t handle);
+
+/**
+ * @brief Re-update the lightbulb status variable
+ *
+ * @param handle Instance handle
+ * @param new_status new status
+ * @param trigger If set to true, then it will be updated immediately
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_update_status_variable(lightbulb_handle_t handle, lightbulb_status_t *new_status, bool trigger);
+
+/**
+ * @brief Start some blinking/breathing effects
+ *
+ * @param handle Instance handle
+ * @param config
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_basic_effect_start(lightbulb_handle_t handle, lightbulb_effect_config_t *config);
+
+/**
+ * @brief Start a timeline effect, a sequence of keyframes with their own fades and holds
+ * @note lightbulb_handle_basic_effect_stop() and lightbulb_handle_basic_effect_stop_and_restore() also stop a timeline effect.
+ *
+ * @param handle Instance handle
+ * @param config Timeline configuration
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_timeline_effect_start(lightbulb_handle_t handle, const lightbulb_timeline_config_t *config);
+
+/**
+ * @brief Stop the effect in progress and keep the current lighting output
+ *
+ * @param handle Instance handle
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_basic_effect_stop(lightbulb_handle_t handle);
+
+/**
+ * @brief Stop the effect in progress and restore the previous lighting output
+ *
+ * @param handle Instance handle
+ * @return esp_err_t
+ */
+esp_err_t lightbulb_handle_basic_effect_stop_and_restore(lightbulb_handle_t handle);
+
 /**
  * @brief Used to test lightbulb hardware functionality
  *
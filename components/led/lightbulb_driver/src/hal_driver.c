@@ -30,6 +30,14 @@
 #endif
 #endif
 
+#if CONFIG_PWM_HW_FADE_OFFLOAD
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+#define FADE_HW_OFFLOAD 1
+#else
+#warning The current IDF version does not support stopping a hardware fade, whole fades are not offloaded
+#endif
+#endif
+
 static const char *TAG = "hal_manage";
 
 #if CONFIG_ENABLE_LIGHTBULB_DEBUG_LOG_OUTPUT
@@ -56,13 +64,19 @@ static void gpio_reverse(int gpio_num)
 }
 #endif
 
-#define CHANGE_RATE_MS                          (12)
-#define FADE_CB_CHECK_MS                        (CHANGE_RATE_MS * 2)
+#define CHANGE_RATE_MS                          (TIMELINE_TICK_MS)
 #define HARDWARE_RETAIN_RATE_MS                 (CHANGE_RATE_MS)
 #define MAX_TABLE_SIZE                          (256)
 #define DEFAULT_GAMMA_CURVE                     (1.0)
+#define MIN_BALANCE_COE                         (0.5f)
+#define MAX_BALANCE_COE                         (1.0f)
 #define HAL_OUT_MAX_CHANNEL                     (5)
 #define ERROR_COUNT_THRESHOLD                   (1)
+#define FADE_REQUEST_QUEUE_SIZE                 (8)
+#define FADE_MAX_SLEEP_TICKS                    (250)
+#define FADE_CURVE_SEGMENTS                     (16)
+#define TIMELINE_MAX_OPS_PER_STEP               (64)
+#define FADE_HW_OFFLOAD_MIN_TICKS               (2)
 
 typedef esp_err_t (*x_init_t)(void *config);
 typedef esp_err_t (*x_regist_channel_t)(int channel, int value);
@@ -75,6 +89,10 @@ typedef esp_err_t (*x_set_hw_fade_t)(int channel, uint16_t value, int fade_ms);
 typedef esp_err_t (*x_set_init_mode_t)(bool set_wy_mode);
 typedef esp_err_t (*x_deinit_t)(void);
 typedef esp_err_t (*x_set_sleep_t)(bool enable_sleep);
+typedef esp_err_t (*x_stop_hw_fade_t)(int channel, uint16_t *value);
+typedef bool (*x_hw_fade_end_cb_t)(int channel, void *priv);
+typedef esp_err_t (*x_set_fade_active_t)(bool is_active);
+typedef esp_err_t (*x_set_hw_fade_end_cb_t)(x_hw_fade_end_cb_t cb, void *priv);
 
 typedef struct {
     lightbulb_driver_t type;
@@ -90,6 +108,9 @@ typedef struct {
     x_set_hw_fade_t set_hw_fade;
     x_set_init_mode_t set_init_mode;
     x_set_sleep_t set_sleep_status;
+    x_stop_hw_fade_t stop_hw_fade;
+    x_set_hw_fade_end_cb_t set_hw_fade_end_cb;
+    x_set_fade_active_t set_fade_active;
     uint8_t driver_color_bit_depth;
     uint16_t hardware_allow_max_input_value;
     /* Supports all channels output at the same time */
@@ -97,37 +118,150 @@ typedef struct {
     uint8_t channel_num;
 } hal_obj_t;
 
+#if CONFIG_LB_FADE_USE_FIXED_POINT
+/**
+ * @brief Fade values are kept in Q16.16 fixed-point format
+ *
+ * @note The largest driver input is 4096, so the integer part never exceeds 15 bits.
+ * Truncating a Q16.16 value gives the same integer as truncating the float it was built from,
+ * so the value written at the end of a fade is identical to the floating-point engine.
+ */
+typedef int32_t fade_value_t;
+typedef int32_t fade_count_t;
+#define FADE_FRACTION_BITS                      (16)
+#define FADE_VALUE_FROM_FLOAT(x)                ((fade_value_t)((x) * (1 << FADE_FRACTION_BITS)))
+#define FADE_VALUE_TO_INT(x)                    ((int)((x) >> FADE_FRACTION_BITS))
+#define FADE_VALUE_TO_FLOAT(x)                  ((float)(x) / (1 << FADE_FRACTION_BITS))
+#define FADE_VALUE_ABS(x)                       (((x) < 0) ? -(x) : (x))
+#else
+typedef float fade_value_t;
+typedef float fade_count_t;
+#define FADE_VALUE_FROM_FLOAT(x)                (x)
+#define FADE_VALUE_TO_INT(x)                    ((int)(x))
+#define FADE_VALUE_TO_FLOAT(x)                  (x)
+#define FADE_VALUE_ABS(x)                       fabsf(x)
+#endif
+
 typedef struct {
-    float cur;
-    float final;
-    float step;
-    float cycle;
-    float num;
-    float min;
+    fade_value_t cur;
+    fade_value_t final;
+    fade_value_t step;
+    fade_count_t cycle;
+    fade_count_t num;
+    fade_value_t min;
+    uint16_t curve_ticks; /* only for curved fades, 0 for linear fades */
+    uint16_t curve_tick;
+    uint8_t curve_segment;
 } fade_data_t;
 
+typedef enum {
+    FADE_REQUEST_SET_CHANNEL = 0,
+    FADE_REQUEST_SET_CHANNEL_GROUP,
+    FADE_REQUEST_START_ACTION,
+    FADE_REQUEST_START_GROUP_ACTION,
+    FADE_REQUEST_STOP_ACTION,
+    FADE_REQUEST_START_TIMELINE,
+} fade_request_type_t;
+
+/**
+ * @brief A running timeline, owned by the fade tick once its request is applied
+ *
+ */
+typedef struct {
+    uint8_t *code;
+    uint16_t pc;
+    uint8_t channel_mask;
+    uint8_t loop_count[TIMELINE_MAX_LOOPS];
+    uint32_t step_ticks;        /* ticks left in the current step */
+    uint32_t total_ticks;       /* ticks left before the timeline ends, 0 for no limit */
+    hal_timeline_end_cb_t end_cb;
+    void *end_priv;
+    uint32_t end_arg;
+} timeline_state_t;
+
+/**
+ * @brief A new target posted by an API caller, applied by the fade tick
+ *
+ * @note Single channel requests only use the entry of their channel in value and value_min.
+ */
 typedef struct {
+    fade_request_type_t type;
+    uint8_t channel;
+    uint8_t channel_mask;
+    bool fade_flag;
+    lightbulb_fade_curve_t curve;
+    uint16_t time_ms;
+    uint16_t value[HAL_OUT_MAX_CHANNEL];
+    uint16_t value_min[HAL_OUT_MAX_CHANNEL];
+    timeline_state_t *timeline;
+} fade_request_t;
+
+/**
+ * @brief RGB output tables, the gamma tables with the white balance coefficients already applied
+ *
+ */
+typedef uint16_t rgb_output_table_t[3][MAX_TABLE_SIZE];
+
+typedef struct hal_context_s {
     fade_data_t fade_data[HAL_OUT_MAX_CHANNEL];
+    fade_value_t curve_points[HAL_OUT_MAX_CHANNEL][FADE_CURVE_SEGMENTS + 1];
     hal_obj_t *interface;
     bool use_hw_fade;
-    bool use_balance;
+    bool use_hw_fade_offload;
+    uint8_t hw_fade_mask;       /* channels whose whole fade was handed to the hardware and has not ended yet */
+    int64_t hw_fade_start_us[HAL_OUT_MAX_CHANNEL];
     bool use_common_gamma_table;
-    SemaphoreHandle_t fade_mutex;
+    uint8_t registered_channel_mask;
+    fade_request_t request[FADE_REQUEST_QUEUE_SIZE];
+    uint32_t request_head;
+    uint32_t request_tail;
+    uint16_t output_value[HAL_OUT_MAX_CHANNEL];
+    uint8_t retry_mask;
+    uint32_t sleep_ticks;       /* ticks until this instance needs the fade tick again, 0 when idle */
+    bool fade_active;           /* last fade state reported to the driver */
+    int64_t tick_time_us;
+    int err_count;
+    lightbulb_fade_stats_t fade_stats;
+    timeline_state_t *timeline;
+    uint16_t *rgb_gamma_table_group[4];
+    uint16_t linear_table[MAX_TABLE_SIZE];
+    rgb_output_table_t *rgb_output_table_group;
+    rgb_output_table_t *rgb_output_table;
+    hardware_monitor_user_cb_t monitor_cb;
+    lightbulb_fade_curve_cb_t custom_fade_curve;
+    struct hal_context_s *next;
+} hal_context_t;
+
+/**
+ * @brief Fade tick shared by all HAL instances
+ *
+ * @note Created with the first instance and deleted with the last one. On every wake-up the task runs the instances
+ * that have new requests or reached their next tick, then arms the timer for the earliest next tick.
+ */
+typedef struct {
+    hal_context_t *instances;
+    SemaphoreHandle_t lock;     /* held while the instances are run, added or removed */
+    SemaphoreHandle_t task_exit;
+    TaskHandle_t notify_task;
+    bool running;               /* cleared under the lock to let the task leave its loop */
 #if FADE_TICKS_FROM_GPTIMER
     gptimer_handle_t fade_timer;
-    TaskHandle_t notify_task;
+    bool gptimer_is_enabled;
     bool gptimer_is_active;
 #else
     esp_timer_handle_t fade_timer;
 #endif
-} hal_context_t;
-
-static uint16_t *s_rgb_gamma_table_group[4]     = { NULL };
-uint16_t s_default_linear_table[MAX_TABLE_SIZE] = { 0 };
-static float s_rgb_white_balance_coefficient[3] = { 1.0, 1.0, 1.0 };
-static int s_err_count                          = 0;
-static hardware_monitor_user_cb_t s_user_cb     = NULL;
-static hal_context_t *s_hal_obj                 = NULL;
+} fade_tick_t;
+
+static fade_tick_t *s_fade_tick                 = NULL;
+// Serializes the creation and deletion of s_fade_tick, the mutex is created on first use under the spinlock
+static portMUX_TYPE s_fade_tick_owner_lock      = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t s_fade_tick_owner_mutex_buffer;
+static SemaphoreHandle_t s_fade_tick_owner_mutex = NULL;
+static portMUX_TYPE s_request_lock              = portMUX_INITIALIZER_UNLOCKED;
+#if FADE_HW_OFFLOAD
+static portMUX_TYPE s_hw_fade_lock              = portMUX_INITIALIZER_UNLOCKED;
+#endif
 
 static hal_obj_t s_hal_obj_group[]           = {
 #ifdef CONFIG_ENABLE_PWM_DRIVER
@@ -140,11 +274,19 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = true,
         .init = (x_init_t)pwm_init,
         .set_channel = (x_set_channel_t)pwm_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)pwm_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)pwm_set_cctb_or_cw_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)pwm_set_rgbcctb_or_rgbcw_channel,
         .regist_channel = (x_regist_channel_t)pwm_regist_channel,
         .set_shutdown = (x_set_shutdown_t)pwm_set_shutdown,
         .set_hw_fade = (x_set_hw_fade_t)pwm_set_hw_fade,
         .deinit = (x_deinit_t)pwm_deinit,
         .set_sleep_status = (x_set_sleep_t)pwm_set_sleep,
+        .set_fade_active = (x_set_fade_active_t)pwm_set_fade_active,
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0))
+        .stop_hw_fade = (x_stop_hw_fade_t)pwm_stop_hw_fade,
+        .set_hw_fade_end_cb = (x_set_hw_fade_end_cb_t)pwm_set_fade_end_cb,
+#endif
     },
 #endif
 #ifdef CONFIG_ENABLE_SM2135E_DRIVER
@@ -157,6 +299,8 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = false,
         .init = (x_init_t)sm2135e_init,
         .set_channel = (x_set_channel_t)_sm2135e_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)_sm2135e_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)_sm2135e_set_wy_channel,
         .regist_channel = (x_regist_channel_t)sm2135e_regist_channel,
         .set_shutdown = (x_set_shutdown_t)sm2135e_set_shutdown,
         .deinit = (x_deinit_t)sm2135e_deinit,
@@ -173,6 +317,9 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = true,
         .init = (x_init_t)sm2135eh_init,
         .set_channel = (x_set_channel_t)_sm2135eh_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)_sm2135eh_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)_sm2135eh_set_wy_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)_sm2135eh_set_rgbwy_channel,
         .regist_channel = (x_regist_channel_t)sm2135eh_regist_channel,
         .set_shutdown = (x_set_shutdown_t)sm2135eh_set_shutdown,
         .deinit = (x_deinit_t)sm2135eh_deinit,
@@ -189,6 +336,9 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = true,
         .init = (x_init_t)sm2x35egh_init,
         .set_channel = (x_set_channel_t)sm2x35egh_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)sm2x35egh_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)sm2x35egh_set_cw_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)sm2x35egh_set_rgbcw_channel,
         .regist_channel = (x_regist_channel_t)sm2x35egh_regist_channel,
         .set_shutdown = (x_set_shutdown_t)sm2x35egh_set_shutdown,
         .deinit = (x_deinit_t)sm2x35egh_deinit,
@@ -205,6 +355,9 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = true,
         .init = (x_init_t)sm2x35egh_init,
         .set_channel = (x_set_channel_t)sm2x35egh_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)sm2x35egh_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)sm2x35egh_set_cw_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)sm2x35egh_set_rgbcw_channel,
         .regist_channel = (x_regist_channel_t)sm2x35egh_regist_channel,
         .set_shutdown = (x_set_shutdown_t)sm2x35egh_set_shutdown,
         .deinit = (x_deinit_t)sm2x35egh_deinit,
@@ -221,6 +374,9 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = true,
         .init = (x_init_t)bp5758d_init,
         .set_channel = (x_set_channel_t)bp5758d_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)bp5758d_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)bp5758d_set_cw_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)bp5758d_set_rgbcw_channel,
         .regist_channel = (x_regist_channel_t)bp5758d_regist_channel,
         .set_shutdown = (x_set_shutdown_t)bp5758d_set_shutdown,
         .deinit = (x_deinit_t)bp5758d_deinit,
@@ -237,6 +393,9 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = true,
         .init = (x_init_t)bp1658cj_init,
         .set_channel = (x_set_channel_t)bp1658cj_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)bp1658cj_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)bp1658cj_set_cw_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)bp1658cj_set_rgbcw_channel,
         .regist_channel = (x_regist_channel_t)bp1658cj_regist_channel,
         .set_shutdown = (x_set_shutdown_t)bp1658cj_set_shutdown,
         .deinit = (x_deinit_t)bp1658cj_deinit,
@@ -253,6 +412,9 @@ static hal_obj_t s_hal_obj_group[]           = {
         .all_ch_allow_output = true,
         .init = (x_init_t)kp18058_init,
         .set_channel = (x_set_channel_t)kp18058_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)kp18058_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)kp18058_set_cw_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)kp18058_set_rgbcw_channel,
         .regist_channel = (x_regist_channel_t)kp18058_regist_channel,
         .set_shutdown = (x_set_shutdown_t)kp18058_set_shutdown,
         .deinit = (x_deinit_t)kp18058_deinit,
@@ -271,6 +433,24 @@ static hal_obj_t s_hal_obj_group[]           = {
         .set_rgb_channel = (x_set_rgb_channel_t)_ws2812_set_rgb_channel,
         .deinit = (x_deinit_t)ws2812_deinit,
     },
+#endif
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+    {
+        .type = DRIVER_SIMULATED,
+        .name = "SIMULATED",
+        .driver_color_bit_depth = 12,
+        .channel_num = 5,
+        .hardware_allow_max_input_value = (1 << 12) - 1,
+        .all_ch_allow_output = true,
+        .init = (x_init_t)simulated_init,
+        .set_channel = (x_set_channel_t)simulated_set_channel,
+        .set_rgb_channel = (x_set_rgb_channel_t)simulated_set_rgb_channel,
+        .set_wy_or_ct_channel = (x_set_wy_or_cb_channel_t)simulated_set_wy_channel,
+        .set_rgbwy_or_rgbct_channel = (x_set_rgbwy_or_rgbct_channel_t)simulated_set_rgbwy_channel,
+        .regist_channel = (x_regist_channel_t)simulated_regist_channel,
+        .set_shutdown = (x_set_shutdown_t)simulated_set_shutdown,
+        .deinit = (x_deinit_t)simulated_deinit,
+    },
 #endif
     {
         .type = DRIVER_SELECT_MAX,
@@ -278,42 +458,34 @@ static hal_obj_t s_hal_obj_group[]           = {
 };
 
 #if FADE_TICKS_FROM_GPTIMER
-static void fade_cb(void *priv);
 static IRAM_ATTR bool on_timer_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
 {
+    fade_tick_t *fade_tick = (fade_tick_t *)user_ctx;
     portBASE_TYPE task_woken = pdFALSE;
-    vTaskNotifyGiveFromISR (s_hal_obj->notify_task, &task_woken);
+    vTaskNotifyGiveFromISR (fade_tick->notify_task, &task_woken);
 
     return task_woken == pdTRUE;
 }
-
-static void fade_tick_task(void *arg)
+#else
+static void on_esp_timer_cb(void *arg)
 {
-    while (true) {
-        ulTaskNotifyTake(true, portMAX_DELAY);
-        fade_cb(NULL);
-    }
-    vTaskDelete(NULL);
+    fade_tick_t *fade_tick = (fade_tick_t *)arg;
+    xTaskNotifyGive(fade_tick->notify_task);
 }
 #endif
 
-static float final_processing(uint8_t channel, uint16_t src_value)
+static fade_value_t final_processing(hal_context_t *hal, uint8_t channel, uint16_t src_value)
 {
     if (channel >= CHANNEL_ID_COLD_CCT_WHITE) {
         if (src_value >= MAX_TABLE_SIZE) {
             ESP_LOGE(TAG, "The data is not supported and will be truncated to 255");
             src_value = 255;
         }
-        return s_default_linear_table[src_value];
-    }
-
-    /* Only handle RGB channels */
-    float target_value = src_value;
-    if (s_hal_obj->use_balance) {
-        target_value = s_rgb_white_balance_coefficient[channel] * src_value;
+        return FADE_VALUE_FROM_FLOAT(hal->linear_table[src_value]);
     }
 
-    return target_value;
+    /* RGB channels already carry the white balance from the output tables */
+    return FADE_VALUE_FROM_FLOAT(src_value);
 }
 
 static esp_err_t gamma_table_create(uint16_t *output_gamma_table, uint16_t table_size, float gamma_curve_coefficient, int8_t target_bit_depth)
@@ -337,440 +509,394 @@ static esp_err_t gamma_table_create(uint16_t *output_gamma_table, uint16_t table
     return ESP_OK;
 }
 
-static void force_stop_all_ch(void)
+/**
+ * @brief The coefficients scale the gamma tables down, out of 0.5-1.0 they would overflow or wrap the output tables
+ *
+ */
+static bool balance_coefficient_is_valid(const lightbulb_custom_balance_coefficient_t *balance)
 {
-    s_hal_obj->fade_data[0].num = 0;
-    s_hal_obj->fade_data[1].num = 0;
-    s_hal_obj->fade_data[2].num = 0;
-    s_hal_obj->fade_data[3].num = 0;
-    s_hal_obj->fade_data[4].num = 0;
+    const float balance_coe[3] = { balance->r_balance_coe, balance->g_balance_coe, balance->b_balance_coe };
 
-    s_hal_obj->fade_data[0].cycle = 0;
-    s_hal_obj->fade_data[1].cycle = 0;
-    s_hal_obj->fade_data[2].cycle = 0;
-    s_hal_obj->fade_data[3].cycle = 0;
-    s_hal_obj->fade_data[4].cycle = 0;
+    for (int channel = 0; channel < 3; channel++) {
+        // Negated so that a NaN is rejected too
+        if (!(balance_coe[channel] >= MIN_BALANCE_COE && balance_coe[channel] <= MAX_BALANCE_COE)) {
+            return false;
+        }
+    }
+    return true;
 }
 
-static void cleanup(void)
+/**
+ * @brief Fuse the gamma tables and the white balance coefficients into the RGB output tables
+ *
+ * @note Two copies of the output tables are kept. The copy not in use is rebuilt and then published
+ * with a single pointer store, so a reader never sees a partially written table.
+ */
+static void rgb_output_table_build(hal_context_t *hal, const float balance_coe[3])
 {
-    if (s_rgb_gamma_table_group[0]) {
-        free(s_rgb_gamma_table_group[0]);
-        s_rgb_gamma_table_group[0] = NULL;
+    rgb_output_table_t *next = &hal->rgb_output_table_group[0];
+    if (__atomic_load_n(&hal->rgb_output_table, __ATOMIC_ACQUIRE) == next) {
+        next = &hal->rgb_output_table_group[1];
     }
-    if (s_rgb_gamma_table_group[1]) {
-        free(s_rgb_gamma_table_group[1]);
-        s_rgb_gamma_table_group[1] = NULL;
+
+    for (int channel = 0; channel < 3; channel++) {
+        uint16_t *gamma_table = hal->use_common_gamma_table ? hal->rgb_gamma_table_group[3] : hal->rgb_gamma_table_group[channel];
+        for (int i = 0; i < MAX_TABLE_SIZE; i++) {
+            (*next)[channel][i] = (uint16_t)(balance_coe[channel] * gamma_table[i]);
+        }
     }
-    if (s_rgb_gamma_table_group[2]) {
-        free(s_rgb_gamma_table_group[2]);
-        s_rgb_gamma_table_group[2] = NULL;
+
+    __atomic_store_n(&hal->rgb_output_table, next, __ATOMIC_RELEASE);
+}
+
+static void force_stop_all_ch(hal_context_t *hal)
+{
+    hal->fade_data[0].num = 0;
+    hal->fade_data[1].num = 0;
+    hal->fade_data[2].num = 0;
+    hal->fade_data[3].num = 0;
+    hal->fade_data[4].num = 0;
+
+    hal->fade_data[0].cycle = 0;
+    hal->fade_data[1].cycle = 0;
+    hal->fade_data[2].cycle = 0;
+    hal->fade_data[3].cycle = 0;
+    hal->fade_data[4].cycle = 0;
+}
+
+static void timeline_free(timeline_state_t *timeline)
+{
+    if (timeline) {
+        free(timeline->code);
+        free(timeline);
     }
-    if (s_rgb_gamma_table_group[3]) {
-        free(s_rgb_gamma_table_group[3]);
-        s_rgb_gamma_table_group[3] = NULL;
+}
+
+static void cleanup(hal_context_t *hal)
+{
+    if (hal->rgb_gamma_table_group[0]) {
+        free(hal->rgb_gamma_table_group[0]);
+        hal->rgb_gamma_table_group[0] = NULL;
     }
-    if (s_hal_obj->fade_mutex) {
-        vSemaphoreDelete(s_hal_obj->fade_mutex);
-        s_hal_obj->fade_mutex = NULL;
+    if (hal->rgb_gamma_table_group[1]) {
+        free(hal->rgb_gamma_table_group[1]);
+        hal->rgb_gamma_table_group[1] = NULL;
     }
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (s_hal_obj->fade_timer) {
-        gptimer_disable(s_hal_obj->fade_timer);
-        gptimer_del_timer(s_hal_obj->fade_timer);
+    if (hal->rgb_gamma_table_group[2]) {
+        free(hal->rgb_gamma_table_group[2]);
+        hal->rgb_gamma_table_group[2] = NULL;
     }
-    if (s_hal_obj->notify_task) {
-        vTaskDelete(s_hal_obj->notify_task);
+    if (hal->rgb_gamma_table_group[3]) {
+        free(hal->rgb_gamma_table_group[3]);
+        hal->rgb_gamma_table_group[3] = NULL;
     }
-#else
-    if (s_hal_obj->fade_timer) {
-        esp_timer_delete(s_hal_obj->fade_timer);
-        s_hal_obj->fade_timer = NULL;
+    if (hal->rgb_output_table_group) {
+        hal->rgb_output_table = NULL;
+        free(hal->rgb_output_table_group);
+        hal->rgb_output_table_group = NULL;
     }
-#endif
-    if (s_hal_obj) {
-        free(s_hal_obj);
-        s_hal_obj = NULL;
+    // Timelines are owned by the requests until the fade tick applies them
+    timeline_free(hal->timeline);
+    for (uint32_t i = hal->request_tail; i != hal->request_head; i++) {
+        fade_request_t *request = &hal->request[i % FADE_REQUEST_QUEUE_SIZE];
+        if (request->type == FADE_REQUEST_START_TIMELINE) {
+            timeline_free(request->timeline);
+        }
     }
+    free(hal);
 }
 
 /**
- * @brief fade processing logic
- *
- * @note
- *
- * fade_data[channel].num -> Fade cycle, This value is related to CHANGE_RATE_MS and fade_ms time
- * fade_data[channel].step -> Fade step, < 0 indicates decrement, otherwise increment. The actual meaning is delta.
- * fade_data[channel].cycle -> This value is used for the actions.
- *
- * fade_data[channel].cur -> Current value
- * fade_data[channel].final -> Final value
- * fade_data[channel].min -> Minimum value
- * Final, min, cur are used to define a set of ranges, which will allow grayscale changes in arbitrary ranges, not from 0% to 100%.
+ * @brief Write the current value of all channels updated in this tick
  *
+ * @note The widest interface whose channels are all registered is used, so that every channel changes in the same bus frame.
+ * Channels that are not covered by a group interface are written one by one.
  *
+ * @param update_mask Channels updated in this tick
+ * @return esp_err_t
  */
-static void fade_cb(void *priv)
+static esp_err_t flush_channels(hal_context_t *hal, uint8_t update_mask)
 {
     esp_err_t err = ESP_OK;
-    if (xSemaphoreTake(s_hal_obj->fade_mutex, 0) == pdFALSE) {
-        return;
-    }
-    int idle_channel_num = 0;
-    // 1. Check all channels
-    for (int channel = 0; channel < s_hal_obj->interface->channel_num; channel++) {
-        if (err != ESP_OK) {
-            err = ESP_OK;
-            s_err_count++;
-        } else {
-            s_err_count = 0;
-        }
-        if (s_err_count >= ERROR_COUNT_THRESHOLD) {
-            s_err_count = 0;
-            bool stop_flag = false;
-
-            if (s_user_cb) {
-                stop_flag = s_user_cb();
-            }
-            if (stop_flag == true) {
-                force_stop_all_ch();
-#ifdef FADE_TICKS_FROM_GPTIMER
-                if (s_hal_obj->gptimer_is_active) {
-                    s_hal_obj->gptimer_is_active = false;
-                    gptimer_stop(s_hal_obj->fade_timer);
-                }
-#else
-                esp_timer_stop(s_hal_obj->fade_timer);
-#endif
-                ESP_LOGE(TAG, "Hardware may be unresponsive, fade terminated");
-            }
-            xSemaphoreGive(s_hal_obj->fade_mutex);
-            return;
-        }
-
-        // If this channel needs to be updated
-        if (s_hal_obj->fade_data[channel].num > 0) {
-            s_hal_obj->fade_data[channel].num--;
-
-            // If this channel need to perform fade
-            if (s_hal_obj->fade_data[channel].step) {
-                s_hal_obj->fade_data[channel].cur = s_hal_obj->fade_data[channel].cur + s_hal_obj->fade_data[channel].step;
-
-                // Range check
-                if (s_hal_obj->fade_data[channel].cur > s_hal_obj->fade_data[channel].final && s_hal_obj->fade_data[channel].cycle) {
-                    s_hal_obj->fade_data[channel].cur = s_hal_obj->fade_data[channel].final;
-                }
-                if (s_hal_obj->fade_data[channel].cur < s_hal_obj->fade_data[channel].min && s_hal_obj->fade_data[channel].cycle) {
-                    s_hal_obj->fade_data[channel].cur = s_hal_obj->fade_data[channel].min;
-                }
+    hal_obj_t *interface = hal->interface;
+    uint8_t registered = hal->registered_channel_mask;
+    uint16_t value[HAL_OUT_MAX_CHANNEL] = { 0 };
 
-                // If this channel is not the last step of the fade
-                if (s_hal_obj->fade_data[channel].num != 0) {
-                    if (s_hal_obj->use_hw_fade && s_hal_obj->interface->type == DRIVER_ESP_PWM) {
-                        err |= s_hal_obj->interface->set_hw_fade(channel, s_hal_obj->fade_data[channel].cur, HARDWARE_RETAIN_RATE_MS - 2);
-                    } else if (s_hal_obj->interface->type != DRIVER_WS2812) {
-                        err |= s_hal_obj->interface->set_channel(channel, s_hal_obj->fade_data[channel].cur);
-                    } else {
-                        //Nothing
-                    }
-#if FADE_DEBUG_LOG_OUTPUT
-                    ESP_LOGW(TAG, "1.ch[%d]: cur:%f", channel, s_hal_obj->fade_data[channel].cur);
-                    gpio_reverse(PROBE_GPIO);
-#endif
-                    // Update the final value of this channel, which may be the maximum value or the minimum value, depending on whether it is currently increasing or decreasing.
-                } else {
-                    s_hal_obj->fade_data[channel].cur = s_hal_obj->fade_data[channel].cycle && s_hal_obj->fade_data[channel].step < 0 ? s_hal_obj->fade_data[channel].min : s_hal_obj->fade_data[channel].final;
-                    if (s_hal_obj->use_hw_fade && s_hal_obj->interface->type == DRIVER_ESP_PWM) {
-                        err |= s_hal_obj->interface->set_hw_fade(channel, s_hal_obj->fade_data[channel].cur, HARDWARE_RETAIN_RATE_MS - 2);
-                    } else if (s_hal_obj->interface->type != DRIVER_WS2812) {
-                        err |= s_hal_obj->interface->set_channel(channel, s_hal_obj->fade_data[channel].cur);
-                    } else {
-                        //Nothing
-                    }
-#if FADE_DEBUG_LOG_OUTPUT
-                    ESP_LOGW(TAG, "2..ch[%d]: cur:%f", channel, s_hal_obj->fade_data[channel].cur);
-                    gpio_reverse(PROBE_GPIO);
-#endif
-                }
-                // Because this channel does not need to perform fade, write the final value directly
-            } else {
-                if (s_hal_obj->use_hw_fade && s_hal_obj->interface->type == DRIVER_ESP_PWM) {
-                    err |= s_hal_obj->interface->set_hw_fade(channel, s_hal_obj->fade_data[channel].cur, HARDWARE_RETAIN_RATE_MS - 2);
-                } else if (s_hal_obj->interface->type != DRIVER_WS2812) {
-                    err |= s_hal_obj->interface->set_channel(channel, s_hal_obj->fade_data[channel].cur);
-                } else {
-                    //Nothing
-                }
-#if FADE_DEBUG_LOG_OUTPUT
-                ESP_LOGW(TAG, "3...ch[%d]: cur:%f", channel, s_hal_obj->fade_data[channel].cur);
-                gpio_reverse(PROBE_GPIO);
-#endif
-            }
-            // If this channel finishes updating, `fade_data[channel].num` will be less than 1, need to check if auto loop is needed again.
-        } else if (s_hal_obj->fade_data[channel].cycle) {
-            s_hal_obj->fade_data[channel].num = s_hal_obj->fade_data[channel].cycle - 1;
+    if (update_mask == 0) {
+        return ESP_OK;
+    }
 
-            // Set the value that needs to be updated in the next cycle
-            if (s_hal_obj->fade_data[channel].step) {
-                s_hal_obj->fade_data[channel].step *= -1;
-                s_hal_obj->fade_data[channel].cur += s_hal_obj->fade_data[channel].step;
-            } else {
-                s_hal_obj->fade_data[channel].cur = (s_hal_obj->fade_data[channel].cur == s_hal_obj->fade_data[channel].final) ? s_hal_obj->fade_data[channel].min : s_hal_obj->fade_data[channel].final;
-            }
-            if (s_hal_obj->use_hw_fade && s_hal_obj->interface->type == DRIVER_ESP_PWM) {
-                err |= s_hal_obj->interface->set_hw_fade(channel, s_hal_obj->fade_data[channel].cur, HARDWARE_RETAIN_RATE_MS - 2);
-            } else if (s_hal_obj->interface->type != DRIVER_WS2812) {
-                err |= s_hal_obj->interface->set_channel(channel, s_hal_obj->fade_data[channel].cur);
-            } else {
-                //Nothing
-            }
-#if FADE_DEBUG_LOG_OUTPUT
-            ESP_LOGW(TAG, "4....ch[%d]: cur:%f setp:%f fin:%f", channel, s_hal_obj->fade_data[channel].cur, s_hal_obj->fade_data[channel].step, s_hal_obj->fade_data[channel].final);
-            gpio_reverse(PROBE_GPIO);
-#endif
-            // Here all channels complete the expected behavior.
-        } else {
-            idle_channel_num++;
-        }
+    for (int channel = 0; channel < interface->channel_num; channel++) {
+        value[channel] = FADE_VALUE_TO_INT(hal->fade_data[channel].cur);
     }
 
-    // Enable multi-channel set only for ws2812 driver
-    if (s_hal_obj->interface->type == DRIVER_WS2812) {
-        s_hal_obj->interface->set_rgb_channel(s_hal_obj->fade_data[0].cur, s_hal_obj->fade_data[1].cur, s_hal_obj->fade_data[2].cur);
+    // 1. All channels in one frame
+    if (interface->set_rgbwy_or_rgbct_channel && (registered & (SELECT_COLOR_CHANNEL | SELECT_WHITE_CHANNEL)) == (SELECT_COLOR_CHANNEL | SELECT_WHITE_CHANNEL)) {
+        return interface->set_rgbwy_or_rgbct_channel(value[0], value[1], value[2], value[3], value[4]);
     }
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (idle_channel_num >= s_hal_obj->interface->channel_num) {
-        if (s_hal_obj->gptimer_is_active) {
-            s_hal_obj->gptimer_is_active = false;
-            gptimer_stop(s_hal_obj->fade_timer);
-        }
+
+    // 2. Color and white channels in one frame each
+    if ((update_mask & SELECT_COLOR_CHANNEL) && interface->set_rgb_channel && (registered & SELECT_COLOR_CHANNEL) == SELECT_COLOR_CHANNEL) {
+        err |= interface->set_rgb_channel(value[0], value[1], value[2]);
+        update_mask &= ~SELECT_COLOR_CHANNEL;
     }
-#else
-#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
-    if (idle_channel_num >= s_hal_obj->interface->channel_num && esp_timer_is_active(s_hal_obj->fade_timer)) {
-        esp_timer_stop(s_hal_obj->fade_timer);
+    if ((update_mask & SELECT_WHITE_CHANNEL) && interface->set_wy_or_ct_channel && (registered & SELECT_WHITE_CHANNEL) == SELECT_WHITE_CHANNEL) {
+        err |= interface->set_wy_or_ct_channel(value[3], value[4]);
+        update_mask &= ~SELECT_WHITE_CHANNEL;
     }
-#else
-    if (idle_channel_num >= s_hal_obj->interface->channel_num) {
-        esp_timer_stop(s_hal_obj->fade_timer);
+
+    // 3. The remaining channels
+    for (int channel = 0; channel < interface->channel_num; channel++) {
+        if ((update_mask & BIT(channel)) && interface->set_channel) {
+            err |= interface->set_channel(channel, value[channel]);
+        }
     }
-#endif
-#endif
-    xSemaphoreGive(s_hal_obj->fade_mutex);
+
+    return err;
 }
 
-esp_err_t hal_output_init(hal_config_t *config, lightbulb_gamma_data_t *gamma, void *priv_data)
+/**
+ * @brief Wake the fade tick up so that a new request is applied without waiting for the next change
+ *
+ */
+static void fade_tick_trigger(void)
 {
-    esp_err_t err = ESP_FAIL;
-    LIGHTBULB_CHECK(config, "config is null", return ESP_FAIL);
-    LIGHTBULB_CHECK(!s_hal_obj, "already init done", return ESP_ERR_INVALID_STATE);
-
-    s_hal_obj = calloc(1, sizeof(hal_context_t));
-    LIGHTBULB_CHECK(s_hal_obj, "alloc fail", return ESP_ERR_NO_MEM);
+    xTaskNotifyGive(s_fade_tick->notify_task);
+}
 
-    s_hal_obj->fade_mutex = xSemaphoreCreateBinary();
-    LIGHTBULB_CHECK(s_hal_obj->fade_mutex, "mutex alloc fail", return ESP_ERR_NO_MEM);
-    xSemaphoreGive(s_hal_obj->fade_mutex);
+/**
+ * @brief Publish a request to the fade tick
+ *
+ * @note The slot is written before the head is moved, so the tick only sees complete requests and never waits for a caller.
+ * Callers serialize among themselves on a spinlock that the tick never takes.
+ */
+static void fade_request_post(hal_context_t *hal, const fade_request_t *request)
+{
+    while (true) {
+        portENTER_CRITICAL(&s_request_lock);
+        uint32_t head = hal->request_head;
+        bool full = (head - __atomic_load_n(&hal->request_tail, __ATOMIC_ACQUIRE)) >= FADE_REQUEST_QUEUE_SIZE;
+        if (!full) {
+            hal->request[head % FADE_REQUEST_QUEUE_SIZE] = *request;
+            __atomic_store_n(&hal->request_head, head + 1, __ATOMIC_RELEASE);
+        }
+        portEXIT_CRITICAL(&s_request_lock);
 
-    for (int i = 0; i < DRIVER_SELECT_MAX; i++) {
-        if (config->type == s_hal_obj_group[i].type) {
-            s_hal_obj->interface = &(s_hal_obj_group[i]);
-            break;
-        } else if (s_hal_obj_group[i].type == DRIVER_SELECT_MAX) {
+        fade_tick_trigger();
+        if (!full) {
             break;
         }
+        // Every tick drains the whole queue, this only happens if the tick task is starved
+        vTaskDelay(1);
     }
-    LIGHTBULB_CHECK(s_hal_obj->interface, "Unable to find the corresponding driver function", goto EXIT);
-
-    err = s_hal_obj->interface->init(config->driver_data);
-    LIGHTBULB_CHECK(err == ESP_OK, "driver init fail", goto EXIT);
-
-    if (gamma && gamma->table != NULL) {
-        ESP_LOGW(TAG, "Use custom gamma table");
-        if (gamma->table->table_size != 256) {
-            ESP_LOGW(TAG, "Unsupported gamma table length");
-            goto EXIT;
-        }
-        s_rgb_gamma_table_group[0] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-        LIGHTBULB_CHECK(s_rgb_gamma_table_group[0], "red channel gamma table buffer alloc fail", goto EXIT);
-        memcpy(s_rgb_gamma_table_group[0], gamma->table->custom_table[0], MAX_TABLE_SIZE);
-
-        s_rgb_gamma_table_group[1] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-        LIGHTBULB_CHECK(s_rgb_gamma_table_group[1], "green channel gamma table buffer alloc fail", goto EXIT);
-        memcpy(s_rgb_gamma_table_group[1], gamma->table->custom_table[1], MAX_TABLE_SIZE);
-
-        s_rgb_gamma_table_group[2] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-        LIGHTBULB_CHECK(s_rgb_gamma_table_group[2], "blue channel gamma table buffer alloc fail", goto EXIT);
-        memcpy(s_rgb_gamma_table_group[2], gamma->table->custom_table[2], MAX_TABLE_SIZE);
+}
 
-    } else if (gamma) {
-        ESP_LOGW(TAG, "Generate gamma table with external parameter");
-        if ((gamma->r_curve_coe == gamma->g_curve_coe) && (gamma->g_curve_coe == gamma->b_curve_coe)) {
-            s_rgb_gamma_table_group[3] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-            LIGHTBULB_CHECK(s_rgb_gamma_table_group[3], "common gamma table buffer alloc fail", goto EXIT);
-            gamma_table_create(s_rgb_gamma_table_group[3], MAX_TABLE_SIZE, gamma->r_curve_coe, s_hal_obj->interface->driver_color_bit_depth);
-            s_hal_obj->use_common_gamma_table = true;
-        } else {
-            // R
-            s_rgb_gamma_table_group[0] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-            LIGHTBULB_CHECK(s_rgb_gamma_table_group[0], "red channel gamma table buffer alloc fail", goto EXIT);
-            gamma_table_create(s_rgb_gamma_table_group[0], MAX_TABLE_SIZE, gamma->r_curve_coe, s_hal_obj->interface->driver_color_bit_depth);
-            // G
-            s_rgb_gamma_table_group[1] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-            LIGHTBULB_CHECK(s_rgb_gamma_table_group[1], "green channel gamma table buffer alloc fail", goto EXIT);
-            gamma_table_create(s_rgb_gamma_table_group[1], MAX_TABLE_SIZE, gamma->g_curve_coe, s_hal_obj->interface->driver_color_bit_depth);
-            // B
-            s_rgb_gamma_table_group[2] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-            LIGHTBULB_CHECK(s_rgb_gamma_table_group[2], "blue channel gamma table buffer alloc fail", goto EXIT);
-            gamma_table_create(s_rgb_gamma_table_group[2], MAX_TABLE_SIZE, gamma->b_curve_coe, s_hal_obj->interface->driver_color_bit_depth);
-        }
-    } else {
-        ESP_LOGW(TAG, "Generate table with default parameters");
-        s_rgb_gamma_table_group[3] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
-        LIGHTBULB_CHECK(s_rgb_gamma_table_group[3], "common gamma table buffer alloc fail", goto EXIT);
-        gamma_table_create(s_rgb_gamma_table_group[3], MAX_TABLE_SIZE, DEFAULT_GAMMA_CURVE, s_hal_obj->interface->driver_color_bit_depth);
-        s_hal_obj->use_common_gamma_table = true;
-    }
+static void hardware_error_process(hal_context_t *hal)
+{
+    bool stop_flag = false;
 
-    if (gamma && gamma->balance) {
-        s_hal_obj->use_balance = true;
-        s_rgb_white_balance_coefficient[0] = gamma->balance->r_balance_coe;
-        s_rgb_white_balance_coefficient[1] = gamma->balance->g_balance_coe;
-        s_rgb_white_balance_coefficient[2] = gamma->balance->b_balance_coe;
+    if (hal->monitor_cb) {
+        stop_flag = hal->monitor_cb();
     }
-
-    gamma_table_create(s_default_linear_table, MAX_TABLE_SIZE, 1.0, s_hal_obj->interface->driver_color_bit_depth);
-    s_default_linear_table[255] = s_hal_obj->interface->hardware_allow_max_input_value;
-
-    if (s_hal_obj->use_common_gamma_table) {
-        s_rgb_gamma_table_group[3][255] = s_hal_obj->interface->hardware_allow_max_input_value;
+    if (stop_flag == true) {
+        force_stop_all_ch(hal);
+        hal->retry_mask = 0;
+        hal->sleep_ticks = 0;
+        ESP_LOGE(TAG, "Hardware may be unresponsive, fade terminated");
     } else {
-        s_rgb_gamma_table_group[0][255] = s_hal_obj->interface->hardware_allow_max_input_value;
-        s_rgb_gamma_table_group[1][255] = s_hal_obj->interface->hardware_allow_max_input_value;
-        s_rgb_gamma_table_group[2][255] = s_hal_obj->interface->hardware_allow_max_input_value;
+        // Wake up on the next tick so that the write is retried
+        hal->sleep_ticks = 1;
     }
+}
 
-    /**
-     * @brief Differential configuration for different chips
-     *
-     */
-    if (s_hal_obj->interface->type == DRIVER_SM2135E) {
-        lightbulb_works_mode_t init_mode = *(lightbulb_works_mode_t *)(priv_data);
-        bool wy_mode = (init_mode == WORK_COLOR) ? false : true;
-        err = s_hal_obj->interface->set_init_mode(wy_mode);
-        LIGHTBULB_CHECK(err == ESP_OK, "init mode fail", goto EXIT);
-    } else if (s_hal_obj->interface->type == DRIVER_ESP_PWM) {
-#if CONFIG_PWM_ENABLE_HW_FADE
-        s_hal_obj->use_hw_fade = true;
-#endif
+#if FADE_HW_OFFLOAD
+/**
+ * @brief Fade end interrupt of the hardware
+ *
+ * @note The short fades written on every tick end here too, only the whole fades handed over by fade_hw_offload() are counted.
+ */
+static IRAM_ATTR bool on_hw_fade_end_cb(int channel, void *priv)
+{
+    hal_context_t *hal = (hal_context_t *)priv;
+    bool fade_end = false;
+
+    portENTER_CRITICAL_ISR(&s_hw_fade_lock);
+    if (hal->hw_fade_mask & BIT(channel)) {
+        hal->hw_fade_mask &= ~BIT(channel);
+        hal->fade_stats.hw_fade_us += esp_timer_get_time() - hal->hw_fade_start_us[channel];
+        fade_end = (hal->hw_fade_mask == 0);
     }
+    portEXIT_CRITICAL_ISR(&s_hw_fade_lock);
 
-#ifdef FADE_TICKS_FROM_GPTIMER
-    xTaskCreate(fade_tick_task, "fade_tick_task", CONFIG_LB_NOTIFY_TASK_STACK, NULL, CONFIG_LB_NOTIFY_TASK_PRIORITY, &s_hal_obj->notify_task);
-    LIGHTBULB_CHECK(s_hal_obj->notify_task, "notify task create fail", goto EXIT);
+    // The last offloaded fade ended, the fade tick reports it to the driver
+    BaseType_t task_woken = pdFALSE;
+    if (fade_end && hal->fade_active) {
+        vTaskNotifyGiveFromISR(s_fade_tick->notify_task, &task_woken);
+    }
 
-    gptimer_config_t timer_config = {
-#if CONFIG_IDF_TARGET_ESP32
-#warning This clock source will be affected by the DFS of the power management
-        .clk_src = GPTIMER_CLK_SRC_APB,
-#else
-        .clk_src = GPTIMER_CLK_SRC_XTAL,
-#endif
-        .direction = GPTIMER_COUNT_UP,
-        .resolution_hz = 1000000, // 1MHz, 1 tick = 1us
-    };
-    gptimer_new_timer(&timer_config, &s_hal_obj->fade_timer);
+    return task_woken == pdTRUE;
+}
 
-    gptimer_alarm_config_t alarm_config = {
-        .reload_count = 0,
-        .alarm_count = CHANGE_RATE_MS * 1000,
-        .flags.auto_reload_on_alarm = true,
-    };
-    gptimer_event_callbacks_t cbs = {
-        .on_alarm = on_timer_alarm_cb,
-    };
-    gptimer_register_event_callbacks(s_hal_obj->fade_timer, &cbs, NULL);
-    gptimer_set_alarm_action(s_hal_obj->fade_timer, &alarm_config);
-    gptimer_enable(s_hal_obj->fade_timer);
-#else
-    esp_timer_create_args_t timer_conf = {
-        .callback = fade_cb,
-        .arg = NULL,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "fade_cb",
-#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
-        .skip_unhandled_events = true,
-#endif
-    };
-    err = esp_timer_create(&timer_conf, &s_hal_obj->fade_timer);
-    LIGHTBULB_CHECK(err == ESP_OK, "esp_timer_create fail", goto EXIT);
-#endif
+/**
+ * @brief Hand the linear fades left in the fade state to the hardware, one fade per channel
+ *
+ * @note The channels are left idle at their final value, so the fade tick does not wake up for them until their next target.
+ * Curves and actions keep their software steps, they cannot be expressed as a single hardware fade.
+ *
+ * @return Mask of the channels whose fade now runs in the hardware
+ */
+static uint8_t fade_hw_offload(hal_context_t *hal)
+{
+    uint8_t offload_mask = 0;
 
-    return ESP_OK;
+    for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+        fade_data_t *data = &hal->fade_data[channel];
+        if (data->num < FADE_HW_OFFLOAD_MIN_TICKS || data->cycle || data->curve_ticks || !data->step) {
+            continue;
+        }
 
-EXIT:
-    cleanup();
+        // The hardware starts from the duty it outputs now, the remaining ticks set the fade time
+        int value = FADE_VALUE_TO_INT(data->final);
+        if (hal->interface->set_hw_fade(channel, value, data->num * CHANGE_RATE_MS) != ESP_OK) {
+            continue;
+        }
+        hal->fade_stats.writes++;
+
+        portENTER_CRITICAL(&s_hw_fade_lock);
+        hal->hw_fade_mask |= BIT(channel);
+        hal->hw_fade_start_us[channel] = esp_timer_get_time();
+        hal->fade_stats.hw_fades++;
+        portEXIT_CRITICAL(&s_hw_fade_lock);
+
+        data->cur = data->final;
+        data->num = 0;
+        hal->output_value[channel] = value;
+        offload_mask |= BIT(channel);
+    }
 
-    return err;
+    return offload_mask;
 }
 
-esp_err_t hal_output_deinit()
+/**
+ * @brief Stop the hardware fades of the selected channels, before a new target is armed on them
+ *
+ * @note The fade state holds the final value of an offloaded fade, the value reached by the hardware is read back instead.
+ */
+static void fade_hw_offload_stop(hal_context_t *hal, uint8_t channel_mask)
 {
-    esp_err_t err = ESP_OK;
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    int64_t now = esp_timer_get_time();
 
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (s_hal_obj->gptimer_is_active) {
-        s_hal_obj->gptimer_is_active = false;
-        gptimer_stop(s_hal_obj->fade_timer);
+    portENTER_CRITICAL(&s_hw_fade_lock);
+    uint8_t running_mask = hal->hw_fade_mask & channel_mask;
+    hal->hw_fade_mask &= ~channel_mask;
+    for (int channel = 0; channel < HAL_OUT_MAX_CHANNEL; channel++) {
+        if (running_mask & BIT(channel)) {
+            hal->fade_stats.hw_fade_us += now - hal->hw_fade_start_us[channel];
+        }
     }
-#else
-    esp_timer_stop(s_hal_obj->fade_timer);
-#endif
+    portEXIT_CRITICAL(&s_hw_fade_lock);
 
-    if (s_hal_obj->interface->set_shutdown) {
-        err |= s_hal_obj->interface->set_shutdown();
+    for (int channel = 0; channel < HAL_OUT_MAX_CHANNEL; channel++) {
+        uint16_t value = 0;
+        if ((running_mask & BIT(channel)) && hal->interface->stop_hw_fade(channel, &value) == ESP_OK) {
+            hal->fade_data[channel].cur = FADE_VALUE_FROM_FLOAT(value);
+            hal->output_value[channel] = value;
+        }
     }
-
-    err |= s_hal_obj->interface->deinit();
-
-    cleanup();
-
-    return err;
 }
+#endif
 
-esp_err_t hal_regist_channel(int channel, gpio_num_t gpio_num)
+static float lightness_from_luminance(float luminance)
 {
-    esp_err_t err = ESP_OK;
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
-
-    if (s_hal_obj->interface->regist_channel) {
-        err = s_hal_obj->interface->regist_channel(channel, gpio_num);
-    }
-    return err;
+    return (luminance <= 0.008856f) ? 903.3f * luminance : 116.0f * cbrtf(luminance) - 16.0f;
 }
 
-esp_err_t hal_set_channel(int channel, uint16_t value, uint16_t fade_ms)
+static float luminance_from_lightness(float lightness)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    float cube_root = (lightness + 16.0f) / 116.0f;
+    return (lightness <= 8.0f) ? lightness / 903.3f : cube_root * cube_root * cube_root;
+}
 
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (s_hal_obj->gptimer_is_active) {
-        s_hal_obj->gptimer_is_active = false;
-        gptimer_stop(s_hal_obj->fade_timer);
-    }
-#else
-#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
-    // 1. Stop all fade_cb operations
-    if (esp_timer_is_active(s_hal_obj->fade_timer)) {
-        esp_timer_stop(s_hal_obj->fade_timer);
+/**
+ * @brief Sample the curve of a fade into the points of its channel
+ *
+ * @note Runs once when the fade is armed, this is where powf-like math is allowed.
+ * The fade is split into FADE_CURVE_SEGMENTS segments of equal duration, each walked with a constant step,
+ * so fades shorter than one tick per segment stay linear.
+ *
+ * @param channel Channel of the fade, selects the point table
+ * @param fade_data Fade with cur, final and num already set
+ * @param curve Curve of the fade
+ */
+static void fade_curve_arm(hal_context_t *hal, int channel, fade_data_t *fade_data, lightbulb_fade_curve_t curve)
+{
+    fade_value_t *points = hal->curve_points[channel];
+    lightbulb_fade_curve_cb_t custom = __atomic_load_n(&hal->custom_fade_curve, __ATOMIC_ACQUIRE);
+    int ticks = (int)fade_data->num;
+
+    fade_data->curve_ticks = 0;
+    if (curve == FADE_CURVE_LINEAR || (curve == FADE_CURVE_CUSTOM && !custom) || ticks < FADE_CURVE_SEGMENTS || fade_data->cur == fade_data->final) {
+        return;
     }
-#else
-    esp_timer_stop(s_hal_obj->fade_timer);
-#endif
-#endif
 
-    LIGHTBULB_CHECK(xSemaphoreTake(s_hal_obj->fade_mutex, pdMS_TO_TICKS(FADE_CB_CHECK_MS)) == pdTRUE, "Can't get mutex", return ESP_ERR_INVALID_STATE);
+    float max_value = hal->interface->hardware_allow_max_input_value;
+    float start = FADE_VALUE_TO_FLOAT(fade_data->cur);
+    float final = FADE_VALUE_TO_FLOAT(fade_data->final);
+    float start_lightness = lightness_from_luminance(start / max_value);
+    float final_lightness = lightness_from_luminance(final / max_value);
+
+    for (int i = 1; i < FADE_CURVE_SEGMENTS; i++) {
+        float progress = (float)i / FADE_CURVE_SEGMENTS;
+        float value = 0;
+
+        if (curve == FADE_CURVE_CIE_LSTAR) {
+            value = max_value * luminance_from_lightness(start_lightness + (final_lightness - start_lightness) * progress);
+        } else if (curve == FADE_CURVE_EASE_IN_OUT) {
+            value = start + (final - start) * progress * progress * (3 - 2 * progress);
+        } else {
+            value = start + (final - start) * custom(progress);
+        }
+        points[i] = FADE_VALUE_FROM_FLOAT(MIN(MAX(value, 0), max_value));
+    }
+    points[0] = fade_data->cur;
+    points[FADE_CURVE_SEGMENTS] = fade_data->final;
+
+    fade_data->curve_ticks = ticks;
+    fade_data->curve_tick = 0;
+    fade_data->curve_segment = 0;
+    fade_data->step = (points[1] - points[0]) / (ticks / FADE_CURVE_SEGMENTS);
+}
+
+/**
+ * @brief Advance a curved fade by one tick
+ *
+ * @note Every point is landed on exactly, the step of the next segment is taken from there.
+ */
+static void fade_curve_step(const fade_value_t *points, fade_data_t *fade_data)
+{
+    fade_data->curve_tick++;
+    fade_data->cur += fade_data->step;
+
+    uint32_t segment_end = (fade_data->curve_segment + 1) * fade_data->curve_ticks / FADE_CURVE_SEGMENTS;
+    if (fade_data->curve_tick < segment_end) {
+        return;
+    }
+
+    fade_data->curve_segment++;
+    fade_data->cur = points[fade_data->curve_segment];
+    if (fade_data->curve_segment < FADE_CURVE_SEGMENTS) {
+        uint32_t next_end = (fade_data->curve_segment + 1) * fade_data->curve_ticks / FADE_CURVE_SEGMENTS;
+        fade_data->step = (points[fade_data->curve_segment + 1] - fade_data->cur) / (int)(next_end - segment_end);
+    } else {
+        fade_data->curve_ticks = 0;
+    }
+}
+
+static void fade_apply_set_channel(hal_context_t *hal, const fade_request_t *request)
+{
+    int channel = request->channel;
+    uint16_t value = request->value[channel];
+    uint16_t fade_ms = request->time_ms;
 
 #ifdef CONFIG_ENABLE_DITHERING_CHECK
     // Allows to reduce fade time to increase resolution to avoid dithering
@@ -778,16 +904,16 @@ esp_err_t hal_set_channel(int channel, uint16_t value, uint16_t fade_ms)
     uint32_t max_valve = 0;
 
     fade_data_t data = { 0 };
-    data = s_hal_obj->fade_data [channel];
-    data.final = final_processing(channel, value);
-    if (fabsf(data.final - data.cur) > 0) {
-        min_delta = MIN(min_delta, fabsf(data.final - data.cur));
+    data = hal->fade_data [channel];
+    data.final = final_processing(hal, channel, value);
+    if (FADE_VALUE_ABS(data.final - data.cur) > 0) {
+        min_delta = MIN(min_delta, FADE_VALUE_TO_INT(FADE_VALUE_ABS(data.final - data.cur)));
     }
-    if (data.cur > max_valve) {
-        max_valve = data.cur;
+    if (FADE_VALUE_TO_INT(data.cur) > max_valve) {
+        max_valve = FADE_VALUE_TO_INT(data.cur);
     }
-    if (data.final > max_valve) {
-        max_valve = data.final;
+    if (FADE_VALUE_TO_INT(data.final) > max_valve) {
+        max_valve = FADE_VALUE_TO_INT(data.final);
     }
 
     if (fade_ms > CHANGE_RATE_MS * 2 * min_delta) {
@@ -798,425 +924,1464 @@ esp_err_t hal_set_channel(int channel, uint16_t value, uint16_t fade_ms)
     }
 #endif
 
-    // 2. Get the current value of fade_data
-    fade_data_t fade_data = s_hal_obj->fade_data[channel];
+    // 1. Get the current value of fade_data
+    fade_data_t fade_data = hal->fade_data[channel];
 
-    // 3. Process the final value (e.g. with white balance calibration)
-    fade_data.final = final_processing(channel, value);
+    // 2. Process the final value (e.g. with white balance calibration)
+    fade_data.final = final_processing(hal, channel, value);
 
-    // 4. Count of calls to fade_cb function
+    // 3. Count of calls to fade_cb function
     if (fade_ms < CHANGE_RATE_MS) {
         fade_data.num = 1;
     } else {
         fade_data.num = fade_ms / CHANGE_RATE_MS;
     }
-    if (fabsf(fade_data.cur - fade_data.final) == 0) {
+    if (FADE_VALUE_ABS(fade_data.cur - fade_data.final) == 0) {
         fade_data.num = 1;
     }
 
-    // 5. Count the step value required on each call to fade_ms
-    fade_data.step = fabsf(fade_data.cur - fade_data.final) / fade_data.num;
+    // 4. Count the step value required on each call to fade_ms
+    fade_data.step = FADE_VALUE_ABS(fade_data.cur - fade_data.final) / fade_data.num;
     if (fade_data.cur > fade_data.final) {
         fade_data.step *= -1;
     }
 
-    // 6. Fill parameters
-    s_hal_obj->fade_data[channel].cur = fade_data.cur;
-    s_hal_obj->fade_data[channel].final = fade_data.final;
-    s_hal_obj->fade_data[channel].num = fade_data.num;
-    s_hal_obj->fade_data[channel].step = fade_data.step;
-    s_hal_obj->fade_data[channel].cur = fade_data.cur;
-    s_hal_obj->fade_data[channel].cycle = 0; /* only for actions */
-    s_hal_obj->fade_data[channel].min = 0; /* only for actions */
-    xSemaphoreGive(s_hal_obj->fade_mutex);
-
-    // 7. We need to execute a fade_cb immediately
-    fade_cb(NULL);
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (gptimer_start(s_hal_obj->fade_timer) == ESP_OK) {
-        s_hal_obj->gptimer_is_active = true;
-    }
-#else
-    esp_timer_start_periodic(s_hal_obj->fade_timer, 1000 * CHANGE_RATE_MS);
-#endif
+    // 5. Fill parameters
+    fade_data.cycle = 0; /* only for actions */
+    fade_data.min = 0; /* only for actions */
+    fade_data.curve_ticks = 0;
+    hal->fade_data[channel] = fade_data;
 
-    ESP_LOGD(TAG, "set channel:[%d] value:%d fade_ms:%d cur:%f final:%f step:%f num:%f", channel, value, fade_ms, fade_data.cur, fade_data.final, fade_data.step, fade_data.num);
-    return ESP_OK;
+    ESP_LOGD(TAG, "set channel:[%d] value:%d fade_ms:%d cur:%f final:%f step:%f num:%d", channel, value, fade_ms, FADE_VALUE_TO_FLOAT(fade_data.cur), FADE_VALUE_TO_FLOAT(fade_data.final), FADE_VALUE_TO_FLOAT(fade_data.step), (int)fade_data.num);
 }
 
-esp_err_t hal_set_channel_group(uint16_t value[], uint8_t channel_mask, uint16_t fade_ms)
+/**
+ * @brief Start a fade of the selected channels to the given values
+ *
+ * @note Unselected channels are stopped.
+ */
+static void fade_group_arm(hal_context_t *hal, const uint16_t value[], uint8_t channel_mask, uint16_t fade_ms, lightbulb_fade_curve_t curve)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
-
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (s_hal_obj->gptimer_is_active) {
-        s_hal_obj->gptimer_is_active = false;
-        gptimer_stop(s_hal_obj->fade_timer);
-    }
-#else
-#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
-    // 1. Stop all fade_cb operations
-    if (esp_timer_is_active(s_hal_obj->fade_timer)) {
-        esp_timer_stop(s_hal_obj->fade_timer);
-    }
-#else
-    esp_timer_stop(s_hal_obj->fade_timer);
-#endif
-#endif
-
-    LIGHTBULB_CHECK(xSemaphoreTake(s_hal_obj->fade_mutex, pdMS_TO_TICKS(FADE_CB_CHECK_MS)) == pdTRUE, "Can't get mutex", return ESP_ERR_INVALID_STATE);
-    bool need_timer = false;
-
-#ifdef CONFIG_ENABLE_DITHERING_CHECK
-    // Allows to reduce fade time to increase resolution to avoid dithering
-    uint32_t min_delta = UINT32_MAX;
-    uint32_t max_valve = 0;
-    for (int channel = 0; channel < HAL_OUT_MAX_CHANNEL; channel++) {
-        fade_data_t fade_data [HAL_OUT_MAX_CHANNEL] = { 0 };
-        fade_data [channel] = s_hal_obj->fade_data [channel];
-        fade_data [channel].final = final_processing(channel, value [channel]);
-        if (fabsf(fade_data [channel].final - fade_data [channel].cur) > 0) {
-            min_delta = MIN(min_delta, fabsf(fade_data [channel].final - fade_data [channel].cur));
-        }
-        if (fade_data [channel].cur > max_valve) {
-            max_valve = fade_data [channel].cur;
-        }
-        if (fade_data [channel].final > max_valve) {
-            max_valve = fade_data [channel].final;
-        }
-    }
-
-    if (fade_ms > CHANGE_RATE_MS * 2 * min_delta) {
-        fade_ms = min_delta * CHANGE_RATE_MS * 2;
-        if (max_valve < 12) {
-            fade_ms = fade_ms / 2;
-        }
-    }
+#if FADE_HW_OFFLOAD
+    // Timeline steps arm fades here without a request
+    fade_hw_offload_stop(hal, channel_mask);
 #endif
 
-    // 2. loop update channels through mask bits
+    // 1. loop update channels through mask bits
     fade_data_t fade_data[HAL_OUT_MAX_CHANNEL] = { 0 };
-    for (int channel = 0; channel < s_hal_obj->interface->channel_num; channel++) {
-        // 2.1 Unselected channels are skipped directly
+    for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+        // 1.1 Unselected channels are skipped directly
         if ((channel_mask & BIT(channel)) == 0) {
             continue;
         }
 
-        // 2.2 Get the current value of fade_data
-        fade_data[channel] = s_hal_obj->fade_data[channel];
+        // 1.2 Get the current value of fade_data
+        fade_data[channel] = hal->fade_data[channel];
 
-        // 2.3 Process the final value (e.g. with white balance calibration)
-        fade_data[channel].final = final_processing(channel, value[channel]);
+        // 1.3 Process the final value (e.g. with white balance calibration)
+        fade_data[channel].final = final_processing(hal, channel, value[channel]);
 
-        // 2.4 Count of calls to fade_cb function
+        // 1.4 Count of calls to fade_cb function
         if (fade_ms < CHANGE_RATE_MS) {
             fade_data[channel].num = 1;
         } else {
             fade_data[channel].num = fade_ms / CHANGE_RATE_MS;
         }
-        if (fabsf(fade_data[channel].cur - fade_data[channel].final) == 0) {
+        if (FADE_VALUE_ABS(fade_data[channel].cur - fade_data[channel].final) == 0) {
             fade_data[channel].num = 1;
         }
 
-        // 2.5 Count the step value required on each call to fade_ms
-        fade_data[channel].step = fabsf(fade_data[channel].cur - fade_data[channel].final) / fade_data[channel].num;
+        // 1.5 Count the step value required on each call to fade_ms
+        fade_data[channel].step = FADE_VALUE_ABS(fade_data[channel].cur - fade_data[channel].final) / fade_data[channel].num;
         if (fade_data[channel].cur > fade_data[channel].final) {
             fade_data[channel].step *= -1;
         }
 
-        // 2.6 Fill in other parameters
+        // 1.6 Fill in other parameters
         fade_data[channel].cycle = 0; /* only for actions */
         fade_data[channel].min = 0; /* only for actions */
 
-        // 2.7 If any channel nun > 1 then need to enable timer
-        if (fade_data[channel].num > 1) {
-            need_timer = true;
-        }
-        ESP_LOGD(TAG, "set group:[%d] value:%d fade_ms:%d cur:%f final:%f step:%f num:%f", channel, value[channel], fade_ms, fade_data[channel].cur, fade_data[channel].final, fade_data[channel].step, fade_data[channel].num);
-    }
-    memcpy(s_hal_obj->fade_data, fade_data, sizeof(fade_data));
-    xSemaphoreGive(s_hal_obj->fade_mutex);
-
-    // 3. We need to execute a fade_cb immediately, if need_timer is true then enable the timer to complete the fade operation
-    fade_cb(NULL);
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (need_timer) {
-        if (gptimer_start(s_hal_obj->fade_timer) == ESP_OK) {
-            s_hal_obj->gptimer_is_active = true;
-        }
+        // 1.7 Sample the curve of this fade, the fade tick then walks its points
+        fade_curve_arm(hal, channel, &fade_data[channel], curve);
+        ESP_LOGD(TAG, "set group:[%d] value:%d fade_ms:%d cur:%f final:%f step:%f num:%d", channel, value[channel], fade_ms, FADE_VALUE_TO_FLOAT(fade_data[channel].cur), FADE_VALUE_TO_FLOAT(fade_data[channel].final), FADE_VALUE_TO_FLOAT(fade_data[channel].step), (int)fade_data[channel].num);
     }
-#else
-    if (need_timer) {
-        esp_timer_start_periodic(s_hal_obj->fade_timer, 1000 * CHANGE_RATE_MS);
-    }
-#endif
-    return ESP_OK;
+    memcpy(hal->fade_data, fade_data, sizeof(fade_data));
 }
 
-esp_err_t hal_start_channel_action(int channel, uint16_t value_min, uint16_t value_max, uint16_t period_ms, bool fade_flag)
+static void fade_apply_set_channel_group(hal_context_t *hal, const fade_request_t *request)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
-    LIGHTBULB_CHECK((period_ms > CHANGE_RATE_MS * 2) || (period_ms == 0), "period_ms not allowed", return ESP_ERR_INVALID_ARG);
+    const uint16_t *value = request->value;
+    uint16_t fade_ms = request->time_ms;
 
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (s_hal_obj->gptimer_is_active) {
-        s_hal_obj->gptimer_is_active = false;
-        gptimer_stop(s_hal_obj->fade_timer);
+#ifdef CONFIG_ENABLE_DITHERING_CHECK
+    // Allows to reduce fade time to increase resolution to avoid dithering
+    uint32_t min_delta = UINT32_MAX;
+    uint32_t max_valve = 0;
+    for (int channel = 0; channel < HAL_OUT_MAX_CHANNEL; channel++) {
+        fade_data_t fade_data [HAL_OUT_MAX_CHANNEL] = { 0 };
+        fade_data [channel] = hal->fade_data [channel];
+        fade_data [channel].final = final_processing(hal, channel, value [channel]);
+        if (FADE_VALUE_ABS(fade_data [channel].final - fade_data [channel].cur) > 0) {
+            min_delta = MIN(min_delta, FADE_VALUE_TO_INT(FADE_VALUE_ABS(fade_data [channel].final - fade_data [channel].cur)));
+        }
+        if (FADE_VALUE_TO_INT(fade_data [channel].cur) > max_valve) {
+            max_valve = FADE_VALUE_TO_INT(fade_data [channel].cur);
+        }
+        if (FADE_VALUE_TO_INT(fade_data [channel].final) > max_valve) {
+            max_valve = FADE_VALUE_TO_INT(fade_data [channel].final);
+        }
     }
-#else
-#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
-    // 1. Stop all fade_cb operations
-    if (esp_timer_is_active(s_hal_obj->fade_timer)) {
-        esp_timer_stop(s_hal_obj->fade_timer);
+
+    if (fade_ms > CHANGE_RATE_MS * 2 * min_delta) {
+        fade_ms = min_delta * CHANGE_RATE_MS * 2;
+        if (max_valve < 12) {
+            fade_ms = fade_ms / 2;
+        }
     }
-#else
-    esp_timer_stop(s_hal_obj->fade_timer);
-#endif
 #endif
 
-    LIGHTBULB_CHECK(xSemaphoreTake(s_hal_obj->fade_mutex, pdMS_TO_TICKS(FADE_CB_CHECK_MS)) == pdTRUE, "Can't get mutex", return ESP_ERR_INVALID_STATE);
+    fade_group_arm(hal, value, request->channel_mask, fade_ms, request->curve);
+}
+
+static void fade_apply_start_action(hal_context_t *hal, const fade_request_t *request)
+{
+    int channel = request->channel;
+    uint16_t period_ms = request->time_ms;
+    bool fade_flag = request->fade_flag;
 
-    // 2. Get the current value of fade_data
-    fade_data_t fade_data = s_hal_obj->fade_data[channel];
+    // 1. Get the current value of fade_data
+    fade_data_t fade_data = hal->fade_data[channel];
 
-    // 3. Process the final value (e.g. with white balance calibration).
-    fade_data.min = final_processing(channel, value_min);
-    fade_data.final = final_processing(channel, value_max);
+    // 2. Process the final value (e.g. with white balance calibration).
+    fade_data.min = final_processing(hal, channel, request->value_min[channel]);
+    fade_data.final = final_processing(hal, channel, request->value[channel]);
     // start actions from current value
-    float cur = s_hal_obj->fade_data[channel].cur;
+    fade_value_t cur = hal->fade_data[channel].cur;
     cur = MIN(fade_data.final, cur);
     cur = MAX(fade_data.min, cur);
     fade_data.cur = cur;
 
-    // 4. Count the number of cycles. If cycle > 0, the timer will not stop
+    // 3. Count the number of cycles. If cycle > 0, the timer will not stop
     fade_data.cycle = period_ms / 2 / CHANGE_RATE_MS;
 
-    // 5. Count of calls to fade_cb function.
+    // 4. Count of calls to fade_cb function.
     // There is no need to consider the case where fade_data.cur and fade_data.final are equal, because fade_data.num will be updated again in fade_cb
     fade_data.num = (fade_flag) ? period_ms / 2 / CHANGE_RATE_MS : 0;
+    fade_data.curve_ticks = 0;
 
-    // 6. Count the step value required on each call to fade_ms. The default is increment
-    fade_data.step = (fade_flag) ? (fade_data.final - fade_data.min) / fade_data.num * 1 : 0;
-    // TODO Decrease
-    // fade_data.step = (fade_flag) ? (fade_data.final - fade_data.min) / fade_data.num * -1 : 0;
-
-    // 7. Fill in other parameters
-    s_hal_obj->fade_data[channel].cur = fade_data.cur;
-    s_hal_obj->fade_data[channel].final = fade_data.final;
-    s_hal_obj->fade_data[channel].num = fade_data.num;
-    s_hal_obj->fade_data[channel].min = fade_data.min;
-    s_hal_obj->fade_data[channel].step = fade_data.step;
-    s_hal_obj->fade_data[channel].cycle = fade_data.cycle;
-    xSemaphoreGive(s_hal_obj->fade_mutex);
-
-    // 8. Actions need to be periodic, directly enabled
-    fade_cb(NULL);
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (gptimer_start(s_hal_obj->fade_timer) == ESP_OK) {
-        s_hal_obj->gptimer_is_active = true;
-    }
-#else
-    esp_timer_start_periodic(s_hal_obj->fade_timer, 1000 * CHANGE_RATE_MS);
-#endif
+    // 5. Count the step value required on each call to fade_ms. The default is increment
+    fade_data.step = (fade_flag && fade_data.num) ? (fade_data.final - fade_data.min) / fade_data.num * 1 : 0;
 
-    ESP_LOGD(TAG, "start action:[%d] value:%d period_ms:%d cur:%f final:%f step:%f num:%f cycle:%f", channel, value_min, period_ms, fade_data.cur, fade_data.final, fade_data.step, fade_data.num, fade_data.cycle);
-    return ESP_OK;
+    // 6. Fill in other parameters
+    hal->fade_data[channel] = fade_data;
+
+    ESP_LOGD(TAG, "start action:[%d] value:%d period_ms:%d cur:%f final:%f step:%f num:%d cycle:%d", channel, request->value_min[channel], period_ms, FADE_VALUE_TO_FLOAT(fade_data.cur), FADE_VALUE_TO_FLOAT(fade_data.final), FADE_VALUE_TO_FLOAT(fade_data.step), (int)fade_data.num, (int)fade_data.cycle);
 }
 
-esp_err_t hal_start_channel_group_action(uint16_t value_min[], uint16_t value_max[], uint8_t channel_mask, uint16_t period_ms, bool fade_flag)
+static void fade_apply_start_group_action(hal_context_t *hal, const fade_request_t *request)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
-    LIGHTBULB_CHECK((period_ms > CHANGE_RATE_MS * 2) || (period_ms == 0), "period_ms not allowed", return ESP_ERR_INVALID_ARG);
-
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (s_hal_obj->gptimer_is_active) {
-        s_hal_obj->gptimer_is_active = false;
-        gptimer_stop(s_hal_obj->fade_timer);
-    }
-#else
-#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
-    // 1. Stop all fade_cb operations
-    if (esp_timer_is_active(s_hal_obj->fade_timer)) {
-        esp_timer_stop(s_hal_obj->fade_timer);
-    }
-#else
-    esp_timer_stop(s_hal_obj->fade_timer);
-#endif
-#endif
-
-    LIGHTBULB_CHECK(xSemaphoreTake(s_hal_obj->fade_mutex, pdMS_TO_TICKS(FADE_CB_CHECK_MS)) == pdTRUE, "Can't get mutex", return ESP_ERR_INVALID_STATE);
+    uint16_t period_ms = request->time_ms;
+    bool fade_flag = request->fade_flag;
 
-    // 2. loop update channels through mask bits
+    // 1. loop update channels through mask bits
     fade_data_t fade_data[HAL_OUT_MAX_CHANNEL] = { 0 };
-    for (int channel = 0; channel < s_hal_obj->interface->channel_num; channel++) {
-        // 2.1 Unselected channels are skipped directly
-        if ((channel_mask & BIT(channel)) == 0) {
+    for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+        // 1.1 Unselected channels are skipped directly
+        if ((request->channel_mask & BIT(channel)) == 0) {
             continue;
         }
 
-        // 2.2 Get the current value of fade_data
-        fade_data[channel] = s_hal_obj->fade_data[channel];
+        // 1.2 Get the current value of fade_data
+        fade_data[channel] = hal->fade_data[channel];
 
-        // 2.3 Process the final value (e.g. with white balance calibration).
-        fade_data[channel].min = final_processing(channel, value_min[channel]);
-        fade_data[channel].final = final_processing(channel, value_max[channel]);
-        float cur = s_hal_obj->fade_data[channel].cur;
+        // 1.3 Process the final value (e.g. with white balance calibration).
+        fade_data[channel].min = final_processing(hal, channel, request->value_min[channel]);
+        fade_data[channel].final = final_processing(hal, channel, request->value[channel]);
+        fade_value_t cur = hal->fade_data[channel].cur;
         cur = MIN(fade_data[channel].final, cur);
         cur = MAX(fade_data[channel].min, cur);
         fade_data[channel].cur = cur;
 
-        // 4. Count the number of cycles. If cycle > 0, the timer will not stop
+        // 1.4 Count the number of cycles. If cycle > 0, the timer will not stop
         fade_data[channel].cycle = period_ms / 2 / CHANGE_RATE_MS;
 
-        // 5. Count of calls to fade_cb function.
+        // 1.5 Count of calls to fade_cb function.
         // There is no need to consider the case where fade_data.cur and fade_data.final are equal, because fade_data.num will be updated again in fade_cb
         fade_data[channel].num = (fade_flag) ? period_ms / 2 / CHANGE_RATE_MS : 0;
+        fade_data[channel].curve_ticks = 0;
 
-        // 6. Count the step value required on each call to fade_ms. The default is increment
-        fade_data[channel].step = (fade_flag) ? (fade_data[channel].final - fade_data[channel].min) / fade_data[channel].num * 1 : 0;
-        // TODO Decrease
-        // fade_data[channel].step = (fade_flag) ? (fade_data[channel].final - fade_data[channel].min) / fade_data[channel].num * -1 : 0;
+        // 1.6 Count the step value required on each call to fade_ms. The default is increment
+        fade_data[channel].step = (fade_flag && fade_data[channel].num) ? (fade_data[channel].final - fade_data[channel].min) / fade_data[channel].num * 1 : 0;
 
-        ESP_LOGD(TAG, "start group action:[%d] value_min:%d value_max:%d period_ms:%d cur:%f final:%f step:%f num:%f cycle:%f", channel, value_min[channel], value_max[channel], period_ms, fade_data[channel].cur, fade_data[channel].final, fade_data[channel].step, fade_data[channel].num, fade_data[channel].cycle);
+        ESP_LOGD(TAG, "start group action:[%d] value_min:%d value_max:%d period_ms:%d cur:%f final:%f step:%f num:%d cycle:%d", channel, request->value_min[channel], request->value[channel], period_ms, FADE_VALUE_TO_FLOAT(fade_data[channel].cur), FADE_VALUE_TO_FLOAT(fade_data[channel].final), FADE_VALUE_TO_FLOAT(fade_data[channel].step), (int)fade_data[channel].num, (int)fade_data[channel].cycle);
     };
-    memcpy(s_hal_obj->fade_data, fade_data, sizeof(fade_data));
-    xSemaphoreGive(s_hal_obj->fade_mutex);
+    memcpy(hal->fade_data, fade_data, sizeof(fade_data));
+}
 
-    // 8. Actions need to be periodic, directly enabled
-    fade_cb(NULL);
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (gptimer_start(s_hal_obj->fade_timer) == ESP_OK) {
-        s_hal_obj->gptimer_is_active = true;
-    }
-#else
-    esp_timer_start_periodic(s_hal_obj->fade_timer, 1000 * CHANGE_RATE_MS);
-#endif
+static void fade_apply_stop_action(hal_context_t *hal, const fade_request_t *request)
+{
+    // 1. loop update channels through mask bits
+    fade_data_t fade_data[HAL_OUT_MAX_CHANNEL] = { 0 };
+    for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+        // 1.1 Unselected channels are skipped directly
+        if ((request->channel_mask & BIT(channel)) == 0) {
+            continue;
+        }
 
-    return ESP_OK;
+        // 1.2 Just set the cycle
+        fade_data[channel] = hal->fade_data[channel];
+        fade_data[channel].cycle = 0;
+        ESP_LOGD(TAG, "stop action:[%d]", channel);
+    };
+    memcpy(hal->fade_data, fade_data, sizeof(fade_data));
 }
 
-esp_err_t hal_stop_channel_action(uint8_t channel_mask)
-{
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
+#define TIMELINE_READ_U16(p)                    ((uint16_t)((p)[0] | ((p)[1] << 8)))
 
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (s_hal_obj->gptimer_is_active) {
-        s_hal_obj->gptimer_is_active = false;
-        gptimer_stop(s_hal_obj->fade_timer);
+/**
+ * @brief Drop the running timeline, the fades it armed go on to their end
+ *
+ * @param finished The timeline reached its end or its total time, the end callback is only called in this case
+ */
+static void timeline_stop(hal_context_t *hal, bool finished)
+{
+    timeline_state_t *timeline = hal->timeline;
+    if (!timeline) {
+        return;
     }
-#else
-#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
-    // 1. Stop all fade_cb operations
-    if (esp_timer_is_active(s_hal_obj->fade_timer)) {
-        esp_timer_stop(s_hal_obj->fade_timer);
+
+    hal->timeline = NULL;
+    // The callback may call back into the lightbulb API, which posts to this tick, so it runs in the timer task
+    // A full timer queue gets one tick to drain before the callback is dropped
+    if (finished && timeline->end_cb) {
+        if (xTimerPendFunctionCall(timeline->end_cb, timeline->end_priv, timeline->end_arg, 0) != pdPASS &&
+                xTimerPendFunctionCall(timeline->end_cb, timeline->end_priv, timeline->end_arg, pdMS_TO_TICKS(CHANGE_RATE_MS)) != pdPASS) {
+            ESP_LOGE(TAG, "timer queue is full, the timeline end callback is dropped");
+        }
     }
-#else
-    esp_timer_stop(s_hal_obj->fade_timer);
-#endif
-#endif
+    timeline_free(timeline);
+}
 
-    LIGHTBULB_CHECK(xSemaphoreTake(s_hal_obj->fade_mutex, pdMS_TO_TICKS(FADE_CB_CHECK_MS)) == pdTRUE, "Can't get mutex", return ESP_ERR_INVALID_STATE);
+/**
+ * @brief Run the ops of the timeline until one of them takes time
+ *
+ * @param finished Set when the timeline has ended, false if it was stopped for running too many ops without taking time
+ * @return false when the timeline has ended
+ */
+static bool timeline_run(hal_context_t *hal, bool *finished)
+{
+    timeline_state_t *timeline = hal->timeline;
+
+    for (int i = 0; i < TIMELINE_MAX_OPS_PER_STEP; i++) {
+        const uint8_t *op = &timeline->code[timeline->pc];
+        uint8_t loop_id = op[0] >> 4;
+
+        switch (op[0] & 0x0F) {
+        case TIMELINE_OP_FADE: {
+            uint16_t value[HAL_OUT_MAX_CHANNEL] = { 0 };
+            const uint8_t *data = &op[3];
+            for (int channel = 0; channel < HAL_OUT_MAX_CHANNEL; channel++) {
+                if (timeline->channel_mask & BIT(channel)) {
+                    value[channel] = TIMELINE_READ_U16(data);
+                    data += 2;
+                }
+            }
+            fade_group_arm(hal, value, timeline->channel_mask, TIMELINE_READ_U16(&op[1]), (lightbulb_fade_curve_t)(op[0] >> 4));
+            timeline->step_ticks = TIMELINE_READ_U16(&op[1]) / CHANGE_RATE_MS;
+            timeline->pc = data - timeline->code;
+            break;
+        }
+        case TIMELINE_OP_HOLD:
+            timeline->step_ticks = TIMELINE_READ_U16(&op[1]) / CHANGE_RATE_MS;
+            timeline->pc += TIMELINE_HOLD_SIZE;
+            break;
+        case TIMELINE_OP_LOOP:
+            if (op[1] == 0 || timeline->loop_count[loop_id] < op[1]) {
+                timeline->loop_count[loop_id] += (op[1] != 0);
+                timeline->pc = TIMELINE_READ_U16(&op[2]);
+            } else {
+                timeline->loop_count[loop_id] = 0;
+                timeline->pc += TIMELINE_LOOP_SIZE;
+            }
+            break;
+        default:
+            *finished = true;
+            return false;
+        }
 
-    // 2. loop update channels through mask bits
-    fade_data_t fade_data[HAL_OUT_MAX_CHANNEL] = { 0 };
-    for (int channel = 0; channel < s_hal_obj->interface->channel_num; channel++) {
-        // 2.1 Unselected channels are skipped directly
-        if ((channel_mask & BIT(channel)) == 0) {
-            continue;
+        if (timeline->step_ticks) {
+            return true;
         }
+    }
 
-        // 2.2 Just set the cycle
-        fade_data[channel] = s_hal_obj->fade_data[channel];
-        fade_data[channel].cycle = 0;
-        ESP_LOGD(TAG, "stop action:[%d]", channel);
-    };
-    memcpy(s_hal_obj->fade_data, fade_data, sizeof(fade_data));
-    xSemaphoreGive(s_hal_obj->fade_mutex);
+    // Loops without time are rejected when they are built, only a long run of jumps gets here
+    ESP_LOGW(TAG, "timeline runs %d ops without taking any time, stopped", TIMELINE_MAX_OPS_PER_STEP);
+    *finished = false;
+    return false;
+}
 
-    fade_cb(NULL);
-#ifdef FADE_TICKS_FROM_GPTIMER
-    if (gptimer_start(s_hal_obj->fade_timer) == ESP_OK) {
-        s_hal_obj->gptimer_is_active = true;
+/**
+ * @brief Advance the running timeline by one tick, the next step starts on the tick the current one ends
+ *
+ */
+static void timeline_tick(hal_context_t *hal)
+{
+    timeline_state_t *timeline = hal->timeline;
+    bool finished = true;
+    if (!timeline) {
+        return;
+    }
+
+    if (timeline->total_ticks && --timeline->total_ticks == 0) {
+        timeline_stop(hal, true);
+    } else if (--timeline->step_ticks == 0 && !timeline_run(hal, &finished)) {
+        timeline_stop(hal, finished);
     }
-#else
-    esp_timer_start_periodic(s_hal_obj->fade_timer, 1000 * CHANGE_RATE_MS);
-#endif
-    return ESP_OK;
 }
 
-esp_err_t hal_get_driver_feature(hal_feature_query_list_t type, void *out_data)
+static void fade_apply_start_timeline(hal_context_t *hal, const fade_request_t *request)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
-    LIGHTBULB_CHECK(out_data, "out_data is null", return ESP_ERR_INVALID_STATE);
+    bool finished = true;
 
-    if (QUERY_IS_ALLOW_ALL_OUTPUT == type) {
-        bool *_out_data = (bool *)out_data;
-        *_out_data = (bool *)s_hal_obj->interface->all_ch_allow_output;
-    } else if (QUERY_MAX_INPUT_VALUE == type) {
-        uint16_t *_out_data = (uint16_t *)out_data;
-        *_out_data = s_hal_obj->interface->hardware_allow_max_input_value;
-    } else if (QUERY_COLOR_BIT_DEPTH == type) {
-        uint8_t *_out_data = (uint8_t *)out_data;
-        *_out_data = s_hal_obj->interface->driver_color_bit_depth;
-    } else if (QUERY_DRIVER_NAME == type) {
-        char **_out_data = (char **)out_data;
-        *_out_data = (char *)s_hal_obj->interface->name;
-    } else {
-        ESP_LOGE(TAG, "feature query(%d) not support", type);
-        return ESP_ERR_NOT_SUPPORTED;
+    timeline_stop(hal, false);
+    hal->timeline = request->timeline;
+    if (!timeline_run(hal, &finished)) {
+        timeline_stop(hal, finished);
     }
-    return ESP_OK;
 }
 
-esp_err_t hal_get_gamma_value(uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b)
+/**
+ * @brief Apply every request published since the last tick, in the order they were posted
+ *
+ * @note Only the fade tick writes fade_data, so no lock is needed here.
+ *
+ * @return Mask of the channels targeted by the applied requests
+ */
+static uint8_t fade_request_apply_all(hal_context_t *hal)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
-    LIGHTBULB_CHECK(out_r != NULL || out_g != NULL || out_b != NULL, "out_data is null", return ESP_ERR_INVALID_STATE);
+    uint8_t channel_mask = 0;
+    uint32_t tail = hal->request_tail;
+    uint32_t head = __atomic_load_n(&hal->request_head, __ATOMIC_ACQUIRE);
+
+    while (tail != head) {
+        fade_request_t *request = &hal->request[tail % FADE_REQUEST_QUEUE_SIZE];
+        bool single_channel = (request->type == FADE_REQUEST_SET_CHANNEL || request->type == FADE_REQUEST_START_ACTION);
+        channel_mask |= single_channel ? BIT(request->channel) : request->channel_mask;
+
+        // Any other new target ends the running timeline
+        if (request->type != FADE_REQUEST_START_TIMELINE) {
+            timeline_stop(hal, false);
+        }
+#if FADE_HW_OFFLOAD
+        // New targets start from the value the hardware reached, stopping an action leaves the fades alone
+        if (request->type != FADE_REQUEST_START_TIMELINE && request->type != FADE_REQUEST_STOP_ACTION) {
+            fade_hw_offload_stop(hal, single_channel ? BIT(request->channel) : request->channel_mask);
+        }
+#endif
+
+        switch (request->type) {
+        case FADE_REQUEST_SET_CHANNEL:
+            fade_apply_set_channel(hal, request);
+            break;
+        case FADE_REQUEST_SET_CHANNEL_GROUP:
+            fade_apply_set_channel_group(hal, request);
+            break;
+        case FADE_REQUEST_START_ACTION:
+            fade_apply_start_action(hal, request);
+            break;
+        case FADE_REQUEST_START_GROUP_ACTION:
+            fade_apply_start_group_action(hal, request);
+            break;
+        case FADE_REQUEST_STOP_ACTION:
+            fade_apply_stop_action(hal, request);
+            break;
+        case FADE_REQUEST_START_TIMELINE:
+            fade_apply_start_timeline(hal, request);
+            break;
+        }
+        tail++;
+    }
 
-    if (s_hal_obj->use_common_gamma_table) {
-        *out_r = s_rgb_gamma_table_group[3][r];
-        *out_g = s_rgb_gamma_table_group[3][g];
-        *out_b = s_rgb_gamma_table_group[3][b];
+    __atomic_store_n(&hal->request_tail, tail, __ATOMIC_RELEASE);
 
-        ESP_LOGD(TAG, "common gamma_value input:[%d %d %d] output:[%d %d %d]", r, g, b, *out_r, *out_g, *out_b);
-        return ESP_OK;
+    return channel_mask;
+}
+
+/**
+ * @brief Advance the fade of all channels by one tick, without touching the hardware
+ *
+ * @note
+ *
+ * fade_data[channel].num -> Fade cycle, This value is related to CHANGE_RATE_MS and fade_ms time
+ * fade_data[channel].step -> Fade step, < 0 indicates decrement, otherwise increment. The actual meaning is delta.
+ * fade_data[channel].cycle -> This value is used for the actions.
+ *
+ * fade_data[channel].cur -> Current value
+ * fade_data[channel].final -> Final value
+ * fade_data[channel].min -> Minimum value
+ * Final, min, cur are used to define a set of ranges, which will allow grayscale changes in arbitrary ranges, not from 0% to 100%.
+ *
+ * @param fade_data Fade state of all channels, either the live one or a copy used to look ahead
+ * @param idle_channel_num Number of channels that have nothing left to do
+ * @return Mask of the channels whose value was updated in this tick
+ */
+static uint8_t fade_data_step(hal_context_t *hal, fade_data_t *fade_data, int *idle_channel_num)
+{
+    uint8_t step_mask = 0;
+
+    for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+        fade_data_t *data = &fade_data[channel];
+
+        // If this channel needs to be updated
+        if (data->num > 0) {
+            data->num--;
+
+            // Curved fades walk the points sampled when the fade was armed
+            if (data->curve_ticks) {
+                fade_curve_step(hal->curve_points[channel], data);
+                // If this channel need to perform fade
+            } else if (data->step) {
+                data->cur = data->cur + data->step;
+
+                // Range check
+                if (data->cur > data->final && data->cycle) {
+                    data->cur = data->final;
+                }
+                if (data->cur < data->min && data->cycle) {
+                    data->cur = data->min;
+                }
+
+                // On the last step of the fade, update the final value of this channel, which may be the maximum value or the minimum value, depending on whether it is currently increasing or decreasing.
+                if (data->num == 0) {
+                    data->cur = data->cycle && data->step < 0 ? data->min : data->final;
+                }
+            }
+            // Otherwise this channel does not need to perform fade, the final value is written directly
+            step_mask |= BIT(channel);
+
+            // If this channel finishes updating, `fade_data[channel].num` will be less than 1, need to check if auto loop is needed again.
+        } else if (data->cycle) {
+            data->num = data->cycle - 1;
+
+            // Set the value that needs to be updated in the next cycle
+            if (data->step) {
+                data->step *= -1;
+                data->cur += data->step;
+            } else {
+                data->cur = (data->cur == data->final) ? data->min : data->final;
+            }
+            step_mask |= BIT(channel);
+
+            // Here all channels complete the expected behavior.
+        } else {
+            (*idle_channel_num)++;
+        }
     }
 
-    *out_r = s_rgb_gamma_table_group[0][r];
-    *out_g = s_rgb_gamma_table_group[1][g];
-    *out_b = s_rgb_gamma_table_group[2][b];
+    return step_mask;
+}
+
+/**
+ * @brief Write the channels whose output value changed since the last write
+ *
+ * @param step_mask Channels updated by the ticks processed in this wake-up
+ * @param force_mask Channels that are written even if their output value did not change
+ * @return esp_err_t
+ */
+static esp_err_t fade_output_write(hal_context_t *hal, uint8_t step_mask, uint8_t force_mask)
+{
+    esp_err_t err = ESP_OK;
+    uint8_t write_mask = 0;
+    uint8_t update_mask = 0;
+
+    force_mask |= hal->retry_mask;
+    for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+        int value = FADE_VALUE_TO_INT(hal->fade_data[channel].cur);
+        if (!(step_mask & BIT(channel)) || (value == hal->output_value[channel] && !(force_mask & BIT(channel)))) {
+            continue;
+        }
+        write_mask |= BIT(channel);
+
+        if (hal->use_hw_fade && hal->interface->type == DRIVER_ESP_PWM) {
+            err |= hal->interface->set_hw_fade(channel, value, HARDWARE_RETAIN_RATE_MS - 2);
+            hal->fade_stats.writes++;
+        } else {
+            update_mask |= BIT(channel);
+        }
+#if FADE_DEBUG_LOG_OUTPUT
+        ESP_LOGW(TAG, "ch[%d]: cur:%f", channel, FADE_VALUE_TO_FLOAT(hal->fade_data[channel].cur));
+        gpio_reverse(PROBE_GPIO);
+#endif
+    }
+
+    if (update_mask) {
+        err |= flush_channels(hal, update_mask);
+        hal->fade_stats.writes++;
+    }
+
+    // Channels of a failed write are written again on the next wake-up
+    if (err == ESP_OK) {
+        for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+            if (write_mask & BIT(channel)) {
+                hal->output_value[channel] = FADE_VALUE_TO_INT(hal->fade_data[channel].cur);
+            }
+        }
+        hal->retry_mask = 0;
+    } else {
+        hal->retry_mask = write_mask;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Count the ticks until the output value of some channel changes
+ *
+ * @note Runs the fade on a copy of the fade state. Slow fades move by a fraction of an output step per tick,
+ * so most ticks would write the same value again and can be skipped.
+ *
+ * @return Number of ticks to sleep, 0 if every channel goes idle without changing its output
+ */
+static uint32_t fade_ticks_to_next_change(hal_context_t *hal)
+{
+    fade_data_t fade_data[HAL_OUT_MAX_CHANNEL];
+    memcpy(fade_data, hal->fade_data, sizeof(fade_data));
+
+    for (uint32_t ticks = 1; ticks <= FADE_MAX_SLEEP_TICKS; ticks++) {
+        int idle_channel_num = 0;
+        uint8_t step_mask = fade_data_step(hal, fade_data, &idle_channel_num);
+
+        for (int channel = 0; channel < hal->interface->channel_num; channel++) {
+            if ((step_mask & BIT(channel)) && FADE_VALUE_TO_INT(fade_data[channel].cur) != hal->output_value[channel]) {
+                return ticks;
+            }
+        }
+        if (idle_channel_num == hal->interface->channel_num) {
+            return 0;
+        }
+    }
+
+    // Wake up anyway so that the look-ahead stays bounded
+    return FADE_MAX_SLEEP_TICKS;
+}
+
+/**
+ * @brief fade processing logic
+ *
+ * @note The tick period is CHANGE_RATE_MS, but the timer is only armed for the next tick that changes an output value.
+ * The ticks skipped in between are caught up here before anything is written.
+ *
+ */
+static void fade_cb(hal_context_t *hal)
+{
+    esp_err_t err = ESP_OK;
+    int idle_channel_num = 0;
+    uint8_t step_mask = 0;
+    int64_t now = esp_timer_get_time();
+
+    // 1. Catch up the ticks elapsed since the last processed one, at most up to the scheduled wake-up
+    int64_t elapsed = (now - hal->tick_time_us + CHANGE_RATE_MS * 500) / (CHANGE_RATE_MS * 1000);
+    uint32_t ticks = MIN(MAX(elapsed, 0), hal->sleep_ticks);
+    for (uint32_t i = 0; i < ticks; i++) {
+        step_mask |= fade_data_step(hal, hal->fade_data, &idle_channel_num);
+        timeline_tick(hal);
+    }
+    hal->tick_time_us += (int64_t)ticks * CHANGE_RATE_MS * 1000;
+
+    // 2. Take the new targets posted since the last wake-up, they start with an immediate tick
+    uint8_t force_mask = fade_request_apply_all(hal);
+    if (force_mask) {
+#if FADE_HW_OFFLOAD
+        portENTER_CRITICAL(&s_hw_fade_lock);
+        memset(&hal->fade_stats, 0, sizeof(hal->fade_stats));
+        portEXIT_CRITICAL(&s_hw_fade_lock);
+#else
+        memset(&hal->fade_stats, 0, sizeof(hal->fade_stats));
+#endif
+        step_mask |= fade_data_step(hal, hal->fade_data, &idle_channel_num);
+        timeline_tick(hal);
+        hal->tick_time_us = now;
+    }
+    hal->fade_stats.ticks++;
+
+#if FADE_HW_OFFLOAD
+    // 3. Whole linear fades go to the hardware, the first step taken above is not written
+    if (hal->use_hw_fade_offload) {
+        uint8_t offload_mask = fade_hw_offload(hal);
+        step_mask &= ~offload_mask;
+        force_mask &= ~offload_mask;
+    }
+#endif
+
+    // 4. Only the channels whose output value changed are written
+    err = fade_output_write(hal, step_mask, force_mask);
+    if (err != ESP_OK && ++hal->err_count >= ERROR_COUNT_THRESHOLD) {
+        hal->err_count = 0;
+        hardware_error_process(hal);
+        return;
+    } else if (err == ESP_OK) {
+        hal->err_count = 0;
+    }
+
+    // 5. Sleep until the next tick that changes an output value or starts a timeline step, 0 leaves the instance idle until its next request
+    uint32_t sleep_ticks = hal->retry_mask ? 1 : fade_ticks_to_next_change(hal);
+    if (hal->timeline) {
+        uint32_t step_ticks = hal->timeline->step_ticks;
+        if (hal->timeline->total_ticks) {
+            step_ticks = MIN(step_ticks, hal->timeline->total_ticks);
+        }
+        sleep_ticks = sleep_ticks ? MIN(sleep_ticks, step_ticks) : step_ticks;
+    }
+    hal->sleep_ticks = sleep_ticks;
+}
+
+static int64_t fade_tick_next_us(const hal_context_t *hal)
+{
+    return hal->tick_time_us + (int64_t)hal->sleep_ticks * CHANGE_RATE_MS * 1000;
+}
+
+/**
+ * @brief Check whether an instance is run in this wake-up of the shared fade tick
+ *
+ * @note An instance less than half a tick away from its next tick is run now instead of waking the task up again,
+ * fade_cb() rounds the elapsed time to the closest tick anyway.
+ */
+static bool fade_tick_is_due(const hal_context_t *hal, int64_t now)
+{
+    if (__atomic_load_n(&hal->request_head, __ATOMIC_ACQUIRE) != hal->request_tail) {
+        return true;
+    }
+
+    return hal->sleep_ticks && now + CHANGE_RATE_MS * 500 >= fade_tick_next_us(hal);
+}
+
+/**
+ * @brief Wake the fade tick up again at the given time, INT64_MAX stops the timer
+ *
+ * @note Only called from the fade tick task, which owns the timer state. The alarm is one-shot and armed again
+ * on every wake-up, so a late tick never leaves a periodic alarm running at an old interval.
+ */
+static void fade_tick_timer_arm(int64_t wake_us)
+{
+    int64_t delay_us = MAX(wake_us - esp_timer_get_time(), 1);
+
+#if FADE_TICKS_FROM_GPTIMER
+    if (s_fade_tick->gptimer_is_active) {
+        s_fade_tick->gptimer_is_active = false;
+        gptimer_stop(s_fade_tick->fade_timer);
+    }
+    if (wake_us != INT64_MAX) {
+        gptimer_alarm_config_t alarm_config = {
+            .alarm_count = delay_us,
+            .flags.auto_reload_on_alarm = false,
+        };
+        gptimer_set_raw_count(s_fade_tick->fade_timer, 0);
+        gptimer_set_alarm_action(s_fade_tick->fade_timer, &alarm_config);
+        s_fade_tick->gptimer_is_active = (gptimer_start(s_fade_tick->fade_timer) == ESP_OK);
+    }
+#else
+    esp_timer_stop(s_fade_tick->fade_timer);
+    if (wake_us != INT64_MAX) {
+        esp_timer_start_once(s_fade_tick->fade_timer, delay_us);
+    }
+#endif
+}
+
+/**
+ * @brief Tell the driver whether the output of an instance is changing
+ *
+ * @note The PWM driver holds its power locks only while a fade runs. An offloaded fade runs until its end interrupt,
+ * which wakes the fade tick up to report it.
+ */
+static void fade_active_update(hal_context_t *hal)
+{
+    bool is_active = hal->sleep_ticks || __atomic_load_n(&hal->hw_fade_mask, __ATOMIC_RELAXED);
+
+    if (is_active != hal->fade_active && hal->interface->set_fade_active) {
+        if (hal->interface->set_fade_active(is_active) == ESP_OK) {
+            hal->fade_active = is_active;
+        }
+    }
+}
+
+static void fade_tick_task(void *arg)
+{
+    fade_tick_t *fade_tick = (fade_tick_t *)arg;
+
+    while (true) {
+        ulTaskNotifyTake(true, portMAX_DELAY);
+        xSemaphoreTake(fade_tick->lock, portMAX_DELAY);
+        if (!fade_tick->running) {
+            xSemaphoreGive(fade_tick->lock);
+            break;
+        }
+
+        int64_t wake_us = INT64_MAX;
+        for (hal_context_t *hal = fade_tick->instances; hal; hal = hal->next) {
+            int64_t start = esp_timer_get_time();
+            if (fade_tick_is_due(hal, start)) {
+                fade_cb(hal);
+                hal->fade_stats.busy_us += esp_timer_get_time() - start;
+            }
+            fade_active_update(hal);
+            if (hal->sleep_ticks) {
+                wake_us = MIN(wake_us, fade_tick_next_us(hal));
+            }
+        }
+        fade_tick_timer_arm(wake_us);
+
+        xSemaphoreGive(fade_tick->lock);
+    }
+
+    xSemaphoreGive(fade_tick->task_exit);
+    vTaskDelete(NULL);
+}
+
+static void fade_tick_owner_take(void)
+{
+    portENTER_CRITICAL(&s_fade_tick_owner_lock);
+    if (!s_fade_tick_owner_mutex) {
+        s_fade_tick_owner_mutex = xSemaphoreCreateMutexStatic(&s_fade_tick_owner_mutex_buffer);
+    }
+    portEXIT_CRITICAL(&s_fade_tick_owner_lock);
+
+    xSemaphoreTake(s_fade_tick_owner_mutex, portMAX_DELAY);
+}
+
+static void fade_tick_owner_give(void)
+{
+    xSemaphoreGive(s_fade_tick_owner_mutex);
+}
+
+/**
+ * @brief Stop and delete the timer, no alarm reaches the task afterwards
+ *
+ */
+static void fade_tick_timer_delete(void)
+{
+#if FADE_TICKS_FROM_GPTIMER
+    if (s_fade_tick->fade_timer) {
+        if (s_fade_tick->gptimer_is_active) {
+            s_fade_tick->gptimer_is_active = false;
+            gptimer_stop(s_fade_tick->fade_timer);
+        }
+        if (s_fade_tick->gptimer_is_enabled) {
+            s_fade_tick->gptimer_is_enabled = false;
+            gptimer_disable(s_fade_tick->fade_timer);
+        }
+        gptimer_del_timer(s_fade_tick->fade_timer);
+        s_fade_tick->fade_timer = NULL;
+    }
+#else
+    if (s_fade_tick->fade_timer) {
+        esp_timer_stop(s_fade_tick->fade_timer);
+        esp_timer_delete(s_fade_tick->fade_timer);
+        s_fade_tick->fade_timer = NULL;
+    }
+#endif
+}
+
+/**
+ * @brief Free the fade tick, the timer must be deleted and the task must have exited
+ *
+ */
+static void fade_tick_free(void)
+{
+    if (s_fade_tick->task_exit) {
+        vSemaphoreDelete(s_fade_tick->task_exit);
+    }
+    if (s_fade_tick->lock) {
+        vSemaphoreDelete(s_fade_tick->lock);
+    }
+    free(s_fade_tick);
+    s_fade_tick = NULL;
+}
+
+/**
+ * @brief Create the fade tick, the owner mutex must be held
+ *
+ * @note The task is created last, so a failure only has to undo the timer and the semaphores.
+ */
+static esp_err_t fade_tick_create(void)
+{
+    esp_err_t err = ESP_OK;
+
+    s_fade_tick = calloc(1, sizeof(fade_tick_t));
+    LIGHTBULB_CHECK(s_fade_tick, "alloc fail", return ESP_ERR_NO_MEM);
+
+    s_fade_tick->lock = xSemaphoreCreateMutex();
+    LIGHTBULB_CHECK(s_fade_tick->lock, "fade tick lock create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+    s_fade_tick->task_exit = xSemaphoreCreateBinary();
+    LIGHTBULB_CHECK(s_fade_tick->task_exit, "fade tick exit semaphore create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+
+#if FADE_TICKS_FROM_GPTIMER
+    gptimer_config_t timer_config = {
+#if CONFIG_IDF_TARGET_ESP32
+#warning This clock source will be affected by the DFS of the power management
+        .clk_src = GPTIMER_CLK_SRC_APB,
+#else
+        .clk_src = GPTIMER_CLK_SRC_XTAL,
+#endif
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000, // 1MHz, 1 tick = 1us
+    };
+    err = gptimer_new_timer(&timer_config, &s_fade_tick->fade_timer);
+    LIGHTBULB_CHECK(err == ESP_OK, "gptimer_new_timer fail", s_fade_tick->fade_timer = NULL; goto EXIT);
+
+    // The alarm is set by fade_tick_timer_arm() before every start
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = on_timer_alarm_cb,
+    };
+    err = gptimer_register_event_callbacks(s_fade_tick->fade_timer, &cbs, s_fade_tick);
+    LIGHTBULB_CHECK(err == ESP_OK, "gptimer_register_event_callbacks fail", goto EXIT);
+    err = gptimer_enable(s_fade_tick->fade_timer);
+    LIGHTBULB_CHECK(err == ESP_OK, "gptimer_enable fail", goto EXIT);
+    s_fade_tick->gptimer_is_enabled = true;
+#else
+    esp_timer_create_args_t timer_conf = {
+        .callback = on_esp_timer_cb,
+        .arg = s_fade_tick,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "fade_cb",
+#if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0))
+        .skip_unhandled_events = true,
+#endif
+    };
+    err = esp_timer_create(&timer_conf, &s_fade_tick->fade_timer);
+    LIGHTBULB_CHECK(err == ESP_OK, "esp_timer_create fail", s_fade_tick->fade_timer = NULL; goto EXIT);
+#endif
+
+    s_fade_tick->running = true;
+    xTaskCreate(fade_tick_task, "fade_tick_task", CONFIG_LB_NOTIFY_TASK_STACK, s_fade_tick, CONFIG_LB_NOTIFY_TASK_PRIORITY, &s_fade_tick->notify_task);
+    LIGHTBULB_CHECK(s_fade_tick->notify_task, "notify task create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+
+    return ESP_OK;
+
+EXIT:
+    fade_tick_timer_delete();
+    fade_tick_free();
+
+    return err;
+}
+
+/**
+ * @brief Let the shared fade tick run an instance, the tick is created with the first one
+ *
+ * @note The drivers keep their state in globals, so each driver type serves one instance. The check and the insertion
+ * are done under the same lock, two instances of one driver can not both get in.
+ */
+static esp_err_t fade_tick_attach(hal_context_t *hal)
+{
+    esp_err_t err = ESP_OK;
+    bool is_used = false;
+
+    fade_tick_owner_take();
+    if (!s_fade_tick) {
+        err = fade_tick_create();
+        LIGHTBULB_CHECK(err == ESP_OK, "fade tick create fail", goto EXIT);
+    }
+
+    xSemaphoreTake(s_fade_tick->lock, portMAX_DELAY);
+    for (hal_context_t *node = s_fade_tick->instances; node; node = node->next) {
+        if (node->interface->type == hal->interface->type) {
+            is_used = true;
+        }
+    }
+    if (!is_used) {
+        hal->next = s_fade_tick->instances;
+        s_fade_tick->instances = hal;
+    }
+    xSemaphoreGive(s_fade_tick->lock);
+    LIGHTBULB_CHECK(!is_used, "driver is used by another instance", err = ESP_ERR_INVALID_STATE; goto EXIT);
+
+EXIT:
+    fade_tick_owner_give();
+    return err;
+}
+
+/**
+ * @brief Stop running an instance, the tick is deleted with the last one
+ *
+ * @note Once this returns the fade tick no longer touches the instance.
+ */
+static void fade_tick_detach(hal_context_t *hal)
+{
+    fade_tick_owner_take();
+    if (!s_fade_tick) {
+        goto EXIT;
+    }
+
+    xSemaphoreTake(s_fade_tick->lock, portMAX_DELAY);
+    for (hal_context_t **node = &s_fade_tick->instances; *node; node = &(*node)->next) {
+        if (*node == hal) {
+            *node = hal->next;
+            break;
+        }
+    }
+    if (s_fade_tick->instances) {
+        xSemaphoreGive(s_fade_tick->lock);
+        goto EXIT;
+    }
+
+    // 1. The last instance is gone, delete the timer first so that no alarm can reach the task or the memory
+    fade_tick_timer_delete();
+    s_fade_tick->running = false;
+    xSemaphoreGive(s_fade_tick->lock);
+
+    // 2. Wake the task up and wait until it has left its loop, it may be waiting for the lock
+    xTaskNotifyGive(s_fade_tick->notify_task);
+    xSemaphoreTake(s_fade_tick->task_exit, portMAX_DELAY);
+
+    // 3. Nothing refers to the fade tick any more
+    fade_tick_free();
+
+EXIT:
+    fade_tick_owner_give();
+}
+
+esp_err_t hal_output_init(hal_config_t *config, lightbulb_gamma_data_t *gamma, void *priv_data, hal_handle_t *handle)
+{
+    esp_err_t err = ESP_FAIL;
+    bool driver_is_init = false;
+    LIGHTBULB_CHECK(config, "config is null", return ESP_FAIL);
+    LIGHTBULB_CHECK(handle, "handle is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(!gamma || !gamma->balance || balance_coefficient_is_valid(gamma->balance), "balance coefficient out of range", return ESP_ERR_INVALID_ARG);
+
+    hal_context_t *hal = calloc(1, sizeof(hal_context_t));
+    LIGHTBULB_CHECK(hal, "alloc fail", return ESP_ERR_NO_MEM);
+
+    for (int i = 0; i < DRIVER_SELECT_MAX; i++) {
+        if (config->type == s_hal_obj_group[i].type) {
+            hal->interface = &(s_hal_obj_group[i]);
+            break;
+        } else if (s_hal_obj_group[i].type == DRIVER_SELECT_MAX) {
+            break;
+        }
+    }
+    LIGHTBULB_CHECK(hal->interface, "Unable to find the corresponding driver function", goto EXIT);
+
+    // The driver type is claimed before its init, which would reset the state of another instance
+    err = fade_tick_attach(hal);
+    LIGHTBULB_CHECK(err == ESP_OK, "fade tick attach fail", free(hal); return err);
+
+    err = hal->interface->init(config->driver_data);
+    LIGHTBULB_CHECK(err == ESP_OK, "driver init fail", goto EXIT);
+    driver_is_init = true;
+
+    // Drivers without channel registration always drive all of their channels
+    if (!hal->interface->regist_channel) {
+        hal->registered_channel_mask = BIT(hal->interface->channel_num) - 1;
+    }
+
+    if (gamma && gamma->table != NULL) {
+        ESP_LOGW(TAG, "Use custom gamma table");
+        LIGHTBULB_CHECK(gamma->table->table_size == MAX_TABLE_SIZE, "Unsupported gamma table length", err = ESP_ERR_INVALID_ARG; goto EXIT);
+        hal->rgb_gamma_table_group[0] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+        LIGHTBULB_CHECK(hal->rgb_gamma_table_group[0], "red channel gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+        memcpy(hal->rgb_gamma_table_group[0], gamma->table->custom_table[0], MAX_TABLE_SIZE * sizeof(uint16_t));
+
+        hal->rgb_gamma_table_group[1] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+        LIGHTBULB_CHECK(hal->rgb_gamma_table_group[1], "green channel gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+        memcpy(hal->rgb_gamma_table_group[1], gamma->table->custom_table[1], MAX_TABLE_SIZE * sizeof(uint16_t));
+
+        hal->rgb_gamma_table_group[2] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+        LIGHTBULB_CHECK(hal->rgb_gamma_table_group[2], "blue channel gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+        memcpy(hal->rgb_gamma_table_group[2], gamma->table->custom_table[2], MAX_TABLE_SIZE * sizeof(uint16_t));
+
+    } else if (gamma) {
+        ESP_LOGW(TAG, "Generate gamma table with external parameter");
+        if ((gamma->r_curve_coe == gamma->g_curve_coe) && (gamma->g_curve_coe == gamma->b_curve_coe)) {
+            hal->rgb_gamma_table_group[3] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+            LIGHTBULB_CHECK(hal->rgb_gamma_table_group[3], "common gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+            gamma_table_create(hal->rgb_gamma_table_group[3], MAX_TABLE_SIZE, gamma->r_curve_coe, hal->interface->driver_color_bit_depth);
+            hal->use_common_gamma_table = true;
+        } else {
+            // R
+            hal->rgb_gamma_table_group[0] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+            LIGHTBULB_CHECK(hal->rgb_gamma_table_group[0], "red channel gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+            gamma_table_create(hal->rgb_gamma_table_group[0], MAX_TABLE_SIZE, gamma->r_curve_coe, hal->interface->driver_color_bit_depth);
+            // G
+            hal->rgb_gamma_table_group[1] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+            LIGHTBULB_CHECK(hal->rgb_gamma_table_group[1], "green channel gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+            gamma_table_create(hal->rgb_gamma_table_group[1], MAX_TABLE_SIZE, gamma->g_curve_coe, hal->interface->driver_color_bit_depth);
+            // B
+            hal->rgb_gamma_table_group[2] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+            LIGHTBULB_CHECK(hal->rgb_gamma_table_group[2], "blue channel gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+            gamma_table_create(hal->rgb_gamma_table_group[2], MAX_TABLE_SIZE, gamma->b_curve_coe, hal->interface->driver_color_bit_depth);
+        }
+    } else {
+        ESP_LOGW(TAG, "Generate table with default parameters");
+        hal->rgb_gamma_table_group[3] = calloc(MAX_TABLE_SIZE, sizeof(uint16_t));
+        LIGHTBULB_CHECK(hal->rgb_gamma_table_group[3], "common gamma table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+        gamma_table_create(hal->rgb_gamma_table_group[3], MAX_TABLE_SIZE, DEFAULT_GAMMA_CURVE, hal->interface->driver_color_bit_depth);
+        hal->use_common_gamma_table = true;
+    }
+
+    gamma_table_create(hal->linear_table, MAX_TABLE_SIZE, 1.0, hal->interface->driver_color_bit_depth);
+    hal->linear_table[255] = hal->interface->hardware_allow_max_input_value;
+
+    if (hal->use_common_gamma_table) {
+        hal->rgb_gamma_table_group[3][255] = hal->interface->hardware_allow_max_input_value;
+    } else {
+        hal->rgb_gamma_table_group[0][255] = hal->interface->hardware_allow_max_input_value;
+        hal->rgb_gamma_table_group[1][255] = hal->interface->hardware_allow_max_input_value;
+        hal->rgb_gamma_table_group[2][255] = hal->interface->hardware_allow_max_input_value;
+    }
+
+    float balance_coe[3] = { 1.0, 1.0, 1.0 };
+    if (gamma && gamma->balance) {
+        balance_coe[0] = gamma->balance->r_balance_coe;
+        balance_coe[1] = gamma->balance->g_balance_coe;
+        balance_coe[2] = gamma->balance->b_balance_coe;
+    }
+    hal->rgb_output_table_group = calloc(2, sizeof(rgb_output_table_t));
+    LIGHTBULB_CHECK(hal->rgb_output_table_group, "rgb output table buffer alloc fail", err = ESP_ERR_NO_MEM; goto EXIT);
+    rgb_output_table_build(hal, balance_coe);
+
+    /**
+     * @brief Differential configuration for different chips
+     *
+     */
+    if (hal->interface->type == DRIVER_SM2135E) {
+        lightbulb_works_mode_t init_mode = *(lightbulb_works_mode_t *)(priv_data);
+        bool wy_mode = (init_mode == WORK_COLOR) ? false : true;
+        err = hal->interface->set_init_mode(wy_mode);
+        LIGHTBULB_CHECK(err == ESP_OK, "init mode fail", goto EXIT);
+    } else if (hal->interface->type == DRIVER_ESP_PWM) {
+#if CONFIG_PWM_ENABLE_HW_FADE
+        hal->use_hw_fade = true;
+#endif
+    }
+
+#if FADE_HW_OFFLOAD
+    if (hal->use_hw_fade && hal->interface->set_hw_fade_end_cb) {
+        hal->use_hw_fade_offload = (hal->interface->set_hw_fade_end_cb(on_hw_fade_end_cb, hal) == ESP_OK);
+    }
+#endif
+
+    *handle = hal;
+
+    return ESP_OK;
+
+EXIT:
+    fade_tick_detach(hal);
+    if (driver_is_init) {
+        hal->interface->deinit();
+    }
+    cleanup(hal);
+
+    return err;
+}
+
+esp_err_t hal_output_deinit(hal_handle_t hal)
+{
+    esp_err_t err = ESP_OK;
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+
+#if FADE_HW_OFFLOAD
+    // The fade end interrupt wakes the fade tick up, which may be deleted with this instance
+    if (hal->use_hw_fade_offload) {
+        hal->interface->set_hw_fade_end_cb(NULL, NULL);
+    }
+#endif
+
+    fade_tick_detach(hal);
+
+#if FADE_HW_OFFLOAD
+    if (hal->use_hw_fade_offload) {
+        fade_hw_offload_stop(hal, hal->registered_channel_mask);
+    }
+#endif
+
+    if (hal->interface->set_shutdown) {
+        err |= hal->interface->set_shutdown();
+    }
+
+    err |= hal->interface->deinit();
+
+    cleanup(hal);
+
+    return err;
+}
+
+esp_err_t hal_regist_channel(hal_handle_t hal, int channel, gpio_num_t gpio_num)
+{
+    esp_err_t err = ESP_OK;
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    if (hal->interface->regist_channel) {
+        err = hal->interface->regist_channel(channel, gpio_num);
+    }
+    if (err == ESP_OK) {
+        hal->registered_channel_mask |= BIT(channel);
+    }
+    return err;
+}
+
+esp_err_t hal_set_channel(hal_handle_t hal, int channel, uint16_t value, uint16_t fade_ms)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(channel >= 0 && channel < HAL_OUT_MAX_CHANNEL, "channel:%d not allowed", return ESP_ERR_INVALID_ARG, channel);
+
+    fade_request_t request = {
+        .type = FADE_REQUEST_SET_CHANNEL,
+        .channel = channel,
+        .time_ms = fade_ms,
+    };
+    request.value[channel] = value;
+    fade_request_post(hal, &request);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_set_channel_group(hal_handle_t hal, uint16_t value[], uint8_t channel_mask, uint16_t fade_ms, lightbulb_fade_curve_t curve)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(curve < FADE_CURVE_MAX, "curve:%d not allowed", return ESP_ERR_INVALID_ARG, curve);
+
+    fade_request_t request = {
+        .type = FADE_REQUEST_SET_CHANNEL_GROUP,
+        .channel_mask = channel_mask,
+        .curve = curve,
+        .time_ms = fade_ms,
+    };
+    memcpy(request.value, value, sizeof(request.value));
+    fade_request_post(hal, &request);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_start_channel_action(hal_handle_t hal, int channel, uint16_t value_min, uint16_t value_max, uint16_t period_ms, bool fade_flag)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(channel >= 0 && channel < HAL_OUT_MAX_CHANNEL, "channel:%d not allowed", return ESP_ERR_INVALID_ARG, channel);
+    LIGHTBULB_CHECK((period_ms > CHANGE_RATE_MS * 2) || (period_ms == 0), "period_ms not allowed", return ESP_ERR_INVALID_ARG);
+
+    fade_request_t request = {
+        .type = FADE_REQUEST_START_ACTION,
+        .channel = channel,
+        .time_ms = period_ms,
+        .fade_flag = fade_flag,
+    };
+    request.value[channel] = value_max;
+    request.value_min[channel] = value_min;
+    fade_request_post(hal, &request);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_start_channel_group_action(hal_handle_t hal, uint16_t value_min[], uint16_t value_max[], uint8_t channel_mask, uint16_t period_ms, bool fade_flag)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK((period_ms > CHANGE_RATE_MS * 2) || (period_ms == 0), "period_ms not allowed", return ESP_ERR_INVALID_ARG);
+
+    fade_request_t request = {
+        .type = FADE_REQUEST_START_GROUP_ACTION,
+        .channel_mask = channel_mask,
+        .time_ms = period_ms,
+        .fade_flag = fade_flag,
+    };
+    memcpy(request.value, value_max, sizeof(request.value));
+    memcpy(request.value_min, value_min, sizeof(request.value_min));
+    fade_request_post(hal, &request);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_stop_channel_action(hal_handle_t hal, uint8_t channel_mask)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    fade_request_t request = {
+        .type = FADE_REQUEST_STOP_ACTION,
+        .channel_mask = channel_mask,
+    };
+    fade_request_post(hal, &request);
+
+    return ESP_OK;
+}
+
+static uint8_t *timeline_put_u16(uint8_t *data, uint16_t value)
+{
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+    return data + 2;
+}
+
+/**
+ * @brief Ticks of one pass over the ops from start to the end of the code, each loop is counted once
+ *
+ * @return -1 if start is not the offset of an op
+ */
+static int32_t timeline_pass_ticks(const hal_timeline_t *timeline, uint16_t start)
+{
+    int32_t ticks = -1;
+    uint16_t pc = 0;
+
+    while (pc < timeline->len) {
+        const uint8_t *op = &timeline->code[pc];
+        if (pc == start) {
+            ticks = 0;
+        }
+
+        switch (op[0] & 0x0F) {
+        case TIMELINE_OP_FADE:
+            ticks += (ticks >= 0) ? TIMELINE_READ_U16(&op[1]) / CHANGE_RATE_MS : 0;
+            pc += TIMELINE_FADE_SIZE(__builtin_popcount(timeline->channel_mask));
+            break;
+        case TIMELINE_OP_HOLD:
+            ticks += (ticks >= 0) ? TIMELINE_READ_U16(&op[1]) / CHANGE_RATE_MS : 0;
+            pc += TIMELINE_HOLD_SIZE;
+            break;
+        default:
+            pc += TIMELINE_LOOP_SIZE;
+            break;
+        }
+    }
+
+    return ticks;
+}
+
+esp_err_t hal_timeline_create(hal_timeline_t *timeline, uint8_t channel_mask, uint16_t size)
+{
+    LIGHTBULB_CHECK(timeline, "timeline is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(channel_mask && channel_mask < BIT(HAL_OUT_MAX_CHANNEL), "channel_mask:%d not allowed", return ESP_ERR_INVALID_ARG, channel_mask);
+
+    memset(timeline, 0, sizeof(hal_timeline_t));
+    timeline->code = calloc(1, size + TIMELINE_END_SIZE);
+    LIGHTBULB_CHECK(timeline->code, "alloc fail", return ESP_ERR_NO_MEM);
+    timeline->size = size + TIMELINE_END_SIZE;
+    timeline->channel_mask = channel_mask;
+
+    return ESP_OK;
+}
+
+esp_err_t hal_timeline_add_fade(hal_timeline_t *timeline, const uint16_t value[], uint16_t fade_ms, lightbulb_fade_curve_t curve)
+{
+    LIGHTBULB_CHECK(timeline && timeline->code && value, "timeline is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(curve < FADE_CURVE_MAX, "curve:%d not allowed", return ESP_ERR_INVALID_ARG, curve);
+    LIGHTBULB_CHECK(timeline->len + TIMELINE_FADE_SIZE(__builtin_popcount(timeline->channel_mask)) + TIMELINE_END_SIZE <= timeline->size, "timeline is full", return ESP_ERR_NO_MEM);
+
+    uint8_t *data = &timeline->code[timeline->len];
+    *data++ = TIMELINE_OP_FADE | (curve << 4);
+    data = timeline_put_u16(data, fade_ms);
+    for (int channel = 0; channel < HAL_OUT_MAX_CHANNEL; channel++) {
+        if (timeline->channel_mask & BIT(channel)) {
+            data = timeline_put_u16(data, value[channel]);
+        }
+    }
+    timeline->len = data - timeline->code;
+
+    return ESP_OK;
+}
+
+esp_err_t hal_timeline_add_hold(hal_timeline_t *timeline, uint16_t hold_ms)
+{
+    LIGHTBULB_CHECK(timeline && timeline->code, "timeline is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(timeline->len + TIMELINE_HOLD_SIZE + TIMELINE_END_SIZE <= timeline->size, "timeline is full", return ESP_ERR_NO_MEM);
+
+    uint8_t *data = &timeline->code[timeline->len];
+    *data++ = TIMELINE_OP_HOLD;
+    data = timeline_put_u16(data, hold_ms);
+    timeline->len = data - timeline->code;
+
+    return ESP_OK;
+}
+
+esp_err_t hal_timeline_add_loop(hal_timeline_t *timeline, uint8_t loop_id, uint8_t count, uint16_t target)
+{
+    LIGHTBULB_CHECK(timeline && timeline->code, "timeline is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(loop_id < TIMELINE_MAX_LOOPS, "loop_id:%d not allowed", return ESP_ERR_INVALID_ARG, loop_id);
+    LIGHTBULB_CHECK(target < timeline->len, "target:%d not allowed", return ESP_ERR_INVALID_ARG, target);
+    LIGHTBULB_CHECK(timeline->len + TIMELINE_LOOP_SIZE + TIMELINE_END_SIZE <= timeline->size, "timeline is full", return ESP_ERR_NO_MEM);
+
+    // The fade tick runs the ops of a step at once, a loop without any tick would never let it go
+    int32_t body_ticks = timeline_pass_ticks(timeline, target);
+    LIGHTBULB_CHECK(body_ticks >= 0, "target:%d is not an op", return ESP_ERR_INVALID_ARG, target);
+    LIGHTBULB_CHECK(body_ticks > 0, "loop to target:%d takes no time, fades and holds shorter than %dms do not count", return ESP_ERR_INVALID_ARG, target, TIMELINE_TICK_MS);
+
+    uint8_t *data = &timeline->code[timeline->len];
+    *data++ = TIMELINE_OP_LOOP | (loop_id << 4);
+    *data++ = count;
+    data = timeline_put_u16(data, target);
+    timeline->len = data - timeline->code;
+
+    return ESP_OK;
+}
+
+esp_err_t hal_timeline_delete(hal_timeline_t *timeline)
+{
+    LIGHTBULB_CHECK(timeline, "timeline is null", return ESP_ERR_INVALID_ARG);
+
+    free(timeline->code);
+    memset(timeline, 0, sizeof(hal_timeline_t));
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Hand a timeline over to the fade tick, which runs it in place of the current targets
+ *
+ * @note On success the code belongs to the fade tick, hal_timeline_delete() then only clears the builder.
+ * Any other request posted afterwards ends the timeline without calling end_cb.
+ */
+esp_err_t hal_start_timeline(hal_handle_t hal, hal_timeline_t *timeline, uint32_t total_ms, hal_timeline_end_cb_t end_cb, void *priv, uint32_t arg)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(timeline && timeline->code, "timeline is null", return ESP_ERR_INVALID_ARG);
+
+    timeline_state_t *state = calloc(1, sizeof(timeline_state_t));
+    LIGHTBULB_CHECK(state, "alloc fail", return ESP_ERR_NO_MEM);
+
+    // There is always room for the END op, the add functions keep it free
+    timeline->code[timeline->len++] = TIMELINE_OP_END;
+    state->code = timeline->code;
+    state->channel_mask = timeline->channel_mask;
+    state->total_ticks = total_ms ? MAX(total_ms / CHANGE_RATE_MS, 1) : 0;
+    state->end_cb = end_cb;
+    state->end_priv = priv;
+    state->end_arg = arg;
+    timeline->code = NULL;
+
+    fade_request_t request = {
+        .type = FADE_REQUEST_START_TIMELINE,
+        .channel_mask = state->channel_mask,
+        .timeline = state,
+    };
+    fade_request_post(hal, &request);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_get_driver_feature(hal_handle_t hal, hal_feature_query_list_t type, void *out_data)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(out_data, "out_data is null", return ESP_ERR_INVALID_STATE);
+
+    if (QUERY_IS_ALLOW_ALL_OUTPUT == type) {
+        bool *_out_data = (bool *)out_data;
+        *_out_data = (bool *)hal->interface->all_ch_allow_output;
+    } else if (QUERY_MAX_INPUT_VALUE == type) {
+        uint16_t *_out_data = (uint16_t *)out_data;
+        *_out_data = hal->interface->hardware_allow_max_input_value;
+    } else if (QUERY_COLOR_BIT_DEPTH == type) {
+        uint8_t *_out_data = (uint8_t *)out_data;
+        *_out_data = hal->interface->driver_color_bit_depth;
+    } else if (QUERY_DRIVER_NAME == type) {
+        char **_out_data = (char **)out_data;
+        *_out_data = (char *)hal->interface->name;
+    } else {
+        ESP_LOGE(TAG, "feature query(%d) not support", type);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+esp_err_t hal_get_gamma_value(hal_handle_t hal, uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(out_r != NULL || out_g != NULL || out_b != NULL, "out_data is null", return ESP_ERR_INVALID_STATE);
+
+    if (hal->use_common_gamma_table) {
+        *out_r = hal->rgb_gamma_table_group[3][r];
+        *out_g = hal->rgb_gamma_table_group[3][g];
+        *out_b = hal->rgb_gamma_table_group[3][b];
+
+        ESP_LOGD(TAG, "common gamma_value input:[%d %d %d] output:[%d %d %d]", r, g, b, *out_r, *out_g, *out_b);
+        return ESP_OK;
+    }
+
+    *out_r = hal->rgb_gamma_table_group[0][r];
+    *out_g = hal->rgb_gamma_table_group[1][g];
+    *out_b = hal->rgb_gamma_table_group[2][b];
+
+    ESP_LOGD(TAG, " custom or external gamma_value input:[%d %d %d] output:[%d %d %d]", r, g, b, *out_r, *out_g, *out_b);
+    return ESP_OK;
+}
+
+esp_err_t hal_get_balanced_gamma_value(hal_handle_t hal, uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(out_r != NULL || out_g != NULL || out_b != NULL, "out_data is null", return ESP_ERR_INVALID_STATE);
+
+    rgb_output_table_t *table = __atomic_load_n(&hal->rgb_output_table, __ATOMIC_ACQUIRE);
+
+    *out_r = (*table)[0][r];
+    *out_g = (*table)[1][g];
+    *out_b = (*table)[2][b];
+
+    ESP_LOGD(TAG, "balanced gamma_value input:[%d %d %d] output:[%d %d %d]", r, g, b, *out_r, *out_g, *out_b);
+    return ESP_OK;
+}
+
+esp_err_t hal_set_balance_coefficient(hal_handle_t hal, lightbulb_custom_balance_coefficient_t *balance)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(balance, "balance is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(balance_coefficient_is_valid(balance), "balance coefficient out of range", return ESP_ERR_INVALID_ARG);
+
+    const float balance_coe[3] = { balance->r_balance_coe, balance->g_balance_coe, balance->b_balance_coe };
+    rgb_output_table_build(hal, balance_coe);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_set_custom_fade_curve(hal_handle_t hal, lightbulb_fade_curve_cb_t curve)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+
+    // Sampled by the fade tick when a fade is armed
+    __atomic_store_n(&hal->custom_fade_curve, curve, __ATOMIC_RELEASE);
+
+    return ESP_OK;
+}
+
+esp_err_t hal_get_fade_stats(hal_handle_t hal, lightbulb_fade_stats_t *stats)
+{
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(stats, "stats is null", return ESP_ERR_INVALID_ARG);
+
+    // The fade tick updates the stats while it holds its lock, the end of an offloaded fade under the spinlock
+    xSemaphoreTake(s_fade_tick->lock, portMAX_DELAY);
+#if FADE_HW_OFFLOAD
+    portENTER_CRITICAL(&s_hw_fade_lock);
+    *stats = hal->fade_stats;
+    portEXIT_CRITICAL(&s_hw_fade_lock);
+#else
+    *stats = hal->fade_stats;
+#endif
+    xSemaphoreGive(s_fade_tick->lock);
 
-    ESP_LOGD(TAG, " custom or external gamma_value input:[%d %d %d] output:[%d %d %d]", r, g, b, *out_r, *out_g, *out_b);
     return ESP_OK;
 }
 
-esp_err_t hal_get_linear_function_value(uint8_t input, uint16_t *output)
+esp_err_t hal_get_linear_function_value(hal_handle_t hal, uint8_t input, uint16_t *output)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
     LIGHTBULB_CHECK(output != NULL, "out_data is null", return ESP_ERR_INVALID_STATE);
 
-    *output = s_default_linear_table[input];
+    *output = hal->linear_table[input];
 
     ESP_LOGD(TAG, "linear_function_value input:[%d] output:[%d]", input, *output);
     return ESP_OK;
 }
 
-esp_err_t hal_register_monitor_cb(hardware_monitor_user_cb_t cb)
+esp_err_t hal_register_monitor_cb(hal_handle_t hal, hardware_monitor_user_cb_t cb)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
-    s_user_cb = cb;
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    hal->monitor_cb = cb;
 
     return ESP_OK;
 }
 
-esp_err_t hal_sleep_control(bool enable_sleep)
+esp_err_t hal_sleep_control(hal_handle_t hal, bool enable_sleep)
 {
-    LIGHTBULB_CHECK(s_hal_obj, "init() must be called first", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(hal, "init() must be called first", return ESP_ERR_INVALID_STATE);
 
-    if (s_hal_obj->interface->set_sleep_status) {
-        s_hal_obj->interface->set_sleep_status(enable_sleep);
+    if (hal->interface->set_sleep_status) {
+        hal->interface->set_sleep_status(enable_sleep);
     } else {
-        ESP_LOGW(TAG, "%s does not register sleep control functions", s_hal_obj->interface->name);
+        ESP_LOGW(TAG, "%s does not register sleep control functions", hal->interface->name);
     }
 
     return ESP_OK;
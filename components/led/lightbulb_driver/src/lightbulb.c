@@ -13,11 +13,19 @@
 // limitations under the License.
 
 #include <math.h>
+#include <inttypes.h>
 #include <string.h>
 
 #include <nvs_flash.h>
+#include <esp_timer.h>
+#if CONFIG_LB_FAST_RESTORE_USE_RTC_MEM
+#include <esp_attr.h>
+#endif
 
 #include "hal_driver.h"
+#if CONFIG_LB_STATUS_USE_JOURNAL
+#include "status_journal.h"
+#endif
 #include "lightbulb.h"
 
 static const char *TAG = "lightbulb";
@@ -30,28 +38,27 @@ static const char *TAG = "lightbulb";
  * @brief Resource Access Control
  *
  */
-#define LIGHTBULB_MUTEX_TAKE(delay_ms)                  (xSemaphoreTake(s_lb_obj->mutex, delay_ms))
-#define LIGHTBULB_MUTEX_GIVE()                          (xSemaphoreGive(s_lb_obj->mutex))
+#define LIGHTBULB_MUTEX_TAKE(delay_ms)                  (xSemaphoreTake(handle->mutex, delay_ms))
+#define LIGHTBULB_MUTEX_GIVE()                          (xSemaphoreGive(handle->mutex))
 
 /**
  * @brief Lightbulb function check
  *
  */
-#define CHECK_COLOR_CHANNEL_IS_SELECT()                 (s_lb_obj->cap.mode_mask & BIT(1) ? true : false)
-#define CHECK_WHITE_CHANNEL_IS_SELECT()                 (s_lb_obj->cap.mode_mask & BIT(2) ? true : false)
-#define CHECK_LOW_POWER_FUNC_IS_ENABLE()                ((s_lb_obj->cap.enable_lowpower && s_lb_obj->power_timer) ? true : false)
-#define CHECK_AUTO_STATUS_STORAGE_FUNC_IS_ENABLE()      ((s_lb_obj->cap.enable_status_storage && s_lb_obj->storage_timer) ? true : false)
-#define CHECK_WHITE_OUTPUT_REQ_MIXED()                  (s_lb_obj->cap.enable_mix_cct)
-#define CHECK_AUTO_ON_FUNC_IS_ENABLE()                  ((!s_lb_obj->cap.disable_auto_on) ? true : false)
-#define CHECK_EFFECT_TIMER_IS_ACTIVE()                  (s_lb_obj->effect_timer && (xTimerIsTimerActive(s_lb_obj->effect_timer) == pdTRUE))
-#define CHECK_EFFECT_ALLOW_TO_BE_INTERRUPTED()          (s_lb_obj->effect_running_flag && (!s_lb_obj->effect_interrupt_forbidden_flag))
-#define CHECK_EFFECT_IS_RUNNING()                       (s_lb_obj->effect_running_flag)
+#define CHECK_COLOR_CHANNEL_IS_SELECT()                 (handle->cap.mode_mask & BIT(1) ? true : false)
+#define CHECK_WHITE_CHANNEL_IS_SELECT()                 (handle->cap.mode_mask & BIT(2) ? true : false)
+#define CHECK_LOW_POWER_FUNC_IS_ENABLE()                ((handle->cap.enable_lowpower && handle->power_timer) ? true : false)
+#define CHECK_AUTO_STATUS_STORAGE_FUNC_IS_ENABLE()      ((handle->cap.enable_status_storage && handle->storage_timer) ? true : false)
+#define CHECK_WHITE_OUTPUT_REQ_MIXED()                  (handle->cap.enable_mix_cct)
+#define CHECK_AUTO_ON_FUNC_IS_ENABLE()                  ((!handle->cap.disable_auto_on) ? true : false)
+#define CHECK_EFFECT_ALLOW_TO_BE_INTERRUPTED()          (handle->effect_running_flag && (!handle->effect_interrupt_forbidden_flag))
+#define CHECK_EFFECT_IS_RUNNING()                       (handle->effect_running_flag)
 
 /**
  * @brief Lightbulb fade time calculate
  *
  */
-#define CALCULATE_FADE_TIME()                           (s_lb_obj->cap.enable_fades ? s_lb_obj->cap.fades_ms : 0)
+#define CALCULATE_FADE_TIME()                           (handle->cap.enable_fades ? handle->cap.fades_ms : 0)
 
 
 /**
@@ -70,21 +77,131 @@ static const char *TAG = "lightbulb";
 #define MAX_FADE_MS                                     (3000)
 #define MIN_FADE_MS                                     (100)
 
-typedef struct {
+/**
+ * @brief White conversion tables, indexed by CCT or brightness percentage
+ *
+ */
+#define WHITE_TABLE_SIZE                                (101)
+
+typedef struct lightbulb_obj_s {
     lightbulb_status_t status;
     lightbulb_capability_t cap;
     lightbulb_power_limit_t power;
     lightbulb_cct_kelvin_range_t kelvin_range;
+    uint16_t kelvin_table[WHITE_TABLE_SIZE];
+    uint32_t cold_table[WHITE_TABLE_SIZE];
+    uint32_t warm_table[WHITE_TABLE_SIZE];
+    uint8_t white_brightness_table[WHITE_TABLE_SIZE];
     TimerHandle_t power_timer;
     TimerHandle_t storage_timer;
-    TimerHandle_t effect_timer;
     SemaphoreHandle_t mutex;
     bool effect_interrupt_forbidden_flag;
     bool effect_running_flag;
+    uint32_t effect_id;                         // Tells a late end callback of a replaced effect from the current one
+    uint8_t transaction_depth;
+    bool transaction_pending_flag;
+    bool transaction_start_on;                  // On/off status when the outermost transaction began
+    lightbulb_fade_curve_t transaction_curve;
+    bool is_default;                            // Created by lightbulb_init(), owns the stored status and the fast restore slot
+    hal_handle_t hal;
+    struct lightbulb_obj_s *next;
 } lightbulb_obj_t;
 
 static lightbulb_obj_t *s_lb_obj = NULL;
 
+/**
+ * @brief All instances, effect end callbacks look their instance up here
+ * @note The lock is created by the first instance under a spinlock and kept, it is taken before the mutex of an instance.
+ *
+ */
+static lightbulb_obj_t *s_lb_list = NULL;
+static portMUX_TYPE s_lb_list_lock = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t s_lb_list_mutex_buffer;
+static SemaphoreHandle_t s_lb_list_mutex = NULL;
+static uint32_t s_effect_id = 0;
+
+/**
+ * @brief Latest status for lightbulb_status_fast_restore()
+ * @note Kept in RTC memory, a soft reset restores the changes still waiting for the storage delay.
+ *       Without RTC memory it only lives until the restart.
+ *
+ */
+#define FAST_RESTORE_MAGIC                              (0x4C425354)
+
+typedef struct {
+    uint32_t magic;
+    lightbulb_status_t status;
+    uint32_t checksum;          // Rejects the random content after power-on and a reset in the middle of an update
+} fast_restore_slot_t;
+
+#if CONFIG_LB_FAST_RESTORE_USE_RTC_MEM
+static RTC_NOINIT_ATTR fast_restore_slot_t s_fast_restore_slot;
+#else
+static fast_restore_slot_t s_fast_restore_slot;
+#endif
+static lightbulb_boot_stats_t s_boot_stats;
+
+static uint32_t fast_restore_checksum(const fast_restore_slot_t *slot)
+{
+    const uint8_t *data = (const uint8_t *)&slot->status;
+    uint32_t checksum = slot->magic;
+
+    for (int i = 0; i < sizeof(lightbulb_status_t); i++) {
+        checksum = (checksum << 5) + checksum + data[i];
+    }
+
+    return checksum;
+}
+
+static void fast_restore_save(lightbulb_obj_t *handle)
+{
+    if (!handle->is_default || !handle->cap.enable_status_storage) {
+        return;
+    }
+
+    s_fast_restore_slot.magic = FAST_RESTORE_MAGIC;
+    memcpy(&s_fast_restore_slot.status, &handle->status, sizeof(lightbulb_status_t));
+    s_fast_restore_slot.checksum = fast_restore_checksum(&s_fast_restore_slot);
+}
+
+esp_err_t lightbulb_status_fast_restore(lightbulb_status_t *value)
+{
+    LIGHTBULB_CHECK(value, "value is null", return ESP_ERR_INVALID_ARG);
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    int64_t start_us = esp_timer_get_time();
+
+    memset(&s_boot_stats, 0, sizeof(lightbulb_boot_stats_t));
+
+    // 1. RTC memory survives a soft reset and is newer than the stored status
+    if (s_fast_restore_slot.magic == FAST_RESTORE_MAGIC && s_fast_restore_slot.checksum == fast_restore_checksum(&s_fast_restore_slot)) {
+        memcpy(value, &s_fast_restore_slot.status, sizeof(lightbulb_status_t));
+        s_boot_stats.source = STATUS_SOURCE_RTC_MEM;
+        err = ESP_OK;
+    }
+#if CONFIG_LB_STATUS_USE_JOURNAL
+    // 2. The journal partition is read directly, nvs does not need to be initialized
+    else if (status_journal_load(value) == ESP_OK) {
+        s_boot_stats.source = STATUS_SOURCE_JOURNAL;
+        err = ESP_OK;
+    }
+#endif
+
+    s_boot_stats.restore_start_us = start_us;
+    s_boot_stats.restore_us = esp_timer_get_time() - start_us;
+
+    return err;
+}
+
+esp_err_t lightbulb_get_boot_stats(lightbulb_boot_stats_t *stats)
+{
+    LIGHTBULB_CHECK(stats, "stats is null", return ESP_ERR_INVALID_ARG);
+
+    memcpy(stats, &s_boot_stats, sizeof(lightbulb_boot_stats_t));
+
+    return ESP_OK;
+}
+
 esp_err_t lightbulb_status_set_to_nvs(const lightbulb_status_t *value)
 {
     LIGHTBULB_CHECK(value, "value is null", return ESP_ERR_INVALID_ARG);
@@ -92,6 +209,13 @@ esp_err_t lightbulb_status_set_to_nvs(const lightbulb_status_t *value)
     esp_err_t err = ESP_OK;
     nvs_handle_t handle = 0;
 
+#if CONFIG_LB_STATUS_USE_JOURNAL
+    // Without a journal partition the status is still kept in nvs
+    if (status_journal_open() == ESP_OK) {
+        return status_journal_append(value);
+    }
+#endif
+
     err = nvs_open(LIGHTBULB_NAMESPACE, NVS_READWRITE, &handle);
     LIGHTBULB_CHECK(err == ESP_OK, "nvs open fail, reason code: %d", return err, err);
 
@@ -114,6 +238,16 @@ esp_err_t lightbulb_status_get_from_nvs(lightbulb_status_t *value)
     nvs_handle_t handle = 0;
     size_t req_len = sizeof(lightbulb_status_t);
 
+#if CONFIG_LB_STATUS_USE_JOURNAL
+    // An empty journal falls through to nvs, which holds the status stored by an older firmware
+    if (status_journal_open() == ESP_OK) {
+        err = status_journal_load(value);
+        if (err != ESP_ERR_NOT_FOUND) {
+            return err;
+        }
+    }
+#endif
+
     err = nvs_open(LIGHTBULB_NAMESPACE, NVS_READWRITE, &handle);
     LIGHTBULB_CHECK(err == ESP_OK, "nvs open fail, reason code: %d", return err, err);
 
@@ -130,6 +264,24 @@ esp_err_t lightbulb_status_erase_nvs_storage(void)
     esp_err_t err = ESP_OK;
     nvs_handle_t handle = 0;
 
+    s_fast_restore_slot.magic = 0;
+
+#if CONFIG_LB_STATUS_USE_JOURNAL
+    if (status_journal_open() == ESP_OK) {
+        err = status_journal_erase();
+        LIGHTBULB_CHECK(err == ESP_OK, "journal erase fail, reason code: %d", return err, err);
+
+        // An empty journal falls back to nvs, so the status an older firmware left there goes too
+        if (nvs_open(LIGHTBULB_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+            if (nvs_erase_key(handle, LIGHTBULB_STORAGE_KEY) == ESP_OK) {
+                nvs_commit(handle);
+            }
+            nvs_close(handle);
+        }
+        return ESP_OK;
+    }
+#endif
+
     err = nvs_open(LIGHTBULB_NAMESPACE, NVS_READWRITE, &handle);
     LIGHTBULB_CHECK(err == ESP_OK, "nvs open fail, reason code: %d", return err, err);
 
@@ -144,6 +296,17 @@ esp_err_t lightbulb_status_erase_nvs_storage(void)
     return ESP_OK;
 }
 
+esp_err_t lightbulb_get_status_journal_stats(lightbulb_status_journal_stats_t *stats)
+{
+    LIGHTBULB_CHECK(stats, "stats is null", return ESP_ERR_INVALID_ARG);
+
+#if CONFIG_LB_STATUS_USE_JOURNAL
+    return status_journal_get_stats(stats);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
 /**
  * @brief Convert CCT percentage to Kelvin
  * @note
@@ -158,14 +321,9 @@ esp_err_t lightbulb_status_erase_nvs_storage(void)
  * @return uint16_t
  *
  */
-static uint16_t percentage_convert_to_kelvin(uint16_t percentage)
+static uint16_t percentage_convert_to_kelvin(lightbulb_obj_t *handle, uint16_t percentage)
 {
-    float _percentage = (float)percentage / 100;
-    uint16_t _kelvin = (_percentage * (s_lb_obj->kelvin_range.max - s_lb_obj->kelvin_range.min) + s_lb_obj->kelvin_range.min);
-
-    /* Convert to the nearest integer */
-    _kelvin = (_kelvin / 100) * 100;
-    return _kelvin;
+    return handle->kelvin_table[MIN(percentage, WHITE_TABLE_SIZE - 1)];
 }
 
 /**
@@ -181,16 +339,16 @@ static uint16_t percentage_convert_to_kelvin(uint16_t percentage)
  * @param kelvin
  * @return uint8_t
  */
-static uint8_t kelvin_convert_to_percentage(uint16_t kelvin)
+static uint8_t kelvin_convert_to_percentage(lightbulb_obj_t *handle, uint16_t kelvin)
 {
-    if (kelvin > s_lb_obj->kelvin_range.max) {
-        kelvin = s_lb_obj->kelvin_range.max;
+    if (kelvin > handle->kelvin_range.max) {
+        kelvin = handle->kelvin_range.max;
     }
-    if (kelvin < s_lb_obj->kelvin_range.min) {
-        kelvin = s_lb_obj->kelvin_range.min;
+    if (kelvin < handle->kelvin_range.min) {
+        kelvin = handle->kelvin_range.min;
     }
 
-    return 100 * ((float)(kelvin - s_lb_obj->kelvin_range.min) / (s_lb_obj->kelvin_range.max - s_lb_obj->kelvin_range.min));
+    return 100 * (kelvin - handle->kelvin_range.min) / (handle->kelvin_range.max - handle->kelvin_range.min);
 }
 
 /**
@@ -221,31 +379,13 @@ static uint8_t kelvin_convert_to_percentage(uint16_t kelvin)
  * @param out_warm range: 0-255
  *
  */
-static void cct_and_brightness_convert_to_cold_and_warm(uint8_t cct, uint8_t brightness, uint16_t *out_cold, uint16_t *out_warm)
-{
-    // 1. Calculate the percentage of cold and warm
-    float _warm = (100 - cct) / 100.0;
-    float _cold = cct / 100.0;
-    ESP_LOGD(TAG, "_warm:%f _cold:%f", _warm, _cold);
-
-    // 2. According to the maximum power assign percentage
-    float _warm_finally = _warm * 1.0;
-    float _cold_finally = _cold * 1.0;
-    float x = s_lb_obj->power.white_max_power / 100.0;
-    float max_power = x * (255.0);
-    ESP_LOGD(TAG, "x:%f, max_power:%f", x, max_power);
-    for (int i = 0; i <= max_power; i++) {
-        if (_warm_finally >= 255 || _cold_finally >= 255) {
-            break;
-        }
-        _warm_finally = _warm * i;
-        _cold_finally = _cold * i;
-    }
-    ESP_LOGD(TAG, "_warm_finally:%f _cold_finally:%f", _warm_finally, _cold_finally);
+static void cct_and_brightness_convert_to_cold_and_warm(lightbulb_obj_t *handle, uint8_t cct, uint8_t brightness, uint16_t *out_cold, uint16_t *out_warm)
+{
+    cct = MIN(cct, WHITE_TABLE_SIZE - 1);
 
-    // 3. Reassign based on brightness
-    *out_warm = _warm_finally * (brightness / 100.0);
-    *out_cold = _cold_finally * (brightness / 100.0);
+    // The tables hold the full brightness output in Q16 (16 fractional bits), scale it down to the requested brightness
+    *out_warm = handle->warm_table[cct] * brightness / (100 << 16);
+    *out_cold = handle->cold_table[cct] * brightness / (100 << 16);
 
     ESP_LOGD(TAG, "software cct: [input: %d %d], [output:%d %d]", cct, brightness, *out_cold, *out_warm);
 }
@@ -264,14 +404,14 @@ static void cct_and_brightness_convert_to_cold_and_warm(uint8_t cct, uint8_t bri
  *      1        10
  *      0        0
  */
-static uint8_t process_color_value_limit(uint8_t value)
+static uint8_t process_color_value_limit(lightbulb_obj_t *handle, uint8_t value)
 {
     if (value == 0) {
         return 0;
     }
     float percentage = value / 100.0;
 
-    uint8_t result = (s_lb_obj->power.color_max_value - s_lb_obj->power.color_min_value) * percentage + s_lb_obj->power.color_min_value;
+    uint8_t result = (handle->power.color_max_value - handle->power.color_min_value) * percentage + handle->power.color_min_value;
     ESP_LOGD(TAG, "color_value convert input:%d output:%d", value, result);
     return result;
 }
@@ -290,16 +430,44 @@ static uint8_t process_color_value_limit(uint8_t value)
  *      1        10
  *      0        0
  */
-static uint8_t process_white_brightness_limit(uint8_t brightness)
+static uint8_t process_white_brightness_limit(lightbulb_obj_t *handle, uint8_t brightness)
 {
-    if (brightness == 0) {
-        return 0;
-    }
-    float percentage = brightness / 100.0;
+    return handle->white_brightness_table[MIN(brightness, WHITE_TABLE_SIZE - 1)];
+}
 
-    uint8_t result = (s_lb_obj->power.white_max_brightness - s_lb_obj->power.white_min_brightness) * percentage + s_lb_obj->power.white_min_brightness;
-    ESP_LOGD(TAG, "white_brightness_output input:%d output:%d", brightness, result);
-    return result;
+/**
+ * @brief Build the white conversion tables from the Kelvin range and the power limits
+ *
+ * @note Runs once in lightbulb_init(), every white command is then a lookup.
+ * The values are the ones the per-call float conversions produced, the cold and warm outputs keep 16 fractional bits (Q16).
+ */
+static void white_table_build(lightbulb_obj_t *handle)
+{
+    float x = handle->power.white_max_power / 100.0;
+    int max_power = x * (255.0);
+
+    for (int i = 0; i < WHITE_TABLE_SIZE; i++) {
+        // 1. CCT percentage to Kelvin, rounded down to 100K
+        uint16_t _kelvin = ((float)i / 100) * (handle->kelvin_range.max - handle->kelvin_range.min) + handle->kelvin_range.min;
+        handle->kelvin_table[i] = (_kelvin / 100) * 100;
+
+        // 2. Scale the cold and warm ratio up until one channel reaches 255 or the maximum power is used
+        float _warm = (100 - i) / 100.0;
+        float _cold = i / 100.0;
+        float _larger = MAX(_warm, _cold);
+        int scale = MIN(max_power, (int)ceilf(255 / _larger));
+        while (scale > 0 && _larger * (scale - 1) >= 255) {
+            scale--;
+        }
+        while (scale < max_power && _larger * scale < 255) {
+            scale++;
+        }
+        handle->warm_table[i] = _warm * scale * 65536 + 0.5f;
+        handle->cold_table[i] = _cold * scale * 65536 + 0.5f;
+
+        // 3. Brightness percentage to the limited brightness
+        handle->white_brightness_table[i] = i ? (handle->power.white_max_brightness - handle->power.white_min_brightness) * (i / 100.0) + handle->power.white_min_brightness : 0;
+    }
 }
 
 /**
@@ -315,7 +483,7 @@ static uint8_t process_white_brightness_limit(uint8_t brightness)
  *      63,63,63        21,21,21                            42,42,42                            63,63,63
  *
  */
-static void process_color_power_limit(uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b)
+static void process_color_power_limit(lightbulb_obj_t *handle, uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b)
 {
     if (r == 0 && g == 0 && b == 0) {
         *out_r = 0;
@@ -328,15 +496,19 @@ static void process_color_power_limit(uint8_t r, uint8_t g, uint8_t b, uint16_t
     uint16_t gamma_r;
     uint16_t gamma_g;
     uint16_t gamma_b;
+    uint16_t balanced_r;
+    uint16_t balanced_g;
+    uint16_t balanced_b;
 
-    // 1. First we need to find the mapped value in the gamma table
-    hal_get_driver_feature(QUERY_MAX_INPUT_VALUE, &total);
-    hal_get_gamma_value(r, g, b, &gamma_r, &gamma_g, &gamma_b);
+    // 1. First we need to find the mapped value in the gamma table, with and without the white balance
+    hal_get_driver_feature(handle->hal, QUERY_MAX_INPUT_VALUE, &total);
+    hal_get_gamma_value(handle->hal, r, g, b, &gamma_r, &gamma_g, &gamma_b);
+    hal_get_balanced_gamma_value(handle->hal, r, g, b, &balanced_r, &balanced_g, &balanced_b);
 
     // 2. Second, we need to calculate the color distribution ratio of the rgb channel, and their ratio determines the final rendered color.
-    float rgb_ratio_r = gamma_r * 1.0 / (total);
-    float rgb_ratio_g = gamma_g * 1.0 / (total);
-    float rgb_ratio_b = gamma_b * 1.0 / (total);
+    float rgb_ratio_r = balanced_r * 1.0 / (total);
+    float rgb_ratio_g = balanced_g * 1.0 / (total);
+    float rgb_ratio_b = balanced_b * 1.0 / (total);
     ESP_LOGD(TAG, "rgb_ratio_r:%f rgb_ratio_g:%f rgb_ratio_b:%f total:%d", rgb_ratio_r, rgb_ratio_g, rgb_ratio_b, total);
 
     // 3. Next, we need to calculate the grayscale ratio, which provides a baseline value for subsequent power limiting.
@@ -348,7 +520,7 @@ static void process_color_power_limit(uint8_t r, uint8_t g, uint8_t b, uint16_t
     ESP_LOGD(TAG, "grayscale_ratio_r:%f grayscale_ratio_g:%f grayscale_ratio_b:%f baseline:%f", grayscale_ratio_r, grayscale_ratio_g, grayscale_ratio_b, baseline);
 
     // 4. Finally, we recalculate the final value based on the maximum allowed output power.
-    float x = s_lb_obj->power.color_max_power / 100.0;
+    float x = handle->power.color_max_power / 100.0;
     float max_power = x * (total);
     float max_power_baseline = MIN(total, baseline * max_power);
     ESP_LOGD(TAG, "x:%f, max_power:%f max_power_baseline:%f", x, max_power, max_power_baseline);
@@ -370,29 +542,71 @@ static void process_white_power_limit(uint8_t cold, uint8_t warm, uint8_t *out_c
     return;
 }
 
+/**
+ * @brief Output values of a color, limited like every color written by lightbulb_handle_set_hsv(handle)
+ *
+ * @param color_value Zeroed output, red, green and blue are filled
+ */
+static void color_output_value_calculate(lightbulb_obj_t *handle, uint16_t hue, uint8_t saturation, uint8_t value, uint16_t color_value[])
+{
+    // 1. calculate value
+    uint8_t _value = process_color_value_limit(handle, value);
+
+    // 2. convert to r g b
+    lightbulb_hsv2rgb(hue, saturation, _value, (uint8_t *)&color_value[0], (uint8_t *)&color_value[1], (uint8_t *)&color_value[2]);
+    ESP_LOGI(TAG, "8 bit color conversion value [r:%d g:%d b:%d]", color_value[0], color_value[1], color_value[2]);
+
+    // 3. according to power, re-calculate
+    process_color_power_limit(handle, color_value[0], color_value[1], color_value[2], &color_value[0], &color_value[1], &color_value[2]);
+}
+
+/**
+ * @brief Output values of a white, limited like every white written by lightbulb_handle_set_cctb(handle)
+ *
+ * @param cct range: 0-100
+ * @param white_value Zeroed output, the two white channels are filled
+ */
+static void white_output_value_calculate(lightbulb_obj_t *handle, uint8_t cct, uint8_t brightness, uint16_t white_value[])
+{
+    // 1. calculate brightness
+    ESP_LOGD(TAG, "input cct:%d brightness:%d", cct, brightness);
+    uint8_t _brightness = process_white_brightness_limit(handle, brightness);
+    ESP_LOGD(TAG, "setp_1 output cct:%d brightness:%d", cct, _brightness);
+
+    // 2. convert to cold warm
+    if (CHECK_WHITE_OUTPUT_REQ_MIXED()) {
+        cct_and_brightness_convert_to_cold_and_warm(handle, cct, _brightness, &white_value[3], &white_value[4]);
+        ESP_LOGI(TAG, "convert cold:%d warm:%d", white_value[3], white_value[4]);
+        process_white_power_limit(white_value[3], white_value[4], (uint8_t *)&white_value[3], (uint8_t *)&white_value[4]);
+    } else {
+        white_value[3] = cct * 255 / 100;
+        white_value[4] = _brightness * 255 / 100;
+        ESP_LOGI(TAG, "convert cct:%d brightness:%d", white_value[3], white_value[4]);
+    }
+}
+
 static void timercb(TimerHandle_t tmr)
 {
-    if (tmr == s_lb_obj->power_timer) {
-        hal_sleep_control(true);
-    } else if (tmr == s_lb_obj->storage_timer) {
-        lightbulb_status_set_to_nvs(&s_lb_obj->status);
-        if (s_lb_obj->cap.storage_cb) {
-            s_lb_obj->cap.storage_cb(s_lb_obj->status);
+    lightbulb_obj_t *handle = pvTimerGetTimerID(tmr);
+
+    if (tmr == handle->power_timer) {
+        hal_sleep_control(handle->hal, true);
+    } else if (tmr == handle->storage_timer) {
+        // Other instances only report their status, there is a single storage key
+        if (handle->is_default) {
+            lightbulb_status_set_to_nvs(&handle->status);
         }
-    } else if (tmr == s_lb_obj->effect_timer) {
-        lightbulb_basic_effect_stop();
-        void(*user_cb)(void) = pvTimerGetTimerID(tmr);
-        if (user_cb) {
-            user_cb();
+        if (handle->cap.storage_cb) {
+            handle->cap.storage_cb(handle->status);
         }
     }
 }
 
-static uint8_t get_channel_mask(lightbulb_works_mode_t cur_mode)
+static uint8_t get_channel_mask(lightbulb_obj_t *handle, lightbulb_works_mode_t cur_mode)
 {
     uint8_t channel_mask = 0;
     uint8_t allow_all_output = false;
-    hal_get_driver_feature(QUERY_IS_ALLOW_ALL_OUTPUT, &allow_all_output);
+    hal_get_driver_feature(handle->hal, QUERY_IS_ALLOW_ALL_OUTPUT, &allow_all_output);
     if (cur_mode == WORK_COLOR) {
         channel_mask = SELECT_COLOR_CHANNEL;
         /* If the driver cannot output all channels at the same time, it needs to be unselected in the App layer, such as driver IC: SM2135 */
@@ -408,58 +622,111 @@ static uint8_t get_channel_mask(lightbulb_works_mode_t cur_mode)
     return channel_mask;
 }
 
-static void print_func(void)
+static void print_func(lightbulb_obj_t *handle)
 {
     char *name;
 
-    hal_get_driver_feature(QUERY_DRIVER_NAME, &name);
+    hal_get_driver_feature(handle->hal, QUERY_DRIVER_NAME, &name);
     ESP_LOGI(TAG, "---------------------------------------------------------------------");
     ESP_LOGI(TAG, "lightbulb driver component version: %d.%d.%d", LIGHTBULB_DRIVER_VER_MAJOR, LIGHTBULB_DRIVER_VER_MINOR, LIGHTBULB_DRIVER_VER_PATCH);
     ESP_LOGI(TAG, "driver name: %s", name);
-    ESP_LOGI(TAG, "low power control: %s", s_lb_obj->cap.enable_lowpower ? "enable" : "disable");
-    ESP_LOGI(TAG, "status storage: %s", s_lb_obj->cap.enable_status_storage ? "enable" : "disable");
-    ESP_LOGI(TAG, "status storage delay %d ms", s_lb_obj->cap.enable_status_storage == true ? s_lb_obj->cap.storage_delay_ms : 0);
-    ESP_LOGI(TAG, "fade: %s", s_lb_obj->cap.enable_fades ? "enable" : "disable");
-    ESP_LOGI(TAG, "fade %d ms", s_lb_obj->cap.enable_fades == true ? s_lb_obj->cap.fades_ms : 0);
-    ESP_LOGI(TAG, "mode: %d", s_lb_obj->cap.mode_mask);
+    ESP_LOGI(TAG, "low power control: %s", handle->cap.enable_lowpower ? "enable" : "disable");
+    ESP_LOGI(TAG, "status storage: %s", handle->cap.enable_status_storage ? "enable" : "disable");
+    ESP_LOGI(TAG, "status storage delay %d ms", handle->cap.enable_status_storage == true ? handle->cap.storage_delay_ms : 0);
+    ESP_LOGI(TAG, "fade: %s", handle->cap.enable_fades ? "enable" : "disable");
+    ESP_LOGI(TAG, "fade %d ms", handle->cap.enable_fades == true ? handle->cap.fades_ms : 0);
+    ESP_LOGI(TAG, "mode: %d", handle->cap.mode_mask);
     if (CHECK_WHITE_CHANNEL_IS_SELECT()) {
         ESP_LOGI(TAG, "     white mode: enable");
     }
     if (CHECK_COLOR_CHANNEL_IS_SELECT()) {
         ESP_LOGI(TAG, "     color mode: enable");
     }
-    ESP_LOGI(TAG, "mix cct: %s", s_lb_obj->cap.enable_mix_cct ? "enable" : "disable");
-    ESP_LOGI(TAG, "sync change: %s", s_lb_obj->cap.sync_change_brightness_value ? "enable" : "disable");
+    ESP_LOGI(TAG, "mix cct: %s", handle->cap.enable_mix_cct ? "enable" : "disable");
+    ESP_LOGI(TAG, "sync change: %s", handle->cap.sync_change_brightness_value ? "enable" : "disable");
     ESP_LOGI(TAG, "power limit param: ");
-    ESP_LOGI(TAG, "     white max brightness: %d", s_lb_obj->power.white_max_brightness);
-    ESP_LOGI(TAG, "     white min brightness: %d", s_lb_obj->power.white_min_brightness);
-    ESP_LOGI(TAG, "     white max power: %d", s_lb_obj->power.white_max_power);
-    ESP_LOGI(TAG, "     color max brightness: %d", s_lb_obj->power.color_max_value);
-    ESP_LOGI(TAG, "     color min brightness: %d", s_lb_obj->power.color_min_value);
-    ESP_LOGI(TAG, "     color max power: %d", s_lb_obj->power.color_max_power);
+    ESP_LOGI(TAG, "     white max brightness: %d", handle->power.white_max_brightness);
+    ESP_LOGI(TAG, "     white min brightness: %d", handle->power.white_min_brightness);
+    ESP_LOGI(TAG, "     white max power: %d", handle->power.white_max_power);
+    ESP_LOGI(TAG, "     color max brightness: %d", handle->power.color_max_value);
+    ESP_LOGI(TAG, "     color min brightness: %d", handle->power.color_min_value);
+    ESP_LOGI(TAG, "     color max power: %d", handle->power.color_max_power);
     if (CHECK_WHITE_CHANNEL_IS_SELECT()) {
         ESP_LOGI(TAG, "cct kelvin range param: ");
-        ESP_LOGI(TAG, "     max cct: %d", s_lb_obj->kelvin_range.max);
-        ESP_LOGI(TAG, "     min cct: %d", s_lb_obj->kelvin_range.min);
-        ESP_LOGI(TAG, "cct: %d%%, %dK, brightness: %d", s_lb_obj->status.cct_percentage, percentage_convert_to_kelvin(s_lb_obj->status.cct_percentage), s_lb_obj->status.brightness);
+        ESP_LOGI(TAG, "     max cct: %d", handle->kelvin_range.max);
+        ESP_LOGI(TAG, "     min cct: %d", handle->kelvin_range.min);
+        ESP_LOGI(TAG, "cct: %d%%, %dK, brightness: %d", handle->status.cct_percentage, percentage_convert_to_kelvin(handle, handle->status.cct_percentage), handle->status.brightness);
+    }
+    ESP_LOGI(TAG, "hue: %d, saturation: %d, value: %d", handle->status.hue, handle->status.saturation, handle->status.value);
+    ESP_LOGI(TAG, "select works mode: %s, power status: %d", handle->status.mode == WORK_COLOR ? "color" : "white", handle->status.on);
+    if (s_boot_stats.restore_start_us) {
+        ESP_LOGI(TAG, "fast restore: source %d, read in %"PRIu32" us, light on %"PRIu32" us after boot", s_boot_stats.source, s_boot_stats.restore_us, s_boot_stats.light_on_us);
     }
-    ESP_LOGI(TAG, "hue: %d, saturation: %d, value: %d", s_lb_obj->status.hue, s_lb_obj->status.saturation, s_lb_obj->status.value);
-    ESP_LOGI(TAG, "select works mode: %s, power status: %d", s_lb_obj->status.mode == WORK_COLOR ? "color" : "white", s_lb_obj->status.on);
     ESP_LOGI(TAG, "---------------------------------------------------------------------");
 }
 
-esp_err_t lightbulb_init(lightbulb_config_t *config)
+static esp_err_t instance_delete(lightbulb_obj_t *handle)
+{
+    esp_err_t err = ESP_OK;
+
+    if (s_lb_list_mutex) {
+        xSemaphoreTake(s_lb_list_mutex, portMAX_DELAY);
+        for (lightbulb_obj_t **node = &s_lb_list; *node; node = &(*node)->next) {
+            if (*node == handle) {
+                *node = handle->next;
+                break;
+            }
+        }
+        xSemaphoreGive(s_lb_list_mutex);
+    }
+
+    if (handle->power_timer) {
+        xTimerStop(handle->power_timer, 0);
+        xTimerDelete(handle->power_timer, 0);
+        handle->power_timer = NULL;
+    }
+
+    if (handle->storage_timer) {
+        xTimerStop(handle->storage_timer, 0);
+        xTimerDelete(handle->storage_timer, 0);
+        handle->storage_timer = NULL;
+    }
+#if CONFIG_LB_STATUS_USE_JOURNAL
+    if (handle->is_default) {
+        status_journal_close();
+    }
+#endif
+    if (handle->hal) {
+        err = hal_output_deinit(handle->hal);
+    }
+    if (handle->mutex) {
+        vSemaphoreDelete(handle->mutex);
+    }
+    free(handle);
+
+    return err;
+}
+
+static esp_err_t instance_create(lightbulb_config_t *config, bool is_default, lightbulb_handle_t *out_handle)
 {
     esp_err_t err = ESP_FAIL;
     LIGHTBULB_CHECK(config, "Config is null", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(config->type > DRIVER_SELECT_INVALID, "Invalid driver select", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_CHECK(!s_lb_obj, "Already init done", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_CHECK(out_handle, "handle is null", return ESP_ERR_INVALID_ARG);
+
+    // Concurrent first inits must not create two list mutexes
+    portENTER_CRITICAL(&s_lb_list_lock);
+    if (!s_lb_list_mutex) {
+        s_lb_list_mutex = xSemaphoreCreateMutexStatic(&s_lb_list_mutex_buffer);
+    }
+    portEXIT_CRITICAL(&s_lb_list_lock);
 
-    s_lb_obj = calloc(1, sizeof(lightbulb_obj_t));
-    LIGHTBULB_CHECK(s_lb_obj, "calloc fail", goto EXIT);
+    lightbulb_obj_t *handle = calloc(1, sizeof(lightbulb_obj_t));
+    LIGHTBULB_CHECK(handle, "calloc fail", return ESP_ERR_NO_MEM);
+    handle->is_default = is_default;
 
-    s_lb_obj->mutex = xSemaphoreCreateMutex();
-    LIGHTBULB_CHECK(s_lb_obj->mutex, "mutex create fail", goto EXIT);
+    handle->mutex = xSemaphoreCreateMutex();
+    LIGHTBULB_CHECK(handle->mutex, "mutex create fail", goto EXIT);
 
     // hal configuration
     void *driver_conf = NULL;
@@ -510,7 +777,12 @@ esp_err_t lightbulb_init(lightbulb_config_t *config)
         }
     }
 #endif
-    if (config->type != DRIVER_ESP_PWM && config->type != DRIVER_WS2812) {
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+    if (config->type == DRIVER_SIMULATED) {
+        driver_conf = (void *) & (config->driver_conf.simulated);
+    }
+#endif
+    if (config->type != DRIVER_ESP_PWM && config->type != DRIVER_WS2812 && config->type != DRIVER_SIMULATED) {
         if (config->capability.enable_mix_cct != true) {
             config->capability.enable_mix_cct = true;
             ESP_LOGW(TAG, "The IIC dimming chip must enable CCT mix, rewrite the enable_mix_cct variable to true.");
@@ -520,195 +792,279 @@ esp_err_t lightbulb_init(lightbulb_config_t *config)
         .type = config->type,
         .driver_data = driver_conf,
     };
-    err = hal_output_init(&hal_conf, config->gamma_conf, (void *)&config->init_status.mode);
+    err = hal_output_init(&hal_conf, config->gamma_conf, (void *)&config->init_status.mode, &handle->hal);
     LIGHTBULB_CHECK(err == ESP_OK, "hal init fail", goto EXIT);
 
     // Load init status
-    memcpy(&s_lb_obj->status, &config->init_status, sizeof(lightbulb_status_t));
-    memcpy(&s_lb_obj->cap, &config->capability, sizeof(lightbulb_capability_t));
+    memcpy(&handle->status, &config->init_status, sizeof(lightbulb_status_t));
+    memcpy(&handle->cap, &config->capability, sizeof(lightbulb_capability_t));
 
     // Channel registration
     if (CHECK_COLOR_CHANNEL_IS_SELECT()) {
         if (config->type == DRIVER_ESP_PWM) {
-            hal_regist_channel(CHANNEL_ID_RED, config->io_conf.pwm_io.red);
-            hal_regist_channel(CHANNEL_ID_GREEN, config->io_conf.pwm_io.green);
-            hal_regist_channel(CHANNEL_ID_BLUE, config->io_conf.pwm_io.blue);
+            hal_regist_channel(handle->hal, CHANNEL_ID_RED, config->io_conf.pwm_io.red);
+            hal_regist_channel(handle->hal, CHANNEL_ID_GREEN, config->io_conf.pwm_io.green);
+            hal_regist_channel(handle->hal, CHANNEL_ID_BLUE, config->io_conf.pwm_io.blue);
         } else {
-            hal_regist_channel(CHANNEL_ID_RED, config->io_conf.iic_io.red);
-            hal_regist_channel(CHANNEL_ID_GREEN, config->io_conf.iic_io.green);
-            hal_regist_channel(CHANNEL_ID_BLUE, config->io_conf.iic_io.blue);
+            hal_regist_channel(handle->hal, CHANNEL_ID_RED, config->io_conf.iic_io.red);
+            hal_regist_channel(handle->hal, CHANNEL_ID_GREEN, config->io_conf.iic_io.green);
+            hal_regist_channel(handle->hal, CHANNEL_ID_BLUE, config->io_conf.iic_io.blue);
         }
     }
     if (CHECK_WHITE_CHANNEL_IS_SELECT()) {
         if (config->type == DRIVER_ESP_PWM) {
-            hal_regist_channel(CHANNEL_ID_COLD_CCT_WHITE, config->io_conf.pwm_io.cold_cct);
-            hal_regist_channel(CHANNEL_ID_WARM_BRIGHTNESS_YELLOW, config->io_conf.pwm_io.warm_brightness);
+            hal_regist_channel(handle->hal, CHANNEL_ID_COLD_CCT_WHITE, config->io_conf.pwm_io.cold_cct);
+            hal_regist_channel(handle->hal, CHANNEL_ID_WARM_BRIGHTNESS_YELLOW, config->io_conf.pwm_io.warm_brightness);
         } else {
-            hal_regist_channel(CHANNEL_ID_COLD_CCT_WHITE, config->io_conf.iic_io.cold_white);
-            hal_regist_channel(CHANNEL_ID_WARM_BRIGHTNESS_YELLOW, config->io_conf.iic_io.warm_yellow);
+            hal_regist_channel(handle->hal, CHANNEL_ID_COLD_CCT_WHITE, config->io_conf.iic_io.cold_white);
+            hal_regist_channel(handle->hal, CHANNEL_ID_WARM_BRIGHTNESS_YELLOW, config->io_conf.iic_io.warm_yellow);
         }
     }
 
     // monitor cb
     if (config->capability.monitor_cb) {
-        hal_register_monitor_cb(config->capability.monitor_cb);
+        hal_register_monitor_cb(handle->hal, config->capability.monitor_cb);
     }
 
     // Fade check
-    if (s_lb_obj->cap.enable_fades) {
-        s_lb_obj->cap.fades_ms = MIN(MAX_FADE_MS, s_lb_obj->cap.fades_ms);
-        s_lb_obj->cap.fades_ms = MAX(MIN_FADE_MS, s_lb_obj->cap.fades_ms);
+    if (handle->cap.enable_fades) {
+        handle->cap.fades_ms = MIN(MAX_FADE_MS, handle->cap.fades_ms);
+        handle->cap.fades_ms = MAX(MIN_FADE_MS, handle->cap.fades_ms);
+    }
+    if (handle->cap.fade_curve >= FADE_CURVE_MAX) {
+        handle->cap.fade_curve = FADE_CURVE_LINEAR;
+        ESP_LOGW(TAG, "Invalid fade curve, rewrite the fade_curve variable to linear.");
     }
 
     // Low power check
     if (config->capability.enable_lowpower) {
         /* Make sure the fade is done and the flash operation is done, then enable light sleep */
-        uint32_t time_ms = MAX(s_lb_obj->cap.fades_ms, s_lb_obj->cap.storage_delay_ms) + 1000;
-        s_lb_obj->power_timer = xTimerCreate("power_timer", pdMS_TO_TICKS(time_ms), false, NULL, timercb);
-        LIGHTBULB_CHECK(s_lb_obj->power_timer != NULL, "create timer fail", goto EXIT);
+        uint32_t time_ms = MAX(handle->cap.fades_ms, handle->cap.storage_delay_ms) + 1000;
+        handle->power_timer = xTimerCreate("power_timer", pdMS_TO_TICKS(time_ms), false, handle, timercb);
+        LIGHTBULB_CHECK(handle->power_timer != NULL, "create timer fail", goto EXIT);
     }
 
     // Storage check
     if (config->capability.enable_status_storage) {
-        s_lb_obj->cap.storage_delay_ms = MAX(s_lb_obj->cap.fades_ms, s_lb_obj->cap.storage_delay_ms) + 1000;
-        s_lb_obj->storage_timer = xTimerCreate("storage_timer", pdMS_TO_TICKS(s_lb_obj->cap.storage_delay_ms), false, NULL, timercb);
-        LIGHTBULB_CHECK(s_lb_obj->storage_timer != NULL, "create timer fail", goto EXIT);
+        handle->cap.storage_delay_ms = MAX(handle->cap.fades_ms, handle->cap.storage_delay_ms) + 1000;
+        handle->storage_timer = xTimerCreate("storage_timer", pdMS_TO_TICKS(handle->cap.storage_delay_ms), false, handle, timercb);
+        LIGHTBULB_CHECK(handle->storage_timer != NULL, "create timer fail", goto EXIT);
     }
 
     // Power Limit check
     if (config->external_limit) {
-        memcpy(&s_lb_obj->power, config->external_limit, sizeof(lightbulb_power_limit_t));
+        memcpy(&handle->power, config->external_limit, sizeof(lightbulb_power_limit_t));
     } else {
-        s_lb_obj->power.color_max_value = 100;
-        s_lb_obj->power.white_max_brightness = 100;
-        s_lb_obj->power.color_min_value = 1;
-        s_lb_obj->power.white_min_brightness = 1;
-        s_lb_obj->power.color_max_power = 300;
-        s_lb_obj->power.white_max_power = 200;
+        handle->power.color_max_value = 100;
+        handle->power.white_max_brightness = 100;
+        handle->power.color_min_value = 1;
+        handle->power.white_min_brightness = 1;
+        handle->power.color_max_power = 300;
+        handle->power.white_max_power = 200;
     }
 
     // cct Limit check
     if (CHECK_WHITE_CHANNEL_IS_SELECT()) {
         if (config->kelvin_range) {
-            memcpy(&s_lb_obj->kelvin_range, config->kelvin_range, sizeof(lightbulb_cct_kelvin_range_t));
-            LIGHTBULB_CHECK(s_lb_obj->kelvin_range.max > s_lb_obj->kelvin_range.min, "CCT data error", goto EXIT)
+            memcpy(&handle->kelvin_range, config->kelvin_range, sizeof(lightbulb_cct_kelvin_range_t));
+            LIGHTBULB_CHECK(handle->kelvin_range.max > handle->kelvin_range.min, "CCT data error", goto EXIT)
         } else {
-            s_lb_obj->kelvin_range.max = MAX_CCT_K;
-            s_lb_obj->kelvin_range.min = MIN_CCT_K;
+            handle->kelvin_range.max = MAX_CCT_K;
+            handle->kelvin_range.min = MIN_CCT_K;
         }
     }
+    white_table_build(handle);
 
     // Output status according to init parameter
-    if (s_lb_obj->status.on) {
+    if (handle->status.on) {
         /* Fade can cause perceptible state changes when the system restarts abnormally, so we need to temporarily disable fade. */
-        if (s_lb_obj->cap.enable_fades) {
-            lightbulb_set_fades_function(false);
-            lightbulb_set_switch(true);
-            lightbulb_set_fades_function(true);
+        if (handle->cap.enable_fades) {
+            lightbulb_handle_set_fades_function(handle, false);
+            lightbulb_handle_set_switch(handle, true);
+            lightbulb_handle_set_fades_function(handle, true);
         } else {
-            lightbulb_set_switch(true);
+            lightbulb_handle_set_switch(handle, true);
+        }
+        // Boot-to-light latency of the init following lightbulb_status_fast_restore()
+        if (handle->is_default && s_boot_stats.restore_start_us && !s_boot_stats.light_on_us) {
+            s_boot_stats.light_on_us = esp_timer_get_time();
         }
     }
 
-    print_func();
+    xSemaphoreTake(s_lb_list_mutex, portMAX_DELAY);
+    handle->next = s_lb_list;
+    s_lb_list = handle;
+    xSemaphoreGive(s_lb_list_mutex);
+
+    print_func(handle);
+    *out_handle = handle;
 
     return ESP_OK;
 
 EXIT:
-    lightbulb_deinit();
+    instance_delete(handle);
 
     return err;
 }
 
+esp_err_t lightbulb_init(lightbulb_config_t *config)
+{
+    LIGHTBULB_CHECK(!s_lb_obj, "Already init done", return ESP_ERR_INVALID_STATE);
+
+    return instance_create(config, true, &s_lb_obj);
+}
+
 esp_err_t lightbulb_deinit(void)
 {
     LIGHTBULB_CHECK(s_lb_obj, "deinit fail", return ESP_ERR_INVALID_STATE);
 
-    if (s_lb_obj->power_timer) {
-        xTimerStop(s_lb_obj->power_timer, 0);
-        xTimerDelete(s_lb_obj->power_timer, 0);
-        s_lb_obj->power_timer = NULL;
-    }
+    lightbulb_obj_t *handle = s_lb_obj;
+    s_lb_obj = NULL;
 
-    if (s_lb_obj->storage_timer) {
-        xTimerStop(s_lb_obj->storage_timer, 0);
-        xTimerDelete(s_lb_obj->storage_timer, 0);
-        s_lb_obj->storage_timer = NULL;
-    }
+    return instance_delete(handle);
+}
 
-    if (s_lb_obj->effect_timer) {
-        xTimerStop(s_lb_obj->effect_timer, 0);
-        xTimerDelete(s_lb_obj->effect_timer, 0);
-        s_lb_obj->effect_timer = NULL;
-    }
-    free(s_lb_obj);
-    s_lb_obj = NULL;
+esp_err_t lightbulb_create(lightbulb_config_t *config, lightbulb_handle_t *handle)
+{
+    return instance_create(config, false, handle);
+}
+
+esp_err_t lightbulb_delete(lightbulb_handle_t handle)
+{
+    LIGHTBULB_CHECK(handle, "handle is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle != s_lb_obj, "the default instance is deleted by lightbulb_deinit()", return ESP_ERR_INVALID_ARG);
 
-    return hal_output_deinit();
+    return instance_delete(handle);
 }
 
-esp_err_t lightbulb_set_xyy(float x, float y, float Y)
+esp_err_t lightbulb_handle_set_xyy(lightbulb_handle_t handle, float x, float y, float Y)
 {
     LIGHTBULB_CHECK(x <= 1.0, "x out of range", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_CHECK(y <= 1.0, "y out of range", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(y > 0 && y <= 1.0, "y out of range", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(Y <= 100.0, "Y out of range", return ESP_ERR_INVALID_ARG);
 
     uint8_t r, g, b;
     uint16_t h;
     uint8_t s, v;
 
-    lightbulb_xyy2rgb(x, y, Y, &r, &g, &b);
-    lightbulb_rgb2hsv(r, g, b, &h, &s, &v);
+    esp_err_t err = lightbulb_xyy2rgb(x, y, Y, &r, &g, &b);
+    LIGHTBULB_CHECK(err == ESP_OK, "xyY convert fail", return err);
+    err = lightbulb_rgb2hsv(r, g, b, &h, &s, &v);
+    LIGHTBULB_CHECK(err == ESP_OK, "rgb convert fail", return err);
+
+    return lightbulb_handle_set_hsv(handle, h, s, v);
+}
+
+/**
+ * @brief sRGB 8-bit code to linear light, 65535 is full scale
+ *
+ */
+static const uint16_t s_srgb_to_linear_table[256] = {
+        0,    20,    40,    60,    80,    99,   119,   139,   159,   179,   199,   219,
+      241,   264,   288,   313,   340,   367,   396,   427,   458,   491,   526,   562,
+      599,   637,   677,   718,   761,   805,   851,   898,   947,   997,  1048,  1101,
+     1156,  1212,  1270,  1330,  1391,  1453,  1517,  1583,  1651,  1720,  1790,  1863,
+     1937,  2013,  2090,  2170,  2250,  2333,  2418,  2504,  2592,  2681,  2773,  2866,
+     2961,  3058,  3157,  3258,  3360,  3464,  3570,  3678,  3788,  3900,  4014,  4129,
+     4247,  4366,  4488,  4611,  4736,  4864,  4993,  5124,  5257,  5392,  5530,  5669,
+     5810,  5953,  6099,  6246,  6395,  6547,  6700,  6856,  7014,  7174,  7335,  7500,
+     7666,  7834,  8004,  8177,  8352,  8528,  8708,  8889,  9072,  9258,  9445,  9635,
+     9828, 10022, 10219, 10417, 10619, 10822, 11028, 11235, 11446, 11658, 11873, 12090,
+    12309, 12530, 12754, 12980, 13209, 13440, 13673, 13909, 14146, 14387, 14629, 14874,
+    15122, 15371, 15623, 15878, 16135, 16394, 16656, 16920, 17187, 17456, 17727, 18001,
+    18277, 18556, 18837, 19121, 19407, 19696, 19987, 20281, 20577, 20876, 21177, 21481,
+    21787, 22096, 22407, 22721, 23038, 23357, 23678, 24002, 24329, 24658, 24990, 25325,
+    25662, 26001, 26344, 26688, 27036, 27386, 27739, 28094, 28452, 28813, 29176, 29542,
+    29911, 30282, 30656, 31033, 31412, 31794, 32179, 32567, 32957, 33350, 33745, 34143,
+    34544, 34948, 35355, 35764, 36176, 36591, 37008, 37429, 37852, 38278, 38706, 39138,
+    39572, 40009, 40449, 40891, 41337, 41785, 42236, 42690, 43147, 43606, 44069, 44534,
+    45002, 45473, 45947, 46423, 46903, 47385, 47871, 48359, 48850, 49344, 49841, 50341,
+    50844, 51349, 51858, 52369, 52884, 53401, 53921, 54445, 54971, 55500, 56032, 56567,
+    57105, 57646, 58190, 58737, 59287, 59840, 60396, 60955, 61517, 62082, 62650, 63221,
+    63795, 64372, 64952, 65535,
+};
+
+/**
+ * @brief Smallest linear light, 65535 is full scale, that is encoded to each sRGB 8-bit code
+ *
+ * @note Uses the same gamma curve as the float conversion it replaces, 0.00304 linear threshold included.
+ *
+ */
+static const uint16_t s_linear_to_srgb_threshold_table[256] = {
+        0,    10,    30,    50,    70,    90,   110,   130,   150,   170,   189,   209,
+      230,   253,   276,   301,   327,   354,   382,   412,   443,   475,   509,   544,
+      580,   618,   657,   698,   740,   783,   828,   875,   923,   972,  1023,  1075,
+     1129,  1185,  1242,  1300,  1360,  1422,  1486,  1551,  1617,  1685,  1755,  1827,
+     1900,  1975,  2052,  2130,  2210,  2292,  2376,  2461,  2548,  2637,  2727,  2820,
+     2914,  3010,  3108,  3208,  3309,  3412,  3518,  3625,  3734,  3844,  3957,  4072,
+     4188,  4307,  4427,  4550,  4674,  4800,  4928,  5059,  5191,  5325,  5461,  5599,
+     5740,  5882,  6026,  6173,  6321,  6471,  6624,  6778,  6935,  7094,  7255,  7418,
+     7583,  7750,  7919,  8091,  8265,  8440,  8618,  8798,  8981,  9165,  9352,  9541,
+     9732,  9925, 10121, 10318, 10518, 10720, 10925, 11132, 11341, 11552, 11765, 11981,
+    12199, 12420, 12643, 12868, 13095, 13325, 13557, 13791, 14028, 14267, 14508, 14752,
+    14998, 15247, 15498, 15751, 16007, 16265, 16525, 16788, 17054, 17321, 17592, 17864,
+    18139, 18417, 18697, 18980, 19264, 19552, 19842, 20134, 20429, 20727, 21027, 21329,
+    21634, 21942, 22252, 22564, 22880, 23197, 23518, 23840, 24166, 24494, 24824, 25158,
+    25493, 25832, 26173, 26516, 26862, 27211, 27563, 27917, 28273, 28633, 28995, 29359,
+    29727, 30097, 30469, 30845, 31223, 31603, 31987, 32373, 32762, 33153, 33547, 33944,
+    34344, 34747, 35152, 35560, 35970, 36384, 36800, 37219, 37640, 38065, 38492, 38922,
+    39355, 39790, 40229, 40670, 41114, 41561, 42011, 42463, 42918, 43377, 43838, 44301,
+    44768, 45238, 45710, 46185, 46663, 47144, 47628, 48115, 48605, 49097, 49593, 50091,
+    50592, 51096, 51604, 52114, 52627, 53142, 53661, 54183, 54708, 55235, 55766, 56300,
+    56836, 57376, 57918, 58464, 59012, 59564, 60118, 60675, 61236, 61799, 62366, 62935,
+    63508, 64083, 64662, 65244,
+};
+
+#define LINEAR_FULL_SCALE                               (65535)
+
+static uint8_t linear_convert_to_srgb(int64_t linear)
+{
+    uint8_t code = 0;
+
+    if (linear <= 0) {
+        return 0;
+    }
+    if (linear >= LINEAR_FULL_SCALE) {
+        return 255;
+    }
 
-    return lightbulb_set_hsv(h, s, v);
+    // Largest code whose threshold is reached
+    for (uint8_t bit = 0x80; bit; bit >>= 1) {
+        if (s_linear_to_srgb_threshold_table[code | bit] <= linear) {
+            code |= bit;
+        }
+    }
+    return code;
 }
 
 esp_err_t lightbulb_xyy2rgb(float x, float y, float Y, uint8_t *red, uint8_t *green, uint8_t *blue)
 {
     LIGHTBULB_CHECK(x <= 1.0, "x out of range", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_CHECK(y <= 1.0, "y out of range", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(y > 0 && y <= 1.0, "y out of range", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(Y <= 100.0, "Y out of range", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_CHECK(red, "red is null", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(green, "green is null", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(blue, "blue is null", return ESP_ERR_INVALID_ARG);
 
-    float _x = x;
-    float _y = y;
-    float _z = 1.0f - _x - _y;
-    float _X, _Y, _Z;
-    float _r, _g, _b;
+    // 1. Fixed point inputs, chromaticity in Q16, luminance in linear full scale
+    int64_t _x = (int64_t)(x * 65536 + 0.5f);
+    int64_t _y = MAX((int64_t)(y * 65536 + 0.5f), 1);
+    int64_t _Y = (int64_t)(Y * (LINEAR_FULL_SCALE / 100.0f) + 0.5f);
 
-    // Calculate XYZ values
-    _Y = Y / 100.0;
-    _X = (_Y / _y) * _x;
-    _Z = (_Y / _y) * _z;
+    // 2. Calculate XYZ values
+    int64_t _X = _Y * _x / _y;
+    int64_t _Z = _Y * (65536 - _x - _y) / _y;
 
-    // X, Y and Z input refer to a D65/2° standard illuminant.
-    // sR, sG and sB (standard RGB) output range = 0 ÷ 255
-    // convert XYZ to RGB - CIE XYZ to sRGB
-    _r = (_X * 3.2410f) - (_Y * 1.5374f) - (_Z * 0.4986f);
-    _g = -(_X * 0.9692f) + (_Y * 1.8760f) + (_Z * 0.0416f);
-    _b = (_X * 0.0556f) - (_Y * 0.2040f) + (_Z * 1.0570f);
+    // 3. X, Y and Z input refer to a D65/2° standard illuminant, convert XYZ to linear sRGB, coefficients are scaled by 10000
+    int64_t _r = (_X * 32410 - _Y * 15374 - _Z * 4986) / 10000;
+    int64_t _g = (-_X * 9692 + _Y * 18760 + _Z * 416) / 10000;
+    int64_t _b = (_X * 556 - _Y * 2040 + _Z * 10570) / 10000;
 
-    // apply gamma 2.2 correction
-    _r = (_r <= 0.00304f ? 12.92f * _r : (1.055f) * pow(_r, (1.0f / 2.4f)) - 0.055f);
-    _g = (_g <= 0.00304f ? 12.92f * _g : (1.055f) * pow(_g, (1.0f / 2.4f)) - 0.055f);
-    _b = (_b <= 0.00304f ? 12.92f * _b : (1.055f) * pow(_b, (1.0f / 2.4f)) - 0.055f);
-
-    // Round off
-    _r = MIN(1.0, _r);
-    _r = MAX(0, _r);
-
-    _g = MIN(1.0, _g);
-    _g = MAX(0, _g);
-
-    _b = MIN(1.0, _b);
-    _b = MAX(0, _b);
-
-    *red = (uint8_t)(_r * 255 + 0.5);
-    *green = (uint8_t)(_g * 255 + 0.5);
-    *blue = (uint8_t)(_b * 255 + 0.5);
+    // 4. Apply gamma and round off, out of range values are clamped
+    *red = linear_convert_to_srgb(_r);
+    *green = linear_convert_to_srgb(_g);
+    *blue = linear_convert_to_srgb(_b);
 
     return ESP_OK;
 }
@@ -719,39 +1075,21 @@ esp_err_t lightbulb_rgb2xyy(uint8_t red, uint8_t green, uint8_t blue, float *x,
     LIGHTBULB_CHECK(x, "x is null", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(y, "y is null", return ESP_ERR_INVALID_ARG);
 
-    float _red = red / 255.0;
-    float _green = green / 255.0;
-    float _blue = blue / 255.0;
-
-    if (_red > 0.04045) {
-        _red = pow(( _red + 0.055 ) / 1.055, 2.4);
-    } else {
-        _red = _red / 12.92;
-    }
-
-    if ( _green > 0.04045 ) {
-        _green = pow(( _green + 0.055 ) / 1.055, 2.4);
-    } else {
-        _green = _green / 12.92;
-    }
-
-    if ( _blue > 0.04045 ) {
-        _blue = pow(( _blue + 0.055 ) / 1.055, 2.4);
-    } else {
-        _blue = _blue / 12.92;
-    }
-
-    _red = _red * 100;
-    _green = _green * 100;
-    _blue = _blue * 100;
+    // 1. Remove gamma, linear full scale
+    int32_t _red = s_srgb_to_linear_table[red];
+    int32_t _green = s_srgb_to_linear_table[green];
+    int32_t _blue = s_srgb_to_linear_table[blue];
 
-    float _X = _red * 0.4124 + _green * 0.3576 + _blue * 0.1805;
-    float _Y = _red * 0.2126 + _green * 0.7152 + _blue * 0.0722;
-    float _Z = _red * 0.0193 + _green * 0.1192 + _blue * 0.9505;
+    // 2. Convert linear sRGB to XYZ, coefficients are scaled by 10000
+    int32_t _X = _red * 4124 + _green * 3576 + _blue * 1805;
+    int32_t _Y = _red * 2126 + _green * 7152 + _blue * 722;
+    int32_t _Z = _red * 193 + _green * 1192 + _blue * 9505;
+    int32_t sum = _X + _Y + _Z;
 
-    *Y = _Y;
-    *x = _X / ( _X + _Y + _Z );
-    *y = _Y / ( _X + _Y + _Z );
+    // 3. Black has no chromaticity, report the white point coordinates 0
+    *Y = _Y / (LINEAR_FULL_SCALE * 100.0f);
+    *x = sum ? (float)_X / sum : 0;
+    *y = sum ? (float)_Y / sum : 0;
 
     return ESP_OK;
 }
@@ -831,580 +1169,760 @@ esp_err_t lightbulb_rgb2hsv(uint16_t red, uint16_t green, uint16_t blue, uint16_
     LIGHTBULB_CHECK(green <= 255, "green out of range", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(blue <= 255, "blue out of range", return ESP_ERR_INVALID_ARG);
 
-    float _hue, _saturation, _value;
-    float m_max = MAX(red, MAX(green, blue));
-    float m_min = MIN(red, MIN(green, blue));
-    float m_delta = m_max - m_min;
-
-    _value = m_max / 255.0;
+    int32_t m_max = MAX(red, MAX(green, blue));
+    int32_t m_min = MIN(red, MIN(green, blue));
+    int32_t m_delta = m_max - m_min;
+    int32_t _hue = 0;
 
+    // Hue in degrees scaled by m_delta, rounded on the final division
     if (m_delta == 0) {
-        _hue = 0;
-        _saturation = 0;
+        *hue = 0;
+        *saturation = 0;
     } else {
-        _saturation = m_delta / m_max;
-
         if (red == m_max) {
-            _hue = (green - blue) / m_delta;
+            _hue = 60 * ((int32_t)green - (int32_t)blue);
         } else if (green == m_max) {
-            _hue = 2 + (blue - red) / m_delta;
+            _hue = 120 * m_delta + 60 * ((int32_t)blue - (int32_t)red);
         } else {
-            _hue = 4 + (red - green) / m_delta;
+            _hue = 240 * m_delta + 60 * ((int32_t)red - (int32_t)green);
         }
 
-        _hue = _hue * 60;
-
         if (_hue < 0) {
-            _hue = _hue + 360;
+            _hue += 360 * m_delta;
         }
-    }
 
-    *hue = (int)(_hue + 0.5);
-    *saturation = (int)(_saturation * 100 + 0.5);
-    *value = (int)(_value * 100 + 0.5);
+        *hue = (2 * _hue + m_delta) / (2 * m_delta);
+        *saturation = (200 * m_delta + m_max) / (2 * m_max);
+    }
+    *value = (200 * m_max + 255) / 510;
 
     return ESP_OK;
 }
 
-esp_err_t lightbulb_kelvin2percentage(uint16_t kelvin, uint8_t *percentage)
+esp_err_t lightbulb_handle_kelvin2percentage(lightbulb_handle_t handle, uint16_t kelvin, uint8_t *percentage)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(percentage, "percentage is null", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_CHECK(kelvin >= s_lb_obj->kelvin_range.min && kelvin <= s_lb_obj->kelvin_range.max, "kelvin out of range", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(kelvin >= handle->kelvin_range.min && kelvin <= handle->kelvin_range.max, "kelvin out of range", return ESP_ERR_INVALID_ARG);
 
-    *percentage = kelvin_convert_to_percentage(kelvin);
+    *percentage = kelvin_convert_to_percentage(handle, kelvin);
 
     return ESP_OK;
 }
 
-esp_err_t lightbulb_percentage2kelvin(uint8_t percentage, uint16_t *kelvin)
+esp_err_t lightbulb_handle_percentage2kelvin(lightbulb_handle_t handle, uint8_t percentage, uint16_t *kelvin)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(kelvin, "kelvin is null", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(percentage <= 100, "percentage out of range", return ESP_ERR_INVALID_ARG);
 
-    *kelvin = percentage_convert_to_kelvin(percentage);
+    *kelvin = percentage_convert_to_kelvin(handle, percentage);
 
     return ESP_OK;
 }
 
-esp_err_t lightbulb_set_hue(uint16_t hue)
+esp_err_t lightbulb_handle_set_hue(lightbulb_handle_t handle, uint16_t hue)
 {
-    return lightbulb_set_hsv(hue, s_lb_obj->status.saturation, s_lb_obj->status.value);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return lightbulb_handle_set_hsv(handle, hue, handle->status.saturation, handle->status.value);
 }
 
-esp_err_t lightbulb_set_saturation(uint8_t saturation)
+esp_err_t lightbulb_handle_set_saturation(lightbulb_handle_t handle, uint8_t saturation)
 {
-    return lightbulb_set_hsv(s_lb_obj->status.hue, saturation, s_lb_obj->status.value);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return lightbulb_handle_set_hsv(handle, handle->status.hue, saturation, handle->status.value);
 }
 
-esp_err_t lightbulb_set_value(uint8_t value)
+esp_err_t lightbulb_handle_set_value(lightbulb_handle_t handle, uint8_t value)
 {
-    return lightbulb_set_hsv(s_lb_obj->status.hue, s_lb_obj->status.saturation, value);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return lightbulb_handle_set_hsv(handle, handle->status.hue, handle->status.saturation, value);
 }
 
-esp_err_t lightbulb_set_cct(uint16_t cct)
+esp_err_t lightbulb_handle_set_cct(lightbulb_handle_t handle, uint16_t cct)
 {
-    return lightbulb_set_cctb(cct, s_lb_obj->status.brightness);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return lightbulb_handle_set_cctb(handle, cct, handle->status.brightness);
 }
 
-esp_err_t lightbulb_set_brightness(uint8_t brightness)
+esp_err_t lightbulb_handle_set_brightness(lightbulb_handle_t handle, uint8_t brightness)
 {
-    return lightbulb_set_cctb(s_lb_obj->status.cct_percentage, brightness);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return lightbulb_handle_set_cctb(handle, handle->status.cct_percentage, brightness);
 }
 
-esp_err_t lightbulb_set_hsv(uint16_t hue, uint8_t saturation, uint8_t value)
+esp_err_t lightbulb_handle_set_hsv(lightbulb_handle_t handle, uint16_t hue, uint8_t saturation, uint8_t value)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_CHECK(hue <= 360, "hue out of range: %d", return ESP_ERR_INVALID_ARG, hue);
-    LIGHTBULB_CHECK(saturation <= 100, "saturation out of range: %d", return ESP_ERR_INVALID_ARG, saturation);
-    LIGHTBULB_CHECK(value <= 100, "value out of range: %d", return ESP_ERR_INVALID_ARG, value);
-    LIGHTBULB_CHECK(CHECK_COLOR_CHANNEL_IS_SELECT(), "color channel output is disable", return ESP_ERR_INVALID_STATE);
-    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return lightbulb_handle_set_hsv_with_curve(handle, hue, saturation, value, handle->cap.fade_curve);
+}
 
+/**
+ * @brief Write a color and save it in the status, the mutex must be held
+ *
+ */
+static esp_err_t color_apply(lightbulb_obj_t *handle, uint16_t hue, uint8_t saturation, uint8_t value, lightbulb_fade_curve_t curve)
+{
     esp_err_t err = ESP_OK;
 
     if (CHECK_AUTO_STATUS_STORAGE_FUNC_IS_ENABLE()) {
-        xTimerReset(s_lb_obj->storage_timer, 0);
+        xTimerReset(handle->storage_timer, 0);
     }
 
     if (CHECK_EFFECT_IS_RUNNING() && CHECK_EFFECT_ALLOW_TO_BE_INTERRUPTED()) {
         ESP_LOGW(TAG, "The effect has stopped because the %s API is changing the lights.", __FUNCTION__);
-        if (CHECK_EFFECT_TIMER_IS_ACTIVE()) {
-            xTimerStop(s_lb_obj->effect_timer, 0);
-        }
-        s_lb_obj->effect_interrupt_forbidden_flag = false;
-        s_lb_obj->effect_running_flag = false;
+        handle->effect_interrupt_forbidden_flag = false;
+        handle->effect_running_flag = false;
     } else if (CHECK_EFFECT_IS_RUNNING()) {
         ESP_LOGW(TAG, "The effect are not allowed to be interrupted, skip calling %s, just save this change.", __FUNCTION__);
         goto SAVE_ONLY;
     }
 
-    if (s_lb_obj->status.on || CHECK_AUTO_ON_FUNC_IS_ENABLE()) {
+    if (handle->status.on || CHECK_AUTO_ON_FUNC_IS_ENABLE()) {
         if (CHECK_LOW_POWER_FUNC_IS_ENABLE()) {
-            xTimerStop(s_lb_obj->power_timer, 0);
+            xTimerStop(handle->power_timer, 0);
         }
 
         uint16_t color_value[5] = { 0 };
         uint16_t fade_time = CALCULATE_FADE_TIME();
-        uint8_t channel_mask = get_channel_mask(WORK_COLOR);
-        uint8_t _value = value;
+        uint8_t channel_mask = get_channel_mask(handle, WORK_COLOR);
 
-        // 1. calculate value
         ESP_LOGI(TAG, "set [h:%d s:%d v:%d]", hue, saturation, value);
-        _value = process_color_value_limit(value);
-
-        // 2. convert to r g b
-        lightbulb_hsv2rgb(hue, saturation, _value, (uint8_t *)&color_value[0], (uint8_t *)&color_value[1], (uint8_t *)&color_value[2]);
-        ESP_LOGI(TAG, "8 bit color conversion value [r:%d g:%d b:%d]", color_value[0], color_value[1], color_value[2]);
-
-        // 3. according to power, re-calculate
-        process_color_power_limit(color_value[0], color_value[1], color_value[2], &color_value[0], &color_value[1], &color_value[2]);
+        color_output_value_calculate(handle, hue, saturation, value, color_value);
         ESP_LOGI(TAG, "hal write value [r:%d g:%d b:%d], channel_mask:%d fade_ms:%d", color_value[0], color_value[1], color_value[2], channel_mask, fade_time);
 
-        err = hal_set_channel_group(color_value, channel_mask, fade_time);
-        LIGHTBULB_CHECK(err == ESP_OK, "set hal channel group fail", goto EXIT);
+        err = hal_set_channel_group(handle->hal, color_value, channel_mask, fade_time, curve);
+        LIGHTBULB_CHECK(err == ESP_OK, "set hal channel group fail", return err);
 
-        s_lb_obj->status.on = true;
+        handle->status.on = true;
     } else {
         ESP_LOGW(TAG, "skip calling %s, just save this change.", __FUNCTION__);
     }
 
 SAVE_ONLY:
-    s_lb_obj->status.mode = WORK_COLOR;
-    s_lb_obj->status.hue = hue;
-    s_lb_obj->status.saturation = saturation;
-    s_lb_obj->status.value = value;
+    handle->status.mode = WORK_COLOR;
+    handle->status.hue = hue;
+    handle->status.saturation = saturation;
+    handle->status.value = value;
 
-    if (s_lb_obj->cap.sync_change_brightness_value && CHECK_WHITE_CHANNEL_IS_SELECT()) {
-        s_lb_obj->status.brightness = value;
+    if (handle->cap.sync_change_brightness_value && CHECK_WHITE_CHANNEL_IS_SELECT()) {
+        handle->status.brightness = value;
     }
+    fast_restore_save(handle);
 
-EXIT:
-    LIGHTBULB_MUTEX_GIVE();
     return err;
 }
 
-esp_err_t lightbulb_set_cctb(uint16_t cct, uint8_t brightness)
+/**
+ * @brief Write a white and save it in the status, the mutex must be held
+ *
+ */
+static esp_err_t white_apply(lightbulb_obj_t *handle, uint8_t cct, uint8_t brightness, lightbulb_fade_curve_t curve)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_CHECK(brightness <= 100, "brightness out of range: %d", return ESP_ERR_INVALID_ARG, brightness);
-    if (cct > 100) {
-        LIGHTBULB_CHECK(cct >= s_lb_obj->kelvin_range.min && cct <= s_lb_obj->kelvin_range.max, "cct out of range: %d", NULL, cct);
-        ESP_LOGW(TAG, "will convert kelvin to percentage, %dK -> %d%%", cct, kelvin_convert_to_percentage(cct));
-        cct = kelvin_convert_to_percentage(cct);
-    }
-    LIGHTBULB_CHECK(cct <= 100, "cct out of range: %d", return ESP_ERR_INVALID_ARG, cct);
-    LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT(), "white channel output is disable", return ESP_ERR_INVALID_STATE);
-    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-
     esp_err_t err = ESP_OK;
 
     if (CHECK_AUTO_STATUS_STORAGE_FUNC_IS_ENABLE()) {
-        xTimerReset(s_lb_obj->storage_timer, 0);
+        xTimerReset(handle->storage_timer, 0);
     }
 
     if (CHECK_EFFECT_IS_RUNNING() && CHECK_EFFECT_ALLOW_TO_BE_INTERRUPTED()) {
         ESP_LOGW(TAG, "The effect has stopped because the %s API is changing the lights.", __FUNCTION__);
-        if (CHECK_EFFECT_TIMER_IS_ACTIVE()) {
-            xTimerStop(s_lb_obj->effect_timer, 0);
-        }
-        s_lb_obj->effect_interrupt_forbidden_flag = false;
-        s_lb_obj->effect_running_flag = false;
+        handle->effect_interrupt_forbidden_flag = false;
+        handle->effect_running_flag = false;
     } else if (CHECK_EFFECT_IS_RUNNING()) {
         ESP_LOGW(TAG, "The effect are not allowed to be interrupted, skip calling %s, just save this change.", __FUNCTION__);
         goto SAVE_ONLY;
     }
 
-    if (s_lb_obj->status.on || CHECK_AUTO_ON_FUNC_IS_ENABLE()) {
+    if (handle->status.on || CHECK_AUTO_ON_FUNC_IS_ENABLE()) {
         if (CHECK_LOW_POWER_FUNC_IS_ENABLE()) {
-            xTimerStop(s_lb_obj->power_timer, 0);
+            xTimerStop(handle->power_timer, 0);
         }
 
         uint16_t white_value[5] = { 0 };
         uint16_t fade_time = CALCULATE_FADE_TIME();
-        uint8_t channel_mask = get_channel_mask(WORK_WHITE);
-        uint8_t _brightness = brightness;
+        uint8_t channel_mask = get_channel_mask(handle, WORK_WHITE);
 
         ESP_LOGI(TAG, "set cct:%d brightness:%d", cct, brightness);
-        // 1. calculate brightness
-        ESP_LOGD(TAG, "input cct:%d brightness:%d", cct, brightness);
-        _brightness = process_white_brightness_limit(_brightness);
-        ESP_LOGD(TAG, "setp_1 output cct:%d brightness:%d", cct, _brightness);
-
-        // 2. convert to cold warm
-        if (CHECK_WHITE_OUTPUT_REQ_MIXED()) {
-            cct_and_brightness_convert_to_cold_and_warm(cct, _brightness, &white_value[3], &white_value[4]);
-            ESP_LOGI(TAG, "convert cold:%d warm:%d", white_value[3], white_value[4]);
-            process_white_power_limit(white_value[3], white_value[4], (uint8_t *)&white_value[3], (uint8_t *)&white_value[4]);
-        } else {
-            white_value[3] = cct * 255 / 100;
-            white_value[4] = _brightness * 255 / 100;
-            ESP_LOGI(TAG, "convert cct:%d brightness:%d", white_value[3], white_value[4]);
-        }
+        white_output_value_calculate(handle, cct, brightness, white_value);
         ESP_LOGI(TAG, "hal write value [white1:%d white2:%d], channel_mask:%d fade_ms:%d", white_value[3], white_value[4], channel_mask, fade_time);
 
-        err = hal_set_channel_group(white_value, channel_mask, fade_time);
-        LIGHTBULB_CHECK(err == ESP_OK, "set hal channel group fail", goto EXIT);
+        err = hal_set_channel_group(handle->hal, white_value, channel_mask, fade_time, curve);
+        LIGHTBULB_CHECK(err == ESP_OK, "set hal channel group fail", return err);
 
-        s_lb_obj->status.on = true;
+        handle->status.on = true;
     } else {
         ESP_LOGW(TAG, "skip calling %s, just save this change.", __FUNCTION__);
     }
 
 SAVE_ONLY:
-    s_lb_obj->status.mode = WORK_WHITE;
-    s_lb_obj->status.cct_percentage = cct;
-    s_lb_obj->status.brightness = brightness;
+    handle->status.mode = WORK_WHITE;
+    handle->status.cct_percentage = cct;
+    handle->status.brightness = brightness;
 
-    if (s_lb_obj->cap.sync_change_brightness_value && CHECK_COLOR_CHANNEL_IS_SELECT()) {
-        s_lb_obj->status.value = brightness;
+    if (handle->cap.sync_change_brightness_value && CHECK_COLOR_CHANNEL_IS_SELECT()) {
+        handle->status.value = brightness;
     }
+    fast_restore_save(handle);
 
-EXIT:
-    LIGHTBULB_MUTEX_GIVE();
     return err;
 }
 
-esp_err_t lightbulb_set_switch(bool status)
+/**
+ * @brief Turn the output of the current mode off and save it in the status, the mutex must be held
+ *
+ */
+static esp_err_t switch_off_apply(lightbulb_obj_t *handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
-
     esp_err_t err = ESP_OK;
     uint32_t fade_time = CALCULATE_FADE_TIME();
-    ESP_LOGI(TAG, "%s will update on/off status: %s -> %s", __FUNCTION__, s_lb_obj->status.on ? "on" : "off", status ? "on" : "off");
-
-    if (!status) {
-        LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-        if (CHECK_LOW_POWER_FUNC_IS_ENABLE()) {
-            xTimerReset(s_lb_obj->power_timer, 0);
-        }
-        if (CHECK_AUTO_STATUS_STORAGE_FUNC_IS_ENABLE()) {
-            xTimerReset(s_lb_obj->storage_timer, 0);
-        }
-        if (CHECK_EFFECT_IS_RUNNING() && CHECK_EFFECT_ALLOW_TO_BE_INTERRUPTED()) {
-            ESP_LOGW(TAG, "The effect has stopped because the %s API is changing the lights.", __FUNCTION__);
-            if (CHECK_EFFECT_TIMER_IS_ACTIVE()) {
-                xTimerStop(s_lb_obj->effect_timer, 0);
-            }
-            s_lb_obj->effect_interrupt_forbidden_flag = false;
-            s_lb_obj->effect_running_flag = false;
-        } else if (CHECK_EFFECT_IS_RUNNING()) {
-            ESP_LOGW(TAG, "The effect are not allowed to be interrupted, skip calling %s, just save this change.", __FUNCTION__);
-            s_lb_obj->status.on = false;
-            LIGHTBULB_MUTEX_GIVE();
-            return ESP_FAIL;
-        }
-        s_lb_obj->status.on = false;
 
-        if (CHECK_COLOR_CHANNEL_IS_SELECT() && (s_lb_obj->status.mode == WORK_COLOR)) {
-            uint16_t value[5] = { 0 };
-            uint8_t channel_mask = get_channel_mask(WORK_COLOR);
-            hal_set_channel_group(value, channel_mask, fade_time);
-        }
-        if (CHECK_WHITE_CHANNEL_IS_SELECT() && (s_lb_obj->status.mode == WORK_WHITE)) {
-            if (CHECK_WHITE_OUTPUT_REQ_MIXED()) {
-                uint16_t value[5] = { 0 };
-                uint8_t channel_mask = get_channel_mask(WORK_WHITE);
-                hal_set_channel_group(value, channel_mask, fade_time);
-            } else {
-                err = hal_set_channel(CHANNEL_ID_WARM_BRIGHTNESS_YELLOW, 0, fade_time);
-            }
-        }
-        LIGHTBULB_MUTEX_GIVE();
-    } else {
-        switch (s_lb_obj->status.mode) {
-        case WORK_COLOR:
-            LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-            s_lb_obj->status.on = true;
-            s_lb_obj->status.value = (s_lb_obj->status.value) ? s_lb_obj->status.value : 100;
-            LIGHTBULB_MUTEX_GIVE();
-            err = lightbulb_set_hsv(s_lb_obj->status.hue, s_lb_obj->status.saturation, s_lb_obj->status.value);
-            break;
-
-        case WORK_WHITE:
-            LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-            s_lb_obj->status.on = true;
-            s_lb_obj->status.brightness = (s_lb_obj->status.brightness) ? s_lb_obj->status.brightness : 100;
-            LIGHTBULB_MUTEX_GIVE();
-            err = lightbulb_set_cctb(s_lb_obj->status.cct_percentage, s_lb_obj->status.brightness);
-            break;
-
-        default:
-            ESP_LOGW(TAG, "This operation is not supported");
-            break;
-        }
+    if (CHECK_LOW_POWER_FUNC_IS_ENABLE()) {
+        xTimerReset(handle->power_timer, 0);
     }
-
+    if (CHECK_AUTO_STATUS_STORAGE_FUNC_IS_ENABLE()) {
+        xTimerReset(handle->storage_timer, 0);
+    }
+    if (CHECK_EFFECT_IS_RUNNING() && CHECK_EFFECT_ALLOW_TO_BE_INTERRUPTED()) {
+        ESP_LOGW(TAG, "The effect has stopped because the %s API is changing the lights.", __FUNCTION__);
+        handle->effect_interrupt_forbidden_flag = false;
+        handle->effect_running_flag = false;
+    } else if (CHECK_EFFECT_IS_RUNNING()) {
+        ESP_LOGW(TAG, "The effect are not allowed to be interrupted, skip calling %s, just save this change.", __FUNCTION__);
+        handle->status.on = false;
+        fast_restore_save(handle);
+        return ESP_FAIL;
+    }
+    handle->status.on = false;
+    fast_restore_save(handle);
+
+    if (CHECK_COLOR_CHANNEL_IS_SELECT() && (handle->status.mode == WORK_COLOR)) {
+        uint16_t value[5] = { 0 };
+        uint8_t channel_mask = get_channel_mask(handle, WORK_COLOR);
+        hal_set_channel_group(handle->hal, value, channel_mask, fade_time, handle->cap.fade_curve);
+    }
+    if (CHECK_WHITE_CHANNEL_IS_SELECT() && (handle->status.mode == WORK_WHITE)) {
+        if (CHECK_WHITE_OUTPUT_REQ_MIXED()) {
+            uint16_t value[5] = { 0 };
+            uint8_t channel_mask = get_channel_mask(handle, WORK_WHITE);
+            hal_set_channel_group(handle->hal, value, channel_mask, fade_time, handle->cap.fade_curve);
+        } else {
+            err = hal_set_channel(handle->hal, CHANNEL_ID_WARM_BRIGHTNESS_YELLOW, 0, fade_time);
+        }
+    }
+
     return err;
 }
 
-int16_t lightbulb_get_hue(void)
+esp_err_t lightbulb_handle_set_hsv_with_curve(lightbulb_handle_t handle, uint16_t hue, uint8_t saturation, uint8_t value, lightbulb_fade_curve_t curve)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(curve < FADE_CURVE_MAX, "curve out of range: %d", return ESP_ERR_INVALID_ARG, curve);
+    LIGHTBULB_CHECK(hue <= 360, "hue out of range: %d", return ESP_ERR_INVALID_ARG, hue);
+    LIGHTBULB_CHECK(saturation <= 100, "saturation out of range: %d", return ESP_ERR_INVALID_ARG, saturation);
+    LIGHTBULB_CHECK(value <= 100, "value out of range: %d", return ESP_ERR_INVALID_ARG, value);
+    LIGHTBULB_CHECK(CHECK_COLOR_CHANNEL_IS_SELECT(), "color channel output is disable", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+
+    esp_err_t err = ESP_OK;
+
+    if (handle->transaction_depth) {
+        // The light ends up on at commit exactly when this call would have turned it on
+        ESP_LOGD(TAG, "defer [h:%d s:%d v:%d] to commit", hue, saturation, value);
+        handle->transaction_pending_flag = true;
+        handle->transaction_curve = curve;
+        handle->status.on = handle->status.on || CHECK_AUTO_ON_FUNC_IS_ENABLE();
+        handle->status.mode = WORK_COLOR;
+        handle->status.hue = hue;
+        handle->status.saturation = saturation;
+        handle->status.value = value;
+        if (handle->cap.sync_change_brightness_value && CHECK_WHITE_CHANNEL_IS_SELECT()) {
+            handle->status.brightness = value;
+        }
+        fast_restore_save(handle);
+    } else {
+        err = color_apply(handle, hue, saturation, value, curve);
+    }
+
+    LIGHTBULB_MUTEX_GIVE();
+    return err;
+}
+
+esp_err_t lightbulb_handle_set_cctb(lightbulb_handle_t handle, uint16_t cct, uint8_t brightness)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return lightbulb_handle_set_cctb_with_curve(handle, cct, brightness, handle->cap.fade_curve);
+}
+
+esp_err_t lightbulb_handle_set_cctb_with_curve(lightbulb_handle_t handle, uint16_t cct, uint8_t brightness, lightbulb_fade_curve_t curve)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(curve < FADE_CURVE_MAX, "curve out of range: %d", return ESP_ERR_INVALID_ARG, curve);
+    LIGHTBULB_CHECK(brightness <= 100, "brightness out of range: %d", return ESP_ERR_INVALID_ARG, brightness);
+    if (cct > 100) {
+        LIGHTBULB_CHECK(cct >= handle->kelvin_range.min && cct <= handle->kelvin_range.max, "cct out of range: %d", NULL, cct);
+        ESP_LOGW(TAG, "will convert kelvin to percentage, %dK -> %d%%", cct, kelvin_convert_to_percentage(handle, cct));
+        cct = kelvin_convert_to_percentage(handle, cct);
+    }
+    LIGHTBULB_CHECK(cct <= 100, "cct out of range: %d", return ESP_ERR_INVALID_ARG, cct);
+    LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT(), "white channel output is disable", return ESP_ERR_INVALID_STATE);
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+
+    esp_err_t err = ESP_OK;
+
+    if (handle->transaction_depth) {
+        ESP_LOGD(TAG, "defer cct:%d brightness:%d to commit", cct, brightness);
+        handle->transaction_pending_flag = true;
+        handle->transaction_curve = curve;
+        handle->status.on = handle->status.on || CHECK_AUTO_ON_FUNC_IS_ENABLE();
+        handle->status.mode = WORK_WHITE;
+        handle->status.cct_percentage = cct;
+        handle->status.brightness = brightness;
+        if (handle->cap.sync_change_brightness_value && CHECK_COLOR_CHANNEL_IS_SELECT()) {
+            handle->status.value = brightness;
+        }
+        fast_restore_save(handle);
+    } else {
+        err = white_apply(handle, cct, brightness, curve);
+    }
+
+    LIGHTBULB_MUTEX_GIVE();
+    return err;
+}
+
+esp_err_t lightbulb_handle_begin(lightbulb_handle_t handle)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+
+    esp_err_t err = ESP_OK;
+    LIGHTBULB_CHECK(handle->transaction_depth < UINT8_MAX, "too many nested transactions", err = ESP_ERR_INVALID_STATE; goto EXIT);
+    if (handle->transaction_depth == 0) {
+        handle->transaction_start_on = handle->status.on;
+    }
+    handle->transaction_depth++;
+
+EXIT:
+    LIGHTBULB_MUTEX_GIVE();
+    return err;
+}
+
+esp_err_t lightbulb_handle_commit(lightbulb_handle_t handle)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+
+    esp_err_t err = ESP_OK;
+    LIGHTBULB_CHECK(handle->transaction_depth > 0, "no transaction to commit", err = ESP_ERR_INVALID_STATE; goto EXIT);
+
+    // 1. Only the outermost commit writes the output
+    handle->transaction_depth--;
+    if (handle->transaction_depth || !handle->transaction_pending_flag) {
+        goto EXIT;
+    }
+    handle->transaction_pending_flag = false;
+
+    // 2. The saved status already holds every deferred change in call order, write it as one change under the same lock
+    ESP_LOGI(TAG, "commit deferred %s change", !handle->status.on ? "off" : (handle->status.mode == WORK_COLOR ? "color" : "white"));
+    if (!handle->status.on) {
+        // An output that was already off is not faded to zero again, the saved status is written when switched on
+        if (handle->transaction_start_on) {
+            err = switch_off_apply(handle);
+        }
+    } else if (handle->status.mode == WORK_COLOR) {
+        err = color_apply(handle, handle->status.hue, handle->status.saturation, handle->status.value, handle->transaction_curve);
+    } else {
+        err = white_apply(handle, handle->status.cct_percentage, handle->status.brightness, handle->transaction_curve);
+    }
+
+EXIT:
+    LIGHTBULB_MUTEX_GIVE();
+    return err;
+}
+
+esp_err_t lightbulb_handle_set_switch(lightbulb_handle_t handle, bool status)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    esp_err_t err = ESP_OK;
+    ESP_LOGI(TAG, "%s will update on/off status: %s -> %s", __FUNCTION__, handle->status.on ? "on" : "off", status ? "on" : "off");
+
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+    if (status) {
+        if (handle->status.mode == WORK_COLOR) {
+            handle->status.value = (handle->status.value) ? handle->status.value : 100;
+        } else if (handle->status.mode == WORK_WHITE) {
+            handle->status.brightness = (handle->status.brightness) ? handle->status.brightness : 100;
+        } else {
+            ESP_LOGW(TAG, "This operation is not supported");
+            goto EXIT;
+        }
+    }
+
+    if (handle->transaction_depth) {
+        ESP_LOGD(TAG, "defer %s to commit", status ? "on" : "off");
+        handle->transaction_pending_flag = true;
+        handle->transaction_curve = handle->cap.fade_curve;
+        handle->status.on = status;
+        fast_restore_save(handle);
+    } else if (!status) {
+        err = switch_off_apply(handle);
+    } else if (handle->status.mode == WORK_COLOR) {
+        handle->status.on = true;
+        err = color_apply(handle, handle->status.hue, handle->status.saturation, handle->status.value, handle->cap.fade_curve);
+    } else {
+        handle->status.on = true;
+        err = white_apply(handle, handle->status.cct_percentage, handle->status.brightness, handle->cap.fade_curve);
+    }
+
+EXIT:
+    LIGHTBULB_MUTEX_GIVE();
+    return err;
+}
+
+int16_t lightbulb_handle_get_hue(lightbulb_handle_t handle)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(CHECK_COLOR_CHANNEL_IS_SELECT(), "color channel output is disable", return -1);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    int16_t result = s_lb_obj->status.hue;
+    int16_t result = handle->status.hue;
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-int8_t lightbulb_get_saturation(void)
+int8_t lightbulb_handle_get_saturation(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return -1);
+    LIGHTBULB_CHECK(handle, "not init", return -1);
     LIGHTBULB_CHECK(CHECK_COLOR_CHANNEL_IS_SELECT(), "color channel output is disable", return -1);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    int8_t result = s_lb_obj->status.saturation;
+    int8_t result = handle->status.saturation;
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-int8_t lightbulb_get_value(void)
+int8_t lightbulb_handle_get_value(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return -1);
+    LIGHTBULB_CHECK(handle, "not init", return -1);
     LIGHTBULB_CHECK(CHECK_COLOR_CHANNEL_IS_SELECT(), "color channel output is disable", return -1);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    int8_t result = s_lb_obj->status.value;
+    int8_t result = handle->status.value;
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-int8_t lightbulb_get_cct_percentage(void)
+int8_t lightbulb_handle_get_cct_percentage(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return -1);
+    LIGHTBULB_CHECK(handle, "not init", return -1);
     LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT(), "white channel output is disable", return -1);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    int8_t result = s_lb_obj->status.cct_percentage;
+    int8_t result = handle->status.cct_percentage;
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-int16_t lightbulb_get_cct_kelvin(void)
+int16_t lightbulb_handle_get_cct_kelvin(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return -1);
+    LIGHTBULB_CHECK(handle, "not init", return -1);
     LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT(), "white channel output is disable", return -1);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    int16_t result = percentage_convert_to_kelvin(s_lb_obj->status.cct_percentage);
+    int16_t result = percentage_convert_to_kelvin(handle, handle->status.cct_percentage);
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-int8_t lightbulb_get_brightness(void)
+int8_t lightbulb_handle_get_brightness(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return -1);
+    LIGHTBULB_CHECK(handle, "not init", return -1);
     LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT(), "white channel output is disable", return -1);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    int8_t result = s_lb_obj->status.brightness;
+    int8_t result = handle->status.brightness;
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-esp_err_t lightbulb_get_all_detail(lightbulb_status_t *status)
+esp_err_t lightbulb_handle_get_all_detail(lightbulb_handle_t handle, lightbulb_status_t *status)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(status, "status is null", return ESP_FAIL);
     LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT() || CHECK_COLOR_CHANNEL_IS_SELECT(), "white or color channel output is disable", return false);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    memcpy(status, &s_lb_obj->status, sizeof(lightbulb_status_t));
+    memcpy(status, &handle->status, sizeof(lightbulb_status_t));
     LIGHTBULB_MUTEX_GIVE();
 
     return ESP_OK;
 }
 
-bool lightbulb_get_switch(void)
+bool lightbulb_handle_get_switch(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT() || CHECK_COLOR_CHANNEL_IS_SELECT(), "white or color channel output is disable", return false);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    bool result = s_lb_obj->status.on;
+    bool result = handle->status.on;
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-esp_err_t lightbulb_set_fades_function(bool is_enable)
+esp_err_t lightbulb_handle_set_fades_function(lightbulb_handle_t handle, bool is_enable)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
     if (is_enable) {
-        s_lb_obj->cap.enable_fades = true;
+        handle->cap.enable_fades = true;
     } else {
-        s_lb_obj->cap.enable_fades = false;
+        handle->cap.enable_fades = false;
     }
     LIGHTBULB_MUTEX_GIVE();
 
     return ESP_OK;
 }
 
-esp_err_t lightbulb_set_storage_function(bool is_enable)
+esp_err_t lightbulb_handle_set_storage_function(lightbulb_handle_t handle, bool is_enable)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
     if (is_enable) {
-        s_lb_obj->cap.enable_status_storage = true;
+        handle->cap.enable_status_storage = true;
     } else {
-        s_lb_obj->cap.enable_status_storage = false;
+        handle->cap.enable_status_storage = false;
+        if (handle->is_default) {
+            s_fast_restore_slot.magic = 0;
+        }
     }
     LIGHTBULB_MUTEX_GIVE();
 
     return ESP_OK;
 }
 
-esp_err_t lightbulb_set_fade_time(uint32_t fades_ms)
+esp_err_t lightbulb_handle_set_fade_time(lightbulb_handle_t handle, uint32_t fades_ms)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    s_lb_obj->cap.fades_ms = fades_ms;
+    handle->cap.fades_ms = fades_ms;
     LIGHTBULB_MUTEX_GIVE();
 
     return ESP_OK;
 }
 
-bool lightbulb_get_fades_function_status(void)
+esp_err_t lightbulb_handle_set_balance_coefficient(lightbulb_handle_t handle, lightbulb_custom_balance_coefficient_t *balance)
+{
+    esp_err_t err = ESP_OK;
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(balance, "balance is null", return ESP_ERR_INVALID_ARG);
+
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+    err = hal_set_balance_coefficient(handle->hal, balance);
+    LIGHTBULB_MUTEX_GIVE();
+
+    return err;
+}
+
+esp_err_t lightbulb_handle_set_custom_fade_curve(lightbulb_handle_t handle, lightbulb_fade_curve_cb_t curve)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+
+    return hal_set_custom_fade_curve(handle->hal, curve);
+}
+
+esp_err_t lightbulb_handle_get_fade_stats(lightbulb_handle_t handle, lightbulb_fade_stats_t *stats)
+{
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(stats, "stats is null", return ESP_ERR_INVALID_ARG);
+
+    return hal_get_fade_stats(handle->hal, stats);
+}
+
+bool lightbulb_handle_get_fades_function_status(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    bool result = s_lb_obj->cap.enable_fades;
+    bool result = handle->cap.enable_fades;
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-lightbulb_works_mode_t lightbulb_get_mode(void)
+lightbulb_works_mode_t lightbulb_handle_get_mode(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
     lightbulb_works_mode_t result = WORK_NONE;
     if (CHECK_COLOR_CHANNEL_IS_SELECT() || CHECK_WHITE_CHANNEL_IS_SELECT()) {
-        result = s_lb_obj->status.mode;
+        result = handle->status.mode;
     }
     LIGHTBULB_MUTEX_GIVE();
 
     return result;
 }
 
-esp_err_t  lightbulb_update_status_variable(lightbulb_status_t *new_status, bool trigger)
+esp_err_t lightbulb_handle_update_status_variable(lightbulb_handle_t handle, lightbulb_status_t *new_status, bool trigger)
 {
     LIGHTBULB_CHECK(new_status, "new_status is null", return ESP_FAIL);
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
     esp_err_t err = ESP_OK;
 
-    memcpy(&s_lb_obj->status, new_status, sizeof(lightbulb_status_t));
+    memcpy(&handle->status, new_status, sizeof(lightbulb_status_t));
+    fast_restore_save(handle);
     LIGHTBULB_MUTEX_GIVE();
 
     if (trigger) {
-        err = lightbulb_set_switch(s_lb_obj->status.on);
+        err = lightbulb_handle_set_switch(handle, handle->status.on);
     }
     return err;
 }
 
-esp_err_t lightbulb_basic_effect_start(lightbulb_effect_config_t *config)
+/**
+ * @brief Runs in the timer task when an effect timeline ends or its total time elapses
+ *
+ * @param priv User callback of the effect
+ * @param effect_id Effect the timeline was started for
+ */
+static void effect_end_cb(void *priv, uint32_t effect_id)
 {
-    esp_err_t err = ESP_ERR_INVALID_STATE;
-    LIGHTBULB_CHECK(config, "config is null", return ESP_FAIL);
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
-    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+    void(*user_cb)(void) = priv;
+    bool is_current = false;
+
+    // The instance may have been deleted while the callback was pending
+    xSemaphoreTake(s_lb_list_mutex, portMAX_DELAY);
+    for (lightbulb_obj_t *handle = s_lb_list; handle; handle = handle->next) {
+        if (handle->effect_id != effect_id) {
+            continue;
+        }
+        LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+        is_current = handle->effect_running_flag;
+        if (is_current) {
+            handle->effect_interrupt_forbidden_flag = false;
+            handle->effect_running_flag = false;
+        }
+        LIGHTBULB_MUTEX_GIVE();
+        break;
+    }
+    xSemaphoreGive(s_lb_list_mutex);
 
-    bool flag = ((config->effect_type == EFFECT_BREATH) ? true : false);
+    if (is_current && user_cb) {
+        user_cb();
+    }
+}
 
+static esp_err_t effect_timeline_start(lightbulb_obj_t *handle, hal_timeline_t *timeline, int total_ms, void(*user_cb)(void), bool interrupt_forbidden)
+{
     if (CHECK_LOW_POWER_FUNC_IS_ENABLE()) {
-        xTimerStop(s_lb_obj->power_timer, 0);
+        xTimerStop(handle->power_timer, 0);
     }
 
-    if (CHECK_EFFECT_TIMER_IS_ACTIVE()) {
-        xTimerStop(s_lb_obj->effect_timer, 0);
+    // Unique over all instances, so that the end callback finds the instance by it
+    handle->effect_id = __atomic_add_fetch(&s_effect_id, 1, __ATOMIC_RELAXED);
+    esp_err_t err = hal_start_timeline(handle->hal, timeline, MAX(total_ms, 0), effect_end_cb, user_cb, handle->effect_id);
+    LIGHTBULB_CHECK(err == ESP_OK, "start timeline fail", return err);
+
+    handle->effect_interrupt_forbidden_flag = interrupt_forbidden;
+    handle->effect_running_flag = true;
+    if (total_ms > 0) {
+        ESP_LOGI(TAG, "The effect will stop after %d ms.", total_ms);
+    } else {
+        ESP_LOGI(TAG, "The effect has no total time, it will keep running until it ends or is stopped.");
     }
+    ESP_LOGI(TAG, "This effect will %s to be interrupted", handle->effect_interrupt_forbidden_flag ? "not be allowed" : "allow");
+
+    return ESP_OK;
+}
+
+esp_err_t lightbulb_handle_basic_effect_start(lightbulb_handle_t handle, lightbulb_effect_config_t *config)
+{
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    LIGHTBULB_CHECK(config, "config is null", return ESP_FAIL);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(config->effect_cycle_ms > TIMELINE_TICK_MS * 2, "effect_cycle_ms not allowed: %d", return ESP_ERR_INVALID_ARG, config->effect_cycle_ms);
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+
+    hal_timeline_t timeline = { 0 };
+    uint16_t value_max[5] = { 0 };
+    uint16_t value_min[5] = { 0 };
+    uint16_t half_cycle_ms = config->effect_cycle_ms / 2;
+    uint8_t channel_mask = 0;
 
     if (config->mode == WORK_COLOR) {
         LIGHTBULB_CHECK(CHECK_COLOR_CHANNEL_IS_SELECT(), "color channel output is disable", goto EXIT);
-        uint16_t color_value_max[5] = { 0 };
-        uint16_t color_value_min[5] = { 0 };
-        uint8_t channel_mask = get_channel_mask(WORK_COLOR);
-        err = ESP_OK;
-
-        color_value_max[0] = config->red * config->max_brightness / 100;
-        color_value_max[1] = config->green * config->max_brightness / 100;
-        color_value_max[2] = config->blue * config->max_brightness / 100;
-        hal_get_gamma_value(color_value_max[0], color_value_max[1], color_value_max[2], &color_value_max[0], &color_value_max[1], &color_value_max[2]);
+        channel_mask = get_channel_mask(handle, WORK_COLOR);
 
-        color_value_min[0] = config->red * config->min_brightness / 100;
-        color_value_min[1] = config->green * config->min_brightness / 100;
-        color_value_min[2] = config->blue * config->min_brightness / 100;
-        hal_get_gamma_value(color_value_min[0], color_value_min[1], color_value_min[2], &color_value_min[0], &color_value_min[1], &color_value_min[2]);
+        value_max[0] = config->red * config->max_brightness / 100;
+        value_max[1] = config->green * config->max_brightness / 100;
+        value_max[2] = config->blue * config->max_brightness / 100;
+        hal_get_balanced_gamma_value(handle->hal, value_max[0], value_max[1], value_max[2], &value_max[0], &value_max[1], &value_max[2]);
 
-        err |= hal_start_channel_group_action(color_value_min, color_value_max, channel_mask, config->effect_cycle_ms, flag);
+        value_min[0] = config->red * config->min_brightness / 100;
+        value_min[1] = config->green * config->min_brightness / 100;
+        value_min[2] = config->blue * config->min_brightness / 100;
+        hal_get_balanced_gamma_value(handle->hal, value_min[0], value_min[1], value_min[2], &value_min[0], &value_min[1], &value_min[2]);
 
     } else if (config->mode == WORK_WHITE) {
         LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT(), "white channel output is disable", goto EXIT);
         if (config->cct > 100) {
-            LIGHTBULB_CHECK(config->cct >= s_lb_obj->kelvin_range.min && config->cct <= s_lb_obj->kelvin_range.max, "cct kelvin out of range: %d", goto EXIT, config->cct);
-            ESP_LOGW(TAG, "will convert kelvin to percentage, %dK -> %d%%", config->cct, kelvin_convert_to_percentage(config->cct));
-            config->cct = kelvin_convert_to_percentage(config->cct);
+            LIGHTBULB_CHECK(config->cct >= handle->kelvin_range.min && config->cct <= handle->kelvin_range.max, "cct kelvin out of range: %d", goto EXIT, config->cct);
+            ESP_LOGW(TAG, "will convert kelvin to percentage, %dK -> %d%%", config->cct, kelvin_convert_to_percentage(handle, config->cct));
+            config->cct = kelvin_convert_to_percentage(handle, config->cct);
         }
-        uint16_t white_value_max[5] = { 0 };
-        uint16_t white_value_min[5] = { 0 };
-        uint8_t channel_mask = get_channel_mask(WORK_WHITE);
-        err = ESP_OK;
+        channel_mask = get_channel_mask(handle, WORK_WHITE);
 
         if (CHECK_WHITE_OUTPUT_REQ_MIXED()) {
-            cct_and_brightness_convert_to_cold_and_warm(config->cct, config->max_brightness, &white_value_max[3], &white_value_max[4]);
-            cct_and_brightness_convert_to_cold_and_warm(config->cct, config->min_brightness, &white_value_min[3], &white_value_min[4]);
-            err |= hal_start_channel_group_action(white_value_min, white_value_max, channel_mask, config->effect_cycle_ms, flag);
+            cct_and_brightness_convert_to_cold_and_warm(handle, config->cct, config->max_brightness, &value_max[3], &value_max[4]);
+            cct_and_brightness_convert_to_cold_and_warm(handle, config->cct, config->min_brightness, &value_min[3], &value_min[4]);
         } else {
-            white_value_max[4] = config->max_brightness * 255 / 100;
-            white_value_min[4] = config->min_brightness * 255 / 100;
-            err |= hal_set_channel(CHANNEL_ID_COLD_CCT_WHITE, config->cct * 255 / 100, 0);
-            err |= hal_start_channel_action(CHANNEL_ID_WARM_BRIGHTNESS_YELLOW, white_value_min[4], white_value_max[4], config->effect_cycle_ms, flag);
+            value_max[3] = config->cct * 255 / 100;
+            value_min[3] = value_max[3];
+            value_max[4] = config->max_brightness * 255 / 100;
+            value_min[4] = config->min_brightness * 255 / 100;
         }
     } else {
         err = ESP_ERR_NOT_SUPPORTED;
+        goto EXIT;
     }
 
+    // Breath fades between the two levels, blink jumps to each level and holds it for half a cycle
+    err = hal_timeline_create(&timeline, channel_mask, 2 * (TIMELINE_FADE_SIZE(5) + TIMELINE_HOLD_SIZE) + TIMELINE_LOOP_SIZE);
+    LIGHTBULB_CHECK(err == ESP_OK, "timeline create fail", goto EXIT);
+    if (config->effect_type == EFFECT_BREATH) {
+        err |= hal_timeline_add_fade(&timeline, value_max, half_cycle_ms, FADE_CURVE_LINEAR);
+        err |= hal_timeline_add_fade(&timeline, value_min, half_cycle_ms, FADE_CURVE_LINEAR);
+    } else {
+        err |= hal_timeline_add_fade(&timeline, value_max, 0, FADE_CURVE_LINEAR);
+        err |= hal_timeline_add_hold(&timeline, half_cycle_ms);
+        err |= hal_timeline_add_fade(&timeline, value_min, 0, FADE_CURVE_LINEAR);
+        err |= hal_timeline_add_hold(&timeline, half_cycle_ms);
+    }
+    err |= hal_timeline_add_loop(&timeline, 0, 0, 0);
+    LIGHTBULB_CHECK(err == ESP_OK, "timeline build fail", goto EXIT);
+
+    err = effect_timeline_start(handle, &timeline, config->total_ms, config->user_cb, config->interrupt_forbidden);
     if (err == ESP_OK) {
-        s_lb_obj->effect_interrupt_forbidden_flag = config->interrupt_forbidden;
-        s_lb_obj->effect_running_flag = true;
-        if (config->total_ms > 0) {
-            if (!s_lb_obj->effect_timer) {
-                s_lb_obj->effect_timer = xTimerCreate("effect_timer", pdMS_TO_TICKS(config->total_ms), false, NULL, timercb);
-                LIGHTBULB_CHECK(s_lb_obj->effect_timer, "create timer fail", goto EXIT);
-            } else {
-                xTimerChangePeriod(s_lb_obj->effect_timer, pdMS_TO_TICKS(config->total_ms), 0);
-            }
-            if (config->user_cb) {
-                vTimerSetTimerID(s_lb_obj->effect_timer, config->user_cb);
-            } else {
-                vTimerSetTimerID(s_lb_obj->effect_timer, NULL);
-            }
-            xTimerStart(s_lb_obj->effect_timer, 0);
-            /* Make sure the timer has started running */
-            while (!CHECK_EFFECT_TIMER_IS_ACTIVE()) {
-                vTaskDelay(1);
-            }
-            ESP_LOGI(TAG, "The auto-stop timer will trigger after %d ms.", config->total_ms);
-        } else {
-            ESP_LOGI(TAG, "The auto-stop timer is not running, the effect will keep running.");
-        }
         ESP_LOGI(TAG, "effect config: \r\n"
                  "\teffect type: %d\r\n"
                  "\tmode: %d\r\n"
@@ -1418,17 +1936,97 @@ esp_err_t lightbulb_basic_effect_start(lightbulb_effect_config_t *config)
                  "\ttotal_ms:%d\r\n"
                  "\tinterrupt_forbidden:%d", config->effect_type, config->mode, config->red, config->green, config->blue,
                  config->cct, config->min_brightness, config->max_brightness, config->effect_cycle_ms, config->total_ms, config->interrupt_forbidden);
-        ESP_LOGI(TAG, "This effect will %s to be interrupted", s_lb_obj->effect_interrupt_forbidden_flag ? "not be allowed" : "allow");
     }
 
 EXIT:
+    hal_timeline_delete(&timeline);
     LIGHTBULB_MUTEX_GIVE();
     return err;
 }
 
-esp_err_t lightbulb_basic_effect_stop(void)
+esp_err_t lightbulb_handle_timeline_effect_start(lightbulb_handle_t handle, const lightbulb_timeline_config_t *config)
+{
+    LIGHTBULB_CHECK(config && config->keyframes, "config is null", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(config->keyframe_num > 0 && config->keyframe_num <= LIGHTBULB_TIMELINE_MAX_KEYFRAMES, "keyframe_num out of range: %d", return ESP_ERR_INVALID_ARG, config->keyframe_num);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
+
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    hal_timeline_t timeline = { 0 };
+    uint16_t keyframe_offset[LIGHTBULB_TIMELINE_MAX_KEYFRAMES] = { 0 };
+    uint8_t channel_mask = 0;
+    uint8_t mode_mask = 0;
+    uint8_t loop_num = 0;
+    bool allow_all_output = false;
+
+    // 1. Check every keyframe before anything is converted
+    for (int i = 0; i < config->keyframe_num; i++) {
+        const lightbulb_keyframe_t *keyframe = &config->keyframes[i];
+        LIGHTBULB_CHECK(keyframe->curve < FADE_CURVE_MAX, "keyframe %d curve out of range: %d", goto EXIT, i, keyframe->curve);
+        LIGHTBULB_CHECK(keyframe->loop_to <= i, "keyframe %d loop_to out of range: %d", goto EXIT, i, keyframe->loop_to);
+        if (keyframe->mode == WORK_COLOR) {
+            LIGHTBULB_CHECK(CHECK_COLOR_CHANNEL_IS_SELECT(), "color channel output is disable", err = ESP_ERR_INVALID_STATE; goto EXIT);
+            LIGHTBULB_CHECK(keyframe->hue <= 360 && keyframe->saturation <= 100 && keyframe->value <= 100, "keyframe %d hsv out of range", goto EXIT, i);
+            channel_mask |= get_channel_mask(handle, WORK_COLOR);
+        } else if (keyframe->mode == WORK_WHITE) {
+            LIGHTBULB_CHECK(CHECK_WHITE_CHANNEL_IS_SELECT(), "white channel output is disable", err = ESP_ERR_INVALID_STATE; goto EXIT);
+            LIGHTBULB_CHECK(keyframe->brightness <= 100, "keyframe %d brightness out of range: %d", goto EXIT, i, keyframe->brightness);
+            LIGHTBULB_CHECK(keyframe->cct <= 100 || (keyframe->cct >= handle->kelvin_range.min && keyframe->cct <= handle->kelvin_range.max), "keyframe %d cct out of range: %d", goto EXIT, i, keyframe->cct);
+            channel_mask |= get_channel_mask(handle, WORK_WHITE);
+        } else {
+            err = ESP_ERR_NOT_SUPPORTED;
+            goto EXIT;
+        }
+        mode_mask |= BIT(keyframe->mode);
+        loop_num += (keyframe->loop_count != 0);
+    }
+    // The last loop id is kept for the repeat of the whole timeline
+    LIGHTBULB_CHECK(loop_num < TIMELINE_MAX_LOOPS, "too many loops: %d", goto EXIT, loop_num);
+    hal_get_driver_feature(handle->hal, QUERY_IS_ALLOW_ALL_OUTPUT, &allow_all_output);
+    LIGHTBULB_CHECK(allow_all_output || mode_mask != (BIT(WORK_COLOR) | BIT(WORK_WHITE)), "the driver can not mix color and white keyframes", err = ESP_ERR_NOT_SUPPORTED; goto EXIT);
+
+    // 2. Convert every keyframe once, the fade tick only walks the output values
+    err = hal_timeline_create(&timeline, channel_mask, config->keyframe_num * (TIMELINE_FADE_SIZE(5) + TIMELINE_HOLD_SIZE + TIMELINE_LOOP_SIZE) + TIMELINE_LOOP_SIZE);
+    LIGHTBULB_CHECK(err == ESP_OK, "timeline create fail", goto EXIT);
+    loop_num = 0;
+    for (int i = 0; i < config->keyframe_num; i++) {
+        const lightbulb_keyframe_t *keyframe = &config->keyframes[i];
+        uint16_t value[5] = { 0 };
+
+        if (keyframe->mode == WORK_COLOR) {
+            color_output_value_calculate(handle, keyframe->hue, keyframe->saturation, keyframe->value, value);
+        } else {
+            uint8_t cct = (keyframe->cct > 100) ? kelvin_convert_to_percentage(handle, keyframe->cct) : keyframe->cct;
+            white_output_value_calculate(handle, cct, keyframe->brightness, value);
+        }
+
+        keyframe_offset[i] = timeline.len;
+        err |= hal_timeline_add_fade(&timeline, value, keyframe->fade_ms, keyframe->curve);
+        if (keyframe->hold_ms) {
+            err |= hal_timeline_add_hold(&timeline, keyframe->hold_ms);
+        }
+        if (keyframe->loop_count) {
+            err |= hal_timeline_add_loop(&timeline, loop_num++, keyframe->loop_count, keyframe_offset[keyframe->loop_to]);
+        }
+    }
+    if (config->repeat != 1) {
+        err |= hal_timeline_add_loop(&timeline, loop_num, config->repeat ? config->repeat - 1 : 0, 0);
+    }
+    LIGHTBULB_CHECK(err == ESP_OK, "timeline build fail", goto EXIT);
+    ESP_LOGI(TAG, "timeline of %d keyframes in %d bytes", config->keyframe_num, timeline.len);
+
+    // 3. Hand it over to the fade tick
+    err = effect_timeline_start(handle, &timeline, config->total_ms, config->user_cb, config->interrupt_forbidden);
+
+EXIT:
+    hal_timeline_delete(&timeline);
+    LIGHTBULB_MUTEX_GIVE();
+    return err;
+}
+
+esp_err_t lightbulb_handle_basic_effect_stop(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
     esp_err_t err = ESP_FAIL;
@@ -1440,23 +2038,207 @@ esp_err_t lightbulb_basic_effect_stop(void)
     if (CHECK_WHITE_CHANNEL_IS_SELECT()) {
         channel_mask |= (SELECT_WHITE_CHANNEL);
     }
-    err = hal_stop_channel_action(channel_mask);
-    s_lb_obj->effect_interrupt_forbidden_flag = false;
-    s_lb_obj->effect_running_flag = false;
+    err = hal_stop_channel_action(handle->hal, channel_mask);
+    handle->effect_interrupt_forbidden_flag = false;
+    handle->effect_running_flag = false;
     LIGHTBULB_MUTEX_GIVE();
 
     return err;
 }
 
-esp_err_t lightbulb_basic_effect_stop_and_restore(void)
+esp_err_t lightbulb_handle_basic_effect_stop_and_restore(lightbulb_handle_t handle)
 {
-    LIGHTBULB_CHECK(s_lb_obj, "not init", return ESP_ERR_INVALID_ARG);
+    LIGHTBULB_CHECK(handle, "not init", return ESP_ERR_INVALID_ARG);
 
     LIGHTBULB_MUTEX_TAKE(portMAX_DELAY);
-    bool is_on = s_lb_obj->status.on;
-    s_lb_obj->effect_interrupt_forbidden_flag = false;
-    s_lb_obj->effect_running_flag = false;
+    bool is_on = handle->status.on;
+    handle->effect_interrupt_forbidden_flag = false;
+    handle->effect_running_flag = false;
     LIGHTBULB_MUTEX_GIVE();
 
-    return lightbulb_set_switch(is_on);
+    return lightbulb_handle_set_switch(handle, is_on);
+}
+
+/**
+ * @brief The API without a handle works on the instance created by lightbulb_init()
+ *
+ */
+esp_err_t lightbulb_set_xyy(float x, float y, float Y)
+{
+    return lightbulb_handle_set_xyy(s_lb_obj, x, y, Y);
+}
+
+esp_err_t lightbulb_kelvin2percentage(uint16_t kelvin, uint8_t *percentage)
+{
+    return lightbulb_handle_kelvin2percentage(s_lb_obj, kelvin, percentage);
+}
+
+esp_err_t lightbulb_percentage2kelvin(uint8_t percentage, uint16_t *kelvin)
+{
+    return lightbulb_handle_percentage2kelvin(s_lb_obj, percentage, kelvin);
+}
+
+esp_err_t lightbulb_set_hue(uint16_t hue)
+{
+    return lightbulb_handle_set_hue(s_lb_obj, hue);
+}
+
+esp_err_t lightbulb_set_saturation(uint8_t saturation)
+{
+    return lightbulb_handle_set_saturation(s_lb_obj, saturation);
+}
+
+esp_err_t lightbulb_set_value(uint8_t value)
+{
+    return lightbulb_handle_set_value(s_lb_obj, value);
+}
+
+esp_err_t lightbulb_set_cct(uint16_t cct)
+{
+    return lightbulb_handle_set_cct(s_lb_obj, cct);
+}
+
+esp_err_t lightbulb_set_brightness(uint8_t brightness)
+{
+    return lightbulb_handle_set_brightness(s_lb_obj, brightness);
+}
+
+esp_err_t lightbulb_set_hsv(uint16_t hue, uint8_t saturation, uint8_t value)
+{
+    return lightbulb_handle_set_hsv(s_lb_obj, hue, saturation, value);
+}
+
+esp_err_t lightbulb_set_hsv_with_curve(uint16_t hue, uint8_t saturation, uint8_t value, lightbulb_fade_curve_t curve)
+{
+    return lightbulb_handle_set_hsv_with_curve(s_lb_obj, hue, saturation, value, curve);
+}
+
+esp_err_t lightbulb_set_cctb(uint16_t cct, uint8_t brightness)
+{
+    return lightbulb_handle_set_cctb(s_lb_obj, cct, brightness);
+}
+
+esp_err_t lightbulb_set_cctb_with_curve(uint16_t cct, uint8_t brightness, lightbulb_fade_curve_t curve)
+{
+    return lightbulb_handle_set_cctb_with_curve(s_lb_obj, cct, brightness, curve);
+}
+
+esp_err_t lightbulb_begin(void)
+{
+    return lightbulb_handle_begin(s_lb_obj);
+}
+
+esp_err_t lightbulb_commit(void)
+{
+    return lightbulb_handle_commit(s_lb_obj);
+}
+
+esp_err_t lightbulb_set_switch(bool status)
+{
+    return lightbulb_handle_set_switch(s_lb_obj, status);
+}
+
+int16_t lightbulb_get_hue(void)
+{
+    return lightbulb_handle_get_hue(s_lb_obj);
+}
+
+int8_t lightbulb_get_saturation(void)
+{
+    return lightbulb_handle_get_saturation(s_lb_obj);
+}
+
+int8_t lightbulb_get_value(void)
+{
+    return lightbulb_handle_get_value(s_lb_obj);
+}
+
+int8_t lightbulb_get_cct_percentage(void)
+{
+    return lightbulb_handle_get_cct_percentage(s_lb_obj);
+}
+
+int16_t lightbulb_get_cct_kelvin(void)
+{
+    return lightbulb_handle_get_cct_kelvin(s_lb_obj);
+}
+
+int8_t lightbulb_get_brightness(void)
+{
+    return lightbulb_handle_get_brightness(s_lb_obj);
+}
+
+esp_err_t lightbulb_get_all_detail(lightbulb_status_t *status)
+{
+    return lightbulb_handle_get_all_detail(s_lb_obj, status);
+}
+
+bool lightbulb_get_switch(void)
+{
+    return lightbulb_handle_get_switch(s_lb_obj);
+}
+
+esp_err_t lightbulb_set_fades_function(bool is_enable)
+{
+    return lightbulb_handle_set_fades_function(s_lb_obj, is_enable);
+}
+
+esp_err_t lightbulb_set_storage_function(bool is_enable)
+{
+    return lightbulb_handle_set_storage_function(s_lb_obj, is_enable);
+}
+
+esp_err_t lightbulb_set_fade_time(uint32_t fades_ms)
+{
+    return lightbulb_handle_set_fade_time(s_lb_obj, fades_ms);
+}
+
+esp_err_t lightbulb_set_balance_coefficient(lightbulb_custom_balance_coefficient_t *balance)
+{
+    return lightbulb_handle_set_balance_coefficient(s_lb_obj, balance);
+}
+
+esp_err_t lightbulb_set_custom_fade_curve(lightbulb_fade_curve_cb_t curve)
+{
+    return lightbulb_handle_set_custom_fade_curve(s_lb_obj, curve);
+}
+
+esp_err_t lightbulb_get_fade_stats(lightbulb_fade_stats_t *stats)
+{
+    return lightbulb_handle_get_fade_stats(s_lb_obj, stats);
+}
+
+bool lightbulb_get_fades_function_status(void)
+{
+    return lightbulb_handle_get_fades_function_status(s_lb_obj);
+}
+
+lightbulb_works_mode_t lightbulb_get_mode(void)
+{
+    return lightbulb_handle_get_mode(s_lb_obj);
+}
+
+esp_err_t lightbulb_update_status_variable(lightbulb_status_t *new_status, bool trigger)
+{
+    return lightbulb_handle_update_status_variable(s_lb_obj, new_status, trigger);
+}
+
+esp_err_t lightbulb_basic_effect_start(lightbulb_effect_config_t *config)
+{
+    return lightbulb_handle_basic_effect_start(s_lb_obj, config);
+}
+
+esp_err_t lightbulb_timeline_effect_start(const lightbulb_timeline_config_t *config)
+{
+    return lightbulb_handle_timeline_effect_start(s_lb_obj, config);
+}
+
+esp_err_t lightbulb_basic_effect_stop(void)
+{
+    return lightbulb_handle_basic_effect_stop(s_lb_obj);
+}
+
+esp_err_t lightbulb_basic_effect_stop_and_restore(void)
+{
+    return lightbulb_handle_basic_effect_stop_and_restore(s_lb_obj);
 }
@@ -54,19 +54,73 @@ typedef enum {
     QUERY_DRIVER_NAME,
 } hal_feature_query_list_t;
 
-esp_err_t hal_output_init(hal_config_t *config, lightbulb_gamma_data_t *gamma, void *priv_data);
-esp_err_t hal_output_deinit(void);
-esp_err_t hal_regist_channel(int channel, gpio_num_t gpio_num);
-esp_err_t hal_get_driver_feature(hal_feature_query_list_t type, void *out_data);
-esp_err_t hal_get_gamma_value(uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b);
-esp_err_t hal_get_linear_function_value(uint8_t input, uint16_t *output);
-esp_err_t hal_set_channel(int channel, uint16_t value, uint16_t fade_ms);
-esp_err_t hal_set_channel_group(uint16_t value[], uint8_t channel_mask, uint16_t fade_ms);
-esp_err_t hal_start_channel_action(int channel, uint16_t value_min, uint16_t value_max, uint16_t period_ms, bool fade_flag);
-esp_err_t hal_start_channel_group_action(uint16_t value_min[], uint16_t value_max[], uint8_t channel_mask, uint16_t period_ms, bool fade_flag);
-esp_err_t hal_stop_channel_action(uint8_t channel_mask);
-esp_err_t hal_register_monitor_cb(hardware_monitor_user_cb_t cb);
-esp_err_t hal_sleep_control(bool enable_sleep);
+/**
+ * @brief Timeline bytecode, built with the hal_timeline_add_xxx() functions and evaluated by the fade tick
+ * @note Multi-byte fields are little endian. A fade carries one value per channel of the timeline mask, in channel order.
+ *
+ * | op   | layout                                                  |
+ * | FADE | 0x00 | curve << 4, fade ms (2), values (2 per channel)  |
+ * | HOLD | 0x01, hold ms (2)                                       |
+ * | LOOP | 0x02 | loop id << 4, count (1), target offset (2)       |
+ * | END  | 0x03                                                    |
+ *
+ * A step lasts its fade or hold time rounded down to whole TIMELINE_TICK_MS ticks, the next op runs on the tick it ends.
+ * LOOP jumps back to the target count more times, then falls through; count 0 loops forever.
+ * A loop whose body does not take a single tick is rejected by hal_timeline_add_loop().
+ */
+#define TIMELINE_TICK_MS                            (12)
+#define TIMELINE_OP_FADE                            (0x00)
+#define TIMELINE_OP_HOLD                            (0x01)
+#define TIMELINE_OP_LOOP                            (0x02)
+#define TIMELINE_OP_END                             (0x03)
+#define TIMELINE_MAX_LOOPS                          (16)
+#define TIMELINE_FADE_SIZE(channel_num)             (3 + 2 * (channel_num))
+#define TIMELINE_HOLD_SIZE                          (3)
+#define TIMELINE_LOOP_SIZE                          (4)
+#define TIMELINE_END_SIZE                           (1)
+
+typedef struct {
+    uint8_t *code;
+    uint16_t len;
+    uint16_t size;
+    uint8_t channel_mask;
+} hal_timeline_t;
+
+/**
+ * @brief Called from the FreeRTOS timer task when a timeline reaches its end or its total time
+ *
+ */
+typedef void (*hal_timeline_end_cb_t)(void *priv, uint32_t arg);
+
+/**
+ * @brief One output driver with its own tables and fade state, all instances share the fade tick task and timer
+ *
+ */
+typedef struct hal_context_s *hal_handle_t;
+
+esp_err_t hal_output_init(hal_config_t *config, lightbulb_gamma_data_t *gamma, void *priv_data, hal_handle_t *handle);
+esp_err_t hal_output_deinit(hal_handle_t hal);
+esp_err_t hal_regist_channel(hal_handle_t hal, int channel, gpio_num_t gpio_num);
+esp_err_t hal_get_driver_feature(hal_handle_t hal, hal_feature_query_list_t type, void *out_data);
+esp_err_t hal_get_gamma_value(hal_handle_t hal, uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b);
+esp_err_t hal_get_balanced_gamma_value(hal_handle_t hal, uint8_t r, uint8_t g, uint8_t b, uint16_t *out_r, uint16_t *out_g, uint16_t *out_b);
+esp_err_t hal_set_balance_coefficient(hal_handle_t hal, lightbulb_custom_balance_coefficient_t *balance);
+esp_err_t hal_set_custom_fade_curve(hal_handle_t hal, lightbulb_fade_curve_cb_t curve);
+esp_err_t hal_get_fade_stats(hal_handle_t hal, lightbulb_fade_stats_t *stats);
+esp_err_t hal_get_linear_function_value(hal_handle_t hal, uint8_t input, uint16_t *output);
+esp_err_t hal_set_channel(hal_handle_t hal, int channel, uint16_t value, uint16_t fade_ms);
+esp_err_t hal_set_channel_group(hal_handle_t hal, uint16_t value[], uint8_t channel_mask, uint16_t fade_ms, lightbulb_fade_curve_t curve);
+esp_err_t hal_start_channel_action(hal_handle_t hal, int channel, uint16_t value_min, uint16_t value_max, uint16_t period_ms, bool fade_flag);
+esp_err_t hal_start_channel_group_action(hal_handle_t hal, uint16_t value_min[], uint16_t value_max[], uint8_t channel_mask, uint16_t period_ms, bool fade_flag);
+esp_err_t hal_stop_channel_action(hal_handle_t hal, uint8_t channel_mask);
+esp_err_t hal_timeline_create(hal_timeline_t *timeline, uint8_t channel_mask, uint16_t size);
+esp_err_t hal_timeline_add_fade(hal_timeline_t *timeline, const uint16_t value[], uint16_t fade_ms, lightbulb_fade_curve_t curve);
+esp_err_t hal_timeline_add_hold(hal_timeline_t *timeline, uint16_t hold_ms);
+esp_err_t hal_timeline_add_loop(hal_timeline_t *timeline, uint8_t loop_id, uint8_t count, uint16_t target);
+esp_err_t hal_timeline_delete(hal_timeline_t *timeline);
+esp_err_t hal_start_timeline(hal_handle_t hal, hal_timeline_t *timeline, uint32_t total_ms, hal_timeline_end_cb_t end_cb, void *priv, uint32_t arg);
+esp_err_t hal_register_monitor_cb(hal_handle_t hal, hardware_monitor_user_cb_t cb);
+esp_err_t hal_sleep_control(hal_handle_t hal, bool enable_sleep);
 
 /**
  * @brief To resolve some compilation warning issues
@@ -78,12 +132,37 @@ static inline esp_err_t _sm2135e_set_channel(sm2135e_channel_t channel, uint16_t
 {
     return sm2135e_set_channel(channel, value);
 }
+
+static inline esp_err_t _sm2135e_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
+{
+    return sm2135e_set_rgb_channel(value_r, value_g, value_b);
+}
+
+static inline esp_err_t _sm2135e_set_wy_channel(uint16_t value_w, uint16_t value_y)
+{
+    return sm2135e_set_wy_channel(value_w, value_y);
+}
 #endif
 #ifdef CONFIG_ENABLE_SM2135EH_DRIVER
 static inline esp_err_t _sm2135eh_set_channel(sm2135eh_channel_t channel, uint16_t value)
 {
     return sm2135eh_set_channel(channel, value);
 }
+
+static inline esp_err_t _sm2135eh_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
+{
+    return sm2135eh_set_rgb_channel(value_r, value_g, value_b);
+}
+
+static inline esp_err_t _sm2135eh_set_wy_channel(uint16_t value_w, uint16_t value_y)
+{
+    return sm2135eh_set_wy_channel(value_w, value_y);
+}
+
+static inline esp_err_t _sm2135eh_set_rgbwy_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b, uint16_t value_w, uint16_t value_y)
+{
+    return sm2135eh_set_rgbwy_channel(value_r, value_g, value_b, value_w, value_y);
+}
 #endif
 #ifdef CONFIG_ENABLE_WS2812_DRIVER
 static inline esp_err_t _ws2812_set_rgb_channel(uint16_t value_r, uint16_t value_g, uint16_t value_b)
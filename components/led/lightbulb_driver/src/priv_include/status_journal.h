@@ -0,0 +1,41 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "lightbulb_utils.h"
+#include "lightbulb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Append-only status journal
+ *
+ * @note Every status is appended as a record holding only the fields that changed since the previous one.
+ * A sector starts with a full record, so that only the oldest sector is erased when the ring is full.
+ * All functions open the journal on first use, ESP_ERR_NOT_FOUND means there is no journal partition.
+ * Opening is serialized, a missing partition is remembered until status_journal_close().
+ */
+esp_err_t status_journal_open(void);
+esp_err_t status_journal_close(void);
+esp_err_t status_journal_append(const lightbulb_status_t *status);
+esp_err_t status_journal_load(lightbulb_status_t *status);
+esp_err_t status_journal_erase(void);
+esp_err_t status_journal_get_stats(lightbulb_status_journal_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
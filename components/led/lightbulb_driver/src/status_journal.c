@@ -0,0 +1,574 @@
+// Copyright 2020-2022 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#if !CONFIG_LB_STATUS_JOURNAL_SIMULATED_FLASH
+#include <esp_partition.h>
+#endif
+
+#include "status_journal.h"
+
+static const char *TAG = "status_journal";
+
+#define JOURNAL_MUTEX_TAKE(delay_ms)                    (xSemaphoreTake(s_journal->mutex, delay_ms))
+#define JOURNAL_MUTEX_GIVE()                            (xSemaphoreGive(s_journal->mutex))
+
+/**
+ * @brief Journal layout
+ *
+ * Each sector starts with a header, followed by records aligned to 4 bytes:
+ *
+ * | mask (1) | crc8 of mask and fields (1) | fields present in mask | 0xFF padding |
+ *
+ * The first record of a sector holds all fields. A mask of 0xFF is erased flash and ends the sector.
+ */
+#define JOURNAL_SECTOR_SIZE                             (4096)
+#define JOURNAL_SECTOR_MAGIC                            (0x4C42)
+#define JOURNAL_VERSION                                 (1)
+#define JOURNAL_RECORD_ALIGN                            (4)
+#define JOURNAL_RECORD_MAX_SIZE                         (12)
+#define JOURNAL_ERASED_MASK                             (0xFF)
+#define JOURNAL_SIMULATED_SECTOR_NUM                    (4)
+
+#define FIELD_MODE                                      BIT(0)
+#define FIELD_ON                                        BIT(1)
+#define FIELD_HUE                                       BIT(2)
+#define FIELD_SATURATION                                BIT(3)
+#define FIELD_VALUE                                     BIT(4)
+#define FIELD_CCT                                       BIT(5)
+#define FIELD_BRIGHTNESS                                BIT(6)
+#define FIELD_ALL                                       (BIT(7) - 1)
+
+typedef struct {
+    uint32_t seq;
+    uint16_t magic;
+    uint8_t version;
+    uint8_t crc;
+} journal_sector_header_t;
+
+typedef struct {
+    esp_err_t (*read)(size_t offset, void *buf, size_t len);
+    esp_err_t (*write)(size_t offset, const void *buf, size_t len);
+    esp_err_t (*erase_sector)(size_t offset);
+} journal_flash_t;
+
+typedef struct {
+    const journal_flash_t *flash;
+    uint32_t sector_num;
+    uint32_t sector;                // Sector being appended
+    uint32_t offset;                // Next record offset in that sector, JOURNAL_SECTOR_SIZE when a new sector must be started
+    uint32_t seq;                   // Sequence number of that sector
+    bool valid;                     // status holds the last stored status
+    lightbulb_status_t status;
+    lightbulb_status_journal_stats_t stats;
+    SemaphoreHandle_t mutex;
+} journal_t;
+
+static journal_t *s_journal = NULL;
+static bool s_journal_not_found = false;    // No journal partition, there is nothing to probe again
+
+// Serializes opening and closing, the mutex is created on first use under the spinlock
+static portMUX_TYPE s_journal_open_lock = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t s_journal_open_mutex_buffer;
+static SemaphoreHandle_t s_journal_open_mutex = NULL;
+
+#if CONFIG_LB_STATUS_JOURNAL_SIMULATED_FLASH
+static uint8_t s_simulated_flash[JOURNAL_SIMULATED_SECTOR_NUM * JOURNAL_SECTOR_SIZE];
+static bool s_simulated_flash_formatted = false;
+
+static esp_err_t simulated_flash_read(size_t offset, void *buf, size_t len)
+{
+    memcpy(buf, &s_simulated_flash[offset], len);
+    return ESP_OK;
+}
+
+static esp_err_t simulated_flash_write(size_t offset, const void *buf, size_t len)
+{
+    // Like NOR flash, a write can only clear bits
+    for (size_t i = 0; i < len; i++) {
+        s_simulated_flash[offset + i] &= ((const uint8_t *)buf)[i];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t simulated_flash_erase_sector(size_t offset)
+{
+    memset(&s_simulated_flash[offset], 0xFF, JOURNAL_SECTOR_SIZE);
+    return ESP_OK;
+}
+
+static const journal_flash_t s_journal_flash = {
+    .read = simulated_flash_read,
+    .write = simulated_flash_write,
+    .erase_sector = simulated_flash_erase_sector,
+};
+
+static uint32_t journal_flash_find(void)
+{
+    // The content survives close and open like a partition does, it is blank the first time only
+    if (!s_simulated_flash_formatted) {
+        memset(s_simulated_flash, 0xFF, sizeof(s_simulated_flash));
+        s_simulated_flash_formatted = true;
+    }
+    return JOURNAL_SIMULATED_SECTOR_NUM;
+}
+#else
+static const esp_partition_t *s_partition = NULL;
+
+static esp_err_t partition_flash_read(size_t offset, void *buf, size_t len)
+{
+    return esp_partition_read(s_partition, offset, buf, len);
+}
+
+static esp_err_t partition_flash_write(size_t offset, const void *buf, size_t len)
+{
+    return esp_partition_write(s_partition, offset, buf, len);
+}
+
+static esp_err_t partition_flash_erase_sector(size_t offset)
+{
+    return esp_partition_erase_range(s_partition, offset, JOURNAL_SECTOR_SIZE);
+}
+
+static const journal_flash_t s_journal_flash = {
+    .read = partition_flash_read,
+    .write = partition_flash_write,
+    .erase_sector = partition_flash_erase_sector,
+};
+
+static uint32_t journal_flash_find(void)
+{
+    s_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_LB_STATUS_JOURNAL_PARTITION);
+    return s_partition ? s_partition->size / JOURNAL_SECTOR_SIZE : 0;
+}
+#endif
+
+static uint8_t crc8(uint8_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint8_t header_crc(const journal_sector_header_t *header)
+{
+    return crc8(0, (const uint8_t *)header, offsetof(journal_sector_header_t, crc));
+}
+
+/**
+ * @brief Mask of the fields that differ between two status
+ *
+ */
+static uint8_t status_diff(const lightbulb_status_t *a, const lightbulb_status_t *b)
+{
+    uint8_t mask = 0;
+
+    mask |= (a->mode != b->mode) ? FIELD_MODE : 0;
+    mask |= (a->on != b->on) ? FIELD_ON : 0;
+    mask |= (a->hue != b->hue) ? FIELD_HUE : 0;
+    mask |= (a->saturation != b->saturation) ? FIELD_SATURATION : 0;
+    mask |= (a->value != b->value) ? FIELD_VALUE : 0;
+    mask |= (a->cct_percentage != b->cct_percentage) ? FIELD_CCT : 0;
+    mask |= (a->brightness != b->brightness) ? FIELD_BRIGHTNESS : 0;
+    return mask;
+}
+
+/**
+ * @brief Encode the fields in mask into a record
+ *
+ * @return Record size, padding included
+ */
+static size_t record_encode(const lightbulb_status_t *status, uint8_t mask, uint8_t record[JOURNAL_RECORD_MAX_SIZE])
+{
+    size_t len = 2;
+
+    memset(record, 0xFF, JOURNAL_RECORD_MAX_SIZE);
+    record[0] = mask;
+    if (mask & FIELD_MODE) {
+        record[len++] = status->mode;
+    }
+    if (mask & FIELD_ON) {
+        record[len++] = status->on;
+    }
+    if (mask & FIELD_HUE) {
+        record[len++] = status->hue & 0xFF;
+        record[len++] = status->hue >> 8;
+    }
+    if (mask & FIELD_SATURATION) {
+        record[len++] = status->saturation;
+    }
+    if (mask & FIELD_VALUE) {
+        record[len++] = status->value;
+    }
+    if (mask & FIELD_CCT) {
+        record[len++] = status->cct_percentage;
+    }
+    if (mask & FIELD_BRIGHTNESS) {
+        record[len++] = status->brightness;
+    }
+    record[1] = crc8(0, record, 1);
+    record[1] = crc8(record[1], &record[2], len - 2);
+
+    return (len + JOURNAL_RECORD_ALIGN - 1) / JOURNAL_RECORD_ALIGN * JOURNAL_RECORD_ALIGN;
+}
+
+/**
+ * @brief Apply a record on top of status
+ *
+ * @return Record size, padding included, 0 if the record is torn or corrupted
+ */
+static size_t record_decode(const uint8_t record[JOURNAL_RECORD_MAX_SIZE], size_t available, lightbulb_status_t *status)
+{
+    uint8_t mask = record[0];
+    size_t len = 2;
+
+    if (mask == 0 || (mask & ~FIELD_ALL)) {
+        return 0;
+    }
+    for (int field = 0; field < 7; field++) {
+        len += (mask & BIT(field)) ? ((BIT(field) == FIELD_HUE) ? 2 : 1) : 0;
+    }
+    if (len > available || crc8(crc8(0, record, 1), &record[2], len - 2) != record[1]) {
+        return 0;
+    }
+
+    len = 2;
+    if (mask & FIELD_MODE) {
+        status->mode = record[len++];
+    }
+    if (mask & FIELD_ON) {
+        status->on = record[len++];
+    }
+    if (mask & FIELD_HUE) {
+        status->hue = record[len] | (record[len + 1] << 8);
+        len += 2;
+    }
+    if (mask & FIELD_SATURATION) {
+        status->saturation = record[len++];
+    }
+    if (mask & FIELD_VALUE) {
+        status->value = record[len++];
+    }
+    if (mask & FIELD_CCT) {
+        status->cct_percentage = record[len++];
+    }
+    if (mask & FIELD_BRIGHTNESS) {
+        status->brightness = record[len++];
+    }
+
+    return (len + JOURNAL_RECORD_ALIGN - 1) / JOURNAL_RECORD_ALIGN * JOURNAL_RECORD_ALIGN;
+}
+
+static bool sector_header_read(uint32_t sector, journal_sector_header_t *header)
+{
+    if (s_journal->flash->read(sector * JOURNAL_SECTOR_SIZE, header, sizeof(journal_sector_header_t)) != ESP_OK) {
+        return false;
+    }
+    return header->magic == JOURNAL_SECTOR_MAGIC && header->version == JOURNAL_VERSION && header->crc == header_crc(header);
+}
+
+/**
+ * @brief Replay the records of a sector
+ *
+ * @param sector Sector to replay
+ * @param status Output status after the last valid record
+ * @param end_offset Output offset of the next record, JOURNAL_SECTOR_SIZE if the sector can not be appended any more
+ * @return true if the sector starts with a valid full record
+ */
+static bool sector_replay(uint32_t sector, lightbulb_status_t *status, uint32_t *end_offset)
+{
+    uint32_t offset = sizeof(journal_sector_header_t);
+    uint8_t record[JOURNAL_RECORD_MAX_SIZE];
+    bool has_base = false;
+
+    *end_offset = JOURNAL_SECTOR_SIZE;
+    while (offset < JOURNAL_SECTOR_SIZE) {
+        size_t available = MIN(JOURNAL_RECORD_MAX_SIZE, JOURNAL_SECTOR_SIZE - offset);
+        memset(record, 0xFF, sizeof(record));
+        if (s_journal->flash->read(sector * JOURNAL_SECTOR_SIZE + offset, record, available) != ESP_OK) {
+            break;
+        }
+
+        // 1. Erased flash, the sector can be appended here if nothing was half written after it
+        if (record[0] == JOURNAL_ERASED_MASK) {
+            bool erased = true;
+            for (size_t i = 0; i < available; i++) {
+                erased &= (record[i] == 0xFF);
+            }
+            *end_offset = erased ? offset : JOURNAL_SECTOR_SIZE;
+            break;
+        }
+
+        // 2. The first record must hold every field, a torn record ends the sector
+        if (!has_base && record[0] != FIELD_ALL) {
+            break;
+        }
+        size_t len = record_decode(record, available, status);
+        if (len == 0) {
+            break;
+        }
+        has_base = true;
+        offset += len;
+    }
+
+    return has_base;
+}
+
+static esp_err_t sector_start(uint32_t sector, uint32_t seq)
+{
+    esp_err_t err = ESP_OK;
+    journal_sector_header_t header = {
+        .seq = seq,
+        .magic = JOURNAL_SECTOR_MAGIC,
+        .version = JOURNAL_VERSION,
+    };
+    header.crc = header_crc(&header);
+
+    // The oldest status is dropped here, this is the only erase of the journal
+    err = s_journal->flash->erase_sector(sector * JOURNAL_SECTOR_SIZE);
+    LIGHTBULB_CHECK(err == ESP_OK, "erase sector %"PRIu32" fail, reason code: %d", return err, sector, err);
+    s_journal->stats.erases++;
+
+    err = s_journal->flash->write(sector * JOURNAL_SECTOR_SIZE, &header, sizeof(header));
+    LIGHTBULB_CHECK(err == ESP_OK, "write sector %"PRIu32" header fail, reason code: %d", return err, sector, err);
+    s_journal->stats.bytes += sizeof(header);
+
+    s_journal->sector = sector;
+    s_journal->seq = seq;
+    s_journal->offset = sizeof(header);
+    return ESP_OK;
+}
+
+static void journal_open_lock(void)
+{
+    portENTER_CRITICAL(&s_journal_open_lock);
+    if (!s_journal_open_mutex) {
+        s_journal_open_mutex = xSemaphoreCreateMutexStatic(&s_journal_open_mutex_buffer);
+    }
+    portEXIT_CRITICAL(&s_journal_open_lock);
+
+    xSemaphoreTake(s_journal_open_mutex, portMAX_DELAY);
+}
+
+static void journal_open_unlock(void)
+{
+    xSemaphoreGive(s_journal_open_mutex);
+}
+
+static void journal_free(void)
+{
+    if (!s_journal) {
+        return;
+    }
+
+    if (s_journal->mutex) {
+        vSemaphoreDelete(s_journal->mutex);
+    }
+    free(s_journal);
+    s_journal = NULL;
+}
+
+/**
+ * @brief Find the partition and restore the newest status, the open lock must be held
+ *
+ */
+static esp_err_t journal_load(void)
+{
+    esp_err_t err = ESP_OK;
+    uint32_t sector_num = journal_flash_find();
+    if (sector_num < 2) {
+        ESP_LOGD(TAG, "no journal partition with 2 sectors at least, found %"PRIu32, sector_num);
+        s_journal_not_found = true;
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_journal = calloc(1, sizeof(journal_t));
+    LIGHTBULB_CHECK(s_journal, "alloc fail", return ESP_ERR_NO_MEM);
+    s_journal->flash = &s_journal_flash;
+    s_journal->sector_num = sector_num;
+    s_journal->mutex = xSemaphoreCreateMutex();
+    LIGHTBULB_CHECK(s_journal->mutex, "mutex create fail", err = ESP_ERR_NO_MEM; goto EXIT);
+
+    // 1. The sector with the highest sequence number is the newest
+    journal_sector_header_t header = { 0 };
+    int newest = -1;
+    for (uint32_t sector = 0; sector < sector_num; sector++) {
+        if (sector_header_read(sector, &header) && (newest < 0 || header.seq > s_journal->seq)) {
+            newest = sector;
+            s_journal->seq = header.seq;
+        }
+    }
+
+    // 2. Nothing stored, the first append starts the first sector
+    s_journal->sector = sector_num - 1;
+    s_journal->offset = JOURNAL_SECTOR_SIZE;
+    if (newest < 0) {
+        ESP_LOGI(TAG, "journal is empty, %"PRIu32" sectors", sector_num);
+        return ESP_OK;
+    }
+
+    // 3. Replay the newest sector, or the one before if power was lost before its first record was complete
+    s_journal->sector = newest;
+    s_journal->valid = sector_replay(newest, &s_journal->status, &s_journal->offset);
+    if (!s_journal->valid) {
+        uint32_t previous = (newest + sector_num - 1) % sector_num;
+        uint32_t unused_offset = 0;
+        if (sector_header_read(previous, &header) && header.seq == s_journal->seq - 1) {
+            s_journal->valid = sector_replay(previous, &s_journal->status, &unused_offset);
+        }
+        s_journal->offset = JOURNAL_SECTOR_SIZE;
+    }
+    ESP_LOGI(TAG, "journal restored: %s, sector %"PRIu32" seq %"PRIu32" offset %"PRIu32, s_journal->valid ? "yes" : "no", s_journal->sector, s_journal->seq, s_journal->offset);
+
+    return ESP_OK;
+
+EXIT:
+    journal_free();
+    return err;
+}
+
+esp_err_t status_journal_open(void)
+{
+    esp_err_t err = ESP_OK;
+
+    journal_open_lock();
+    if (!s_journal) {
+        err = s_journal_not_found ? ESP_ERR_NOT_FOUND : journal_load();
+    }
+    journal_open_unlock();
+
+    return err;
+}
+
+esp_err_t status_journal_close(void)
+{
+    journal_open_lock();
+    journal_free();
+    s_journal_not_found = false;
+    journal_open_unlock();
+
+    return ESP_OK;
+}
+
+esp_err_t status_journal_append(const lightbulb_status_t *status)
+{
+    LIGHTBULB_CHECK(status, "status is null", return ESP_ERR_INVALID_ARG);
+    esp_err_t err = status_journal_open();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    JOURNAL_MUTEX_TAKE(portMAX_DELAY);
+    uint8_t record[JOURNAL_RECORD_MAX_SIZE];
+    uint8_t mask = s_journal->valid ? status_diff(status, &s_journal->status) : FIELD_ALL;
+    size_t len = 0;
+    int64_t start = esp_timer_get_time();
+
+    // 1. Nothing changed since the last record, nothing to write
+    if (mask == 0) {
+        goto EXIT;
+    }
+
+    // 2. Continue in the next sector when this one is full, it starts with all fields
+    len = record_encode(status, mask, record);
+    if (s_journal->offset + len > JOURNAL_SECTOR_SIZE) {
+        err = sector_start((s_journal->sector + 1) % s_journal->sector_num, s_journal->seq + 1);
+        LIGHTBULB_CHECK(err == ESP_OK, "start sector fail", s_journal->offset = JOURNAL_SECTOR_SIZE; goto EXIT);
+        len = record_encode(status, FIELD_ALL, record);
+    }
+
+    // 3. Append, a failed write leaves the sector for good
+    err = s_journal->flash->write(s_journal->sector * JOURNAL_SECTOR_SIZE + s_journal->offset, record, len);
+    LIGHTBULB_CHECK(err == ESP_OK, "write record fail, reason code: %d", s_journal->offset = JOURNAL_SECTOR_SIZE; goto EXIT, err);
+    s_journal->offset += len;
+    s_journal->status = *status;
+    s_journal->valid = true;
+
+    s_journal->stats.records++;
+    s_journal->stats.bytes += len;
+    s_journal->stats.last_write_us = esp_timer_get_time() - start;
+    s_journal->stats.max_write_us = MAX(s_journal->stats.max_write_us, s_journal->stats.last_write_us);
+    ESP_LOGD(TAG, "append mask:%x len:%d sector:%"PRIu32" offset:%"PRIu32" %"PRIu32" us", mask, (int)len, s_journal->sector, s_journal->offset, s_journal->stats.last_write_us);
+
+EXIT:
+    JOURNAL_MUTEX_GIVE();
+    return err;
+}
+
+esp_err_t status_journal_load(lightbulb_status_t *status)
+{
+    LIGHTBULB_CHECK(status, "status is null", return ESP_ERR_INVALID_ARG);
+    esp_err_t err = status_journal_open();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    JOURNAL_MUTEX_TAKE(portMAX_DELAY);
+    if (s_journal->valid) {
+        *status = s_journal->status;
+    } else {
+        err = ESP_ERR_NOT_FOUND;
+    }
+    JOURNAL_MUTEX_GIVE();
+
+    return err;
+}
+
+esp_err_t status_journal_erase(void)
+{
+    esp_err_t err = status_journal_open();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    JOURNAL_MUTEX_TAKE(portMAX_DELAY);
+    for (uint32_t sector = 0; sector < s_journal->sector_num; sector++) {
+        err |= s_journal->flash->erase_sector(sector * JOURNAL_SECTOR_SIZE);
+        s_journal->stats.erases++;
+    }
+    s_journal->sector = s_journal->sector_num - 1;
+    s_journal->offset = JOURNAL_SECTOR_SIZE;
+    s_journal->seq = 0;
+    s_journal->valid = false;
+    JOURNAL_MUTEX_GIVE();
+
+    return err;
+}
+
+esp_err_t status_journal_get_stats(lightbulb_status_journal_stats_t *stats)
+{
+    LIGHTBULB_CHECK(stats, "stats is null", return ESP_ERR_INVALID_ARG);
+    esp_err_t err = status_journal_open();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    JOURNAL_MUTEX_TAKE(portMAX_DELAY);
+    *stats = s_journal->stats;
+    JOURNAL_MUTEX_GIVE();
+
+    return ESP_OK;
+}
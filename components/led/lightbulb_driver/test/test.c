@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -20,8 +24,17 @@
 #include <unity.h>
 #include <nvs_flash.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 
 #include <lightbulb.h>
+#ifdef CONFIG_ENABLE_PWM_DRIVER
+#include <driver/ledc.h>
+#endif
+#if CONFIG_ENABLE_SM2135E_DRIVER || CONFIG_ENABLE_SM2135EH_DRIVER || CONFIG_ENABLE_SM2x35EGH_DRIVER || CONFIG_ENABLE_BP5758D_DRIVER || CONFIG_ENABLE_BP1658CJ_DRIVER || CONFIG_ENABLE_KP18058_DRIVER
+#define TEST_IIC_SEND_QUEUE 1
+#include "iic.h"
+#endif
 
 #if 0
 #define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
@@ -293,6 +306,27 @@ TEST_CASE("Parity Check", "[Application Layer]")
     }
 }
 
+#if CONFIG_HEAP_USE_HOOKS
+static volatile uint32_t s_heap_alloc_count = 0;
+/* Only the allocations of these tasks are counted, other tasks may allocate at any time */
+static TaskHandle_t s_heap_watch_task[2] = { NULL };
+
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    for (int i = 0; i < sizeof(s_heap_watch_task) / sizeof(s_heap_watch_task[0]); i++) {
+        if (task && task == s_heap_watch_task[i]) {
+            s_heap_alloc_count++;
+        }
+    }
+}
+
+void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+}
+#endif
+
 #ifdef CONFIG_ENABLE_PWM_DRIVER
 TEST_CASE("PWM", "[Underlying Driver]")
 {
@@ -392,6 +426,365 @@ TEST_CASE("PWM", "[Application Layer]")
     lightbulb_lighting_output_test(LIGHTING_ALL_UNIT, 1000);
     TEST_ESP_OK(lightbulb_deinit());
 }
+
+/**
+ * @brief Duty the LEDC outputs for a PWM channel
+ *
+ */
+static uint32_t pwm_test_get_duty(pwm_channel_t channel)
+{
+#if CONFIG_IDF_TARGET_ESP32
+    return ledc_get_duty(LEDC_HIGH_SPEED_MODE, (ledc_channel_t)channel);
+#else
+    return ledc_get_duty(LEDC_LOW_SPEED_MODE, (ledc_channel_t)channel);
+#endif
+}
+
+/**
+ * @brief Balanced output of an 8 bit input, the linear 12 bit gamma table scaled by the coefficient
+ *
+ */
+static uint16_t pwm_test_balanced_value(uint8_t input, float coe)
+{
+    uint16_t gamma = (input == 255) ? 4096 : (uint16_t)((float)input / 255 * 4096);
+    return (uint16_t)(coe * gamma);
+}
+
+/**
+ * @brief Wait until a PWM channel outputs a duty, within 1, and return the time since start_us in ms
+ *
+ */
+static uint32_t pwm_test_wait_duty(pwm_channel_t channel, uint32_t duty, int64_t start_us, uint32_t timeout_ms)
+{
+    uint32_t elapsed_ms = 0;
+    while (elapsed_ms < timeout_ms) {
+        uint32_t output = pwm_test_get_duty(channel);
+        if (output + 1 >= duty && output <= duty + 1) {
+            break;
+        }
+        vTaskDelay(1);
+        elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+    }
+    return elapsed_ms;
+}
+
+TEST_CASE("PWM balance coefficient", "[Application Layer]")
+{
+    lightbulb_custom_balance_coefficient_t balance = {
+        .r_balance_coe = 1.0,
+        .g_balance_coe = 0.8,
+        .b_balance_coe = 0.6,
+    };
+    lightbulb_gamma_data_t gamma_conf = {
+        .balance = &balance,
+        .r_curve_coe = 1.0,
+        .g_curve_coe = 1.0,
+        .b_curve_coe = 1.0,
+    };
+    lightbulb_power_limit_t limit = {
+        .white_max_brightness = 100,
+        .white_min_brightness = 0,
+        .color_max_value = 100,
+        .color_min_value = 0,
+        .white_max_power = 100,
+        .color_max_power = 300,
+    };
+    lightbulb_config_t config = {
+        .type = DRIVER_ESP_PWM,
+        .driver_conf.pwm.freq_hz = 4000,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .io_conf.pwm_io.red = 25,
+        .io_conf.pwm_io.green = 26,
+        .io_conf.pwm_io.blue = 27,
+        .gamma_conf = &gamma_conf,
+        .external_limit = &limit,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 0,
+        .init_status.value = 100,
+    };
+    const uint16_t hue[3] = { 0, 120, 240 };
+    const uint8_t value[3] = { 100, 50, 20 };
+    const pwm_channel_t channel[3] = { PWM_CHANNEL_R, PWM_CHANNEL_G, PWM_CHANNEL_B };
+    uint8_t rgb[3] = { 0 };
+
+    // 1. Coefficients out of 0.5-1.0 would overflow or wrap the output tables
+    balance.r_balance_coe = 1.5;
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, lightbulb_init(&config));
+    balance.r_balance_coe = 1.0;
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(1000);
+
+    // 2. A single channel is not power limited, it outputs its gamma value scaled by its coefficient
+    TEST_ESP_OK(lightbulb_set_fades_function(false));
+    const float coe[3] = { balance.r_balance_coe, balance.g_balance_coe, balance.b_balance_coe };
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 3; i++) {
+            TEST_ESP_OK(lightbulb_set_hsv(hue[c], 100, value[i]));
+            vTaskDelay(pdMS_TO_TICKS(100));
+            TEST_ESP_OK(lightbulb_hsv2rgb(hue[c], 100, value[i], &rgb[0], &rgb[1], &rgb[2]));
+            TEST_ASSERT_UINT32_WITHIN(1, pwm_test_balanced_value(rgb[c], coe[c]), pwm_test_get_duty(channel[c]));
+        }
+    }
+    TEST_ESP_OK(lightbulb_set_fades_function(true));
+
+    // 3. Recalibrate while a fade is running, the next color change uses the new coefficients
+    TEST_ESP_OK(lightbulb_set_hsv(0, 0, 50));
+    balance.g_balance_coe = 1.0;
+    balance.b_balance_coe = 1.0;
+    TEST_ESP_OK(lightbulb_set_balance_coefficient(&balance));
+    vTaskDelay(1000);
+    TEST_ESP_OK(lightbulb_set_hsv(120, 100, 100));
+    vTaskDelay(1000);
+    TEST_ASSERT_UINT32_WITHIN(1, 4096, pwm_test_get_duty(PWM_CHANNEL_G));
+
+    // 4. Rejected coefficients leave the tables as they are
+    balance.b_balance_coe = -0.5;
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, lightbulb_set_balance_coefficient(&balance));
+    balance.b_balance_coe = 2.0;
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, lightbulb_set_balance_coefficient(&balance));
+    TEST_ESP_OK(lightbulb_set_hsv(240, 100, 100));
+    vTaskDelay(1000);
+    TEST_ASSERT_UINT32_WITHIN(1, 4096, pwm_test_get_duty(PWM_CHANNEL_B));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, lightbulb_set_balance_coefficient(NULL));
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+TEST_CASE("PWM rapid updates", "[Application Layer]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_ESP_PWM,
+        .driver_conf.pwm.freq_hz = 4000,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .io_conf.pwm_io.red = 25,
+        .io_conf.pwm_io.green = 26,
+        .io_conf.pwm_io.blue = 27,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 100,
+    };
+    const pwm_channel_t channel[3] = { PWM_CHANNEL_R, PWM_CHANNEL_G, PWM_CHANNEL_B };
+    uint8_t rgb[3] = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+
+    // 1. New targets arrive faster than the fade tick, none of them may be rejected and the output ends on the last one
+    const int update_num = 500;
+    for (int i = 0; i < update_num; i++) {
+        TEST_ESP_OK(lightbulb_set_hsv(i % 360, 100, 100));
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ESP_OK(lightbulb_hsv2rgb((update_num - 1) % 360, 100, 100, &rgb[0], &rgb[1], &rgb[2]));
+    for (int c = 0; c < 3; c++) {
+        TEST_ASSERT_UINT32_WITHIN(1, pwm_test_balanced_value(rgb[c], 1.0), pwm_test_get_duty(channel[c]));
+    }
+    TEST_ESP_OK(lightbulb_deinit());
+
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+    // 2. The LEDC can not be read back write by write, the simulated output records every write of the same kind of updates.
+    // Each target of a rising ramp wakes the tick up on its own, so each one is written once and in the order it was set.
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+    uint32_t total_num = 0;
+    lightbulb_config_t simulated_config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = 256,
+        .capability.enable_fades = false,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 1,
+    };
+    TEST_ESP_OK(lightbulb_init(&simulated_config));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ESP_OK(simulated_clear_records());
+
+    for (int value = 2; value <= 100; value++) {
+        TEST_ESP_OK(lightbulb_set_hsv(0, 100, value));
+        vTaskDelay(1);
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, &total_num));
+    TEST_ASSERT_EQUAL_UINT32(99, total_num);
+    TEST_ASSERT_EQUAL_UINT32(total_num, record_num);
+    for (int i = 0; i < record_num; i++) {
+        if (i > 0) {
+            TEST_ASSERT_TRUE(records[i].value[SIMULATED_CHANNEL_R] > records[i - 1].value[SIMULATED_CHANNEL_R]);
+        }
+        TEST_ASSERT_EQUAL_UINT16(0, records[i].value[SIMULATED_CHANNEL_G]);
+        TEST_ASSERT_EQUAL_UINT16(0, records[i].value[SIMULATED_CHANNEL_B]);
+    }
+    TEST_ESP_OK(lightbulb_hsv2rgb(0, 100, 100, &rgb[0], &rgb[1], &rgb[2]));
+    TEST_ASSERT_UINT32_WITHIN(1, pwm_test_balanced_value(rgb[0], 1.0), records[record_num - 1].value[SIMULATED_CHANNEL_R]);
+    TEST_ESP_OK(lightbulb_deinit());
+#endif
+}
+
+TEST_CASE("PWM slow fade ticks", "[Performance]")
+{
+    lightbulb_power_limit_t limit = {
+        .white_max_brightness = 100,
+        .white_min_brightness = 0,
+        .color_max_value = 100,
+        .color_min_value = 0,
+        .white_max_power = 100,
+        .color_max_power = 300,
+    };
+    lightbulb_config_t config = {
+        .type = DRIVER_ESP_PWM,
+        .driver_conf.pwm.freq_hz = 4000,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 3000,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .io_conf.pwm_io.red = 25,
+        .io_conf.pwm_io.green = 26,
+        .io_conf.pwm_io.blue = 27,
+        .external_limit = &limit,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 10,
+    };
+    uint8_t rgb[3] = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(3500));
+
+    // 1. The fade moves by a fraction of an output step per 12 ms tick, only the ticks that change the output may wake up
+    lightbulb_fade_stats_t stats = { 0 };
+    TEST_ESP_OK(lightbulb_hsv2rgb(0, 100, 12, &rgb[0], &rgb[1], &rgb[2]));
+    int64_t start_us = esp_timer_get_time();
+    TEST_ESP_OK(lightbulb_set_value(12));
+    uint32_t fade_ms = pwm_test_wait_duty(PWM_CHANNEL_R, pwm_test_balanced_value(rgb[0], 1.0), start_us, 3500);
+    vTaskDelay(pdMS_TO_TICKS(500));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    ESP_LOGI(TAG, "slow fade: %d ms, %d ticks, %d writes, %d ticks at a fixed rate", (int)fade_ms, (int)stats.ticks, (int)stats.writes, 3000 / 12);
+    TEST_ASSERT_UINT32_WITHIN(150, 3000, fade_ms);
+    TEST_ASSERT_UINT32_WITHIN(1, pwm_test_balanced_value(rgb[0], 1.0), pwm_test_get_duty(PWM_CHANNEL_R));
+    TEST_ASSERT_LESS_THAN_UINT32(3000 / 12, stats.ticks);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(stats.ticks * 3, stats.writes);
+
+    // 2. A fast full range fade changes the output on every tick
+    TEST_ESP_OK(lightbulb_set_fade_time(600));
+    TEST_ESP_OK(lightbulb_hsv2rgb(0, 100, 100, &rgb[0], &rgb[1], &rgb[2]));
+    start_us = esp_timer_get_time();
+    TEST_ESP_OK(lightbulb_set_value(100));
+    fade_ms = pwm_test_wait_duty(PWM_CHANNEL_R, pwm_test_balanced_value(rgb[0], 1.0), start_us, 1000);
+    vTaskDelay(pdMS_TO_TICKS(400));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    ESP_LOGI(TAG, "fast fade: %d ms, %d ticks, %d writes, %d ticks at a fixed rate", (int)fade_ms, (int)stats.ticks, (int)stats.writes, 600 / 12);
+    TEST_ASSERT_UINT32_WITHIN(50, 600, fade_ms);
+    TEST_ASSERT_UINT32_WITHIN(1, pwm_test_balanced_value(rgb[0], 1.0), pwm_test_get_duty(PWM_CHANNEL_R));
+    TEST_ASSERT_UINT32_WITHIN(3, 600 / 12, stats.ticks);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+#if CONFIG_PWM_HW_FADE_OFFLOAD
+TEST_CASE("PWM hardware fade offload", "[Performance]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_ESP_PWM,
+        .driver_conf.pwm.freq_hz = 4000,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 2000,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .io_conf.pwm_io.red = 25,
+        .io_conf.pwm_io.green = 26,
+        .io_conf.pwm_io.blue = 27,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 10,
+    };
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(2500));
+
+    // Only the red channel changes, its whole fade runs in the LEDC and the fade tick only wakes up for the new target
+    lightbulb_fade_stats_t stats = { 0 };
+    TEST_ESP_OK(lightbulb_set_value(100));
+    vTaskDelay(pdMS_TO_TICKS(2500));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    ESP_LOGI(TAG, "offloaded fade: %d ticks, %d hardware fades, %d ms without tick, %d ticks at a fixed rate", (int)stats.ticks, (int)stats.hw_fades, (int)stats.hw_fade_us / 1000, 2000 / 12);
+    TEST_ASSERT_EQUAL(1, stats.hw_fades);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(2, stats.ticks);
+    TEST_ASSERT_TRUE(stats.hw_fade_us > 1900 * 1000);
+
+    // A new target in the middle of the fade starts from the duty the hardware reached
+    TEST_ESP_OK(lightbulb_set_value(10));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ESP_OK(lightbulb_set_value(100));
+    vTaskDelay(pdMS_TO_TICKS(2500));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    ESP_LOGI(TAG, "interrupted fade: %d ticks, %d hardware fades, %d ms without tick", (int)stats.ticks, (int)stats.hw_fades, (int)stats.hw_fade_us / 1000);
+    TEST_ASSERT_EQUAL(1, stats.hw_fades);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(2, stats.ticks);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+#endif
+
+#if CONFIG_PM_ENABLE
+TEST_CASE("PWM power locks", "[Performance]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_ESP_PWM,
+        .driver_conf.pwm.freq_hz = 4000,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_lowpower = true,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .io_conf.pwm_io.red = 25,
+        .io_conf.pwm_io.green = 26,
+        .io_conf.pwm_io.blue = 27,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 100,
+    };
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // A lit output only keeps the locks its LEDC clock needs, all locks are taken for the fade only
+    pwm_power_stats_t stats = { 0 };
+    TEST_ESP_OK(pwm_reset_power_stats());
+    TEST_ESP_OK(lightbulb_set_hsv(120, 100, 100));
+    vTaskDelay(pdMS_TO_TICKS(3000));
+    TEST_ESP_OK(pwm_get_power_stats(&stats));
+    ESP_LOGI(TAG, "lit: active %d ms (%d fades), steady %d ms, sleep %d ms, light sleep when steady: %d", (int)(stats.active_us / 1000), (int)stats.active_count, (int)(stats.steady_us / 1000), (int)(stats.sleep_us / 1000), stats.steady_light_sleep);
+    TEST_ASSERT_EQUAL(1, stats.active_count);
+    TEST_ASSERT_TRUE(stats.active_us < 1000 * 1000);
+    TEST_ASSERT_TRUE(stats.steady_us > 2000 * 1000);
+
+    // Once the light is off, the low power timer releases every lock
+    TEST_ESP_OK(pwm_reset_power_stats());
+    TEST_ESP_OK(lightbulb_set_switch(false));
+    vTaskDelay(pdMS_TO_TICKS(4000));
+    TEST_ESP_OK(pwm_get_power_stats(&stats));
+    ESP_LOGI(TAG, "off: active %d ms (%d fades), steady %d ms, sleep %d ms", (int)(stats.active_us / 1000), (int)stats.active_count, (int)(stats.steady_us / 1000), (int)(stats.sleep_us / 1000));
+    TEST_ASSERT_TRUE(stats.sleep_us > 1500 * 1000);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+#endif
 #endif
 
 #ifdef CONFIG_ENABLE_SM2135E_DRIVER
@@ -692,6 +1085,55 @@ TEST_CASE("BP5758D", "[Underlying Driver]")
     TEST_ESP_OK(bp5758d_deinit());
 }
 
+TEST_CASE("BP5758D writes only changed registers", "[Underlying Driver]")
+{
+    iic_driver_stats_t stats = { 0 };
+    driver_bp5758d_t conf = {
+        .current = {10, 10, 10, 20, 20},
+        .iic_clk = 4,
+        .iic_sda = 5,
+        .freq_khz = 300,
+        .enable_iic_queue = false
+    };
+    TEST_ESP_OK(bp5758d_init(&conf));
+    TEST_ESP_OK(bp5758d_regist_channel(BP5758D_CHANNEL_R, BP5758D_PIN_OUT1));
+    TEST_ESP_OK(bp5758d_regist_channel(BP5758D_CHANNEL_G, BP5758D_PIN_OUT2));
+    TEST_ESP_OK(bp5758d_regist_channel(BP5758D_CHANNEL_B, BP5758D_PIN_OUT3));
+    TEST_ESP_OK(bp5758d_regist_channel(BP5758D_CHANNEL_C, BP5758D_PIN_OUT5));
+    TEST_ESP_OK(bp5758d_regist_channel(BP5758D_CHANNEL_W, BP5758D_PIN_OUT4));
+
+    // 1. The first frame after wake up holds all the grayscale registers
+    TEST_ESP_OK(bp5758d_set_rgbcw_channel(100, 200, 300, 400, 500));
+    TEST_ESP_OK(iic_driver_reset_stats(I2C_NUM_0));
+
+    // 2. Nothing changed, nothing is sent
+    TEST_ESP_OK(bp5758d_set_rgbcw_channel(100, 200, 300, 400, 500));
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.sent_frames + stats.failed_frames);
+
+    // 3. One channel changed, address byte plus its 2 grayscale bytes
+    TEST_ESP_OK(bp5758d_set_rgbcw_channel(101, 200, 300, 400, 500));
+    TEST_ESP_OK(bp5758d_set_cw_channel(400, 501));
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    TEST_ASSERT_EQUAL_UINT32(2, stats.sent_frames);
+    TEST_ASSERT_EQUAL_UINT32(2 * 3, stats.sent_bytes);
+
+    // 4. OUT1 and OUT4 changed, the run from OUT1 to OUT4 is sent in one frame
+    TEST_ESP_OK(iic_driver_reset_stats(I2C_NUM_0));
+    TEST_ESP_OK(bp5758d_set_rgbcw_channel(102, 200, 300, 400, 502));
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.sent_frames);
+    TEST_ASSERT_EQUAL_UINT32(1 + 4 * 2, stats.sent_bytes);
+
+    // 5. Shutdown always clears every output
+    TEST_ESP_OK(iic_driver_reset_stats(I2C_NUM_0));
+    TEST_ESP_OK(bp5758d_set_shutdown());
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    TEST_ASSERT_EQUAL_UINT32(1 + 5 * 2, stats.sent_bytes);
+
+    TEST_ESP_OK(bp5758d_deinit());
+}
+
 TEST_CASE("BP5758D", "[Application Layer]")
 {
     lightbulb_config_t config = {
@@ -727,6 +1169,71 @@ TEST_CASE("BP5758D", "[Application Layer]")
     lightbulb_lighting_output_test(LIGHTING_ALL_UNIT, 2000);
     TEST_ESP_OK(lightbulb_deinit());
 }
+
+#if CONFIG_HEAP_USE_HOOKS
+static void test_bp5758d_fade_alloc(bool enable_iic_queue)
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_BP5758D,
+        .driver_conf.bp5758d.current = {10, 10, 10, 20, 20},
+        .driver_conf.bp5758d.iic_clk = 4,
+        .driver_conf.bp5758d.iic_sda = 5,
+        .driver_conf.bp5758d.freq_khz = 300,
+        .driver_conf.bp5758d.enable_iic_queue = enable_iic_queue,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_lowpower = false,
+        .capability.enable_mix_cct = true,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_AND_WHITE_MODE,
+        .capability.storage_cb = NULL,
+        .capability.sync_change_brightness_value = true,
+        .io_conf.iic_io.red = OUT1,
+        .io_conf.iic_io.green = OUT2,
+        .io_conf.iic_io.blue = OUT3,
+        .io_conf.iic_io.cold_white = OUT5,
+        .io_conf.iic_io.warm_yellow = OUT4,
+        .external_limit = NULL,
+        .gamma_conf = NULL,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 100,
+    };
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // 1. The fade tick builds every IIC frame, the send task writes the queued ones
+    s_heap_watch_task[0] = xTaskGetHandle("fade_tick_task");
+    s_heap_watch_task[1] = enable_iic_queue ? xTaskGetHandle("send_task") : NULL;
+    TEST_ASSERT_NOT_NULL(s_heap_watch_task[0]);
+    TEST_ASSERT_TRUE(!enable_iic_queue || s_heap_watch_task[1]);
+
+    // 2. None of them may touch the heap during the fades
+    s_heap_alloc_count = 0;
+    TEST_ESP_OK(lightbulb_set_hsv(120, 100, 100));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ESP_OK(lightbulb_set_hsv(240, 50, 20));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    uint32_t alloc_count = s_heap_alloc_count;
+    memset(s_heap_watch_task, 0, sizeof(s_heap_watch_task));
+    ESP_LOGI(TAG, "heap allocations during fades, iic queue %s: %"PRIu32, enable_iic_queue ? "on" : "off", alloc_count);
+    TEST_ASSERT_EQUAL_UINT32(0, alloc_count);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+#endif
+
+TEST_CASE("BP5758D fade without heap allocation", "[Performance]")
+{
+#if CONFIG_HEAP_USE_HOOKS
+    test_bp5758d_fade_alloc(false);
+    test_bp5758d_fade_alloc(true);
+#else
+    TEST_IGNORE_MESSAGE("CONFIG_HEAP_USE_HOOKS is required to count heap allocations");
+#endif
+}
 #endif
 
 #ifdef CONFIG_ENABLE_BP1658CJ_DRIVER
@@ -994,33 +1501,123 @@ TEST_CASE("WS2812", "[Underlying Driver]")
     ws2812_deinit();
 }
 
-TEST_CASE("WS2812", "[Application Layer]")
+TEST_CASE("WS2812 pixel", "[Underlying Driver]")
 {
-    lightbulb_config_t config = {
-        .type = DRIVER_WS2812,
-        .driver_conf.ws2812.led_num = 22,
-        .driver_conf.ws2812.ctrl_io = 2,
-        .capability.enable_fades = true,
-        .capability.fades_ms = 800,
-        .capability.enable_status_storage = false,
-        .capability.mode_mask = COLOR_MODE,
-        .capability.storage_cb = NULL,
-        .external_limit = NULL,
-        .gamma_conf = NULL,
-        .init_status.mode = WORK_COLOR,
-        .init_status.on = true,
-        .init_status.hue = 0,
-        .init_status.saturation = 100,
-        .init_status.value = 100,
+    driver_ws2812_t ws2812 = {
+        .led_num = 22,
+        .ctrl_io = 4,
     };
-    TEST_ESP_OK(lightbulb_init(&config));
-    vTaskDelay(1000);
-    lightbulb_lighting_output_test(LIGHTING_RAINBOW | LIGHTING_COLOR_EFFECT | LIGHTING_ALEXA, 2000);
-    TEST_ESP_OK(lightbulb_deinit());
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ws2812_set_pixel(0, 255, 0, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, ws2812_commit());
+
+    TEST_ESP_OK(ws2812_init(&ws2812));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, ws2812_set_pixel(ws2812.led_num, 255, 0, 0));
+
+    // Running dot on a dim background
+    for (int i = 0; i < ws2812.led_num * 3; i++) {
+        TEST_ESP_OK(ws2812_set_rgb_channel(0, 0, 10));
+        TEST_ESP_OK(ws2812_set_pixel(i % ws2812.led_num, 255, 0, 0));
+        TEST_ESP_OK(ws2812_commit());
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+
+    // Rainbow, one commit per frame
+    for (int frame = 0; frame < 100; frame++) {
+        for (int i = 0; i < ws2812.led_num; i++) {
+            uint8_t pos = (i * 256 / ws2812.led_num + frame * 4) & 0xFF;
+            TEST_ESP_OK(ws2812_set_pixel(i, 255 - pos, pos, 0));
+        }
+        TEST_ESP_OK(ws2812_commit());
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+
+    TEST_ESP_OK(ws2812_deinit());
 }
-#endif
 
-#ifdef CONFIG_ENABLE_KP18058_DRIVER
+TEST_CASE("WS2812 frame encoding cost", "[Performance]")
+{
+    const int rounds = 64;
+    driver_ws2812_t ws2812 = {
+        .led_num = 300,
+        .ctrl_io = 4,
+    };
+    int64_t total_us = 0;
+
+    TEST_ESP_OK(ws2812_init(&ws2812));
+
+    // ws2812_set_rgb_channel() encodes the whole strip through ws2812_encode_fill(), as every fade tick does
+    for (int round = 0; round < rounds; round++) {
+        // Let the previous frame (~9ms for 300 LEDs) finish, so only the encoding is measured
+        vTaskDelay(pdMS_TO_TICKS(20));
+
+        int64_t start = esp_timer_get_time();
+        TEST_ESP_OK(ws2812_set_rgb_channel(round * 4, 255 - round * 4, round * 2));
+        total_us += esp_timer_get_time() - start;
+    }
+    ESP_LOGI(TAG, "led_num: %d, set_rgb_channel: %lld us, %.1f ns/led", ws2812.led_num, total_us / rounds, total_us * 1000.0 / (rounds * ws2812.led_num));
+
+    TEST_ESP_OK(ws2812_deinit());
+}
+
+TEST_CASE("WS2812 commit cost vs changed pixels", "[Performance]")
+{
+    const uint16_t changed_list[] = { 0, 1, 10, 60, 300, 600 };
+    const int rounds = 20;
+    driver_ws2812_t ws2812 = {
+        .led_num = 600,
+        .ctrl_io = 4,
+    };
+
+    TEST_ESP_OK(ws2812_init(&ws2812));
+
+    for (int i = 0; i < sizeof(changed_list) / sizeof(changed_list[0]); i++) {
+        int64_t total_us = 0;
+
+        for (int round = 0; round < rounds; round++) {
+            for (int led = 0; led < changed_list[i]; led++) {
+                TEST_ESP_OK(ws2812_set_pixel(led, round, 255 - round, led & 0xFF));
+            }
+            // Let the previous frame (~18ms for 600 LEDs) finish, so only the encoding is measured
+            vTaskDelay(pdMS_TO_TICKS(30));
+
+            int64_t start = esp_timer_get_time();
+            TEST_ESP_OK(ws2812_commit());
+            total_us += esp_timer_get_time() - start;
+        }
+        ESP_LOGI(TAG, "led_num: %d, changed: %d, commit: %lld us", ws2812.led_num, changed_list[i], total_us / rounds);
+    }
+
+    TEST_ESP_OK(ws2812_deinit());
+}
+
+TEST_CASE("WS2812", "[Application Layer]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_WS2812,
+        .driver_conf.ws2812.led_num = 22,
+        .driver_conf.ws2812.ctrl_io = 2,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .capability.storage_cb = NULL,
+        .external_limit = NULL,
+        .gamma_conf = NULL,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 100,
+    };
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(1000);
+    lightbulb_lighting_output_test(LIGHTING_RAINBOW | LIGHTING_COLOR_EFFECT | LIGHTING_ALEXA, 2000);
+    TEST_ESP_OK(lightbulb_deinit());
+}
+#endif
+
+#ifdef CONFIG_ENABLE_KP18058_DRIVER
 TEST_CASE("KP18058", "[Underlying Driver]")
 {
     driver_kp18058_t kp18058 = {
@@ -1139,3 +1736,1345 @@ TEST_CASE("KP18058", "[Application Layer]")
 }
 #endif
 
+#if TEST_IIC_SEND_QUEUE
+TEST_CASE("IIC send queue coalescing", "[Underlying Driver]")
+{
+    iic_driver_stats_t stats = { 0 };
+    uint8_t data[10] = { 0 };
+    const int write_count = 500;
+    iic_device_t *device = NULL;
+
+    TEST_ESP_OK(iic_driver_init(I2C_NUM_0, 4, 5, 300 * 1000, &device));
+    TEST_ESP_OK(iic_driver_send_task_create(device));
+    TEST_ESP_OK(iic_driver_reset_stats(I2C_NUM_0));
+
+    // 1. Burst of frames for the same registers, only the latest value needs to reach the bus
+    for (int i = 0; i < write_count; i++) {
+        data[0] = i & 0xFF;
+        TEST_ESP_OK(iic_driver_write(device, 0xA1, data, sizeof(data)));
+    }
+    vTaskDelay(pdMS_TO_TICKS(200));
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    ESP_LOGI(TAG, "same registers: sent:%"PRIu32" coalesced:%"PRIu32" dropped:%"PRIu32" max pending:%"PRIu32, stats.sent_frames, stats.coalesced_frames, stats.dropped_frames, stats.max_pending_frames);
+    TEST_ASSERT_EQUAL_UINT32(write_count, stats.sent_frames + stats.failed_frames + stats.coalesced_frames);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped_frames);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, stats.max_pending_frames);
+
+    // 2. Interleaved registers can not be merged, the queue depth stays bounded
+    TEST_ESP_OK(iic_driver_reset_stats(I2C_NUM_0));
+    for (int i = 0; i < write_count; i++) {
+        TEST_ESP_OK(iic_driver_write(device, (i % 2) ? 0xA1 : 0xA7, data, (i % 2) ? sizeof(data) : 4));
+    }
+    vTaskDelay(pdMS_TO_TICKS(500));
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    ESP_LOGI(TAG, "interleaved: sent:%"PRIu32" coalesced:%"PRIu32" dropped:%"PRIu32" max pending:%"PRIu32, stats.sent_frames, stats.coalesced_frames, stats.dropped_frames, stats.max_pending_frames);
+    TEST_ASSERT_EQUAL_UINT32(write_count, stats.sent_frames + stats.failed_frames + stats.coalesced_frames + stats.dropped_frames);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(CONFIG_LB_IIC_QUEUE_SIZE, stats.max_pending_frames);
+
+    TEST_ESP_OK(iic_driver_deinit(device));
+}
+
+TEST_CASE("IIC shared bus scheduler", "[Underlying Driver]")
+{
+    iic_driver_stats_t stats = { 0 };
+    uint8_t data[10] = { 0 };
+    const int write_count = 200;
+    iic_device_t *device[2] = { NULL };
+    iic_device_t *wrong_pins = NULL;
+
+    // 1. Two chips on one port, a chip wired to other pins of the same port is rejected
+    TEST_ESP_OK(iic_driver_init(I2C_NUM_0, 4, 5, 300 * 1000, &device[0]));
+    TEST_ESP_OK(iic_driver_init(I2C_NUM_0, 4, 5, 300 * 1000, &device[1]));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, iic_driver_init(I2C_NUM_0, 6, 7, 300 * 1000, &wrong_pins));
+    TEST_ASSERT_NULL(wrong_pins);
+    TEST_ESP_OK(iic_driver_send_task_create(device[0]));
+    TEST_ESP_OK(iic_driver_send_task_create(device[1]));
+    TEST_ESP_OK(iic_driver_reset_stats(I2C_NUM_0));
+
+    // 2. Both chips queue interleaved frames, the send task drains them in shared batches
+    for (int i = 0; i < write_count; i++) {
+        data[0] = i & 0xFF;
+        TEST_ESP_OK(iic_driver_write(device[0], (i % 2) ? 0xA1 : 0xA7, data, (i % 2) ? sizeof(data) : 4));
+        TEST_ESP_OK(iic_driver_write(device[1], (i % 2) ? 0xB1 : 0xB7, data, (i % 2) ? sizeof(data) : 4));
+    }
+    vTaskDelay(pdMS_TO_TICKS(500));
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    ESP_LOGI(TAG, "shared bus: sent:%"PRIu32" batches:%"PRIu32" dropped:%"PRIu32" busy:%"PRIu64"us utilization:%d%%", stats.sent_frames, stats.batches, stats.dropped_frames, stats.busy_us, stats.utilization);
+    TEST_ASSERT_EQUAL_UINT32(write_count * 2, stats.sent_frames + stats.failed_frames + stats.coalesced_frames + stats.dropped_frames);
+    TEST_ASSERT_TRUE(stats.batches > 0);
+    TEST_ASSERT_TRUE(stats.batches <= stats.sent_frames + stats.failed_frames);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(100, stats.utilization);
+
+    // 3. A direct write of one chip still works after the other chip leaves the bus
+    TEST_ESP_OK(iic_driver_deinit(device[1]));
+    TEST_ESP_OK(iic_driver_task_destroy(device[0]));
+    TEST_ESP_OK(iic_driver_write(device[0], 0xA1, data, sizeof(data)));
+    TEST_ESP_OK(iic_driver_deinit(device[0]));
+}
+
+TEST_CASE("IIC bus latency at the fade tick rate", "[Performance]")
+{
+    iic_driver_stats_t stats = { 0 };
+    uint8_t data[10] = { 0 };
+    const int tick_count = 100;
+    iic_device_t *device = NULL;
+
+    TEST_ESP_OK(iic_driver_init(I2C_NUM_0, 4, 5, 300 * 1000, &device));
+    TEST_ESP_OK(iic_driver_send_task_create(device));
+    TEST_ESP_OK(iic_driver_reset_stats(I2C_NUM_0));
+
+    // 1. A fade writes all the channels and then the mode byte every 12 ms
+    for (int i = 0; i < tick_count; i++) {
+        data[0] = i & 0xFF;
+        TEST_ESP_OK(iic_driver_write(device, 0xA1, data, sizeof(data)));
+        TEST_ESP_OK(iic_driver_write(device, 0xA7, data, 4));
+        vTaskDelay(pdMS_TO_TICKS(12));
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    // 2. Every written frame lands in the histogram, the bus keeps up with the tick
+    TEST_ESP_OK(iic_driver_get_stats(I2C_NUM_0, &stats));
+    TEST_ESP_OK(iic_driver_print_stats(I2C_NUM_0));
+    uint32_t histogram_total = 0;
+    for (int i = 0; i < IIC_LATENCY_BUCKET_NUM; i++) {
+        histogram_total += stats.latency_histogram[i];
+    }
+    TEST_ASSERT_EQUAL_UINT32(stats.sent_frames + stats.failed_frames, histogram_total);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.dropped_frames);
+    TEST_ASSERT_TRUE(stats.max_transfer_us <= stats.max_latency_us);
+    TEST_ASSERT_TRUE(stats.max_latency_us < 12 * 1000);
+
+    TEST_ESP_OK(iic_driver_deinit(device));
+}
+#endif
+
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+#define BENCH_FADE_TICK_US                          (12 * 1000)
+#define BENCH_SIMULATED_RECORD_NUM                  (2048)
+
+typedef struct {
+    uint32_t writes;
+    int64_t max_jitter_us;
+    int64_t total_jitter_us;
+    uint16_t min_value[SIMULATED_CHANNEL_MAX];
+    uint16_t max_value[SIMULATED_CHANNEL_MAX];
+    uint16_t final_value[SIMULATED_CHANNEL_MAX];
+} bench_simulated_report_t;
+
+/**
+ * @brief Summarize the writes recorded by the simulated driver
+ *
+ * @note Writes are expected on the 12 ms tick grid, the distance to the closest grid point is the tick jitter.
+ */
+static void bench_simulated_analyse(bench_simulated_report_t *report)
+{
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+
+    memset(report, 0, sizeof(bench_simulated_report_t));
+    memset(report->min_value, 0xFF, sizeof(report->min_value));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, &report->writes));
+    TEST_ASSERT_EQUAL_UINT32(report->writes, record_num);
+
+    for (int i = 0; i < record_num; i++) {
+        for (int ch = 0; ch < SIMULATED_CHANNEL_MAX; ch++) {
+            report->min_value[ch] = MIN(report->min_value[ch], records[i].value[ch]);
+            report->max_value[ch] = MAX(report->max_value[ch], records[i].value[ch]);
+        }
+        if (i > 0) {
+            int64_t interval = records[i].time_us - records[i - 1].time_us;
+            int64_t ticks = (interval + BENCH_FADE_TICK_US / 2) / BENCH_FADE_TICK_US;
+            int64_t jitter = llabs(interval - ticks * BENCH_FADE_TICK_US);
+            report->max_jitter_us = MAX(report->max_jitter_us, jitter);
+            report->total_jitter_us += jitter;
+        }
+    }
+    if (record_num) {
+        memcpy(report->final_value, records[record_num - 1].value, sizeof(report->final_value));
+    }
+}
+
+static void bench_simulated_log(const char *name, const bench_simulated_report_t *report, const lightbulb_fade_stats_t *stats)
+{
+    ESP_LOGI(TAG, "%s: %"PRIu32" ticks, %"PRIu32" writes, %"PRIu32" us/tick, jitter max %lld us avg %lld us", name, stats->ticks, report->writes,
+             stats->busy_us / MAX(stats->ticks, 1), report->max_jitter_us, report->total_jitter_us / MAX((int)report->writes - 1, 1));
+}
+
+TEST_CASE("Simulated fade benchmark", "[Performance]")
+{
+    const struct {
+        uint16_t hue;
+        uint8_t saturation;
+        uint8_t value;
+        uint16_t fade_ms;
+    } targets[] = {
+        { 0, 100, 100, 100 },
+        { 120, 100, 100, 800 },
+        { 240, 50, 30, 3000 },
+        { 60, 100, 1, 3000 },
+        { 300, 100, 100, 5000 },
+    };
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 0,
+        .init_status.value = 50,
+    };
+    bench_simulated_report_t report = { 0 };
+    lightbulb_fade_stats_t stats = { 0 };
+    uint16_t reference[SIMULATED_CHANNEL_MAX] = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // 1. hal_set_channel_group, every fade must end on the value written without fade
+    for (int i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        TEST_ESP_OK(simulated_clear_records());
+        TEST_ESP_OK(lightbulb_set_fades_function(false));
+        TEST_ESP_OK(lightbulb_set_hsv(targets[i].hue, targets[i].saturation, targets[i].value));
+        vTaskDelay(pdMS_TO_TICKS(50));
+        bench_simulated_analyse(&report);
+        memcpy(reference, report.final_value, sizeof(reference));
+        TEST_ESP_OK(lightbulb_set_hsv(0, 0, 50));
+        vTaskDelay(pdMS_TO_TICKS(50));
+
+        TEST_ESP_OK(simulated_clear_records());
+        TEST_ESP_OK(lightbulb_set_fades_function(true));
+        TEST_ESP_OK(lightbulb_set_fade_time(targets[i].fade_ms));
+        TEST_ESP_OK(lightbulb_set_hsv(targets[i].hue, targets[i].saturation, targets[i].value));
+        vTaskDelay(pdMS_TO_TICKS(targets[i].fade_ms + 300));
+        bench_simulated_analyse(&report);
+        TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+
+        char name[32] = { 0 };
+        snprintf(name, sizeof(name), "fade %dms to %d,%d,%d", targets[i].fade_ms, targets[i].hue, targets[i].saturation, targets[i].value);
+        bench_simulated_log(name, &report, &stats);
+        TEST_ASSERT_EQUAL_UINT32(stats.writes, report.writes);
+        TEST_ASSERT_EQUAL_UINT16_ARRAY(reference, report.final_value, SIMULATED_CHANNEL_MAX);
+    }
+
+    // 2. hal_start_channel_group_action, the breath must reach the levels that blink jumps between
+    lightbulb_effect_config_t effect = {
+        .effect_type = EFFECT_BLINK,
+        .mode = WORK_COLOR,
+        .red = 255,
+        .green = 128,
+        .blue = 0,
+        .min_brightness = 10,
+        .max_brightness = 100,
+        .effect_cycle_ms = 1000,
+    };
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_basic_effect_start(&effect));
+    vTaskDelay(pdMS_TO_TICKS(1500));
+    TEST_ESP_OK(lightbulb_basic_effect_stop());
+    bench_simulated_analyse(&report);
+    bench_simulated_report_t reference_report = report;
+
+    effect.effect_type = EFFECT_BREATH;
+    TEST_ESP_OK(lightbulb_basic_effect_start(&effect));
+    vTaskDelay(pdMS_TO_TICKS(50));
+    TEST_ESP_OK(simulated_clear_records());
+    vTaskDelay(pdMS_TO_TICKS(3000));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    TEST_ESP_OK(lightbulb_basic_effect_stop());
+    bench_simulated_analyse(&report);
+    bench_simulated_log("breath 1000ms", &report, &stats);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(reference_report.min_value, report.min_value, 3);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(reference_report.max_value, report.max_value, 3);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+/**
+ * @brief Check that every write of a fade carries all the channels in expect_mask
+ *
+ */
+static void test_grouped_flush_check(uint8_t expect_mask, uint32_t fade_ms)
+{
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+    uint32_t total_num = 0;
+    lightbulb_fade_stats_t stats = { 0 };
+
+    vTaskDelay(pdMS_TO_TICKS(fade_ms + 100));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, &total_num));
+    TEST_ASSERT_TRUE(record_num > 1);
+    TEST_ASSERT_EQUAL_UINT32(stats.writes, total_num);
+    TEST_ASSERT_TRUE(stats.writes <= stats.ticks);
+    for (int i = 0; i < record_num; i++) {
+        TEST_ASSERT_EQUAL_HEX8(expect_mask, records[i].channel_mask);
+    }
+}
+
+TEST_CASE("Grouped channel flush", "[Application Layer]")
+{
+    const uint8_t color_mask = BIT(SIMULATED_CHANNEL_R) | BIT(SIMULATED_CHANNEL_G) | BIT(SIMULATED_CHANNEL_B);
+    const uint8_t all_mask = BIT(SIMULATED_CHANNEL_MAX) - 1;
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 100,
+    };
+
+    // 1. Only the color channels are registered, every tick is one RGB frame
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_set_hsv(240, 50, 30));
+    test_grouped_flush_check(color_mask, config.capability.fades_ms);
+    TEST_ESP_OK(lightbulb_deinit());
+
+    // 2. All channels are registered, color and white fades both go out as one RGBWY frame per tick
+    config.capability.mode_mask = COLOR_AND_WHITE_MODE;
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_set_hsv(120, 80, 60));
+    test_grouped_flush_check(all_mask, config.capability.fades_ms);
+
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_set_cctb(50, 80));
+    test_grouped_flush_check(all_mask, config.capability.fades_ms);
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+TEST_CASE("Fade engine tick cost", "[Performance]")
+{
+#if CONFIG_LB_FADE_USE_FIXED_POINT
+    const char *arithmetic = "fixed-point";
+#else
+    const char *arithmetic = "float";
+#endif
+    const uint16_t fade_ms[] = { 100, 800, 3000 };
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 100,
+    };
+    lightbulb_fade_stats_t stats = { 0 };
+    uint32_t ticks = 0;
+    uint32_t busy_us = 0;
+    TEST_ESP_OK(lightbulb_init(&config));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // 1. Fades of all RGB channels through hal_driver.c, the cost per tick comes from the fade tick itself
+    for (int i = 0; i < sizeof(fade_ms) / sizeof(fade_ms[0]); i++) {
+        for (int hue = 60; hue < 360; hue += 60) {
+            TEST_ESP_OK(lightbulb_set_fade_time(fade_ms[i]));
+            TEST_ESP_OK(lightbulb_set_hsv(hue, 100, (hue % 120) ? 100 : 5));
+            vTaskDelay(pdMS_TO_TICKS(fade_ms[i] + 100));
+            TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+            TEST_ASSERT_TRUE(stats.ticks > 0);
+            ticks += stats.ticks;
+            busy_us += stats.busy_us;
+        }
+    }
+
+    // 2. Build the suite with and without CONFIG_LB_FADE_USE_FIXED_POINT to compare the two engines
+    ESP_LOGI(TAG, "%s: %"PRIu32" ticks in %"PRIu32" us, %.1f us/tick", arithmetic, ticks, busy_us, (float)busy_us / MAX(ticks, 1));
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+static float test_fade_curve_quartic(float progress)
+{
+    return progress * progress * progress * progress;
+}
+
+TEST_CASE("Fade curves", "[Application Layer]")
+{
+    const lightbulb_fade_curve_t curves[] = { FADE_CURVE_LINEAR, FADE_CURVE_EASE_IN_OUT, FADE_CURVE_CIE_LSTAR, FADE_CURVE_CUSTOM };
+    const uint16_t fade_ms = 1200;
+    float quarter_progress[sizeof(curves) / sizeof(curves[0])] = { 0 };
+    uint16_t final_value[sizeof(curves) / sizeof(curves[0])] = { 0 };
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = true,
+        .capability.fades_ms = fade_ms,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 10,
+    };
+    bench_simulated_report_t report = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+    TEST_ESP_OK(lightbulb_set_custom_fade_curve(test_fade_curve_quartic));
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, lightbulb_set_hsv_with_curve(0, 100, 100, FADE_CURVE_MAX));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    for (int i = 0; i < sizeof(curves) / sizeof(curves[0]); i++) {
+        const simulated_record_t *records = NULL;
+        uint32_t record_num = 0;
+
+        // 1. Start from 10% without fade
+        TEST_ESP_OK(lightbulb_set_fades_function(false));
+        TEST_ESP_OK(lightbulb_set_hsv(0, 100, 10));
+        vTaskDelay(pdMS_TO_TICKS(50));
+        bench_simulated_analyse(&report);
+        uint16_t from = report.final_value[SIMULATED_CHANNEL_R];
+
+        // 2. Fade to 100% and take the output a quarter of the way through
+        TEST_ESP_OK(simulated_clear_records());
+        TEST_ESP_OK(lightbulb_set_fades_function(true));
+        TEST_ESP_OK(lightbulb_set_hsv_with_curve(0, 100, 100, curves[i]));
+        vTaskDelay(pdMS_TO_TICKS(fade_ms + 300));
+        TEST_ESP_OK(simulated_get_records(&records, &record_num, NULL));
+        TEST_ASSERT_GREATER_THAN_UINT32(0, record_num);
+
+        uint16_t quarter = from;
+        for (int j = 0; j < record_num && records[j].time_us - records[0].time_us <= fade_ms * 1000 / 4; j++) {
+            quarter = records[j].value[SIMULATED_CHANNEL_R];
+        }
+        uint16_t to = records[record_num - 1].value[SIMULATED_CHANNEL_R];
+        quarter_progress[i] = (float)(quarter - from) / (to - from);
+        final_value[i] = to;
+        ESP_LOGI(TAG, "curve %d: %d -> %d, %.3f of the change after a quarter of the fade", curves[i], from, to, quarter_progress[i]);
+    }
+
+    // The curves front-load the change less and less, all of them end on the same target
+    TEST_ASSERT_TRUE(quarter_progress[0] > quarter_progress[1]);
+    TEST_ASSERT_TRUE(quarter_progress[1] > quarter_progress[2]);
+    TEST_ASSERT_TRUE(quarter_progress[2] > quarter_progress[3]);
+    for (int i = 1; i < sizeof(curves) / sizeof(curves[0]); i++) {
+        TEST_ASSERT_EQUAL_UINT16(final_value[0], final_value[i]);
+    }
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+TEST_CASE("Transaction", "[Application Layer]")
+{
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 800,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 10,
+    };
+    bench_simulated_report_t report = { 0 };
+    lightbulb_fade_stats_t stats = { 0 };
+    uint16_t reference[SIMULATED_CHANNEL_MAX] = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+    TEST_ESP_ERR(ESP_ERR_INVALID_STATE, lightbulb_commit());
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // 1. Reference, the same target set in one call
+    TEST_ESP_OK(lightbulb_set_hsv(240, 50, 80));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    bench_simulated_analyse(&report);
+    memcpy(reference, report.final_value, sizeof(reference));
+    TEST_ESP_OK(lightbulb_set_hsv(0, 100, 10));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // 2. Attribute setters inside a nested transaction do not touch the output
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_begin());
+    TEST_ESP_OK(lightbulb_set_hue(240));
+    TEST_ESP_OK(lightbulb_begin());
+    TEST_ESP_OK(lightbulb_set_saturation(50));
+    TEST_ESP_OK(lightbulb_commit());
+    TEST_ESP_OK(lightbulb_set_value(80));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, record_num);
+    TEST_ASSERT_EQUAL(240, lightbulb_get_hue());
+    TEST_ASSERT_EQUAL(50, lightbulb_get_saturation());
+    TEST_ASSERT_EQUAL(80, lightbulb_get_value());
+
+    // 3. The outermost commit starts a single fade to the merged target
+    TEST_ESP_OK(lightbulb_commit());
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    bench_simulated_analyse(&report);
+    bench_simulated_log("transaction", &report, &stats);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(reference, report.final_value, SIMULATED_CHANNEL_MAX);
+    TEST_ESP_ERR(ESP_ERR_INVALID_STATE, lightbulb_commit());
+
+    // 4. The switch is deferred too, the last call wins and the light ends off
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_begin());
+    TEST_ESP_OK(lightbulb_set_hsv(120, 100, 100));
+    TEST_ESP_OK(lightbulb_set_switch(false));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, record_num);
+    TEST_ASSERT_FALSE(lightbulb_get_switch());
+    TEST_ESP_OK(lightbulb_commit());
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    bench_simulated_analyse(&report);
+    for (int i = 0; i < SIMULATED_CHANNEL_MAX; i++) {
+        TEST_ASSERT_EQUAL_UINT16(0, report.final_value[i]);
+    }
+    TEST_ASSERT_FALSE(lightbulb_get_switch());
+    TEST_ASSERT_EQUAL(120, lightbulb_get_hue());
+
+    // 5. Switching back on inside a transaction restores the saved color at commit
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_begin());
+    TEST_ESP_OK(lightbulb_set_switch(true));
+    TEST_ESP_OK(lightbulb_set_hsv(240, 50, 80));
+    TEST_ESP_OK(lightbulb_commit());
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    bench_simulated_analyse(&report);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(reference, report.final_value, SIMULATED_CHANNEL_MAX);
+    TEST_ASSERT_TRUE(lightbulb_get_switch());
+
+    // 6. A light that is off and stays off is not faded to zero again
+    TEST_ESP_OK(lightbulb_set_switch(false));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_begin());
+    TEST_ESP_OK(lightbulb_set_switch(true));
+    TEST_ESP_OK(lightbulb_set_switch(false));
+    TEST_ESP_OK(lightbulb_commit());
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, record_num);
+    TEST_ASSERT_FALSE(lightbulb_get_switch());
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+/**
+ * @brief 8-bit white value the simulated output received, the white channels go through the 12-bit linear table
+ *
+ */
+static int simulated_white_to_8bit(uint16_t output)
+{
+    for (int i = 0; i < 256; i++) {
+        uint16_t linear = (i == 255) ? 4095 : (uint16_t)((float)i / 255 * 4096);
+        if (linear == output) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Set a white and check both outputs against the float conversion at the top of this file
+ *
+ * @param output Output of all channels, updated when the command changed it
+ */
+static void cct_output_check(const lightbulb_power_limit_t *limit, uint8_t cct, uint8_t brightness, uint16_t output[])
+{
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+    uint16_t ref_cold = 0, ref_warm = 0;
+
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_set_cctb(cct, brightness));
+    vTaskDelay(pdMS_TO_TICKS(20));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, NULL));
+    if (record_num) {
+        memcpy(output, records[record_num - 1].value, sizeof(records[0].value));
+    }
+
+    // Same brightness limit as lightbulb_set_cctb()
+    uint8_t _brightness = brightness ? (limit->white_max_brightness - limit->white_min_brightness) * (brightness / 100.0) + limit->white_min_brightness : 0;
+    cct_and_brightness_convert_to_cold_and_warm(limit->white_max_power, cct, _brightness, &ref_cold, &ref_warm);
+    int cold = simulated_white_to_8bit(output[SIMULATED_CHANNEL_W]);
+    int warm = simulated_white_to_8bit(output[SIMULATED_CHANNEL_Y]);
+    TEST_ASSERT_TRUE(cold >= 0 && warm >= 0);
+    TEST_ASSERT_INT_WITHIN(1, ref_cold, cold);
+    TEST_ASSERT_INT_WITHIN(1, ref_warm, warm);
+}
+
+TEST_CASE("CCT tables", "[Application Layer]")
+{
+    lightbulb_cct_kelvin_range_t kelvin_range = { .min = 2700, .max = 6500 };
+    lightbulb_power_limit_t limit = {
+        .white_max_brightness = 100,
+        .white_min_brightness = 1,
+        .color_max_value = 100,
+        .color_min_value = 1,
+        .color_max_power = 300,
+    };
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .kelvin_range = &kelvin_range,
+        .capability.enable_fades = false,
+        .capability.enable_status_storage = false,
+        .capability.enable_mix_cct = true,
+        .capability.mode_mask = WHITE_MODE,
+        .init_status.mode = WORK_WHITE,
+        .init_status.on = false,
+    };
+    TEST_ESP_OK(lightbulb_init(&config));
+
+    // 1. Percentage to Kelvin follows the configured range, rounded down to 100K
+    uint16_t kelvin = 0, last_kelvin = 0;
+    for (uint8_t percentage = 0; percentage <= 100; percentage++) {
+        TEST_ESP_OK(lightbulb_percentage2kelvin(percentage, &kelvin));
+        TEST_ASSERT_EQUAL_UINT16(0, kelvin % 100);
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT16(last_kelvin, kelvin);
+        last_kelvin = kelvin;
+    }
+    TEST_ESP_OK(lightbulb_percentage2kelvin(0, &kelvin));
+    TEST_ASSERT_EQUAL_UINT16(kelvin_range.min, kelvin);
+    TEST_ESP_OK(lightbulb_percentage2kelvin(100, &kelvin));
+    TEST_ASSERT_EQUAL_UINT16(kelvin_range.max, kelvin);
+
+    // 2. Kelvin to percentage, every Kelvin in range
+    for (kelvin = kelvin_range.min; kelvin <= kelvin_range.max; kelvin++) {
+        uint8_t percentage = 0;
+        TEST_ESP_OK(lightbulb_kelvin2percentage(kelvin, &percentage));
+        TEST_ASSERT_EQUAL_UINT8(100 * (kelvin - kelvin_range.min) / (kelvin_range.max - kelvin_range.min), percentage);
+    }
+
+    // 3. Kelvin input is stored as the matching percentage
+    TEST_ESP_OK(lightbulb_set_switch(true));
+    TEST_ESP_OK(lightbulb_set_cctb(kelvin_range.max, 100));
+    TEST_ASSERT_EQUAL(100, lightbulb_get_cct_percentage());
+    TEST_ASSERT_EQUAL(kelvin_range.max, lightbulb_get_cct_kelvin());
+    TEST_ESP_OK(lightbulb_deinit());
+
+    // 4. The Q16 tables stay within 1 LSB of the float conversion, every CCT at full brightness and every brightness on a CCT grid
+    config.external_limit = &limit;
+    config.init_status.on = true;
+    for (uint16_t power = 100; power <= 300; power += 100) {
+        uint16_t output[SIMULATED_CHANNEL_MAX] = { 0 };
+        limit.white_max_power = power;
+        TEST_ESP_OK(lightbulb_init(&config));
+        vTaskDelay(pdMS_TO_TICKS(50));
+        for (int cct = 0; cct <= 100; cct++) {
+            cct_output_check(&limit, cct, 100, output);
+        }
+        for (int cct = 0; cct <= 100; cct += 25) {
+            for (int brightness = 0; brightness <= 100; brightness++) {
+                cct_output_check(&limit, cct, brightness, output);
+            }
+        }
+        TEST_ESP_OK(lightbulb_deinit());
+    }
+}
+
+static volatile uint32_t s_timeline_end_count = 0;
+
+static void test_timeline_end_cb(void)
+{
+    s_timeline_end_count++;
+}
+
+TEST_CASE("Timeline effect", "[Application Layer]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = false,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.value = 100,
+    };
+    // red, green, back to red once, then blue, 900 ms per play
+    const lightbulb_keyframe_t keyframes[] = {
+        { .mode = WORK_COLOR, .hue = 0, .saturation = 100, .value = 100, .hold_ms = 100 },
+        { .mode = WORK_COLOR, .hue = 120, .saturation = 100, .value = 100, .fade_ms = 200, .loop_count = 1, .loop_to = 0 },
+        { .mode = WORK_COLOR, .hue = 240, .saturation = 100, .value = 100, .fade_ms = 200, .curve = FADE_CURVE_EASE_IN_OUT, .hold_ms = 100 },
+    };
+    lightbulb_timeline_config_t timeline = {
+        .keyframes = keyframes,
+        .keyframe_num = sizeof(keyframes) / sizeof(keyframes[0]),
+        .repeat = 2,
+        .user_cb = test_timeline_end_cb,
+    };
+    bench_simulated_report_t report = { 0 };
+    uint16_t reference[SIMULATED_CHANNEL_MAX] = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+    TEST_ESP_OK(lightbulb_set_hsv(240, 100, 100));
+    vTaskDelay(pdMS_TO_TICKS(50));
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_set_hsv(240, 100, 100));
+    vTaskDelay(pdMS_TO_TICKS(50));
+    bench_simulated_analyse(&report);
+    memcpy(reference, report.final_value, sizeof(reference));
+
+    // 1. Plays twice, ends on the last keyframe and reports it once
+    s_timeline_end_count = 0;
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_timeline_effect_start(&timeline));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ASSERT_EQUAL_UINT32(0, s_timeline_end_count);
+    vTaskDelay(pdMS_TO_TICKS(1200));
+    TEST_ASSERT_EQUAL_UINT32(1, s_timeline_end_count);
+    bench_simulated_analyse(&report);
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(reference, report.final_value, SIMULATED_CHANNEL_MAX);
+
+    // 2. Stopped effects and total_ms
+    timeline.repeat = 0;
+    TEST_ESP_OK(lightbulb_timeline_effect_start(&timeline));
+    vTaskDelay(pdMS_TO_TICKS(500));
+    TEST_ESP_OK(lightbulb_basic_effect_stop());
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ASSERT_EQUAL_UINT32(1, s_timeline_end_count);
+
+    timeline.total_ms = 500;
+    TEST_ESP_OK(lightbulb_timeline_effect_start(&timeline));
+    vTaskDelay(pdMS_TO_TICKS(700));
+    TEST_ASSERT_EQUAL_UINT32(2, s_timeline_end_count);
+
+    // 3. A loop can only go back
+    const lightbulb_keyframe_t bad_keyframes[] = {
+        { .mode = WORK_COLOR, .hue = 0, .saturation = 100, .value = 100, .loop_count = 1, .loop_to = 1 },
+        { .mode = WORK_COLOR, .hue = 120, .saturation = 100, .value = 100 },
+    };
+    timeline.keyframes = bad_keyframes;
+    timeline.keyframe_num = 2;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, lightbulb_timeline_effect_start(&timeline));
+    timeline.keyframe_num = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, lightbulb_timeline_effect_start(&timeline));
+
+    // 4. Loops that take no time are rejected instead of ending at once
+    const lightbulb_keyframe_t instant_keyframes[] = {
+        { .mode = WORK_COLOR, .hue = 0, .saturation = 100, .value = 100, .fade_ms = 5 },
+        { .mode = WORK_COLOR, .hue = 120, .saturation = 100, .value = 100, .hold_ms = 11 },
+    };
+    lightbulb_effect_config_t effect = {
+        .effect_type = EFFECT_BLINK,
+        .mode = WORK_COLOR,
+        .red = 255,
+        .max_brightness = 100,
+        .effect_cycle_ms = 20,
+        .user_cb = test_timeline_end_cb,
+    };
+    timeline.keyframes = instant_keyframes;
+    timeline.keyframe_num = 2;
+    timeline.repeat = 0;
+    timeline.total_ms = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, lightbulb_timeline_effect_start(&timeline));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, lightbulb_basic_effect_start(&effect));
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_EQUAL_UINT32(2, s_timeline_end_count);
+    effect.effect_cycle_ms = 25;
+    TEST_ESP_OK(lightbulb_basic_effect_start(&effect));
+    TEST_ESP_OK(lightbulb_basic_effect_stop());
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+TEST_CASE("Timeline effect benchmark", "[Performance]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = false,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.value = 100,
+    };
+    lightbulb_keyframe_t keyframes[6] = { 0 };
+    for (int i = 0; i < 6; i++) {
+        keyframes[i] = (lightbulb_keyframe_t) {
+            .mode = WORK_COLOR, .hue = i * 60, .saturation = 100, .value = 100, .fade_ms = 500, .curve = FADE_CURVE_LINEAR,
+        };
+    }
+    lightbulb_timeline_config_t timeline = {
+        .keyframes = keyframes,
+        .keyframe_num = 6,
+        .repeat = 0,
+    };
+    lightbulb_effect_config_t effect = {
+        .effect_type = EFFECT_BREATH,
+        .mode = WORK_COLOR,
+        .red = 255,
+        .green = 128,
+        .blue = 0,
+        .min_brightness = 10,
+        .max_brightness = 100,
+        .effect_cycle_ms = 1000,
+    };
+    bench_simulated_report_t report = { 0 };
+    lightbulb_fade_stats_t stats = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+
+    // The per tick cost of a timeline should stay close to the one of a plain breath
+    TEST_ESP_OK(lightbulb_basic_effect_start(&effect));
+    TEST_ESP_OK(simulated_clear_records());
+    vTaskDelay(pdMS_TO_TICKS(3000));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    TEST_ESP_OK(lightbulb_basic_effect_stop());
+    bench_simulated_analyse(&report);
+    bench_simulated_log("breath 1000ms", &report, &stats);
+
+    TEST_ESP_OK(lightbulb_timeline_effect_start(&timeline));
+    TEST_ESP_OK(simulated_clear_records());
+    vTaskDelay(pdMS_TO_TICKS(3000));
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    TEST_ESP_OK(lightbulb_basic_effect_stop());
+    bench_simulated_analyse(&report);
+    bench_simulated_log("rainbow timeline 3000ms", &report, &stats);
+    TEST_ASSERT_TRUE(stats.ticks > 0);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+
+TEST_CASE("Multiple instances", "[Application Layer]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .driver_conf.simulated.max_record_num = BENCH_SIMULATED_RECORD_NUM,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 600,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = false,
+        .init_status.value = 100,
+    };
+    lightbulb_handle_t zone = NULL;
+    lightbulb_fade_stats_t stats = { 0 };
+    bench_simulated_report_t report = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+
+    // 1. A driver only has one instance, the default one is not deleted by handle
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, lightbulb_create(&config, &zone));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, lightbulb_delete(NULL));
+
+#ifdef CONFIG_ENABLE_PWM_DRIVER
+    // 2. A PWM zone fades next to the simulated one on the same fade tick
+    lightbulb_config_t pwm_config = {
+        .type = DRIVER_ESP_PWM,
+        .driver_conf.pwm.freq_hz = 4000,
+        .capability.enable_fades = true,
+        .capability.fades_ms = 1000,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .io_conf.pwm_io.red = 25,
+        .io_conf.pwm_io.green = 26,
+        .io_conf.pwm_io.blue = 27,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = false,
+        .init_status.value = 100,
+    };
+    TEST_ESP_OK(lightbulb_create(&pwm_config, &zone));
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_handle_set_hsv(zone, 120, 100, 100));
+    TEST_ESP_OK(lightbulb_set_hsv(0, 100, 100));
+    vTaskDelay(pdMS_TO_TICKS(1200));
+
+    TEST_ASSERT_EQUAL(120, lightbulb_handle_get_hue(zone));
+    TEST_ASSERT_EQUAL(0, lightbulb_get_hue());
+    bench_simulated_analyse(&report);
+    TEST_ASSERT_TRUE(report.final_value[0] > 0);
+    TEST_ASSERT_EQUAL_UINT16(0, report.final_value[1]);
+    TEST_ESP_OK(lightbulb_handle_get_fade_stats(zone, &stats));
+    bench_simulated_log("pwm zone next to simulated", &report, &stats);
+    TEST_ASSERT_TRUE(stats.ticks > 0);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, lightbulb_delete(NULL));
+    TEST_ESP_OK(lightbulb_delete(zone));
+#endif
+
+    // 3. The default instance keeps fading on its own
+    TEST_ESP_OK(simulated_clear_records());
+    TEST_ESP_OK(lightbulb_set_hsv(240, 100, 100));
+    vTaskDelay(pdMS_TO_TICKS(800));
+    bench_simulated_analyse(&report);
+    TEST_ASSERT_TRUE(report.final_value[2] > 0);
+    TEST_ASSERT_EQUAL_UINT16(0, report.final_value[0]);
+    TEST_ESP_OK(lightbulb_get_fade_stats(&stats));
+    TEST_ASSERT_TRUE(stats.ticks > 0);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+#endif
+
+#if CONFIG_LB_STATUS_JOURNAL_SIMULATED_FLASH && CONFIG_ENABLE_SIMULATED_DRIVER
+TEST_CASE("Status journal", "[Application Layer]")
+{
+    const int status_num = 2000;
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .capability.enable_fades = false,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_AND_WHITE_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = false,
+    };
+    lightbulb_status_t status = { .mode = WORK_COLOR, .on = true, .hue = 0, .saturation = 100, .value = 100 };
+    lightbulb_status_t restored = { 0 };
+    lightbulb_status_journal_stats_t stats = { 0 };
+    TEST_ESP_OK(lightbulb_init(&config));
+    TEST_ESP_OK(lightbulb_status_erase_nvs_storage());
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, lightbulb_status_get_from_nvs(&restored));
+    TEST_ESP_OK(lightbulb_get_status_journal_stats(&stats));
+    uint32_t records = stats.records;
+    uint32_t erases = stats.erases;
+
+    // 1. Scene changes, mostly a few fields at a time
+    for (int i = 0; i < status_num; i++) {
+        if (i % 50 == 0) {
+            status.mode = (status.mode == WORK_COLOR) ? WORK_WHITE : WORK_COLOR;
+        }
+        status.hue = i % 361;
+        status.value = i % 101;
+        status.cct_percentage = i % 7;
+        status.on = (i % 10) != 0;
+        TEST_ESP_OK(lightbulb_status_set_to_nvs(&status));
+    }
+    TEST_ESP_OK(lightbulb_status_set_to_nvs(&status));
+    TEST_ESP_OK(lightbulb_get_status_journal_stats(&stats));
+    records = stats.records - records;
+    erases = stats.erases - erases;
+    ESP_LOGI(TAG, "%"PRIu32" records, %"PRIu32" bytes, %"PRIu32" sector erases for %d status, write %"PRIu32" us max", records, stats.bytes, erases, status_num, stats.max_write_us);
+
+    // The repeated status is not written, a 4KB sector holds hundreds of records
+    TEST_ASSERT_EQUAL_UINT32(status_num, records);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(status_num / 200, erases);
+
+    // 2. Restart, the latest status is restored from the journal
+    TEST_ESP_OK(lightbulb_deinit());
+    TEST_ESP_OK(lightbulb_status_get_from_nvs(&restored));
+    TEST_ASSERT_EQUAL(status.mode, restored.mode);
+    TEST_ASSERT_EQUAL(status.on, restored.on);
+    TEST_ASSERT_EQUAL(status.hue, restored.hue);
+    TEST_ASSERT_EQUAL(status.saturation, restored.saturation);
+    TEST_ASSERT_EQUAL(status.value, restored.value);
+    TEST_ASSERT_EQUAL(status.cct_percentage, restored.cct_percentage);
+    TEST_ASSERT_EQUAL(status.brightness, restored.brightness);
+
+    // 3. Erase drops it
+    TEST_ESP_OK(lightbulb_status_erase_nvs_storage());
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, lightbulb_status_get_from_nvs(&restored));
+}
+#endif
+
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+TEST_CASE("Fast restore", "[Application Layer]")
+{
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .capability.enable_fades = false,
+        .capability.enable_status_storage = true,
+        .capability.storage_delay_ms = 10000,
+        .capability.mode_mask = COLOR_AND_WHITE_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+    };
+    lightbulb_status_t restored = { 0 };
+    lightbulb_boot_stats_t stats = { 0 };
+
+    // 1. Soft reset while the change is still waiting for the storage delay
+    TEST_ESP_OK(lightbulb_init(&config));
+    TEST_ESP_OK(lightbulb_set_hsv(120, 50, 80));
+    TEST_ESP_OK(lightbulb_deinit());
+
+    // 2. Restored without nvs, the next init lights the bulb with it
+    TEST_ESP_OK(lightbulb_status_fast_restore(&restored));
+    TEST_ESP_OK(lightbulb_get_boot_stats(&stats));
+    TEST_ASSERT_EQUAL(STATUS_SOURCE_RTC_MEM, stats.source);
+    TEST_ASSERT_EQUAL(WORK_COLOR, restored.mode);
+    TEST_ASSERT_TRUE(restored.on);
+    TEST_ASSERT_EQUAL(120, restored.hue);
+    TEST_ASSERT_EQUAL(50, restored.saturation);
+    TEST_ASSERT_EQUAL(80, restored.value);
+
+    config.init_status = restored;
+    TEST_ESP_OK(lightbulb_init(&config));
+    TEST_ESP_OK(lightbulb_get_boot_stats(&stats));
+    ESP_LOGI(TAG, "status read in %"PRIu32" us, light on %"PRIu32" us after the restore started", stats.restore_us, stats.light_on_us - stats.restore_start_us);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(stats.restore_start_us + stats.restore_us, stats.light_on_us);
+    TEST_ASSERT_EQUAL(120, lightbulb_get_hue());
+    TEST_ASSERT_EQUAL(80, lightbulb_get_value());
+
+    // 3. Without status storage the RTC memory copy is dropped, the stored status is restored from the journal if there is one
+    lightbulb_status_t stored = { .mode = WORK_WHITE, .on = true, .cct_percentage = 30, .brightness = 60 };
+    lightbulb_status_journal_stats_t journal_stats = { 0 };
+    TEST_ESP_OK(lightbulb_set_storage_function(false));
+    TEST_ESP_OK(lightbulb_set_hsv(240, 100, 30));
+    TEST_ESP_OK(lightbulb_deinit());
+    if (lightbulb_get_status_journal_stats(&journal_stats) == ESP_OK) {
+        TEST_ESP_OK(lightbulb_status_set_to_nvs(&stored));
+        memset(&restored, 0, sizeof(restored));
+        TEST_ESP_OK(lightbulb_status_fast_restore(&restored));
+        TEST_ESP_OK(lightbulb_get_boot_stats(&stats));
+        TEST_ASSERT_EQUAL(STATUS_SOURCE_JOURNAL, stats.source);
+    } else {
+        restored = stored;
+        TEST_ESP_ERR(ESP_ERR_NOT_FOUND, lightbulb_status_fast_restore(&restored));
+        TEST_ESP_OK(lightbulb_get_boot_stats(&stats));
+        TEST_ASSERT_EQUAL(STATUS_SOURCE_NONE, stats.source);
+    }
+    TEST_ASSERT_EQUAL(stored.mode, restored.mode);
+    TEST_ASSERT_EQUAL(stored.on, restored.on);
+    TEST_ASSERT_EQUAL(stored.cct_percentage, restored.cct_percentage);
+    TEST_ASSERT_EQUAL(stored.brightness, restored.brightness);
+}
+#endif
+
+/**
+ * @brief Float color conversions of the earlier lightbulb.c, the reference for the integer ones
+ *
+ * @note The bodies are kept verbatim, only the argument checks are left out since every input below is in range.
+ */
+static esp_err_t baseline_xyy2rgb(float x, float y, float Y, uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    float _x = x;
+    float _y = y;
+    float _z = 1.0f - _x - _y;
+    float _X, _Y, _Z;
+    float _r, _g, _b;
+
+    // Calculate XYZ values
+    _Y = Y / 100.0;
+    _X = (_Y / _y) * _x;
+    _Z = (_Y / _y) * _z;
+
+    // X, Y and Z input refer to a D65/2° standard illuminant.
+    // sR, sG and sB (standard RGB) output range = 0 ÷ 255
+    // convert XYZ to RGB - CIE XYZ to sRGB
+    _r = (_X * 3.2410f) - (_Y * 1.5374f) - (_Z * 0.4986f);
+    _g = -(_X * 0.9692f) + (_Y * 1.8760f) + (_Z * 0.0416f);
+    _b = (_X * 0.0556f) - (_Y * 0.2040f) + (_Z * 1.0570f);
+
+    // apply gamma 2.2 correction
+    _r = (_r <= 0.00304f ? 12.92f * _r : (1.055f) * pow(_r, (1.0f / 2.4f)) - 0.055f);
+    _g = (_g <= 0.00304f ? 12.92f * _g : (1.055f) * pow(_g, (1.0f / 2.4f)) - 0.055f);
+    _b = (_b <= 0.00304f ? 12.92f * _b : (1.055f) * pow(_b, (1.0f / 2.4f)) - 0.055f);
+
+    // Round off
+    _r = MIN(1.0, _r);
+    _r = MAX(0, _r);
+
+    _g = MIN(1.0, _g);
+    _g = MAX(0, _g);
+
+    _b = MIN(1.0, _b);
+    _b = MAX(0, _b);
+
+    *red = (uint8_t)(_r * 255 + 0.5);
+    *green = (uint8_t)(_g * 255 + 0.5);
+    *blue = (uint8_t)(_b * 255 + 0.5);
+
+    return ESP_OK;
+}
+
+static esp_err_t baseline_rgb2xyy(uint8_t red, uint8_t green, uint8_t blue, float *x, float *y, float *Y)
+{
+    float _red = red / 255.0;
+    float _green = green / 255.0;
+    float _blue = blue / 255.0;
+
+    if (_red > 0.04045) {
+        _red = pow(( _red + 0.055 ) / 1.055, 2.4);
+    } else {
+        _red = _red / 12.92;
+    }
+
+    if ( _green > 0.04045 ) {
+        _green = pow(( _green + 0.055 ) / 1.055, 2.4);
+    } else {
+        _green = _green / 12.92;
+    }
+
+    if ( _blue > 0.04045 ) {
+        _blue = pow(( _blue + 0.055 ) / 1.055, 2.4);
+    } else {
+        _blue = _blue / 12.92;
+    }
+
+    _red = _red * 100;
+    _green = _green * 100;
+    _blue = _blue * 100;
+
+    float _X = _red * 0.4124 + _green * 0.3576 + _blue * 0.1805;
+    float _Y = _red * 0.2126 + _green * 0.7152 + _blue * 0.0722;
+    float _Z = _red * 0.0193 + _green * 0.1192 + _blue * 0.9505;
+
+    *Y = _Y;
+    *x = _X / ( _X + _Y + _Z );
+    *y = _Y / ( _X + _Y + _Z );
+
+    return ESP_OK;
+}
+
+static esp_err_t baseline_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    hue = hue % 360;
+    uint16_t hi = (hue / 60) % 6;
+    uint16_t F = 100 * hue / 60 - 100 * hi;
+    uint16_t P = value * (100 - saturation) / 100;
+    uint16_t Q = value * (10000 - F * saturation) / 10000;
+    uint16_t T = value * (10000 - saturation * (100 - F)) / 10000;
+
+    switch (hi) {
+    case 0:
+        *red = value;
+        *green = T;
+        *blue = P;
+        break;
+
+    case 1:
+        *red = Q;
+        *green = value;
+        *blue = P;
+        break;
+
+    case 2:
+        *red = P;
+        *green = value;
+        *blue = T;
+        break;
+
+    case 3:
+        *red = P;
+        *green = Q;
+        *blue = value;
+        break;
+
+    case 4:
+        *red = T;
+        *green = P;
+        *blue = value;
+        break;
+
+    case 5:
+        *red = value;
+        *green = P;
+        *blue = Q;
+        break;
+
+    default:
+        return ESP_FAIL;
+    }
+
+    *red = *red * 255 / 100;
+    *green = *green * 255 / 100;
+    *blue = *blue * 255 / 100;
+
+    return ESP_OK;
+}
+
+static esp_err_t baseline_rgb2hsv(uint16_t red, uint16_t green, uint16_t blue, uint16_t *hue, uint8_t *saturation, uint8_t *value)
+{
+    float _hue, _saturation, _value;
+    float m_max = MAX(red, MAX(green, blue));
+    float m_min = MIN(red, MIN(green, blue));
+    float m_delta = m_max - m_min;
+
+    _value = m_max / 255.0;
+
+    if (m_delta == 0) {
+        _hue = 0;
+        _saturation = 0;
+    } else {
+        _saturation = m_delta / m_max;
+
+        if (red == m_max) {
+            _hue = (green - blue) / m_delta;
+        } else if (green == m_max) {
+            _hue = 2 + (blue - red) / m_delta;
+        } else {
+            _hue = 4 + (red - green) / m_delta;
+        }
+
+        _hue = _hue * 60;
+
+        if (_hue < 0) {
+            _hue = _hue + 360;
+        }
+    }
+
+    *hue = (int)(_hue + 0.5);
+    *saturation = (int)(_saturation * 100 + 0.5);
+    *value = (int)(_value * 100 + 0.5);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Input grid of the conversion tests, sparse enough to keep the run on a chip short
+ *
+ * @note host_test compares every input against the same baseline.
+ */
+#define CONVERSION_RGB_STEP                         (3)
+#define CONVERSION_XY_STEP                          (1.0f / 64)
+#define CONVERSION_LUMINANCE_STEP                   (5)
+
+TEST_CASE("Color conversion accuracy", "[Application Layer]")
+{
+    int max_error = 0;
+
+    // 1. hsv2rgb, every input, the same bytes as the baseline
+    for (uint16_t hue = 0; hue <= 360; hue++) {
+        for (uint8_t saturation = 0; saturation <= 100; saturation++) {
+            for (uint8_t value = 0; value <= 100; value++) {
+                uint8_t rgb[3], ref[3];
+                TEST_ESP_OK(lightbulb_hsv2rgb(hue, saturation, value, &rgb[0], &rgb[1], &rgb[2]));
+                TEST_ESP_OK(baseline_hsv2rgb(hue, saturation, value, &ref[0], &ref[1], &ref[2]));
+                for (int i = 0; i < 3; i++) {
+                    max_error = MAX(max_error, abs(rgb[i] - ref[i]));
+                }
+            }
+        }
+        vTaskDelay(1);
+    }
+    ESP_LOGI(TAG, "hsv2rgb max error: %d", max_error);
+    TEST_ASSERT_EQUAL(0, max_error);
+
+    // 2. rgb2hsv, hue compared on the circle
+    int max_hue_error = 0, max_sv_error = 0;
+    for (int red = 0; red <= 255; red += CONVERSION_RGB_STEP) {
+        for (int green = 0; green <= 255; green += CONVERSION_RGB_STEP) {
+            for (int blue = 0; blue <= 255; blue += CONVERSION_RGB_STEP) {
+                uint16_t hue, ref_hue;
+                uint8_t saturation, value, ref_saturation, ref_value;
+                TEST_ESP_OK(lightbulb_rgb2hsv(red, green, blue, &hue, &saturation, &value));
+                TEST_ESP_OK(baseline_rgb2hsv(red, green, blue, &ref_hue, &ref_saturation, &ref_value));
+                int hue_error = abs(hue - ref_hue);
+                max_hue_error = MAX(max_hue_error, MIN(hue_error, 360 - hue_error));
+                max_sv_error = MAX(max_sv_error, MAX(abs(saturation - ref_saturation), abs(value - ref_value)));
+            }
+        }
+        vTaskDelay(1);
+    }
+    ESP_LOGI(TAG, "rgb2hsv max error: hue %d saturation/value %d", max_hue_error, max_sv_error);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(1, max_hue_error);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(1, max_sv_error);
+
+    // 3. xyy2rgb, the chromaticity triangle x + y <= 1 without y = 0
+    max_error = 0;
+    for (float x = 0; x <= 1.0f; x += CONVERSION_XY_STEP) {
+        for (float y = CONVERSION_XY_STEP; x + y <= 1.0f; y += CONVERSION_XY_STEP) {
+            for (int Y = 0; Y <= 100; Y += CONVERSION_LUMINANCE_STEP) {
+                uint8_t rgb[3], ref[3];
+                TEST_ESP_OK(lightbulb_xyy2rgb(x, y, Y, &rgb[0], &rgb[1], &rgb[2]));
+                TEST_ESP_OK(baseline_xyy2rgb(x, y, Y, &ref[0], &ref[1], &ref[2]));
+                for (int i = 0; i < 3; i++) {
+                    max_error = MAX(max_error, abs(rgb[i] - ref[i]));
+                }
+            }
+        }
+        vTaskDelay(1);
+    }
+    ESP_LOGI(TAG, "xyy2rgb max error: %d", max_error);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(1, max_error);
+    uint8_t r, g, b;
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, lightbulb_xyy2rgb(0.3f, 0, 50, &r, &g, &b));
+
+    // 4. rgb2xyy, black has no chromaticity and is skipped
+    float max_xy_error = 0, max_luminance_error = 0;
+    for (int red = 0; red <= 255; red += CONVERSION_RGB_STEP) {
+        for (int green = 0; green <= 255; green += CONVERSION_RGB_STEP) {
+            for (int blue = (red || green) ? 0 : 1; blue <= 255; blue += CONVERSION_RGB_STEP) {
+                float x, y, Y, ref_x, ref_y, ref_Y;
+                TEST_ESP_OK(lightbulb_rgb2xyy(red, green, blue, &x, &y, &Y));
+                TEST_ESP_OK(baseline_rgb2xyy(red, green, blue, &ref_x, &ref_y, &ref_Y));
+                max_xy_error = MAX(max_xy_error, MAX(fabsf(x - ref_x), fabsf(y - ref_y)));
+                max_luminance_error = MAX(max_luminance_error, fabsf(Y - ref_Y));
+            }
+        }
+        vTaskDelay(1);
+    }
+    ESP_LOGI(TAG, "rgb2xyy max error: xy %f Y %f", max_xy_error, max_luminance_error);
+    TEST_ASSERT_TRUE(max_xy_error <= 0.0015f);
+    TEST_ASSERT_TRUE(max_luminance_error <= 0.0008f);
+}
+
+#ifdef CONFIG_ENABLE_SIMULATED_DRIVER
+TEST_CASE("xyY input", "[Application Layer]")
+{
+    const simulated_record_t *records = NULL;
+    uint32_t record_num = 0;
+    lightbulb_config_t config = {
+        .type = DRIVER_SIMULATED,
+        .capability.enable_fades = false,
+        .capability.enable_status_storage = false,
+        .capability.mode_mask = COLOR_MODE,
+        .init_status.mode = WORK_COLOR,
+        .init_status.on = true,
+        .init_status.hue = 0,
+        .init_status.saturation = 100,
+        .init_status.value = 10,
+    };
+    TEST_ESP_OK(lightbulb_init(&config));
+    TEST_ESP_OK(simulated_clear_records());
+
+    // 1. y = 0 has no chromaticity, it is rejected and the output and status are left untouched
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, lightbulb_set_xyy(0.3f, 0, 50));
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, lightbulb_set_xyy(0.3f, -0.1f, 50));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, NULL));
+    TEST_ASSERT_EQUAL_UINT32(0, record_num);
+    TEST_ASSERT_EQUAL(0, lightbulb_get_hue());
+    TEST_ASSERT_EQUAL(10, lightbulb_get_value());
+
+    // 2. A valid point is converted and written
+    TEST_ESP_OK(lightbulb_set_xyy(0.3127f, 0.3290f, 50));
+    TEST_ESP_OK(simulated_get_records(&records, &record_num, NULL));
+    TEST_ASSERT_TRUE(record_num > 0);
+
+    TEST_ESP_OK(lightbulb_deinit());
+}
+#endif
+
+TEST_CASE("Color conversion benchmark", "[Performance]")
+{
+    const int loops = 10000;
+    uint8_t r, g, b, rgb[3];
+    uint16_t h;
+    uint8_t s, v;
+    float x, y, Y;
+    int64_t start = 0, integer_us = 0, float_us = 0;
+
+#define CONVERSION_BENCH(name, integer_call, float_call)                                                       \
+    start = esp_timer_get_time();                                                                               \
+    for (int i = 0; i < loops; i++) {                                                                           \
+        integer_call;                                                                                           \
+    }                                                                                                           \
+    integer_us = esp_timer_get_time() - start;                                                                  \
+    start = esp_timer_get_time();                                                                               \
+    for (int i = 0; i < loops; i++) {                                                                           \
+        float_call;                                                                                             \
+    }                                                                                                           \
+    float_us = esp_timer_get_time() - start;                                                                    \
+    ESP_LOGI(TAG, "%s: %lld ns per conversion, float baseline %lld ns", name, integer_us * 1000 / loops, float_us * 1000 / loops);
+
+    CONVERSION_BENCH("hsv2rgb", lightbulb_hsv2rgb(i % 361, i % 101, (i >> 3) % 101, &r, &g, &b),
+                     baseline_hsv2rgb(i % 361, i % 101, (i >> 3) % 101, &rgb[0], &rgb[1], &rgb[2]));
+    CONVERSION_BENCH("rgb2hsv", lightbulb_rgb2hsv(i & 0xFF, (i >> 4) & 0xFF, (i >> 8) & 0xFF, &h, &s, &v),
+                     baseline_rgb2hsv(i & 0xFF, (i >> 4) & 0xFF, (i >> 8) & 0xFF, &h, &s, &v));
+    CONVERSION_BENCH("xyy2rgb", lightbulb_xyy2rgb(0.1f + (i % 200) / 400.0f, 0.1f + (i % 150) / 400.0f, i % 101, &r, &g, &b),
+                     baseline_xyy2rgb(0.1f + (i % 200) / 400.0f, 0.1f + (i % 150) / 400.0f, i % 101, &rgb[0], &rgb[1], &rgb[2]));
+    CONVERSION_BENCH("rgb2xyy", lightbulb_rgb2xyy(i & 0xFF, (i >> 4) & 0xFF, (i >> 8) | 1, &x, &y, &Y),
+                     baseline_rgb2xyy(i & 0xFF, (i >> 4) & 0xFF, (i >> 8) | 1, &x, &y, &Y));
+#undef CONVERSION_BENCH
+}